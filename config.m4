@@ -80,6 +80,20 @@ if test "$PHP_GEOS" != "no"; then
   AC_CHECK_LIB(geos_c, GEOSisValidDetail_r, AC_DEFINE(HAVE_GEOS_IS_VALID_DETAIL,1,[Whether we have GEOSisValidDetail_r]))
   AC_CHECK_LIB(geos_c, GEOSGeom_setPrecision_r, AC_DEFINE(HAVE_GEOS_GEOM_SET_PRECISION,1,[Whether we have GEOSGeom_setPrecision_r]))
   AC_CHECK_LIB(geos_c, GEOSGeom_getPrecision_r, AC_DEFINE(HAVE_GEOS_GEOM_GET_PRECISION,1,[Whether we have GEOSGeom_getPrecision_r]))
+  AC_CHECK_LIB(geos_c, GEOSPreparedContainsXY_r, AC_DEFINE(HAVE_GEOS_PREPARED_CONTAINS_XY,1,[Whether we have GEOSPreparedContainsXY_r]))
+  AC_CHECK_LIB(geos_c, GEOSCoordSeq_copyToBuffer_r, AC_DEFINE(HAVE_GEOS_COORDSEQ_COPY_TO_BUFFER,1,[Whether we have GEOSCoordSeq_copyToBuffer_r]))
+  AC_CHECK_LIB(geos_c, GEOSMakeValid_r, AC_DEFINE(HAVE_GEOS_MAKE_VALID,1,[Whether we have GEOSMakeValid_r]))
+  AC_CHECK_LIB(geos_c, GEOSContext_setErrorMessageHandler_r, AC_DEFINE(HAVE_GEOS_CONTEXT_SET_ERROR_MESSAGE_HANDLER,1,[Whether we have GEOSContext_setErrorMessageHandler_r]))
+  AC_CHECK_LIB(geos_c, GEOSContext_setInterruptCallback_r, AC_DEFINE(HAVE_GEOS_CONTEXT_SET_INTERRUPT_CALLBACK,1,[Whether we have GEOSContext_setInterruptCallback_r]))
+  AC_CHECK_LIB(geos_c, GEOSCoverageUnion_r, AC_DEFINE(HAVE_GEOS_COVERAGE_UNION,1,[Whether we have GEOSCoverageUnion_r]))
+  AC_CHECK_LIB(geos_c, GEOSCoverageSimplifyVW_r, AC_DEFINE(HAVE_GEOS_COVERAGE_SIMPLIFY_VW,1,[Whether we have GEOSCoverageSimplifyVW_r]))
+  AC_CHECK_LIB(geos_c, GEOSCoverageIsValid_r, AC_DEFINE(HAVE_GEOS_COVERAGE_IS_VALID,1,[Whether we have GEOSCoverageIsValid_r]))
+  AC_CHECK_LIB(geos_c, GEOSIntersectionPrec_r, AC_DEFINE(HAVE_GEOS_INTERSECTION_PREC,1,[Whether we have GEOSIntersectionPrec_r]))
+  AC_CHECK_LIB(geos_c, GEOSDifferencePrec_r, AC_DEFINE(HAVE_GEOS_DIFFERENCE_PREC,1,[Whether we have GEOSDifferencePrec_r]))
+  AC_CHECK_LIB(geos_c, GEOSSymDifferencePrec_r, AC_DEFINE(HAVE_GEOS_SYM_DIFFERENCE_PREC,1,[Whether we have GEOSSymDifferencePrec_r]))
+  AC_CHECK_LIB(geos_c, GEOSUnionPrec_r, AC_DEFINE(HAVE_GEOS_UNION_PREC,1,[Whether we have GEOSUnionPrec_r]))
+  AC_CHECK_LIB(geos_c, GEOSUnaryUnionPrec_r, AC_DEFINE(HAVE_GEOS_UNARY_UNION_PREC,1,[Whether we have GEOSUnaryUnionPrec_r]))
+  AC_CHECK_LIB(geos_c, GEOSGeom_getXMin_r, AC_DEFINE(HAVE_GEOS_GEOM_GET_XMIN,1,[Whether we have GEOSGeom_getXMin_r]))
 
   AC_CHECK_LIB(geos_c, GEOSWKTWriter_setTrim_r, AC_DEFINE(HAVE_GEOS_WKT_WRITER_SET_TRIM,1,[Whether we have GEOSWKTWriter_setTrim_r]))
   AC_CHECK_LIB(geos_c, GEOSWKTWriter_setRoundingPrecision_r, AC_DEFINE(HAVE_GEOS_WKT_WRITER_SET_ROUNDING_PRECISION,1,[Whether we have GEOSWKTWriter_setRoundingPrecision_r]))
@@ -90,6 +104,11 @@ if test "$PHP_GEOS" != "no"; then
   AC_TRY_COMPILE(geos_c.h, GEOS_PREC_NO_TOPO, AC_DEFINE(HAVE_GEOS_PREC_NO_TOPO,1,[Whether we have GEOS_PREC_NO_TOPO]))
   AC_TRY_COMPILE(geos_c.h, GEOS_PREC_KEEP_COLLAPSED, AC_DEFINE(HAVE_GEOS_PREC_KEEP_COLLAPSED,1,[Whether we have GEOS_PREC_KEEP_COLLAPSED]))
 
+  AC_CHECK_LIB(pthread, pthread_create, [
+    AC_DEFINE(HAVE_GEOS_PTHREAD,1,[Whether we have pthread_create])
+    PHP_ADD_LIBRARY(pthread, 1, GEOS_SHARED_LIBADD)
+  ])
+
   CFLAGS=$old_CFLAGS
 
   PHP_ADD_LIBRARY(geos_c, 1, GEOS_SHARED_LIBADD)
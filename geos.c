@@ -24,9 +24,32 @@
 
 /* PHP stuff */
 #include "php.h"
+#include "php_ini.h" /* for PHP_INI_... */
+#include "php_globals.h" /* for PG(memory_limit) */
 #include "ext/standard/info.h" /* for php_info_... */
+#include "ext/standard/php_smart_str.h" /* for smart_str */
 #include "Zend/zend_exceptions.h" /* for zend_throw_exception_object */
 
+#include <math.h> /* for sqrt */
+#include <stdint.h> /* for uint64_t */
+#include <limits.h> /* for LONG_MAX */
+#include <errno.h>
+#ifdef HAVE_MMAP
+#include <sys/mman.h> /* for mmap */
+#include <sys/stat.h> /* for fstat */
+#include <fcntl.h> /* for open */
+#include <sys/file.h> /* for flock */
+#include <unistd.h> /* for ftruncate */
+#endif
+
+/* worker threads need per-context message handlers */
+#if defined(HAVE_GEOS_PTHREAD) && defined(HAVE_GEOS_CONTEXT_SET_ERROR_MESSAGE_HANDLER)
+#define HAVE_GEOS_ASYNC 1
+#include <pthread.h> /* for pthread_create */
+#include <sys/time.h> /* for gettimeofday */
+#include <unistd.h> /* for getpid */
+#endif
+
 /* GEOS stuff */
 #include "geos_c.h"
 
@@ -35,6 +58,7 @@
 
 static ZEND_DECLARE_MODULE_GLOBALS(geos);
 static PHP_GINIT_FUNCTION(geos);
+static PHP_GSHUTDOWN_FUNCTION(geos);
 
 PHP_MINIT_FUNCTION(geos);
 PHP_MSHUTDOWN_FUNCTION(geos);
@@ -42,6 +66,7 @@ PHP_RINIT_FUNCTION(geos);
 PHP_RSHUTDOWN_FUNCTION(geos);
 PHP_MINFO_FUNCTION(geos);
 PHP_FUNCTION(GEOSVersion);
+PHP_FUNCTION(GEOSMemoryUsage);
 PHP_FUNCTION(GEOSPolygonize);
 PHP_FUNCTION(GEOSLineMerge);
 
@@ -59,6 +84,7 @@ PHP_FUNCTION(GEOSRelateMatch);
 
 static zend_function_entry geos_functions[] = {
     PHP_FE(GEOSVersion, NULL)
+    PHP_FE(GEOSMemoryUsage, NULL)
     PHP_FE(GEOSPolygonize, NULL)
     PHP_FE(GEOSLineMerge, NULL)
 
@@ -84,7 +110,7 @@ zend_module_entry geos_module_entry = {
     PHP_GEOS_VERSION,
     PHP_MODULE_GLOBALS(geos),     /* globals descriptor */
     PHP_GINIT(geos),              /* globals ctor */
-    NULL,                         /* globals dtor */
+    PHP_GSHUTDOWN(geos),          /* globals dtor */
     NULL,                         /* post deactivate */
     STANDARD_MODULE_PROPERTIES_EX
 };
@@ -93,8 +119,62 @@ zend_module_entry geos_module_entry = {
 ZEND_GET_MODULE(geos)
 #endif
 
+PHP_INI_BEGIN()
+    STD_PHP_INI_ENTRY("geos.memory_limit", "0", PHP_INI_ALL, OnUpdateLong,
+        memory_limit, zend_geos_globals, geos_globals)
+    STD_PHP_INI_ENTRY("geos.cache_size", "0", PHP_INI_SYSTEM, OnUpdateLong,
+        cache_size, zend_geos_globals, geos_globals)
+    STD_PHP_INI_ENTRY("geos.shm_path", "", PHP_INI_SYSTEM, OnUpdateString,
+        shm_path, zend_geos_globals, geos_globals)
+    STD_PHP_INI_ENTRY("geos.shm_size", "0", PHP_INI_SYSTEM, OnUpdateLong,
+        shm_size, zend_geos_globals, geos_globals)
+    STD_PHP_INI_ENTRY("geos.persistent_indexes", "", PHP_INI_SYSTEM,
+        OnUpdateString, persistent_indexes, zend_geos_globals, geos_globals)
+    STD_PHP_INI_ENTRY("geos.async_workers", "2", PHP_INI_SYSTEM, OnUpdateLong,
+        async_workers, zend_geos_globals, geos_globals)
+PHP_INI_END()
+
 /* -- Utility functions ---------------------- */
 
+#ifdef HAVE_GEOS_CONTEXT_SET_ERROR_MESSAGE_HANDLER
+
+/*
+ * Message handlers get the thread context they were
+ * registered from as user data, see createContext.
+ */
+
+static void noticeHandler(const char *message, void *userdata)
+{
+#ifdef ZTS
+    void ***tsrm_ls = (void ***)userdata;
+#endif
+
+    php_error_docref(NULL TSRMLS_CC, E_NOTICE, "%s", message);
+}
+
+static void errorHandler(const char *message, void *userdata)
+{
+#ifdef ZTS
+    void ***tsrm_ls = (void ***)userdata;
+#endif
+
+    /* TODO: use a GEOSException ? */
+    zend_throw_exception_ex(zend_exception_get_default(TSRMLS_C),
+        1 TSRMLS_CC, "%s", message);
+}
+
+/* errors of contexts outliving requests, which can't throw */
+static void warningHandler(const char *message, void *userdata)
+{
+#ifdef ZTS
+    void ***tsrm_ls = (void ***)userdata;
+#endif
+
+    php_error_docref(NULL TSRMLS_CC, E_WARNING, "%s", message);
+}
+
+#else /* ! HAVE_GEOS_CONTEXT_SET_ERROR_MESSAGE_HANDLER */
+
 static void noticeHandler(const char *fmt, ...)
 {
     TSRMLS_FETCH();
@@ -122,26 +202,234 @@ static void errorHandler(const char *fmt, ...)
 
 }
 
+/* errors of contexts outliving requests, which can't throw */
+static void warningHandler(const char *fmt, ...)
+{
+    TSRMLS_FETCH();
+    char message[256];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(message, sizeof(message) - 1, fmt, args);
+    va_end(args);
+
+    php_error_docref(NULL TSRMLS_CC, E_WARNING, "%s", message);
+}
+
+#endif /* HAVE_GEOS_CONTEXT_SET_ERROR_MESSAGE_HANDLER */
+
+/*
+ * Create a GEOS context reporting to the calling thread. Errors
+ * become exceptions, or warnings for 'persistent' contexts.
+ */
+static GEOSContextHandle_t
+createContext(int persistent TSRMLS_DC)
+{
+#ifdef HAVE_GEOS_CONTEXT_SET_ERROR_MESSAGE_HANDLER
+    GEOSContextHandle_t handle;
+    void *userdata = NULL;
+
+#ifdef ZTS
+    userdata = tsrm_ls;
+#endif
+
+    handle = GEOS_init_r();
+    if ( ! handle ) return NULL;
+    GEOSContext_setNoticeMessageHandler_r(handle, noticeHandler, userdata);
+    GEOSContext_setErrorMessageHandler_r(handle,
+        persistent ? warningHandler : errorHandler, userdata);
+    return handle;
+#else
+    return initGEOS_r(noticeHandler, persistent ? warningHandler : errorHandler);
+#endif
+}
+
 typedef struct Proxy_t {
     zend_object std;
     void* relay;
+    long memory; /* approximate GEOS heap held by relay, in bytes */
+    unsigned char *wkb; /* original bytes of a lazily read GEOSGeometry */
+    size_t wkblen;
+    int shared; /* relay belongs to the shared cache memo, see fetch */
 } Proxy;
 
-static void
-setRelay(zval* val, void* obj) {
-    TSRMLS_FETCH();
+static zend_class_entry *Geometry_ce_ptr;
+
+/* Rough per-object costs of GEOS bookkeeping (vtables, envelopes, vectors) */
+#define GEOS_GEOMETRY_OVERHEAD 64
+#define GEOS_COORDSEQ_OVERHEAD 32
+
+/*
+ * Approximate number of bytes of GEOS heap held by a geometry:
+ * a fixed overhead per component plus the coordinate storage.
+ */
+static long
+geometryMemorySize(const GEOSGeometry* g TSRMLS_DC)
+{
+    long size = GEOS_GEOMETRY_OVERHEAD;
+    int dims = 3;
+    int n, i;
+
+    switch (GEOSGeomTypeId_r(GEOS_G(handle), g))
+    {
+        case GEOS_POINT:
+        case GEOS_LINESTRING:
+        case GEOS_LINEARRING:
+#           ifdef HAVE_GEOS_GEOM_GET_COORDINATE_DIMENSION
+            dims = GEOSGeom_getCoordinateDimension_r(GEOS_G(handle), g);
+#           endif
+            n = GEOSGetNumCoordinates_r(GEOS_G(handle), g);
+            if ( n > 0 ) {
+                size += GEOS_COORDSEQ_OVERHEAD + (long)n * dims * sizeof(double);
+            }
+            break;
+
+        case GEOS_POLYGON:
+            size += geometryMemorySize(
+                GEOSGetExteriorRing_r(GEOS_G(handle), g) TSRMLS_CC);
+            n = GEOSGetNumInteriorRings_r(GEOS_G(handle), g);
+            for (i=0; i<n; ++i) {
+                size += geometryMemorySize(
+                    GEOSGetInteriorRingN_r(GEOS_G(handle), g, i) TSRMLS_CC);
+            }
+            break;
+
+        default:
+            n = GEOSGetNumGeometries_r(GEOS_G(handle), g);
+            for (i=0; i<n; ++i) {
+                size += geometryMemorySize(
+                    GEOSGetGeometryN_r(GEOS_G(handle), g, i) TSRMLS_CC);
+            }
+            break;
+    }
+
+    return size;
+}
+
+/*
+ * Check that holding 'size' more bytes of GEOS heap keeps us
+ * within geos.memory_limit, throwing an exception if it doesn't.
+ *
+ * A negative geos.memory_limit makes GEOS heap count against
+ * PHP's own memory_limit, together with the Zend heap.
+ */
+static int
+checkMemoryLimit(long size TSRMLS_DC)
+{
+    long limit = GEOS_G(memory_limit);
+    long used = GEOS_G(memory_usage) + size;
+
+    if ( limit < 0 ) {
+        limit = PG(memory_limit);
+        used += zend_memory_usage(0 TSRMLS_CC);
+    }
+
+    if ( limit <= 0 || used <= limit ) return SUCCESS;
+
+    zend_throw_exception_ex(zend_exception_get_default(TSRMLS_C),
+        1 TSRMLS_CC, "GEOS memory limit of %ld bytes exhausted "
+        "(tried to hold %ld bytes)", limit, used);
+    return FAILURE;
+}
+
+/*
+ * NOTE: geometries passed in here are owned by the object from
+ *       now on, and are destroyed right away if holding them
+ *       would exceed geos.memory_limit (FAILURE is returned then).
+ */
+static int
+setRelay(zval* val, void* obj TSRMLS_DC) {
     Proxy* proxy = (Proxy*)zend_object_store_get_object(val TSRMLS_CC);
+
+    if ( obj && proxy->std.ce == Geometry_ce_ptr ) {
+        long size = geometryMemorySize((GEOSGeometry*)obj TSRMLS_CC);
+        if ( checkMemoryLimit(size TSRMLS_CC) == FAILURE ) {
+            GEOSGeom_destroy_r(GEOS_G(handle), (GEOSGeometry*)obj);
+            return FAILURE;
+        }
+        proxy->memory = size;
+        GEOS_G(memory_usage) += size;
+    }
+
     proxy->relay = obj;
+    return SUCCESS;
+}
+
+static GEOSWKBWriter* getGeometrySerializer(TSRMLS_D);
+static GEOSWKBReader* getGeometryDeserializer(TSRMLS_D);
+
+/*
+ * Make val a GEOSGeometry holding a copy of the given WKB bytes,
+ * which are only parsed into a geometry once it is first needed.
+ * See GEOSWKBReader::setLazy. Only the bytes are accounted for
+ * until then.
+ */
+static int
+setLazyRelay(zval* val, const unsigned char* wkb, size_t len
+        TSRMLS_DC) {
+    Proxy* proxy = (Proxy*)zend_object_store_get_object(val TSRMLS_CC);
+
+    if ( checkMemoryLimit(len TSRMLS_CC) == FAILURE ) return FAILURE;
+
+    proxy->wkb = (unsigned char*)emalloc(len ? len : 1);
+    memcpy(proxy->wkb, wkb, len);
+    proxy->wkblen = len;
+    proxy->memory = len;
+    GEOS_G(memory_usage) += len;
+    return SUCCESS;
+}
+
+/*
+ * Parse the bytes of a lazy geometry. They are kept for
+ * writing back out until the geometry is modified. Throws
+ * if GEOS rejects them or holding the geometry would exceed
+ * geos.memory_limit.
+ */
+static int
+materializeRelay(Proxy* proxy TSRMLS_DC) {
+    GEOSWKBReader *reader;
+    GEOSGeometry *geom;
+    long size;
+
+    reader = getGeometryDeserializer(TSRMLS_C);
+    if ( ! reader ) return FAILURE; /* should get an exception first */
+    geom = GEOSWKBReader_read_r(GEOS_G(handle), reader, proxy->wkb,
+        proxy->wkblen);
+    if ( ! geom ) return FAILURE; /* should get an exception first */
+
+    size = geometryMemorySize(geom TSRMLS_CC);
+    if ( checkMemoryLimit(size TSRMLS_CC) == FAILURE ) {
+        GEOSGeom_destroy_r(GEOS_G(handle), geom);
+        return FAILURE;
+    }
+
+    proxy->relay = geom;
+    proxy->memory += size;
+    GEOS_G(memory_usage) += size;
+    return SUCCESS;
+}
+
+/* Forget the original bytes of a lazy geometry, once modified */
+static void
+dropLazyWKB(Proxy* proxy TSRMLS_DC) {
+    if ( ! proxy->wkb ) return;
+    efree(proxy->wkb);
+    proxy->wkb = NULL;
+    proxy->memory -= proxy->wkblen;
+    GEOS_G(memory_usage) -= proxy->wkblen;
+    proxy->wkblen = 0;
 }
 
 static inline void *
-getRelay(zval* val, zend_class_entry* ce) {
-    TSRMLS_FETCH();
+getRelay(zval* val, zend_class_entry* ce TSRMLS_DC) {
     Proxy *proxy =  (Proxy*)zend_object_store_get_object(val TSRMLS_CC);
     if ( proxy->std.ce != ce ) {
         php_error_docref(NULL TSRMLS_CC, E_ERROR,
             "Relay object is not an %s", ce->name);
     }
+    /* a lazy geometry GEOS rejects throws, callers get NULL */
+    if ( ! proxy->relay && proxy->wkb ) {
+        if ( materializeRelay(proxy TSRMLS_CC) == FAILURE ) return NULL;
+    }
     if ( ! proxy->relay ) {
         php_error_docref(NULL TSRMLS_CC, E_ERROR,
             "Relay object for object of type %s is not set", ce->name);
@@ -149,6 +437,57 @@ getRelay(zval* val, zend_class_entry* ce) {
     return proxy->relay;
 }
 
+/*
+ * Replace the geometry held by a GEOSGeometry object, destroying
+ * the previous one. Used by operations working in place.
+ */
+static void
+replaceRelay(zval* val, GEOSGeometry* geom TSRMLS_DC) {
+    Proxy* proxy = (Proxy*)zend_object_store_get_object(val TSRMLS_CC);
+    long size = geometryMemorySize(geom TSRMLS_CC);
+
+    dropLazyWKB(proxy TSRMLS_CC);
+    if ( checkMemoryLimit(size - proxy->memory TSRMLS_CC) == FAILURE ) {
+        GEOSGeom_destroy_r(GEOS_G(handle), geom);
+        return;
+    }
+
+    if ( proxy->relay && ! proxy->shared ) {
+        GEOSGeom_destroy_r(GEOS_G(handle), (GEOSGeometry*)proxy->relay);
+    }
+    GEOS_G(memory_usage) += size - proxy->memory;
+    proxy->memory = size;
+    proxy->relay = geom;
+    proxy->shared = 0;
+}
+
+/*
+ * Relay of a GEOSGeometry about to be modified in place. One
+ * borrowed from the shared cache memo is copied first, so that
+ * it stays as stored. Returns NULL after an exception if the
+ * copy can't be made or held.
+ */
+static GEOSGeometry*
+getOwnRelay(zval* val TSRMLS_DC) {
+    Proxy* proxy = (Proxy*)zend_object_store_get_object(val TSRMLS_CC);
+    GEOSGeometry *geom;
+    long size;
+
+    geom = (GEOSGeometry*)getRelay(val, Geometry_ce_ptr TSRMLS_CC);
+    if ( ! geom || ! proxy->shared ) return geom;
+
+    size = geometryMemorySize(geom TSRMLS_CC);
+    if ( checkMemoryLimit(size TSRMLS_CC) == FAILURE ) return NULL;
+    geom = GEOSGeom_clone_r(GEOS_G(handle), geom);
+    if ( ! geom ) return NULL; /* should get an exception first */
+
+    GEOS_G(memory_usage) += size;
+    proxy->memory += size;
+    proxy->relay = geom;
+    proxy->shared = 0;
+    return geom;
+}
+
 static long getZvalAsLong(zval* val)
 {
     long ret;
@@ -162,7 +501,7 @@ static long getZvalAsLong(zval* val)
     return ret;
 }
 
-static long getZvalAsDouble(zval* val)
+static double getZvalAsDouble(zval* val)
 {
     double ret;
     zval tmp;
@@ -177,9 +516,9 @@ static long getZvalAsDouble(zval* val)
 
 static zend_object_value
 Gen_create_obj (zend_class_entry *type,
-    zend_objects_free_object_storage_t st, zend_object_handlers* handlers)
+    zend_objects_free_object_storage_t st, zend_object_handlers* handlers
+    TSRMLS_DC)
 {
-    TSRMLS_FETCH();
     zend_object_value retval;
 
     Proxy *obj = (Proxy *)emalloc(sizeof(Proxy));
@@ -201,1538 +540,8618 @@ Gen_create_obj (zend_class_entry *type,
     return retval;
 }
 
+/*
+ * Relay of a GEOSGeometry found as an element of an input array.
+ * Throws an exception and returns NULL for anything else.
+ */
+static GEOSGeometry*
+getGeometryElement(zval* val TSRMLS_DC)
+{
+    if ( Z_TYPE_P(val) != IS_OBJECT || Z_OBJCE_P(val) != Geometry_ce_ptr ) {
+        zend_throw_exception_ex(zend_exception_get_default(TSRMLS_C),
+            1 TSRMLS_CC, "Expected an array of GEOSGeometry objects");
+        return NULL;
+    }
+    return (GEOSGeometry*)getRelay(val, Geometry_ce_ptr TSRMLS_CC);
+}
 
-/* -- class GEOSGeometry -------------------- */
+/*
+ * Add val to array using the key found at pos in ht, so that
+ * results of batch operations keep the keys of their input.
+ */
+static void
+addZvalWithKey(zval* array, HashTable* ht, HashPosition* pos, zval* val)
+{
+    char *key;
+    uint keylen;
+    ulong index;
 
-PHP_METHOD(Geometry, __construct);
-PHP_METHOD(Geometry, __toString);
-PHP_METHOD(Geometry, project);
-PHP_METHOD(Geometry, interpolate);
-PHP_METHOD(Geometry, buffer);
+    if ( zend_hash_get_current_key_ex(ht, &key, &keylen, &index, 0, pos)
+            == HASH_KEY_IS_STRING ) {
+        add_assoc_zval_ex(array, key, keylen, val);
+    } else {
+        add_index_zval(array, index, val);
+    }
+}
 
-#ifdef HAVE_GEOS_OFFSET_CURVE
-PHP_METHOD(Geometry, offsetCurve);
-#endif
+/*
+ * Add an element of ht to array under the same key, sharing it
+ * unless it is a reference, which would then be shared with the
+ * input array.
+ */
+static void
+addElementWithKey(zval* array, HashTable* ht, HashPosition* pos, zval* val)
+{
+    zval *copy;
 
-PHP_METHOD(Geometry, envelope);
-PHP_METHOD(Geometry, intersection);
-PHP_METHOD(Geometry, convexHull);
-PHP_METHOD(Geometry, difference);
-PHP_METHOD(Geometry, symDifference);
-PHP_METHOD(Geometry, boundary);
-PHP_METHOD(Geometry, union); /* also does union cascaded */
-PHP_METHOD(Geometry, pointOnSurface);
-PHP_METHOD(Geometry, centroid);
-PHP_METHOD(Geometry, relate);
+    if ( Z_ISREF_P(val) ) {
+        MAKE_STD_ZVAL(copy);
+        ZVAL_ZVAL(copy, val, 1, 0);
+        val = copy;
+    } else {
+        Z_ADDREF_P(val);
+    }
+    addZvalWithKey(array, ht, pos, val);
+}
 
-#ifdef HAVE_GEOS_RELATE_BOUNDARY_NODE_RULE
-PHP_METHOD(Geometry, relateBoundaryNodeRule);
-#endif
+/*
+ * Get the extent of a geometry.
+ * Returns 0, leaving the output untouched, for empty geometries.
+ */
+static int
+getGeometryExtent(const GEOSGeometry* g, double* minx, double* miny,
+        double* maxx, double* maxy TSRMLS_DC)
+{
+#ifdef HAVE_GEOS_GEOM_GET_XMIN
+    if ( GEOSisEmpty_r(GEOS_G(handle), g) ) return 0;
+
+    GEOSGeom_getXMin_r(GEOS_G(handle), g, minx);
+    GEOSGeom_getYMin_r(GEOS_G(handle), g, miny);
+    GEOSGeom_getXMax_r(GEOS_G(handle), g, maxx);
+    GEOSGeom_getYMax_r(GEOS_G(handle), g, maxy);
+    return 1;
+#else
+    GEOSGeometry *env;
+    const GEOSGeometry *ring;
+    const GEOSCoordSequence *seq;
+    unsigned int i, size = 0;
+    double x, y;
+
+    env = GEOSEnvelope_r(GEOS_G(handle), g);
+    if ( ! env ) return 0; /* should get an exception first */
+
+    if ( GEOSisEmpty_r(GEOS_G(handle), env) ) {
+        GEOSGeom_destroy_r(GEOS_G(handle), env);
+        return 0;
+    }
 
-PHP_METHOD(Geometry, simplify); /* also does topology-preserving */
-PHP_METHOD(Geometry, normalize);
+    /* envelopes are either points or rectangular polygons */
+    if ( GEOSGeomTypeId_r(GEOS_G(handle), env) == GEOS_POINT ) {
+        seq = GEOSGeom_getCoordSeq_r(GEOS_G(handle), env);
+    } else {
+        ring = GEOSGetExteriorRing_r(GEOS_G(handle), env);
+        seq = GEOSGeom_getCoordSeq_r(GEOS_G(handle), ring);
+    }
 
-#ifdef HAVE_GEOS_GEOM_SET_PRECISION
-PHP_METHOD(Geometry, setPrecision);
-#endif
+    GEOSCoordSeq_getSize_r(GEOS_G(handle), seq, &size);
+    for (i=0; i<size; ++i) {
+        GEOSCoordSeq_getX_r(GEOS_G(handle), seq, i, &x);
+        GEOSCoordSeq_getY_r(GEOS_G(handle), seq, i, &y);
+        if ( ! i || x < *minx ) *minx = x;
+        if ( ! i || y < *miny ) *miny = y;
+        if ( ! i || x > *maxx ) *maxx = x;
+        if ( ! i || y > *maxy ) *maxy = y;
+    }
 
-#ifdef HAVE_GEOS_GEOM_GET_PRECISION
-PHP_METHOD(Geometry, getPrecision);
+    GEOSGeom_destroy_r(GEOS_G(handle), env);
+    return 1;
 #endif
+}
 
-#ifdef HAVE_GEOS_GEOM_EXTRACT_UNIQUE_POINTS
-PHP_METHOD(Geometry, extractUniquePoints);
-#endif
+/*
+ * Read an extent given as an array of minx, miny, maxx and maxy,
+ * either keyed by these names, as returned by GEOSSharedCache::envelope,
+ * or in this order. Throws and returns FAILURE if any is missing.
+ */
+static int
+getExtentArray(HashTable* ht, double* extent TSRMLS_DC)
+{
+    static const char *names[] = { "minx", "miny", "maxx", "maxy" };
+    zval **data;
+    int i;
+
+    for (i=0; i<4; ++i) {
+        if ( zend_hash_find(ht, (char*)names[i], strlen(names[i]) + 1,
+                    (void**)&data) != SUCCESS
+                && zend_hash_index_find(ht, i, (void**)&data) != SUCCESS ) {
+            zend_throw_exception_ex(zend_exception_get_default(TSRMLS_C), 1
+                TSRMLS_CC, "Extent must hold minx, miny, maxx and maxy");
+            return FAILURE;
+        }
+        extent[i] = getZvalAsDouble(*data);
+    }
 
-PHP_METHOD(Geometry, disjoint);
-PHP_METHOD(Geometry, touches);
-PHP_METHOD(Geometry, intersects);
-PHP_METHOD(Geometry, crosses);
-PHP_METHOD(Geometry, within);
-PHP_METHOD(Geometry, contains);
-PHP_METHOD(Geometry, overlaps);
+    return SUCCESS;
+}
 
-#ifdef HAVE_GEOS_COVERS
-PHP_METHOD(Geometry, covers);
-#endif
+/*
+ * Geometry covering the given extent, the same way GEOSEnvelope does:
+ * a point or a line for degenerate extents, a rectangle otherwise.
+ */
+static GEOSGeometry*
+createExtentGeometry(double minx, double miny, double maxx, double maxy
+        TSRMLS_DC)
+{
+    GEOSCoordSequence *seq;
+    GEOSGeometry *shell;
+    double xs[5], ys[5];
+    unsigned int i, n;
+
+    if ( minx == maxx && miny == maxy ) {
+        n = 1;
+        xs[0] = minx; ys[0] = miny;
+    } else if ( minx == maxx || miny == maxy ) {
+        n = 2;
+        xs[0] = minx; ys[0] = miny;
+        xs[1] = maxx; ys[1] = maxy;
+    } else {
+        n = 5;
+        xs[0] = minx; ys[0] = miny;
+        xs[1] = maxx; ys[1] = miny;
+        xs[2] = maxx; ys[2] = maxy;
+        xs[3] = minx; ys[3] = maxy;
+        xs[4] = minx; ys[4] = miny;
+    }
 
-#ifdef HAVE_GEOS_COVERED_BY
-PHP_METHOD(Geometry, coveredBy);
-#endif
+    seq = GEOSCoordSeq_create_r(GEOS_G(handle), n, 2);
+    if ( ! seq ) return NULL; /* should get an exception first */
+    for (i=0; i<n; ++i) {
+        GEOSCoordSeq_setX_r(GEOS_G(handle), seq, i, xs[i]);
+        GEOSCoordSeq_setY_r(GEOS_G(handle), seq, i, ys[i]);
+    }
 
-PHP_METHOD(Geometry, equals);
-PHP_METHOD(Geometry, equalsExact);
-PHP_METHOD(Geometry, isEmpty);
+    if ( n == 1 ) return GEOSGeom_createPoint_r(GEOS_G(handle), seq);
+    if ( n == 2 ) return GEOSGeom_createLineString_r(GEOS_G(handle), seq);
 
-#ifdef HAVE_GEOS_IS_VALID_DETAIL
-PHP_METHOD(Geometry, checkValidity);
-#endif
+    shell = GEOSGeom_createLinearRing_r(GEOS_G(handle), seq);
+    if ( ! shell ) return NULL; /* should get an exception first */
+    return GEOSGeom_createPolygon_r(GEOS_G(handle), shell, NULL, 0);
+}
 
-PHP_METHOD(Geometry, isSimple);
-PHP_METHOD(Geometry, isRing);
-PHP_METHOD(Geometry, hasZ);
+/* -- STR tree -------------------- */
 
-#ifdef HAVE_GEOS_IS_CLOSED
-PHP_METHOD(Geometry, isClosed);
-#endif
+/*
+ * Sort-Tile-Recursive packed R-tree over geometry extents.
+ *
+ * All levels live in a single array: the leaf level (one entry
+ * per item) comes first, each parent level follows the level
+ * below it and the root is the last entry. Every non-leaf entry
+ * references a contiguous range of entries on the level below.
+ */
 
-PHP_METHOD(Geometry, typeName);
-PHP_METHOD(Geometry, typeId);
-PHP_METHOD(Geometry, getSRID);
-PHP_METHOD(Geometry, setSRID);
-PHP_METHOD(Geometry, numGeometries);
-PHP_METHOD(Geometry, geometryN);
-PHP_METHOD(Geometry, numInteriorRings);
+#define STRTREE_NODE_CAPACITY 10
 
-#ifdef HAVE_GEOS_GEOM_GET_NUM_POINTS
-PHP_METHOD(Geometry, numPoints);
-#endif
+typedef struct STREntry_t {
+    double minx, miny, maxx, maxy;
+    long child; /* first child entry, or the item id on the leaf level */
+    long count; /* number of children, 0 on the leaf level */
+} STREntry;
 
-#ifdef HAVE_GEOS_GEOM_GET_X
-PHP_METHOD(Geometry, getX);
-#endif
+typedef struct STRTree_t {
+    STREntry *entries;
+    long nentries;
+    long root; /* -1 for an empty tree */
+    int persistent;
+} STRTree;
 
-#ifdef HAVE_GEOS_GEOM_GET_Y
-PHP_METHOD(Geometry, getY);
-#endif
+static int
+STREntry_cmpX(const void* a, const void* b)
+{
+    double ca = ((const STREntry*)a)->minx + ((const STREntry*)a)->maxx;
+    double cb = ((const STREntry*)b)->minx + ((const STREntry*)b)->maxx;
+    return ca < cb ? -1 : ca > cb ? 1 : 0;
+}
 
-PHP_METHOD(Geometry, interiorRingN);
-PHP_METHOD(Geometry, exteriorRing);
-PHP_METHOD(Geometry, numCoordinates);
-PHP_METHOD(Geometry, dimension);
+static int
+STREntry_cmpY(const void* a, const void* b)
+{
+    double ca = ((const STREntry*)a)->miny + ((const STREntry*)a)->maxy;
+    double cb = ((const STREntry*)b)->miny + ((const STREntry*)b)->maxy;
+    return ca < cb ? -1 : ca > cb ? 1 : 0;
+}
 
-#ifdef HAVE_GEOS_GEOM_GET_COORDINATE_DIMENSION
-PHP_METHOD(Geometry, coordinateDimension);
-#endif
+/* Order a level in vertical slices, each sorted bottom to top */
+static void
+STRTree_sortLevel(STREntry* level, long count)
+{
+    long nodes, slices, sliceSize, i;
 
-#ifdef HAVE_GEOS_GEOM_GET_POINT_N
-PHP_METHOD(Geometry, pointN);
-#endif
+    if ( count <= STRTREE_NODE_CAPACITY ) return;
 
-#ifdef HAVE_GEOS_GEOM_GET_START_POINT
-PHP_METHOD(Geometry, startPoint);
-#endif
+    nodes = (count + STRTREE_NODE_CAPACITY - 1) / STRTREE_NODE_CAPACITY;
+    slices = (long)ceil(sqrt((double)nodes));
+    sliceSize = slices * STRTREE_NODE_CAPACITY;
 
-#ifdef HAVE_GEOS_GEOM_GET_END_POINT
-PHP_METHOD(Geometry, endPoint);
-#endif
+    qsort(level, count, sizeof(STREntry), STREntry_cmpX);
+    for (i=0; i<count; i+=sliceSize) {
+        qsort(level + i, MIN(sliceSize, count - i), sizeof(STREntry),
+            STREntry_cmpY);
+    }
+}
 
-PHP_METHOD(Geometry, area);
-PHP_METHOD(Geometry, length);
-PHP_METHOD(Geometry, distance);
-PHP_METHOD(Geometry, hausdorffDistance);
+/*
+ * Build a tree from 'n' leaf entries, whose 'child' member
+ * carries the item id. The leaves are copied.
+ */
+static void
+STRTree_build(STRTree* tree, const STREntry* items, long n, int persistent)
+{
+    STREntry *parent;
+    long total, count, start, next, i, j;
 
-#ifdef HAVE_GEOS_SNAP
-PHP_METHOD(Geometry, snapTo);
-#endif
+    total = n;
+    for (count = n; count > 1; ) {
+        count = (count + STRTREE_NODE_CAPACITY - 1) / STRTREE_NODE_CAPACITY;
+        total += count;
+    }
 
-#ifdef HAVE_GEOS_NODE
-PHP_METHOD(Geometry, node);
+    tree->persistent = persistent;
+    tree->nentries = total;
+    tree->root = n ? total - 1 : -1;
+    tree->entries = (STREntry*)safe_pemalloc(total ? total : 1,
+        sizeof(STREntry), 0, persistent);
+    if ( n ) memcpy(tree->entries, items, n * sizeof(STREntry));
+    for (i=0; i<n; ++i) tree->entries[i].count = 0;
+
+    start = 0;
+    next = n;
+    for (count = n; count > 1; ) {
+        STRTree_sortLevel(tree->entries + start, count);
+        for (i=0; i<count; i+=STRTREE_NODE_CAPACITY) {
+            parent = &tree->entries[next++];
+            *parent = tree->entries[start + i];
+            parent->child = start + i;
+            parent->count = MIN(STRTREE_NODE_CAPACITY, count - i);
+            for (j=1; j<parent->count; ++j) {
+                const STREntry *e = &tree->entries[start + i + j];
+                if ( e->minx < parent->minx ) parent->minx = e->minx;
+                if ( e->miny < parent->miny ) parent->miny = e->miny;
+                if ( e->maxx > parent->maxx ) parent->maxx = e->maxx;
+                if ( e->maxy > parent->maxy ) parent->maxy = e->maxy;
+            }
+        }
+        start += count;
+        count = (count + STRTREE_NODE_CAPACITY - 1) / STRTREE_NODE_CAPACITY;
+    }
+}
+
+static void
+STRTree_destroy(STRTree* tree)
+{
+    pefree(tree->entries, tree->persistent);
+    tree->entries = NULL;
+    tree->nentries = 0;
+    tree->root = -1;
+}
+
+static void
+STRTree_queryEntry(const STRTree* tree, long e, double minx, double miny,
+        double maxx, double maxy, long** items, long* nitems, long* capacity)
+{
+    const STREntry *entry = &tree->entries[e];
+    long i;
+
+    if ( entry->minx > maxx || entry->maxx < minx
+            || entry->miny > maxy || entry->maxy < miny ) {
+        return;
+    }
+
+    if ( ! entry->count ) {
+        if ( *nitems == *capacity ) {
+            *capacity *= 2;
+            *items = (long*)safe_erealloc(*items, *capacity, sizeof(long), 0);
+        }
+        (*items)[(*nitems)++] = entry->child;
+        return;
+    }
+
+    for (i=0; i<entry->count; ++i) {
+        STRTree_queryEntry(tree, entry->child + i, minx, miny, maxx, maxy,
+            items, nitems, capacity);
+    }
+}
+
+/*
+ * Collect the ids of the items whose extent intersects the given
+ * one into a newly emalloc'ed array, returning their number.
+ */
+static long
+STRTree_query(const STRTree* tree, double minx, double miny,
+        double maxx, double maxy, long** items)
+{
+    long nitems = 0, capacity = 16;
+
+    *items = (long*)safe_emalloc(capacity, sizeof(long), 0);
+    if ( tree->root != -1 ) {
+        STRTree_queryEntry(tree, tree->root, minx, miny, maxx, maxy,
+            items, &nitems, &capacity);
+    }
+    return nitems;
+}
+
+/* Distance between an entry's extent and the given extent */
+static double
+STREntry_distance(const STREntry* e, double minx, double miny,
+        double maxx, double maxy)
+{
+    double dx = 0, dy = 0;
+
+    if ( e->minx > maxx ) dx = e->minx - maxx;
+    else if ( minx > e->maxx ) dx = minx - e->maxx;
+    if ( e->miny > maxy ) dy = e->miny - maxy;
+    else if ( miny > e->maxy ) dy = miny - e->maxy;
+
+    return sqrt(dx * dx + dy * dy);
+}
+
+/* -- Coordinate transforms -------------------- */
+
+/*
+ * Filter rewriting, in place, 'npoints' coordinates stored as
+ * interleaved doubles, 'dims' (2 or 3) per coordinate.
+ */
+typedef void (*CoordinateFilter)(double* coords, unsigned int npoints,
+        unsigned int dims, const void* data);
+
+/*
+ * Copy the coordinates of a sequence into a newly emalloc'ed
+ * buffer of interleaved doubles, 'dims' (2 or 3) per coordinate.
+ */
+static double*
+readCoordSeq(const GEOSCoordSequence* seq, unsigned int* size,
+        unsigned int* dims TSRMLS_DC)
+{
+    double *coords;
+#ifndef HAVE_GEOS_COORDSEQ_COPY_TO_BUFFER
+    unsigned int i;
 #endif
 
-#ifdef HAVE_GEOS_DELAUNAY_TRIANGULATION
-PHP_METHOD(Geometry, delaunayTriangulation);
+    *size = 0;
+    *dims = 0;
+    if ( ! GEOSCoordSeq_getSize_r(GEOS_G(handle), seq, size) ) return NULL;
+    if ( ! GEOSCoordSeq_getDimensions_r(GEOS_G(handle), seq, dims) ) {
+        return NULL;
+    }
+    *dims = *dims > 2 ? 3 : 2;
+
+    coords = (double*)safe_emalloc(*size ? *size : 1,
+        *dims * sizeof(double), 0);
+
+#ifdef HAVE_GEOS_COORDSEQ_COPY_TO_BUFFER
+    if ( ! GEOSCoordSeq_copyToBuffer_r(GEOS_G(handle), seq, coords,
+                                       *dims == 3, 0) ) {
+        efree(coords);
+        return NULL; /* should get an exception first */
+    }
+#else
+    for (i=0; i<*size; ++i) {
+        GEOSCoordSeq_getX_r(GEOS_G(handle), seq, i, &coords[i * *dims]);
+        GEOSCoordSeq_getY_r(GEOS_G(handle), seq, i, &coords[i * *dims + 1]);
+        if ( *dims == 3 ) {
+            GEOSCoordSeq_getZ_r(GEOS_G(handle), seq, i,
+                &coords[i * *dims + 2]);
+        }
+    }
 #endif
 
-#ifdef HAVE_GEOS_VORONOI_DIAGRAM
-PHP_METHOD(Geometry, voronoiDiagram);
+    return coords;
+}
+
+static GEOSCoordSequence*
+transformCoordSeq(const GEOSCoordSequence* seq, CoordinateFilter filter,
+        const void* data TSRMLS_DC)
+{
+    GEOSCoordSequence *ret;
+    unsigned int size, dims;
+    double *coords;
+#ifndef HAVE_GEOS_COORDSEQ_COPY_TO_BUFFER
+    unsigned int i;
 #endif
 
-#ifdef HAVE_GEOS_CLIP_BY_RECT
-PHP_METHOD(Geometry, clipByRect);
+    coords = readCoordSeq(seq, &size, &dims TSRMLS_CC);
+    if ( ! coords ) return NULL; /* should get an exception first */
+
+    filter(coords, size, dims, data);
+
+#ifdef HAVE_GEOS_COORDSEQ_COPY_TO_BUFFER
+    ret = GEOSCoordSeq_copyFromBuffer_r(GEOS_G(handle), coords, size,
+        dims == 3, 0);
+#else
+    ret = GEOSCoordSeq_create_r(GEOS_G(handle), size, dims);
+    for (i=0; ret && i<size; ++i) {
+        GEOSCoordSeq_setX_r(GEOS_G(handle), ret, i, coords[i * dims]);
+        GEOSCoordSeq_setY_r(GEOS_G(handle), ret, i, coords[i * dims + 1]);
+        if ( dims == 3 ) {
+            GEOSCoordSeq_setZ_r(GEOS_G(handle), ret, i, coords[i * dims + 2]);
+        }
+    }
 #endif
 
-static zend_function_entry Geometry_methods[] = {
-    PHP_ME(Geometry, __construct, NULL, 0)
-    PHP_ME(Geometry, __toString, NULL, 0)
-    PHP_ME(Geometry, project, NULL, 0)
-    PHP_ME(Geometry, interpolate, NULL, 0)
-    PHP_ME(Geometry, buffer, NULL, 0)
+    efree(coords);
+    return ret;
+}
 
-#   ifdef HAVE_GEOS_OFFSET_CURVE
-    PHP_ME(Geometry, offsetCurve, NULL, 0)
-#   endif
+/*
+ * Copy of a geometry with all of its coordinates passed
+ * through 'filter'. Structure and SRID are preserved.
+ */
+static GEOSGeometry*
+transformGeometry(const GEOSGeometry* g, CoordinateFilter filter,
+        const void* data TSRMLS_DC)
+{
+    GEOSGeometry *ret = NULL;
+    GEOSGeometry *shell;
+    GEOSGeometry **parts;
+    GEOSCoordSequence *seq;
+    int type, n, i;
+
+    if ( GEOSisEmpty_r(GEOS_G(handle), g) ) {
+        return GEOSGeom_clone_r(GEOS_G(handle), g);
+    }
 
-    PHP_ME(Geometry, envelope, NULL, 0)
-    PHP_ME(Geometry, intersection, NULL, 0)
-    PHP_ME(Geometry, convexHull, NULL, 0)
-    PHP_ME(Geometry, difference, NULL, 0)
-    PHP_ME(Geometry, symDifference, NULL, 0)
-    PHP_ME(Geometry, boundary, NULL, 0)
-    PHP_ME(Geometry, union, NULL, 0)
-    PHP_ME(Geometry, pointOnSurface, NULL, 0)
-    PHP_ME(Geometry, centroid, NULL, 0)
-    PHP_ME(Geometry, relate, NULL, 0)
+    type = GEOSGeomTypeId_r(GEOS_G(handle), g);
+    switch (type) {
+    case GEOS_POINT:
+    case GEOS_LINESTRING:
+    case GEOS_LINEARRING:
+        seq = transformCoordSeq(GEOSGeom_getCoordSeq_r(GEOS_G(handle), g),
+            filter, data TSRMLS_CC);
+        if ( ! seq ) return NULL; /* should get an exception first */
+        if ( type == GEOS_POINT ) {
+            ret = GEOSGeom_createPoint_r(GEOS_G(handle), seq);
+        } else if ( type == GEOS_LINESTRING ) {
+            ret = GEOSGeom_createLineString_r(GEOS_G(handle), seq);
+        } else {
+            ret = GEOSGeom_createLinearRing_r(GEOS_G(handle), seq);
+        }
+        break;
+
+    case GEOS_POLYGON:
+        shell = transformGeometry(GEOSGetExteriorRing_r(GEOS_G(handle), g),
+            filter, data TSRMLS_CC);
+        if ( ! shell ) return NULL; /* should get an exception first */
+        n = GEOSGetNumInteriorRings_r(GEOS_G(handle), g);
+        parts = (GEOSGeometry**)safe_emalloc(n ? n : 1,
+            sizeof(GEOSGeometry*), 0);
+        for (i=0; i<n; ++i) {
+            parts[i] = transformGeometry(
+                GEOSGetInteriorRingN_r(GEOS_G(handle), g, i),
+                filter, data TSRMLS_CC);
+            if ( ! parts[i] ) break;
+        }
+        if ( i == n ) {
+            ret = GEOSGeom_createPolygon_r(GEOS_G(handle), shell, parts, n);
+        } else {
+            GEOSGeom_destroy_r(GEOS_G(handle), shell);
+            while ( i-- ) GEOSGeom_destroy_r(GEOS_G(handle), parts[i]);
+        }
+        efree(parts);
+        break;
+
+    default: /* collections */
+        n = GEOSGetNumGeometries_r(GEOS_G(handle), g);
+        parts = (GEOSGeometry**)safe_emalloc(n ? n : 1,
+            sizeof(GEOSGeometry*), 0);
+        for (i=0; i<n; ++i) {
+            parts[i] = transformGeometry(
+                GEOSGetGeometryN_r(GEOS_G(handle), g, i),
+                filter, data TSRMLS_CC);
+            if ( ! parts[i] ) break;
+        }
+        if ( i == n ) {
+            ret = GEOSGeom_createCollection_r(GEOS_G(handle), type, parts, n);
+        } else {
+            while ( i-- ) GEOSGeom_destroy_r(GEOS_G(handle), parts[i]);
+        }
+        efree(parts);
+        break;
+    }
 
-#   ifdef HAVE_GEOS_RELATE_BOUNDARY_NODE_RULE
-    PHP_ME(Geometry, relateBoundaryNodeRule, NULL, 0)
-#   endif
+    if ( ret ) GEOSSetSRID_r(GEOS_G(handle), ret, GEOSGetSRID_r(GEOS_G(handle), g));
+    return ret;
+}
 
-    PHP_ME(Geometry, simplify, NULL, 0)
-    PHP_ME(Geometry, normalize, NULL, 0)
+/*
+ * Affine filter, 'data' is the matrix { a, b, c, d, e, f, g, h, i,
+ * xoff, yoff, zoff } so that:
+ *   x' = a*x + b*y + c*z + xoff
+ *   y' = d*x + e*y + f*z + yoff
+ *   z' = g*x + h*y + i*z + zoff
+ * Loops are kept branch-free so that compilers can vectorize them.
+ */
+static void
+affineFilter(double* coords, unsigned int npoints, unsigned int dims,
+        const void* data)
+{
+    const double *m = (const double*)data;
+    double x, y, z;
+    unsigned int i;
+
+    if ( dims == 2 ) {
+        for (i=0; i<npoints; ++i) {
+            x = coords[2 * i];
+            y = coords[2 * i + 1];
+            coords[2 * i] = m[0] * x + m[1] * y + m[9];
+            coords[2 * i + 1] = m[3] * x + m[4] * y + m[10];
+        }
+    } else {
+        for (i=0; i<npoints; ++i) {
+            x = coords[3 * i];
+            y = coords[3 * i + 1];
+            z = coords[3 * i + 2];
+            coords[3 * i] = m[0] * x + m[1] * y + m[2] * z + m[9];
+            coords[3 * i + 1] = m[3] * x + m[4] * y + m[5] * z + m[10];
+            coords[3 * i + 2] = m[6] * x + m[7] * y + m[8] * z + m[11];
+        }
+    }
+}
 
-#   ifdef HAVE_GEOS_GEOM_SET_PRECISION
-    PHP_ME(Geometry, setPrecision, NULL, 0)
-#   endif
+static void
+swapXYFilter(double* coords, unsigned int npoints, unsigned int dims,
+        const void* data)
+{
+    double x;
+    unsigned int i;
 
-#   if HAVE_GEOS_GEOM_GET_PRECISION
-    PHP_ME(Geometry, getPrecision, NULL, 0)
-#   endif
+    for (i=0; i<npoints; ++i, coords += dims) {
+        x = coords[0];
+        coords[0] = coords[1];
+        coords[1] = x;
+    }
+}
 
-#   ifdef HAVE_GEOS_GEOM_EXTRACT_UNIQUE_POINTS
-    PHP_ME(Geometry, extractUniquePoints, NULL, 0)
-#   endif
+/* Spherical Web Mercator (EPSG:3857) */
+#define WEB_MERCATOR_RADIUS 6378137.0
+#define WEB_MERCATOR_MAX_LATITUDE 85.0511287798066
 
-    PHP_ME(Geometry, disjoint, NULL, 0)
-    PHP_ME(Geometry, touches, NULL, 0)
-    PHP_ME(Geometry, intersects, NULL, 0)
-    PHP_ME(Geometry, crosses, NULL, 0)
-    PHP_ME(Geometry, within, NULL, 0)
-    PHP_ME(Geometry, contains, NULL, 0)
-    PHP_ME(Geometry, overlaps, NULL, 0)
+static void
+toWebMercatorFilter(double* coords, unsigned int npoints, unsigned int dims,
+        const void* data)
+{
+    const double k = WEB_MERCATOR_RADIUS * M_PI / 180.0;
+    double lat;
+    unsigned int i;
+
+    for (i=0; i<npoints; ++i, coords += dims) {
+        lat = coords[1];
+        if ( lat > WEB_MERCATOR_MAX_LATITUDE ) {
+            lat = WEB_MERCATOR_MAX_LATITUDE;
+        } else if ( lat < -WEB_MERCATOR_MAX_LATITUDE ) {
+            lat = -WEB_MERCATOR_MAX_LATITUDE;
+        }
+        coords[0] *= k;
+        coords[1] = WEB_MERCATOR_RADIUS
+            * log(tan(M_PI / 4.0 + lat * M_PI / 360.0));
+    }
+}
 
-#   ifdef HAVE_GEOS_COVERS
-    PHP_ME(Geometry, covers, NULL, 0)
-#   endif
+static void
+fromWebMercatorFilter(double* coords, unsigned int npoints, unsigned int dims,
+        const void* data)
+{
+    const double k = 180.0 / (M_PI * WEB_MERCATOR_RADIUS);
+    unsigned int i;
 
-#   ifdef HAVE_GEOS_COVERED_BY
-    PHP_ME(Geometry, coveredBy, NULL, 0)
-#   endif
+    for (i=0; i<npoints; ++i, coords += dims) {
+        coords[0] *= k;
+        coords[1] = (2.0 * atan(exp(coords[1] / WEB_MERCATOR_RADIUS))
+            - M_PI / 2.0) * 180.0 / M_PI;
+    }
+}
 
-    PHP_ME(Geometry, equals, NULL, 0)
-    PHP_ME(Geometry, equalsExact, NULL, 0)
-    PHP_ME(Geometry, isEmpty, NULL, 0)
+/* -- Geometry hashing -------------------- */
 
-#   ifdef HAVE_GEOS_IS_VALID_DETAIL
-    PHP_ME(Geometry, checkValidity, NULL, 0)
-#   endif
+/*
+ * 128 bit content hash of a geometry, two 64 bit lanes fed with
+ * the MurmurHash3 x64 mixing steps, one word at a time.
+ */
+typedef struct GeometryHash_t {
+    uint64_t h1;
+    uint64_t h2;
+} GeometryHash;
 
-    PHP_ME(Geometry, isSimple, NULL, 0)
-    PHP_ME(Geometry, isRing, NULL, 0)
-    PHP_ME(Geometry, hasZ, NULL, 0)
+#define ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+static void
+GeometryHash_add(GeometryHash* h, uint64_t k)
+{
+    uint64_t k1 = k, k2 = k;
+
+    k1 *= 0x87c37b91114253d5ULL;
+    k1 = ROTL64(k1, 31);
+    k1 *= 0x4cf5ad432745937fULL;
+    h->h1 ^= k1;
+    h->h1 = ROTL64(h->h1, 27);
+    h->h1 += h->h2;
+    h->h1 = h->h1 * 5 + 0x52dce729;
+
+    k2 *= 0x4cf5ad432745937fULL;
+    k2 = ROTL64(k2, 33);
+    k2 *= 0x87c37b91114253d5ULL;
+    h->h2 ^= k2;
+    h->h2 = ROTL64(h->h2, 31);
+    h->h2 += h->h1;
+    h->h2 = h->h2 * 5 + 0x38495ab5;
+}
+
+static uint64_t
+GeometryHash_fmix(uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+static void
+GeometryHash_addDouble(GeometryHash* h, double d)
+{
+    uint64_t bits;
+
+    /* equal values must hash the same */
+    if ( d == 0 ) d = 0;        /* -0.0 */
+    if ( d != d ) d = NAN;      /* any NaN */
+    memcpy(&bits, &d, sizeof(bits));
+    GeometryHash_add(h, bits);
+}
+
+static int
+GeometryHash_addGeometry(GeometryHash* h, const GEOSGeometry* g TSRMLS_DC)
+{
+    const GEOSCoordSequence *seq;
+    double *coords;
+    unsigned int size, dims, i;
+    int type, n, j;
+
+    type = GEOSGeomTypeId_r(GEOS_G(handle), g);
+    GeometryHash_add(h, (uint64_t)type);
+
+    if ( GEOSisEmpty_r(GEOS_G(handle), g) ) {
+        GeometryHash_add(h, 0);
+        return SUCCESS;
+    }
+
+    switch (type) {
+    case GEOS_POINT:
+    case GEOS_LINESTRING:
+    case GEOS_LINEARRING:
+        seq = GEOSGeom_getCoordSeq_r(GEOS_G(handle), g);
+        if ( ! seq ) return FAILURE; /* should get an exception first */
+        coords = readCoordSeq(seq, &size, &dims TSRMLS_CC);
+        if ( ! coords ) return FAILURE; /* should get an exception first */
+        GeometryHash_add(h, (uint64_t)size);
+        GeometryHash_add(h, (uint64_t)dims);
+        for (i=0; i<size * dims; ++i) {
+            GeometryHash_addDouble(h, coords[i]);
+        }
+        efree(coords);
+        return SUCCESS;
+
+    case GEOS_POLYGON:
+        n = GEOSGetNumInteriorRings_r(GEOS_G(handle), g);
+        GeometryHash_add(h, (uint64_t)n + 1);
+        if ( GeometryHash_addGeometry(h,
+                GEOSGetExteriorRing_r(GEOS_G(handle), g) TSRMLS_CC)
+                == FAILURE ) {
+            return FAILURE;
+        }
+        for (j=0; j<n; ++j) {
+            if ( GeometryHash_addGeometry(h,
+                    GEOSGetInteriorRingN_r(GEOS_G(handle), g, j) TSRMLS_CC)
+                    == FAILURE ) {
+                return FAILURE;
+            }
+        }
+        return SUCCESS;
+
+    default: /* collections */
+        n = GEOSGetNumGeometries_r(GEOS_G(handle), g);
+        GeometryHash_add(h, (uint64_t)n);
+        for (j=0; j<n; ++j) {
+            if ( GeometryHash_addGeometry(h,
+                    GEOSGetGeometryN_r(GEOS_G(handle), g, j) TSRMLS_CC)
+                    == FAILURE ) {
+                return FAILURE;
+            }
+        }
+        return SUCCESS;
+    }
+}
+
+/*
+ * Hash a geometry, including its SRID, into 16 bytes.
+ * With 'normalized' set the hash is computed on a normalized
+ * copy, so that equal geometries with different vertex or
+ * part order share it.
+ */
+static int
+hashGeometry(const GEOSGeometry* g, int normalized, unsigned char* out
+        TSRMLS_DC)
+{
+    GeometryHash h = { 0x9368e53c2f6af274ULL, 0x586dcd208f7cd3fdULL };
+    GEOSGeometry *norm = NULL;
+    uint64_t lanes[2];
+    int ret, i;
+
+    if ( normalized ) {
+        norm = GEOSGeom_clone_r(GEOS_G(handle), g);
+        if ( ! norm ) return FAILURE; /* should get an exception first */
+        if ( GEOSNormalize_r(GEOS_G(handle), norm) == -1 ) {
+            GEOSGeom_destroy_r(GEOS_G(handle), norm);
+            return FAILURE; /* should get an exception first */
+        }
+        g = norm;
+    }
+
+    GeometryHash_add(&h, (uint64_t)(int64_t)GEOSGetSRID_r(GEOS_G(handle), g));
+    ret = GeometryHash_addGeometry(&h, g TSRMLS_CC);
+
+    if ( norm ) GEOSGeom_destroy_r(GEOS_G(handle), norm);
+    if ( ret == FAILURE ) return FAILURE;
+
+    h.h1 += h.h2;
+    h.h2 += h.h1;
+    h.h1 = GeometryHash_fmix(h.h1);
+    h.h2 = GeometryHash_fmix(h.h2);
+    h.h1 += h.h2;
+    h.h2 += h.h1;
+
+    /* big endian, so that the hex form reads as two numbers */
+    lanes[0] = h.h1;
+    lanes[1] = h.h2;
+    for (i=0; i<16; ++i) {
+        out[i] = (unsigned char)(lanes[i / 8] >> (56 - 8 * (i % 8)));
+    }
+
+    return SUCCESS;
+}
+
+/*
+ * Compare two geometries the way hashGeometry sees them: same
+ * type, structure and coordinates, Z included, with -0 equal to
+ * 0 and NaN equal to NaN. SRIDs are not compared.
+ * Returns 1 if equal, 0 if not, 2 on exception.
+ */
+static int
+equalGeometries(const GEOSGeometry* a, const GEOSGeometry* b TSRMLS_DC)
+{
+    const GEOSCoordSequence *seq;
+    double *ca, *cb;
+    unsigned int sa, sb, da, db, i;
+    int type, n, j, ret;
+
+    type = GEOSGeomTypeId_r(GEOS_G(handle), a);
+    if ( type != GEOSGeomTypeId_r(GEOS_G(handle), b) ) return 0;
+
+    n = GEOSisEmpty_r(GEOS_G(handle), a);
+    if ( n != GEOSisEmpty_r(GEOS_G(handle), b) ) return 0;
+    if ( n ) return 1;
+
+    switch (type) {
+    case GEOS_POINT:
+    case GEOS_LINESTRING:
+    case GEOS_LINEARRING:
+        seq = GEOSGeom_getCoordSeq_r(GEOS_G(handle), a);
+        if ( ! seq ) return 2; /* should get an exception first */
+        ca = readCoordSeq(seq, &sa, &da TSRMLS_CC);
+        if ( ! ca ) return 2; /* should get an exception first */
+        seq = GEOSGeom_getCoordSeq_r(GEOS_G(handle), b);
+        cb = seq ? readCoordSeq(seq, &sb, &db TSRMLS_CC) : NULL;
+        if ( ! cb ) {
+            efree(ca);
+            return 2; /* should get an exception first */
+        }
+        ret = sa == sb && da == db;
+        for (i=0; ret && i<sa * da; ++i) {
+            ret = ca[i] == cb[i] || (ca[i] != ca[i] && cb[i] != cb[i]);
+        }
+        efree(ca);
+        efree(cb);
+        return ret;
+
+    case GEOS_POLYGON:
+        n = GEOSGetNumInteriorRings_r(GEOS_G(handle), a);
+        if ( n != GEOSGetNumInteriorRings_r(GEOS_G(handle), b) ) return 0;
+        ret = equalGeometries(GEOSGetExteriorRing_r(GEOS_G(handle), a),
+            GEOSGetExteriorRing_r(GEOS_G(handle), b) TSRMLS_CC);
+        for (j=0; ret == 1 && j<n; ++j) {
+            ret = equalGeometries(GEOSGetInteriorRingN_r(GEOS_G(handle), a, j),
+                GEOSGetInteriorRingN_r(GEOS_G(handle), b, j) TSRMLS_CC);
+        }
+        return ret;
+
+    default: /* collections */
+        n = GEOSGetNumGeometries_r(GEOS_G(handle), a);
+        if ( n != GEOSGetNumGeometries_r(GEOS_G(handle), b) ) return 0;
+        for (j=0, ret=1; ret == 1 && j<n; ++j) {
+            ret = equalGeometries(GEOSGetGeometryN_r(GEOS_G(handle), a, j),
+                GEOSGetGeometryN_r(GEOS_G(handle), b, j) TSRMLS_CC);
+        }
+        return ret;
+    }
+}
+
+/* -- Result cache -------------------- */
+
+/*
+ * Opt-in LRU cache of operation results, enabled by setting
+ * geos.cache_size to a byte budget in php.ini; it can't be
+ * changed by scripts, as the cache is shared by all requests
+ * served by a worker. Entries live in persistent memory so that
+ * they survive across those requests. Keys are made of an
+ * operation code, the operation parameters and the hash of the
+ * input geometry; results are kept as EWKB, as geometries can't
+ * outlive the request context.
+ */
+#define GEOSCACHE_MAX_PARAMS 8
+#define GEOSCACHE_OP_BUFFER 1
+#define GEOSCACHE_OP_SIMPLIFY 2
+
+typedef struct GeometryCacheKey_t {
+    unsigned char bytes[1 + 8 * GEOSCACHE_MAX_PARAMS + 16];
+    uint len;
+} GeometryCacheKey;
+
+typedef struct GeometryCacheEntry_t {
+    struct GeometryCacheEntry_t *prev;
+    struct GeometryCacheEntry_t *next;
+    unsigned char *wkb;
+    size_t wkblen;
+    long size; /* accounted against geos.cache_size */
+    GeometryCacheKey key;
+} GeometryCacheEntry;
+
+/* hash table destructor, gets a pointer to the stored entry pointer */
+static void
+GeometryCache_freeEntry(void* data)
+{
+    GeometryCacheEntry *entry = *(GeometryCacheEntry**)data;
+
+    pefree(entry->wkb, 1);
+    pefree(entry, 1);
+}
+
+static void
+GeometryCache_unlink(GeometryCacheEntry* entry TSRMLS_DC)
+{
+    if ( entry->prev ) entry->prev->next = entry->next;
+    else GEOS_G(cache_head) = entry->next;
+    if ( entry->next ) entry->next->prev = entry->prev;
+    else GEOS_G(cache_tail) = entry->prev;
+    entry->prev = entry->next = NULL;
+}
+
+static void
+GeometryCache_pushFront(GeometryCacheEntry* entry TSRMLS_DC)
+{
+    entry->prev = NULL;
+    entry->next = GEOS_G(cache_head);
+    if ( GEOS_G(cache_head) ) GEOS_G(cache_head)->prev = entry;
+    else GEOS_G(cache_tail) = entry;
+    GEOS_G(cache_head) = entry;
+}
+
+/* Evict least recently used entries until at most 'size' bytes are held */
+static void
+GeometryCache_trim(long size TSRMLS_DC)
+{
+    GeometryCacheEntry *entry;
+
+    while ( GEOS_G(cache_bytes) > size && GEOS_G(cache_tail) ) {
+        entry = GEOS_G(cache_tail);
+        GeometryCache_unlink(entry TSRMLS_CC);
+        GEOS_G(cache_bytes) -= entry->size;
+        /* frees the entry */
+        zend_hash_del(&GEOS_G(cache_table), (char*)entry->key.bytes,
+            entry->key.len);
+    }
+}
+
+static void
+GeometryCache_clear(TSRMLS_D)
+{
+    zend_hash_clean(&GEOS_G(cache_table));
+    GEOS_G(cache_head) = GEOS_G(cache_tail) = NULL;
+    GEOS_G(cache_bytes) = 0;
+}
+
+/*
+ * Build the cache key of an operation on a geometry.
+ * Returns FAILURE, and leaves the exception state alone,
+ * when the cache is disabled or the key can't be computed;
+ * the operation should then just be run uncached.
+ */
+static int
+GeometryCache_key(GeometryCacheKey* key, int op, const double* params,
+        int nparams, const GEOSGeometry* g TSRMLS_DC)
+{
+    if ( GEOS_G(cache_size) <= 0 ) return FAILURE;
+    if ( nparams > GEOSCACHE_MAX_PARAMS ) return FAILURE;
+
+    key->bytes[0] = (unsigned char)op;
+    memcpy(key->bytes + 1, params, nparams * sizeof(double));
+    key->len = 1 + nparams * sizeof(double);
+    if ( hashGeometry(g, 0, key->bytes + key->len TSRMLS_CC) == FAILURE ) {
+        return FAILURE;
+    }
+    key->len += 16;
+
+    return SUCCESS;
+}
+
+/* Cached result for key, or NULL on miss */
+static GEOSGeometry*
+GeometryCache_fetch(const GeometryCacheKey* key TSRMLS_DC)
+{
+    GeometryCacheEntry **found;
+    GeometryCacheEntry *entry;
+    GEOSWKBReader *reader;
+
+    if ( zend_hash_find(&GEOS_G(cache_table), (char*)key->bytes, key->len,
+            (void**)&found) == FAILURE ) {
+        ++GEOS_G(cache_misses);
+        return NULL;
+    }
+    entry = *found;
+
+    reader = getGeometryDeserializer(TSRMLS_C);
+    if ( ! reader ) return NULL;
+
+    ++GEOS_G(cache_hits);
+    GeometryCache_unlink(entry TSRMLS_CC);
+    GeometryCache_pushFront(entry TSRMLS_CC);
+
+    return GEOSWKBReader_read_r(GEOS_G(handle), reader,
+        entry->wkb, entry->wkblen);
+}
+
+/* Remember the result of the operation identified by key */
+static void
+GeometryCache_store(const GeometryCacheKey* key, const GEOSGeometry* g
+        TSRMLS_DC)
+{
+    GeometryCacheEntry *entry;
+    GEOSWKBWriter *writer;
+    unsigned char *wkb;
+    size_t wkblen;
+    long size;
+
+    writer = getGeometrySerializer(TSRMLS_C);
+    if ( ! writer ) return;
+
+    /* not all GEOS versions can write empty points as WKB */
+    if ( GEOSisEmpty_r(GEOS_G(handle), g) ) return;
+
+    wkb = GEOSWKBWriter_write_r(GEOS_G(handle), writer, g, &wkblen);
+    if ( ! wkb ) return;
+
+    size = (long)(sizeof(GeometryCacheEntry) + wkblen);
+    if ( size > GEOS_G(cache_size) ) {
+        GEOSFree_r(GEOS_G(handle), wkb);
+        return;
+    }
+    GeometryCache_trim(GEOS_G(cache_size) - size TSRMLS_CC);
+
+    entry = pemalloc(sizeof(GeometryCacheEntry), 1);
+    entry->wkb = pemalloc(wkblen, 1);
+    memcpy(entry->wkb, wkb, wkblen);
+    GEOSFree_r(GEOS_G(handle), wkb);
+    entry->wkblen = wkblen;
+    entry->size = size;
+    entry->key = *key;
+
+    if ( zend_hash_add(&GEOS_G(cache_table), (char*)entry->key.bytes,
+            entry->key.len, &entry, sizeof(GeometryCacheEntry*), NULL)
+            == FAILURE ) {
+        GeometryCache_freeEntry(&entry);
+        return;
+    }
+    GeometryCache_pushFront(entry TSRMLS_CC);
+    GEOS_G(cache_bytes) += size;
+}
+
+/* -- Shared cache -------------------- */
+
+#ifdef HAVE_MMAP
+
+/*
+ * Geometry store in a file mapped by every process using the
+ * extension (geos.shm_path, geos.shm_size), so that large
+ * reference geometries are serialized once per host.
+ *
+ * Each worker, a process or a thread in threaded builds, still
+ * parses an entry into its own GEOS heap: the first fetch of an
+ * entry does, and the geometry is then kept by the worker until
+ * it exits and lent to every later fetch without a copy. What is
+ * saved is the parsing and copying on every fetch, not the parsed
+ * geometry held by each worker. These geometries are not counted
+ * against geos.memory_limit, which is per request; they are bounded
+ * by geos.shm_size, as an entry is parsed at most once per worker.
+ *
+ * The segment is append-only: entries are carved from the end of
+ * the used space with an atomic add, and published by swapping
+ * them at the head of their hash bucket chain. Readers never
+ * lock; an entry is immutable once reachable. Storing an existing
+ * key again shadows the older entry, whose space is not reclaimed.
+ *
+ * All offsets are relative to the start of the segment,
+ * as every process maps it at a different address. The segment
+ * outlives the processes writing it, so they are checked against
+ * its size before use rather than trusted.
+ *
+ * Initialization happens under an exclusive flock of the file,
+ * which the kernel releases if the initializing process dies;
+ * a segment found in any state but READY under the lock is
+ * initialized again.
+ */
+#define SHAREDCACHE_MAGIC "GEOSSHM1"
+#define SHAREDCACHE_UNINITIALIZED 0
+#define SHAREDCACHE_INITIALIZING 1
+#define SHAREDCACHE_READY 2
+
+typedef struct SharedCacheHeader_t {
+    char magic[8];
+    volatile uint32_t state;
+    uint32_t nbuckets;
+    uint64_t size; /* of the whole segment */
+    volatile uint64_t top; /* end of the used space */
+    volatile uint64_t entries;
+    /* followed by nbuckets bucket heads, 0 for an empty chain */
+} SharedCacheHeader;
+
+typedef struct SharedCacheEntry_t {
+    uint64_t next;
+    uint64_t hash;
+    double minx, miny, maxx, maxy; /* minx > maxx for empty geometries */
+    uint32_t keylen;
+    uint32_t wkblen;
+    /* followed by key and EWKB bytes */
+} SharedCacheEntry;
+
+static SharedCacheHeader *sharedCache = NULL;
+static size_t sharedCacheLength = 0;
+/* validated copies of the header fields, which other processes could trash */
+static uint64_t sharedCacheSize = 0;
+static uint32_t sharedCacheBuckets = 0;
+
+#define SHAREDCACHE_BUCKETS(c) ((volatile uint64_t*)((c) + 1))
+#define SHAREDCACHE_ALIGN(n) (((n) + 7) & ~(uint64_t)7)
+/* offset of the first entry */
+#define SHAREDCACHE_DATA(nbuckets) SHAREDCACHE_ALIGN(sizeof(SharedCacheHeader) \
+    + (uint64_t)(nbuckets) * sizeof(uint64_t))
+
+
+static uint64_t
+SharedCache_hash(const char* key, int keylen)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    int i;
+
+    for (i=0; i<keylen; ++i) {
+        h ^= (unsigned char)key[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+/*
+ * Map the segment, initializing it if this process is the first
+ * one to use it. Failures only disable the shared cache.
+ */
+static void
+SharedCache_attach(const char* path, long size TSRMLS_DC)
+{
+    SharedCacheHeader *c;
+    struct stat st;
+    uint32_t nbuckets;
+    int fd;
+
+    if ( ! path || ! *path || size <= 0 ) return;
+
+    fd = open(path, O_RDWR | O_CREAT, 0600);
+    if ( fd == -1 || flock(fd, LOCK_EX) == -1 || fstat(fd, &st) == -1 ) {
+        php_error_docref(NULL TSRMLS_CC, E_WARNING,
+            "Cannot open geos.shm_path %s: %s", path, strerror(errno));
+        if ( fd != -1 ) close(fd);
+        return;
+    }
+
+    /* an existing segment keeps its size */
+    if ( st.st_size < size && ftruncate(fd, size) == -1 ) {
+        php_error_docref(NULL TSRMLS_CC, E_WARNING,
+            "Cannot resize geos.shm_path %s: %s", path, strerror(errno));
+        close(fd);
+        return;
+    }
+    if ( st.st_size > size ) size = st.st_size;
+
+    c = (SharedCacheHeader*)mmap(NULL, size, PROT_READ | PROT_WRITE,
+        MAP_SHARED, fd, 0);
+    if ( c == MAP_FAILED ) {
+        php_error_docref(NULL TSRMLS_CC, E_WARNING,
+            "Cannot map geos.shm_path %s: %s", path, strerror(errno));
+        close(fd);
+        return;
+    }
+
+    /* new, or left INITIALIZING by a process that died holding the lock */
+    if ( c->state != SHAREDCACHE_READY
+            && (uint64_t)size >= SHAREDCACHE_DATA(64) ) {
+        c->state = SHAREDCACHE_INITIALIZING;
+        __sync_synchronize();
+
+        /* a bucket per couple of kilobytes */
+        nbuckets = 64;
+        while ( nbuckets < (1 << 24) && (long)nbuckets * 2048 < size ) {
+            nbuckets <<= 1;
+        }
+        memset((void*)SHAREDCACHE_BUCKETS(c), 0, nbuckets * sizeof(uint64_t));
+        c->nbuckets = nbuckets;
+        c->size = size;
+        c->top = SHAREDCACHE_DATA(nbuckets);
+        c->entries = 0;
+        memcpy(c->magic, SHAREDCACHE_MAGIC, 8);
+        __sync_synchronize();
+        c->state = SHAREDCACHE_READY;
+    }
+
+    flock(fd, LOCK_UN);
+    close(fd);
+
+    if ( c->state != SHAREDCACHE_READY || memcmp(c->magic, SHAREDCACHE_MAGIC, 8)
+            || c->size > (uint64_t)size || c->nbuckets == 0
+            || SHAREDCACHE_DATA(c->nbuckets) > c->size
+            || c->top < SHAREDCACHE_DATA(c->nbuckets) || c->top % 8 ) {
+        php_error_docref(NULL TSRMLS_CC, E_WARNING,
+            "geos.shm_path %s is not a usable GEOS shared cache", path);
+        munmap((void*)c, size);
+        return;
+    }
+
+    sharedCache = c;
+    sharedCacheLength = size;
+    sharedCacheSize = c->size;
+    sharedCacheBuckets = c->nbuckets;
+}
+
+static void
+SharedCache_detach(void)
+{
+    if ( ! sharedCache ) return;
+    munmap((void*)sharedCache, sharedCacheLength);
+    sharedCache = NULL;
+    sharedCacheLength = 0;
+    sharedCacheSize = 0;
+    sharedCacheBuckets = 0;
+}
+
+/* Entry at offset off, or NULL if it does not fit in the segment */
+static const SharedCacheEntry*
+SharedCache_entry(uint64_t off)
+{
+    const SharedCacheEntry *entry;
+
+    if ( off < SHAREDCACHE_DATA(sharedCacheBuckets) || off % 8
+            || off > sharedCacheSize - sizeof(SharedCacheEntry) ) {
+        return NULL;
+    }
+
+    entry = (const SharedCacheEntry*)((const char*)sharedCache + off);
+    if ( (uint64_t)entry->keylen + entry->wkblen
+            > sharedCacheSize - off - sizeof(SharedCacheEntry) ) {
+        return NULL;
+    }
+    return entry;
+}
+
+static const SharedCacheEntry*
+SharedCache_find(const char* key, int keylen)
+{
+    const SharedCacheEntry *entry;
+    uint64_t hash, off, steps;
+
+    hash = SharedCache_hash(key, keylen);
+    off = SHAREDCACHE_BUCKETS(sharedCache)[hash % sharedCacheBuckets];
+    __sync_synchronize(); /* see the entry as it was published */
+
+    /* a chain can't be longer than the entries fitting in the segment */
+    steps = sharedCacheSize / sizeof(SharedCacheEntry);
+    while ( off && steps-- ) {
+        entry = SharedCache_entry(off);
+        if ( ! entry ) return NULL; /* corrupted chain */
+        if ( entry->hash == hash && entry->keylen == (uint32_t)keylen
+                && ! memcmp(entry + 1, key, keylen) ) {
+            return entry;
+        }
+        off = entry->next;
+    }
+    return NULL;
+}
+
+/*
+ * Append an entry, returning FAILURE when the segment is full.
+ */
+static int
+SharedCache_store(const char* key, int keylen, const unsigned char* wkb,
+        size_t wkblen, const double* extent)
+{
+    SharedCacheEntry *entry;
+    volatile uint64_t *bucket;
+    uint64_t hash, off, len, head;
+
+    if ( wkblen > UINT32_MAX - keylen ) return FAILURE;
+
+    /* never moves top past the end, unlike an add given back on failure */
+    len = SHAREDCACHE_ALIGN(sizeof(SharedCacheEntry) + keylen + wkblen);
+    do {
+        off = sharedCache->top;
+        if ( off < SHAREDCACHE_DATA(sharedCacheBuckets) || off % 8
+                || off > sharedCacheSize || len > sharedCacheSize - off ) {
+            return FAILURE;
+        }
+    } while ( ! __sync_bool_compare_and_swap(&sharedCache->top, off,
+                off + len) );
+
+    hash = SharedCache_hash(key, keylen);
+    entry = (SharedCacheEntry*)((char*)sharedCache + off);
+    entry->hash = hash;
+    entry->minx = extent[0];
+    entry->miny = extent[1];
+    entry->maxx = extent[2];
+    entry->maxy = extent[3];
+    entry->keylen = keylen;
+    entry->wkblen = wkblen;
+    memcpy(entry + 1, key, keylen);
+    memcpy((char*)(entry + 1) + keylen, wkb, wkblen);
+
+    bucket = SHAREDCACHE_BUCKETS(sharedCache) + hash % sharedCacheBuckets;
+    do {
+        head = *bucket;
+        entry->next = head;
+    } while ( ! __sync_bool_compare_and_swap(bucket, head, off) );
+
+    __sync_fetch_and_add(&sharedCache->entries, 1);
+    return SUCCESS;
+}
+
+/*
+ * Geometry of an entry, parsed on first use and kept by the worker
+ * in a module lifetime context, as entries never change once
+ * reachable. The geometry stays owned by the memo. Returns NULL
+ * after an exception if it can't be read.
+ */
+static const GEOSGeometry*
+SharedCache_geometry(const SharedCacheEntry* entry TSRMLS_DC)
+{
+    GEOSGeometry **found;
+    GEOSWKBReader *reader = NULL;
+    GEOSGeometry *geom = NULL;
+    ulong off = (ulong)((const char*)entry - (const char*)sharedCache);
+
+    if ( zend_hash_index_find(&GEOS_G(shm_memo), off, (void**)&found)
+            == SUCCESS ) {
+        return *found;
+    }
+
+    if ( ! GEOS_G(shm_handle) ) GEOS_G(shm_handle) = createContext(1 TSRMLS_CC);
+    if ( GEOS_G(shm_handle) ) {
+        reader = GEOSWKBReader_create_r(GEOS_G(shm_handle));
+    }
+    if ( reader ) {
+        geom = GEOSWKBReader_read_r(GEOS_G(shm_handle), reader,
+            (const unsigned char*)(entry + 1) + entry->keylen, entry->wkblen);
+        GEOSWKBReader_destroy_r(GEOS_G(shm_handle), reader);
+    }
+    if ( ! geom ) {
+        zend_throw_exception_ex(zend_exception_get_default(TSRMLS_C), 1
+            TSRMLS_CC, "Cannot read the shared cache entry");
+        return NULL;
+    }
+
+    zend_hash_index_update(&GEOS_G(shm_memo), off, &geom,
+        sizeof(GEOSGeometry*), NULL);
+    return geom;
+}
+
+#endif /* HAVE_MMAP */
+
+/* -- Point in polygon -------------------- */
+
+/*
+ * Ray-crossing point in polygon test over the edges of all
+ * rings of a polygonal geometry. Edges are bucketed into
+ * horizontal bands so that each point only looks at the edges
+ * crossing its own band. Edges are listed in every band they
+ * cross, so there are fewer bands when edges are long, keeping
+ * the index linear in the number of edges. Points on the boundary
+ * are not contained, nor are NaN points.
+ */
+typedef struct PointInPolygon_t {
+    double *edges; /* x1, y1, x2, y2 for each edge */
+    long nedges;
+    long nbands;
+    long *bandStart; /* nbands + 1 offsets into bandEdges */
+    long *bandEdges;
+    double minx, miny, maxx, maxy;
+    double bandHeight;
+} PointInPolygon;
+
+static void
+PointInPolygon_addRing(PointInPolygon* pip, long* capacity,
+        const GEOSGeometry* ring TSRMLS_DC)
+{
+    const GEOSCoordSequence *seq;
+    unsigned int i, size = 0;
+    double x, y, px = 0, py = 0;
+    double *e;
+
+    seq = GEOSGeom_getCoordSeq_r(GEOS_G(handle), ring);
+    if ( ! seq ) return;
+    GEOSCoordSeq_getSize_r(GEOS_G(handle), seq, &size);
+
+    for (i=0; i<size; ++i) {
+        GEOSCoordSeq_getX_r(GEOS_G(handle), seq, i, &x);
+        GEOSCoordSeq_getY_r(GEOS_G(handle), seq, i, &y);
+        if ( i && (x != px || y != py) ) {
+            if ( pip->nedges == *capacity ) {
+                *capacity = *capacity ? *capacity * 2 : 64;
+                pip->edges = (double*)safe_erealloc(pip->edges, *capacity,
+                    4 * sizeof(double), 0);
+            }
+            e = pip->edges + 4 * pip->nedges++;
+            e[0] = px; e[1] = py; e[2] = x; e[3] = y;
+        }
+        px = x;
+        py = y;
+    }
+}
+
+/* Band of y, clamped to the existing ones. NaN goes to the first */
+static long
+PointInPolygon_band(const PointInPolygon* pip, double y)
+{
+    double band = (y - pip->miny) / pip->bandHeight;
+    if ( ! (band >= 0) ) return 0;
+    if ( band >= pip->nbands ) return pip->nbands - 1;
+    return (long)band;
+}
+
+/* Throw unless the geometry is a polygon or a multipolygon */
+static int
+checkPolygonal(const GEOSGeometry* g TSRMLS_DC)
+{
+    int type = GEOSGeomTypeId_r(GEOS_G(handle), g);
+
+    if ( type != GEOS_POLYGON && type != GEOS_MULTIPOLYGON ) {
+        zend_throw_exception_ex(zend_exception_get_default(TSRMLS_C), 1
+            TSRMLS_CC, "Point classification requires a polygonal geometry");
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+
+/*
+ * Read the edges and extent of a polygonal geometry, without
+ * the bands, see PointInPolygon_index.
+ * Throws and returns NULL for any other geometry type.
+ */
+static PointInPolygon*
+PointInPolygon_readEdges(const GEOSGeometry* g TSRMLS_DC)
+{
+    PointInPolygon *pip;
+    const GEOSGeometry *poly;
+    long capacity = 0, i;
+    int n, np, j;
+    double *e;
+
+    if ( checkPolygonal(g TSRMLS_CC) == FAILURE ) return NULL;
+
+    pip = (PointInPolygon*)ecalloc(1, sizeof(PointInPolygon));
+
+    np = GEOSGetNumGeometries_r(GEOS_G(handle), g);
+    for (j=0; j<np; ++j) {
+        poly = GEOSGetGeometryN_r(GEOS_G(handle), g, j);
+        if ( GEOSisEmpty_r(GEOS_G(handle), poly) ) continue;
+        PointInPolygon_addRing(pip, &capacity,
+            GEOSGetExteriorRing_r(GEOS_G(handle), poly) TSRMLS_CC);
+        n = GEOSGetNumInteriorRings_r(GEOS_G(handle), poly);
+        while ( n-- ) {
+            PointInPolygon_addRing(pip, &capacity,
+                GEOSGetInteriorRingN_r(GEOS_G(handle), poly, n) TSRMLS_CC);
+        }
+    }
+
+    for (i=0; i<pip->nedges; ++i) {
+        e = pip->edges + 4 * i;
+        if ( ! i || MIN(e[0], e[2]) < pip->minx ) pip->minx = MIN(e[0], e[2]);
+        if ( ! i || MIN(e[1], e[3]) < pip->miny ) pip->miny = MIN(e[1], e[3]);
+        if ( ! i || MAX(e[0], e[2]) > pip->maxx ) pip->maxx = MAX(e[0], e[2]);
+        if ( ! i || MAX(e[1], e[3]) > pip->maxy ) pip->maxy = MAX(e[1], e[3]);
+    }
+
+    return pip;
+}
+
+/* Bucket the edges read by PointInPolygon_readEdges into bands */
+static void
+PointInPolygon_index(PointInPolygon* pip)
+{
+    long i, b, b0, b1;
+    double *e;
+    double height = 0, cap;
+
+    for (i=0; i<pip->nedges; ++i) {
+        e = pip->edges + 4 * i;
+        height += fabs(e[3] - e[1]);
+    }
+
+    /*
+     * About four edges per band for evenly spread rings, and at
+     * most about four extra band entries per edge for long ones.
+     */
+    pip->nbands = pip->nedges / 4 + 1;
+    cap = 4.0 * pip->nedges * (pip->maxy - pip->miny) / height + 1;
+    if ( height > 0 && cap < pip->nbands ) pip->nbands = (long)cap;
+    pip->bandHeight = (pip->maxy - pip->miny) / pip->nbands;
+    if ( pip->bandHeight <= 0 ) {
+        pip->nbands = 1;
+        pip->bandHeight = 1;
+    }
+
+    /* counting pass, then fill */
+    pip->bandStart = (long*)ecalloc(pip->nbands + 1, sizeof(long));
+    for (i=0; i<pip->nedges; ++i) {
+        e = pip->edges + 4 * i;
+        b0 = PointInPolygon_band(pip, MIN(e[1], e[3]));
+        b1 = PointInPolygon_band(pip, MAX(e[1], e[3]));
+        for (b=b0; b<=b1; ++b) pip->bandStart[b + 1]++;
+    }
+    for (b=0; b<pip->nbands; ++b) {
+        pip->bandStart[b + 1] += pip->bandStart[b];
+    }
+    pip->bandEdges = (long*)safe_emalloc(pip->bandStart[pip->nbands] + 1,
+        sizeof(long), 0);
+    for (i=0; i<pip->nedges; ++i) {
+        e = pip->edges + 4 * i;
+        b0 = PointInPolygon_band(pip, MIN(e[1], e[3]));
+        b1 = PointInPolygon_band(pip, MAX(e[1], e[3]));
+        /* bandStart[b] is the fill cursor here, restored below */
+        for (b=b0; b<=b1; ++b) pip->bandEdges[pip->bandStart[b]++] = i;
+    }
+    for (b=pip->nbands; b>0; --b) pip->bandStart[b] = pip->bandStart[b - 1];
+    pip->bandStart[0] = 0;
+}
+
+/*
+ * Build the edge index of a polygonal geometry.
+ * Throws and returns NULL for any other geometry type.
+ */
+static PointInPolygon*
+PointInPolygon_create(const GEOSGeometry* g TSRMLS_DC)
+{
+    PointInPolygon *pip = PointInPolygon_readEdges(g TSRMLS_CC);
+
+    if ( pip ) PointInPolygon_index(pip);
+    return pip;
+}
+
+static void
+PointInPolygon_destroy(PointInPolygon* pip)
+{
+    if ( pip->edges ) efree(pip->edges);
+    if ( pip->bandStart ) efree(pip->bandStart);
+    if ( pip->bandEdges ) efree(pip->bandEdges);
+    efree(pip);
+}
+
+static int
+PointInPolygon_contains(const PointInPolygon* pip, double x, double y)
+{
+    const double *e;
+    long i, band;
+    int inside = 0;
+
+    /* written so that NaN coordinates fail */
+    if ( ! pip->nedges || ! (x >= pip->minx && x <= pip->maxx
+            && y >= pip->miny && y <= pip->maxy) ) {
+        return 0;
+    }
+
+    band = PointInPolygon_band(pip, y);
+    for (i=pip->bandStart[band]; i<pip->bandStart[band + 1]; ++i) {
+        e = pip->edges + 4 * pip->bandEdges[i];
+
+        /* on the boundary */
+        if ( (e[2] - e[0]) * (y - e[1]) == (x - e[0]) * (e[3] - e[1])
+                && x >= MIN(e[0], e[2]) && x <= MAX(e[0], e[2])
+                && y >= MIN(e[1], e[3]) && y <= MAX(e[1], e[3]) ) {
+            return 0;
+        }
+
+        if ( (e[1] > y) != (e[3] > y)
+                && x < e[0] + (y - e[1]) * (e[2] - e[0]) / (e[3] - e[1]) ) {
+            inside = ! inside;
+        }
+    }
+
+    return inside;
+}
+
+/*
+ * A geometry readied for repeated predicates. 'geom' must
+ * outlive 'prepared', it is owned only when 'owned' is set.
+ */
+typedef struct PreparedGeometry_t {
+    GEOSGeometry *geom;
+    const GEOSPreparedGeometry *prepared;
+    PointInPolygon *pip; /* lazily built by containsPoints */
+    int owned;
+} PreparedGeometry;
+
+static void
+PreparedGeometry_release(PreparedGeometry* pg TSRMLS_DC)
+{
+    if ( pg->prepared ) {
+        GEOSPreparedGeom_destroy_r(GEOS_G(handle), pg->prepared);
+    }
+    if ( pg->pip ) PointInPolygon_destroy(pg->pip);
+    if ( pg->owned && pg->geom ) {
+        GEOSGeom_destroy_r(GEOS_G(handle), pg->geom);
+    }
+}
+
+/*
+ * Classify a buffer of packed native-endian XY doubles against
+ * the geometry and return a bitmap string with bit (i & 7) of
+ * byte (i >> 3) set when point i is contained.
+ */
+static void
+containsPackedPoints(PreparedGeometry* pg, const char* packed, int len,
+        zval* return_value TSRMLS_DC)
+{
+    unsigned char *bitmap;
+    double xy[2];
+    long npoints, nbytes, i;
+    int ret;
+
+    if ( len % (2 * sizeof(double)) ) {
+        zend_throw_exception_ex(zend_exception_get_default(TSRMLS_C), 1
+            TSRMLS_CC, "Packed coordinates length must be a multiple of %d",
+            (int)(2 * sizeof(double)));
+        return;
+    }
+    npoints = len / (2 * sizeof(double));
+    nbytes = (npoints + 7) / 8;
+
+#ifdef HAVE_GEOS_PREPARED_CONTAINS_XY
+    /* same rule as the PointInPolygon fallback */
+    if ( checkPolygonal(pg->geom TSRMLS_CC) == FAILURE ) RETURN_NULL();
+    if ( ! pg->prepared ) {
+        pg->prepared = GEOSPrepare_r(GEOS_G(handle), pg->geom);
+        if ( ! pg->prepared ) RETURN_NULL(); /* should get an exception first */
+    }
+#else
+    if ( ! pg->pip ) {
+        pg->pip = PointInPolygon_create(pg->geom TSRMLS_CC);
+        if ( ! pg->pip ) RETURN_NULL(); /* should get an exception first */
+    }
+#endif
+
+    bitmap = (unsigned char*)ecalloc(nbytes + 1, 1);
+
+    for (i=0; i<npoints; ++i) {
+        /* the buffer is not necessarily aligned */
+        memcpy(xy, packed + i * sizeof(xy), sizeof(xy));
+        /* NaN points are not contained, whatever the GEOS version */
+        if ( xy[0] != xy[0] || xy[1] != xy[1] ) continue;
+#       ifdef HAVE_GEOS_PREPARED_CONTAINS_XY
+        ret = GEOSPreparedContainsXY_r(GEOS_G(handle), pg->prepared,
+            xy[0], xy[1]);
+        if ( ret == 2 ) {
+            efree(bitmap);
+            RETURN_NULL(); /* should get an exception first */
+        }
+#       else
+        ret = PointInPolygon_contains(pg->pip, xy[0], xy[1]);
+#       endif
+        if ( ret ) bitmap[i >> 3] |= 1 << (i & 7);
+    }
+
+    RETURN_STRINGL((char*)bitmap, nbytes, 0);
+}
+
+/* -- Rasterization -------------------- */
+
+/*
+ * Scanline rasterization of polygonal geometries, reusing the
+ * banded edges of PointInPolygon to find the crossings of each
+ * scanline. Grids have their origin at the top left corner,
+ * rows going down towards lower Y.
+ */
+
+/* Cell rules of GEOSGeometry::rasterize */
+#define GEOSRASTER_CENTER 0   /* cell centre inside the geometry */
+#define GEOSRASTER_TOUCH 1    /* cell touching the geometry */
+#define GEOSRASTER_FRACTION 2 /* covered fraction of the cell */
+
+/* Scanlines per row when computing covered fractions */
+#define GEOSRASTER_SUBSAMPLES 16
+
+typedef struct Raster_t {
+    double originX, originY;
+    double cellSize;
+    long cols, rows;
+    double *xs; /* scanline crossings */
+    long capacity;
+} Raster;
+
+/* Throw unless cellSize and the cols x rows cells count are usable */
+static int
+checkGrid(double cellSize, long cols, long rows TSRMLS_DC)
+{
+    if ( ! (cellSize > 0) || cols < 0 || rows < 0 ) {
+        zend_throw_exception_ex(zend_exception_get_default(TSRMLS_C), 1
+            TSRMLS_CC, "Grid cell size must be positive and its dimensions"
+            " must not be negative");
+        return FAILURE;
+    }
+    if ( rows && cols > LONG_MAX / 8 / rows ) {
+        zend_throw_exception_ex(zend_exception_get_default(TSRMLS_C), 1
+            TSRMLS_CC, "Grid of %ld x %ld cells is too large", cols, rows);
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+
+/* false for NaN and infinities */
+#define RASTER_FINITE(x) ((x) - (x) == 0)
+
+/*
+ * Throw unless the grid origin and the edges are finite, in
+ * world and in cell units, so that cell indices can be computed
+ * by casting to long after clamping.
+ */
+static int
+Raster_check(const Raster* r, const PointInPolygon* pip TSRMLS_DC)
+{
+    long i;
+    int ok;
+
+    ok = RASTER_FINITE(r->originX) && RASTER_FINITE(r->originY)
+        && RASTER_FINITE(r->cellSize);
+    for (i=0; ok && i<4 * pip->nedges; ++i) {
+        ok = RASTER_FINITE(pip->edges[i]);
+    }
+    if ( ok && pip->nedges ) {
+        ok = RASTER_FINITE((pip->minx - r->originX) / r->cellSize)
+            && RASTER_FINITE((pip->maxx - r->originX) / r->cellSize)
+            && RASTER_FINITE((r->originY - pip->miny) / r->cellSize)
+            && RASTER_FINITE((r->originY - pip->maxy) / r->cellSize);
+    }
+
+    if ( ! ok ) {
+        zend_throw_exception_ex(zend_exception_get_default(TSRMLS_C), 1
+            TSRMLS_CC, "Cannot rasterize non-finite coordinates");
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+
+static int
+Raster_cmpDoubles(const void* a, const void* b)
+{
+    double da = *(const double*)a;
+    double db = *(const double*)b;
+    return da < db ? -1 : da > db ? 1 : 0;
+}
+
+/*
+ * Sort the X of the crossings of the edges with the horizontal
+ * line at y into r->xs, the geometry covers the line between
+ * crossings 2i and 2i+1. Returns the number of crossings.
+ */
+static long
+Raster_crossings(Raster* r, const PointInPolygon* pip, double y)
+{
+    const double *e;
+    long i, band, n = 0;
+
+    if ( ! pip->nedges || y < pip->miny || y > pip->maxy ) return 0;
+
+    band = PointInPolygon_band(pip, y);
+    for (i=pip->bandStart[band]; i<pip->bandStart[band + 1]; ++i) {
+        e = pip->edges + 4 * pip->bandEdges[i];
+        if ( (e[1] > y) == (e[3] > y) ) continue;
+        if ( n == r->capacity ) {
+            r->capacity = r->capacity ? r->capacity * 2 : 64;
+            r->xs = (double*)safe_erealloc(r->xs, r->capacity,
+                sizeof(double), 0);
+        }
+        r->xs[n++] = e[0] + (y - e[1]) * (e[2] - e[0]) / (e[3] - e[1]);
+    }
+
+    qsort(r->xs, n, sizeof(double), Raster_cmpDoubles);
+    return n;
+}
+
+/* Set bit (i & 7) of byte (i >> 3) for the cells whose centre is inside */
+static void
+Raster_fillCenters(Raster* r, const PointInPolygon* pip, unsigned char* mask)
+{
+    long row, col, i, n;
+    double y, c0, c1;
+
+    for (row=0; row<r->rows; ++row) {
+        y = r->originY - (row + 0.5) * r->cellSize;
+        n = Raster_crossings(r, pip, y);
+
+        /* centres from the first crossing, included, to the second */
+        for (i=0; i+1<n; i+=2) {
+            c0 = ceil((r->xs[i] - r->originX) / r->cellSize - 0.5);
+            c1 = ceil((r->xs[i + 1] - r->originX) / r->cellSize - 0.5) - 1;
+            /* both ends in [-1, cols] before casting */
+            if ( c0 < 0 ) c0 = 0;
+            if ( c0 > r->cols ) c0 = r->cols;
+            if ( c1 < -1 ) c1 = -1;
+            if ( c1 > r->cols - 1 ) c1 = r->cols - 1;
+            if ( c0 > c1 ) continue;
+            for (col=(long)c0; col<=(long)c1; ++col) {
+                mask[(row * r->cols + col) >> 3] |=
+                    1 << ((row * r->cols + col) & 7);
+            }
+        }
+    }
+}
+
+/*
+ * Clip the segment from (ax, ay) to (bx, by) to the rectangle
+ * from (0, 0) to (w, h), Liang-Barsky style. Returns 0 if it
+ * lies outside.
+ */
+static int
+Raster_clip(double* ax, double* ay, double* bx, double* by, double w,
+        double h)
+{
+    double dx = *bx - *ax, dy = *by - *ay;
+    double p[4], q[4], t, t0 = 0, t1 = 1;
+    int i;
+
+    p[0] = -dx; q[0] = *ax;
+    p[1] = dx;  q[1] = w - *ax;
+    p[2] = -dy; q[2] = *ay;
+    p[3] = dy;  q[3] = h - *ay;
+
+    for (i=0; i<4; ++i) {
+        if ( p[i] == 0 ) {
+            if ( q[i] < 0 ) return 0;
+            continue;
+        }
+        t = q[i] / p[i];
+        if ( p[i] < 0 ) {
+            if ( t > t1 ) return 0;
+            if ( t > t0 ) t0 = t;
+        } else {
+            if ( t < t0 ) return 0;
+            if ( t < t1 ) t1 = t;
+        }
+    }
+
+    *bx = *ax + t1 * dx;
+    *by = *ay + t1 * dy;
+    *ax += t0 * dx;
+    *ay += t0 * dy;
+    return 1;
+}
+
+/* Set the bits of the cells crossed by the edges */
+static void
+Raster_traceEdges(Raster* r, const PointInPolygon* pip, unsigned char* mask)
+{
+    const double *e;
+    double ax, ay, bx, by, dx, dy;
+    double tMaxX, tMaxY, tDeltaX, tDeltaY;
+    long i, cx, cy, ex, ey, steps, cell;
+    int stepX, stepY;
+
+    for (i=0; i<pip->nedges; ++i) {
+        e = pip->edges + 4 * i;
+
+        /* in cell units, Y going down */
+        ax = (e[0] - r->originX) / r->cellSize;
+        ay = (r->originY - e[1]) / r->cellSize;
+        bx = (e[2] - r->originX) / r->cellSize;
+        by = (r->originY - e[3]) / r->cellSize;
+        if ( ! Raster_clip(&ax, &ay, &bx, &by, r->cols, r->rows) ) continue;
+
+        cx = MIN((long)ax, r->cols - 1);
+        cy = MIN((long)ay, r->rows - 1);
+        ex = MIN((long)bx, r->cols - 1);
+        ey = MIN((long)by, r->rows - 1);
+
+        /* walk the cells crossed, Amanatides-Woo style */
+        dx = bx - ax;
+        dy = by - ay;
+        stepX = dx > 0 ? 1 : -1;
+        stepY = dy > 0 ? 1 : -1;
+        tDeltaX = dx != 0 ? fabs(1 / dx) : HUGE_VAL;
+        tDeltaY = dy != 0 ? fabs(1 / dy) : HUGE_VAL;
+        tMaxX = dx > 0 ? (cx + 1 - ax) / dx : dx < 0 ? (ax - cx) / -dx
+            : HUGE_VAL;
+        tMaxY = dy > 0 ? (cy + 1 - ay) / dy : dy < 0 ? (ay - cy) / -dy
+            : HUGE_VAL;
+
+        for (steps = labs(ex - cx) + labs(ey - cy); steps >= 0; --steps) {
+            if ( cx < 0 || cy < 0 || cx >= r->cols || cy >= r->rows ) break;
+            cell = cy * r->cols + cx;
+            mask[cell >> 3] |= 1 << (cell & 7);
+            if ( tMaxX < tMaxY ) {
+                tMaxX += tDeltaX;
+                cx += stepX;
+            } else {
+                tMaxY += tDeltaY;
+                cy += stepY;
+            }
+        }
+    }
+}
+
+/*
+ * Set one byte per cell to the covered fraction of the cell,
+ * scaled to 0-255. Coverage is exact along each scanline and
+ * sampled with GEOSRASTER_SUBSAMPLES scanlines per row.
+ */
+static void
+Raster_fillFractions(Raster* r, const PointInPolygon* pip,
+        unsigned char* fractions)
+{
+    double *partial; /* covered length of cells partly covered */
+    long *full; /* difference array of fully covered cells */
+    long row, col, i, n, s, c0, c1, count;
+    double y, xa, xb, v;
+
+    partial = (double*)safe_emalloc(r->cols + 1, sizeof(double), 0);
+    full = (long*)safe_emalloc(r->cols + 1, sizeof(long), 0);
+
+    for (row=0; row<r->rows; ++row) {
+        memset(partial, 0, (r->cols + 1) * sizeof(double));
+        memset(full, 0, (r->cols + 1) * sizeof(long));
+
+        for (s=0; s<GEOSRASTER_SUBSAMPLES; ++s) {
+            y = r->originY - (row + (s + 0.5) / GEOSRASTER_SUBSAMPLES)
+                * r->cellSize;
+            n = Raster_crossings(r, pip, y);
+
+            for (i=0; i+1<n; i+=2) {
+                xa = (r->xs[i] - r->originX) / r->cellSize;
+                xb = (r->xs[i + 1] - r->originX) / r->cellSize;
+                if ( xa < 0 ) xa = 0;
+                if ( xb > r->cols ) xb = r->cols;
+                if ( xa >= xb ) continue;
+
+                c0 = (long)xa;
+                c1 = (long)xb;
+                if ( c0 == c1 ) {
+                    partial[c0] += xb - xa;
+                    continue;
+                }
+                partial[c0] += c0 + 1 - xa;
+                full[c0 + 1]++;
+                full[c1]--;
+                partial[c1] += xb - c1; /* c1 may be cols, unused */
+            }
+        }
+
+        for (col=0, count=0; col<r->cols; ++col) {
+            count += full[col];
+            v = (count + partial[col]) / GEOSRASTER_SUBSAMPLES;
+            fractions[row * r->cols + col] =
+                v >= 1 ? 255 : (unsigned char)(v * 255 + 0.5);
+        }
+    }
+
+    efree(partial);
+    efree(full);
+}
+
+/* -- Record framing -------------------- */
+
+/* Framing of records written in bulk by the WKT and WKB writers */
+#define GEOSFRAME_NONE 0     /* records are concatenated as they are */
+#define GEOSFRAME_LENGTH 1   /* uint32 little endian length prefix */
+#define GEOSFRAME_NEWLINE 2  /* each record is followed by a newline */
+#define GEOSFRAME_HEX 3      /* hex encoded, followed by a newline */
+
+static int
+checkFraming(long framing TSRMLS_DC)
+{
+    if ( framing < GEOSFRAME_NONE || framing > GEOSFRAME_HEX ) {
+        zend_throw_exception_ex(zend_exception_get_default(TSRMLS_C), 1
+            TSRMLS_CC, "Unknown framing %ld", framing);
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+
+/*
+ * Destination of framed records: either the 'buf' string, or
+ * 'stream' when set, in which case 'buf' is only scratch space.
+ */
+typedef struct RecordSink_t {
+    smart_str buf;
+    php_stream *stream;
+    size_t written;
+} RecordSink;
+
+static void
+encodeRecordLength(char* prefix, size_t len)
+{
+    prefix[0] = (char)(len & 0xFF);
+    prefix[1] = (char)((len >> 8) & 0xFF);
+    prefix[2] = (char)((len >> 16) & 0xFF);
+    prefix[3] = (char)((len >> 24) & 0xFF);
+}
+
+/* Append a record to 'buf' with the given framing */
+static void
+appendFramedRecord(smart_str* buf, const char* data, size_t len,
+        long framing)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    char prefix[4];
+    size_t i;
+
+    switch (framing) {
+    case GEOSFRAME_LENGTH:
+        encodeRecordLength(prefix, len);
+        smart_str_appendl(buf, prefix, 4);
+        smart_str_appendl(buf, data, len);
+        break;
+    case GEOSFRAME_NEWLINE:
+        smart_str_appendl(buf, data, len);
+        smart_str_appendc(buf, '\n');
+        break;
+    case GEOSFRAME_HEX:
+        for (i=0; i<len; ++i) {
+            smart_str_appendc(buf, hex[((unsigned char)data[i]) >> 4]);
+            smart_str_appendc(buf, hex[((unsigned char)data[i]) & 0x0F]);
+        }
+        smart_str_appendc(buf, '\n');
+        break;
+    default:
+        smart_str_appendl(buf, data, len);
+        break;
+    }
+}
+
+/*
+ * Write a record to a sink with the given framing.
+ * Records go straight to streams unless they need encoding.
+ */
+static int
+RecordSink_write(RecordSink* sink, const char* data, size_t len,
+        long framing TSRMLS_DC)
+{
+    char prefix[4];
+    size_t expected, written = 0;
+
+    if ( ! sink->stream ) {
+        appendFramedRecord(&sink->buf, data, len, framing);
+        sink->written = sink->buf.len;
+        return SUCCESS;
+    }
+
+    if ( framing == GEOSFRAME_HEX ) {
+        sink->buf.len = 0;
+        appendFramedRecord(&sink->buf, data, len, framing);
+        expected = sink->buf.len;
+        written = php_stream_write(sink->stream, sink->buf.c, sink->buf.len);
+    } else {
+        expected = len;
+        if ( framing == GEOSFRAME_LENGTH ) {
+            encodeRecordLength(prefix, len);
+            written += php_stream_write(sink->stream, prefix, 4);
+            expected += 4;
+        }
+        written += php_stream_write(sink->stream, data, len);
+        if ( framing == GEOSFRAME_NEWLINE ) {
+            written += php_stream_write(sink->stream, "\n", 1);
+            expected += 1;
+        }
+    }
+
+    sink->written += written;
+    if ( written != expected ) {
+        zend_throw_exception_ex(zend_exception_get_default(TSRMLS_C), 1
+            TSRMLS_CC, "Could only write %ld of %ld bytes to the stream",
+            (long)written, (long)expected);
+        return FAILURE;
+    }
+
+    return SUCCESS;
+}
+
+/*
+ * Serialize a geometry with a WKB writer (when 'wkb' is set) or a
+ * WKT writer. The result is to be released with GEOSFree_r.
+ */
+static char*
+writeGeometryRecord(void* writer, int wkb, const GEOSGeometry* geom,
+        size_t* size TSRMLS_DC)
+{
+    char *ret;
+
+    if ( wkb ) {
+        return (char*)GEOSWKBWriter_write_r(GEOS_G(handle),
+            (GEOSWKBWriter*)writer, geom, size);
+    }
+
+    ret = GEOSWKTWriter_write_r(GEOS_G(handle), (GEOSWKTWriter*)writer,
+        (GEOSGeometry*)geom);
+    if ( ret ) *size = strlen(ret);
+    return ret;
+}
+
+static const unsigned char* getPassThroughWKB(zval* val,
+        GEOSWKBWriter* writer, size_t* len TSRMLS_DC);
+
+/* Write a single geometry into a sink */
+static int
+writeRecord(void* writer, int wkb, zval* zgeom, long framing,
+        RecordSink* sink, zval* offsets TSRMLS_DC)
+{
+    GEOSGeometry *geom;
+    const unsigned char *lazy;
+    char *record;
+    size_t size;
+    int ret;
+
+    if ( wkb && (lazy = getPassThroughWKB(zgeom, (GEOSWKBWriter*)writer,
+            &size TSRMLS_CC)) ) {
+        if ( offsets ) add_next_index_long(offsets, sink->written);
+        return RecordSink_write(sink, (const char*)lazy, size, framing
+            TSRMLS_CC);
+    }
+
+    geom = getGeometryElement(zgeom TSRMLS_CC);
+    if ( ! geom ) return FAILURE; /* should get an exception first */
+
+    record = writeGeometryRecord(writer, wkb, geom, &size TSRMLS_CC);
+    if ( ! record ) return FAILURE; /* should get an exception first */
+
+    if ( offsets ) add_next_index_long(offsets, sink->written);
+    ret = RecordSink_write(sink, record, size, framing TSRMLS_CC);
+    GEOSFree_r(GEOS_G(handle), record);
+
+    return ret;
+}
+
+/*
+ * Write a geometry, or an array of geometries, into a sink.
+ * When 'offsets' is given the start of each record is
+ * appended to it.
+ */
+static int
+writeRecords(void* writer, int wkb, zval* zgeoms, long framing,
+        RecordSink* sink, zval* offsets TSRMLS_DC)
+{
+    zval **data;
+    HashTable *arr_hash;
+    HashPosition pointer;
+
+    if ( checkFraming(framing TSRMLS_CC) == FAILURE ) return FAILURE;
+
+    if ( Z_TYPE_P(zgeoms) != IS_ARRAY ) {
+        return writeRecord(writer, wkb, zgeoms, framing, sink, offsets
+            TSRMLS_CC);
+    }
+
+    arr_hash = Z_ARRVAL_P(zgeoms);
+    for (zend_hash_internal_pointer_reset_ex(arr_hash, &pointer);
+         zend_hash_get_current_data_ex(arr_hash, (void**) &data,
+                                       &pointer) == SUCCESS;
+         zend_hash_move_forward_ex(arr_hash, &pointer))
+    {
+        if ( writeRecord(writer, wkb, *data, framing, sink, offsets
+                         TSRMLS_CC) == FAILURE ) {
+            return FAILURE;
+        }
+    }
+
+    return SUCCESS;
+}
+
+/*
+ * Write an array of geometries into a single buffer, setting
+ * return_value to array('data' => string, 'offsets' => array),
+ * where offsets has the start of each record plus the total size.
+ */
+static void
+writeManyRecords(void* writer, int wkb, zval* zarr, long framing,
+        zval* return_value TSRMLS_DC)
+{
+    RecordSink sink;
+    zval *offsets;
+
+    memset(&sink, 0, sizeof(sink));
+
+    MAKE_STD_ZVAL(offsets);
+    array_init(offsets);
+
+    if ( writeRecords(writer, wkb, zarr, framing, &sink, offsets TSRMLS_CC)
+            == FAILURE ) {
+        smart_str_free(&sink.buf);
+        zval_ptr_dtor(&offsets);
+        RETURN_NULL();
+    }
+
+    add_next_index_long(offsets, sink.buf.len);
+
+    array_init(return_value);
+    if ( sink.buf.c ) {
+        smart_str_0(&sink.buf);
+        add_assoc_stringl(return_value, "data", sink.buf.c, sink.buf.len, 0);
+    } else {
+        add_assoc_stringl(return_value, "data", "", 0, 1);
+    }
+    add_assoc_zval(return_value, "offsets", offsets);
+}
+
+/*
+ * Write a geometry, or an array of geometries, to a stream
+ * and set return_value to the number of bytes written.
+ */
+static void
+writeStreamRecords(void* writer, int wkb, php_stream* stream, zval* zgeoms,
+        long framing, zval* return_value TSRMLS_DC)
+{
+    RecordSink sink;
+    int ret;
+
+    memset(&sink, 0, sizeof(sink));
+    sink.stream = stream;
+
+    ret = writeRecords(writer, wkb, zgeoms, framing, &sink, NULL TSRMLS_CC);
+    smart_str_free(&sink.buf);
+
+    if ( ret == FAILURE ) RETURN_NULL(); /* should get an exception first */
+
+    RETURN_LONG(sink.written);
+}
+
+/* -- WKB scanning -------------------- */
+
+#define WKB_MAX_DEPTH 64
+
+static int
+readWKBUInt32(const unsigned char* buf, int littleEndian, unsigned long* val)
+{
+    if ( littleEndian ) {
+        *val = (unsigned long)buf[0] | ((unsigned long)buf[1] << 8)
+             | ((unsigned long)buf[2] << 16) | ((unsigned long)buf[3] << 24);
+    } else {
+        *val = (unsigned long)buf[3] | ((unsigned long)buf[2] << 8)
+             | ((unsigned long)buf[1] << 16) | ((unsigned long)buf[0] << 24);
+    }
+    return 4;
+}
+
+/*
+ * Length of the WKB geometry at the start of 'buf', without
+ * parsing coordinates. Both EWKB (high bit flags) and ISO (type
+ * codes over 1000) dimensionality is understood.
+ * Returns 0 for malformed or truncated input.
+ */
+static size_t
+wkbRecordLength(const unsigned char* buf, size_t len, int depth)
+{
+    unsigned long type, n, i, npoints;
+    size_t pos = 0, cs, sub;
+    int le, hasZ, hasM;
+
+    if ( depth > WKB_MAX_DEPTH || len < 5 || buf[0] > 1 ) return 0;
+    le = buf[0];
+    pos = 1;
+    pos += readWKBUInt32(buf + pos, le, &type);
+
+    hasZ = (type & 0x80000000) != 0;
+    hasM = (type & 0x40000000) != 0;
+    if ( type & 0x20000000 ) {
+        if ( len - pos < 4 ) return 0;
+        pos += 4; /* SRID */
+    }
+    type &= 0x0FFFFFFF;
+    if ( type >= 1000 ) {
+        if ( type / 1000 == 1 || type / 1000 == 3 ) hasZ = 1;
+        if ( type / 1000 == 2 || type / 1000 == 3 ) hasM = 1;
+        type %= 1000;
+    }
+    cs = 8 * (2 + hasZ + hasM);
+
+    switch (type) {
+    case 1: /* point */
+        if ( len - pos < cs ) return 0;
+        return pos + cs;
+
+    case 2: /* linestring */
+        if ( len - pos < 4 ) return 0;
+        pos += readWKBUInt32(buf + pos, le, &n);
+        if ( n > (len - pos) / cs ) return 0;
+        return pos + n * cs;
+
+    case 3: /* polygon */
+        if ( len - pos < 4 ) return 0;
+        pos += readWKBUInt32(buf + pos, le, &n);
+        for (i=0; i<n; ++i) {
+            if ( len - pos < 4 ) return 0;
+            pos += readWKBUInt32(buf + pos, le, &npoints);
+            if ( npoints > (len - pos) / cs ) return 0;
+            pos += npoints * cs;
+        }
+        return pos;
+
+    case 4: /* multipoint */
+    case 5: /* multilinestring */
+    case 6: /* multipolygon */
+    case 7: /* geometrycollection */
+        if ( len - pos < 4 ) return 0;
+        pos += readWKBUInt32(buf + pos, le, &n);
+        for (i=0; i<n; ++i) {
+            sub = wkbRecordLength(buf + pos, len - pos, depth + 1);
+            if ( ! sub ) return 0;
+            pos += sub;
+        }
+        return pos;
+    }
+
+    return 0;
+}
+
+/*
+ * Type code (without flags) and SRID from the header of a WKB
+ * geometry known to be well formed. Returns the raw type word.
+ */
+static unsigned long
+readWKBHeader(const unsigned char* wkb, unsigned long* type, long* srid)
+{
+    unsigned long word, val;
+
+    readWKBUInt32(wkb + 1, wkb[0], &word);
+    *type = word & 0x0FFFFFFF;
+    *srid = 0;
+    if ( word & 0x20000000 ) {
+        readWKBUInt32(wkb + 5, wkb[0], &val);
+        *srid = (long)(int)val;
+    }
+    return word;
+}
+
+/*
+ * Whether a WKB record can be kept unparsed: it must be a single
+ * well formed geometry GEOS will read later on, which rules out
+ * ISO type codes and measures.
+ */
+static int
+isLazyWKB(const unsigned char* wkb, size_t len)
+{
+    unsigned long type, word;
+    long srid;
+
+    if ( wkbRecordLength(wkb, len, 0) != len ) return 0;
+    word = readWKBHeader(wkb, &type, &srid);
+    return type >= 1 && type <= 7 && ! (word & 0x40000000);
+}
+
+/*
+ * Proxy of a GEOSGeometry still holding its original WKB,
+ * or NULL if it was never lazy or has been modified.
+ */
+static Proxy*
+getLazyProxy(zval* val TSRMLS_DC)
+{
+    Proxy *proxy;
+
+    if ( Z_TYPE_P(val) != IS_OBJECT || Z_OBJCE_P(val) != Geometry_ce_ptr ) {
+        return NULL;
+    }
+    proxy = (Proxy*)zend_object_store_get_object(val TSRMLS_CC);
+    return proxy->wkb ? proxy : NULL;
+}
+
+/*
+ * Original WKB of a lazy geometry, if the writer would encode
+ * it the same way: same byte order, SRID included if and only
+ * if one is set, and Z kept when present. NULL otherwise.
+ */
+static const unsigned char*
+getPassThroughWKB(zval* val, GEOSWKBWriter* writer, size_t* len TSRMLS_DC)
+{
+    Proxy *proxy = getLazyProxy(val TSRMLS_CC);
+    unsigned long type, word;
+    long srid;
+    int withSRID;
+
+    if ( ! proxy ) return NULL;
+
+    word = readWKBHeader(proxy->wkb, &type, &srid);
+    withSRID = GEOSWKBWriter_getIncludeSRID_r(GEOS_G(handle), writer)
+        && srid != 0;
+
+    if ( GEOSWKBWriter_getByteOrder_r(GEOS_G(handle), writer)
+            != proxy->wkb[0] ) {
+        return NULL;
+    }
+    if ( ((word & 0x20000000) != 0) != withSRID ) return NULL;
+    if ( (word & 0x80000000) &&
+            GEOSWKBWriter_getOutputDimension_r(GEOS_G(handle), writer) < 3 ) {
+        return NULL;
+    }
+
+    *len = proxy->wkblen;
+    return proxy->wkb;
+}
+
+/* Upper case hex encoding, as GEOS writes it, into an emalloc'ed string */
+static char*
+encodeHex(const unsigned char* data, size_t len)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    char *ret;
+    size_t i;
+
+    ret = (char*)safe_emalloc(len, 2, 1);
+    for (i=0; i<len; ++i) {
+        ret[2 * i] = hex[data[i] >> 4];
+        ret[2 * i + 1] = hex[data[i] & 0x0F];
+    }
+    ret[2 * len] = '\0';
+    return ret;
+}
+
+/* Decode hex into an emalloc'ed buffer, NULL if not valid hex */
+static unsigned char*
+decodeHex(const unsigned char* hex, size_t len, size_t* outlen)
+{
+    unsigned char *ret;
+    size_t i;
+    int hi, lo;
+
+    if ( len % 2 ) return NULL;
+
+    ret = (unsigned char*)emalloc(len / 2 + 1);
+    for (i=0; i<len; i+=2) {
+        hi = hex[i] <= '9' ? hex[i] - '0' : (hex[i] | 0x20) - 'a' + 10;
+        lo = hex[i+1] <= '9' ? hex[i+1] - '0' : (hex[i+1] | 0x20) - 'a' + 10;
+        if ( hi < 0 || hi > 15 || lo < 0 || lo > 15 ) {
+            efree(ret);
+            return NULL;
+        }
+        ret[i / 2] = (unsigned char)((hi << 4) | lo);
+    }
+    *outlen = len / 2;
+    return ret;
+}
+
+/* -- class GEOSBufferParams -------------------- */
+
+PHP_METHOD(BufferParams, __construct);
+
+static zend_function_entry BufferParams_methods[] = {
+    PHP_ME(BufferParams, __construct, NULL, 0)
+    {NULL, NULL, NULL}
+};
+
+static zend_class_entry *BufferParams_ce_ptr;
+
+static zend_object_handlers BufferParams_object_handlers;
+
+typedef struct BufferStyle_t {
+    long quadSegs;
+    long endCapStyle;
+    long joinStyle;
+    double mitreLimit;
+    long singleSided;
+} BufferStyle;
+
+typedef struct BufferParams_t {
+    BufferStyle style;
+    GEOSBufferParams *params;
+} BufferParams;
+
+/*
+ * Fill style from a style array, see GEOSGeometry::buffer
+ * for the supported keys. Unknown keys are ignored.
+ */
+static void
+parseBufferStyle(HashTable* ht, BufferStyle* style)
+{
+    HashPosition pos;
+    zval **data;
+    char *key;
+    uint keylen;
+    ulong index;
+
+    style->quadSegs = 8;
+    style->endCapStyle = GEOSBUF_CAP_ROUND;
+    style->joinStyle = GEOSBUF_JOIN_ROUND;
+    style->mitreLimit = 5.0;
+    style->singleSided = 0;
+
+    if ( ! ht ) return;
+
+    for (zend_hash_internal_pointer_reset_ex(ht, &pos);
+         zend_hash_get_current_data_ex(ht, (void**)&data, &pos) == SUCCESS;
+         zend_hash_move_forward_ex(ht, &pos))
+    {
+        if ( zend_hash_get_current_key_ex(ht, &key, &keylen, &index, 0, &pos)
+                != HASH_KEY_IS_STRING ) continue;
+
+        if(!strcmp(key, "quad_segs"))
+            style->quadSegs = getZvalAsLong(*data);
+        else if(!strcmp(key, "endcap"))
+            style->endCapStyle = getZvalAsLong(*data);
+        else if(!strcmp(key, "join"))
+            style->joinStyle = getZvalAsLong(*data);
+        else if(!strcmp(key, "mitre_limit") || !strcmp(key, "miter_limit"))
+            style->mitreLimit = getZvalAsDouble(*data);
+        else if(!strcmp(key, "single_sided"))
+            style->singleSided = getZvalAsLong(*data);
+    }
+}
+
+static GEOSBufferParams*
+createBufferParams(const BufferStyle* style TSRMLS_DC)
+{
+    GEOSBufferParams *params;
+
+    params = GEOSBufferParams_create_r(GEOS_G(handle));
+    if ( ! params ) return NULL; /* should get an exception first */
+
+    GEOSBufferParams_setQuadrantSegments_r(GEOS_G(handle), params, style->quadSegs);
+    GEOSBufferParams_setEndCapStyle_r(GEOS_G(handle), params, style->endCapStyle);
+    GEOSBufferParams_setJoinStyle_r(GEOS_G(handle), params, style->joinStyle);
+    GEOSBufferParams_setMitreLimit_r(GEOS_G(handle), params, style->mitreLimit);
+    GEOSBufferParams_setSingleSided_r(GEOS_G(handle), params, style->singleSided);
+
+    return params;
+}
+
+/*
+ * Buffer style from an optional style argument, which can be
+ * either a style array or a GEOSBufferParams object.
+ *
+ * If params is given it receives the native parameters, which
+ * the caller must destroy only if *owned is set on return.
+ */
+static int
+getBufferStyle(zval* zstyle, BufferStyle* style, GEOSBufferParams** params,
+        int* owned TSRMLS_DC)
+{
+    BufferParams *bp;
+
+    if ( zstyle && Z_TYPE_P(zstyle) == IS_OBJECT
+            && Z_OBJCE_P(zstyle) == BufferParams_ce_ptr ) {
+        bp = (BufferParams*)getRelay(zstyle, BufferParams_ce_ptr TSRMLS_CC);
+        *style = bp->style;
+        if ( params ) {
+            *params = bp->params;
+            *owned = 0;
+        }
+        return SUCCESS;
+    }
+
+    if ( zstyle && Z_TYPE_P(zstyle) != IS_ARRAY && Z_TYPE_P(zstyle) != IS_NULL ) {
+        php_error_docref(NULL TSRMLS_CC, E_WARNING,
+            "Buffer style must be an array or a GEOSBufferParams");
+        return FAILURE;
+    }
+
+    parseBufferStyle(zstyle ? HASH_OF(zstyle) : NULL, style);
+    if ( params ) {
+        *params = createBufferParams(style TSRMLS_CC);
+        if ( ! *params ) return FAILURE; /* should get an exception first */
+        *owned = 1;
+    }
+    return SUCCESS;
+}
+
+/*
+ * Buffer a geometry, going through the result cache
+ * when it is enabled.
+ */
+static GEOSGeometry*
+bufferGeometry(const GEOSGeometry* g, double dist, const BufferStyle* style,
+        const GEOSBufferParams* params TSRMLS_DC)
+{
+    GeometryCacheKey key;
+    GEOSGeometry *ret;
+    double args[6];
+    int cached;
+
+    args[0] = dist;
+    args[1] = style->quadSegs;
+    args[2] = style->endCapStyle;
+    args[3] = style->joinStyle;
+    args[4] = style->mitreLimit;
+    args[5] = style->singleSided;
+    cached = GeometryCache_key(&key, GEOSCACHE_OP_BUFFER, args, 6, g
+        TSRMLS_CC) == SUCCESS;
+
+    if ( cached && (ret = GeometryCache_fetch(&key TSRMLS_CC)) ) return ret;
+
+    ret = GEOSBufferWithParams_r(GEOS_G(handle), g, params, dist);
+    if ( ret && cached ) GeometryCache_store(&key, ret TSRMLS_CC);
+    return ret;
+}
+
+static void
+BufferParams_dtor (void *object TSRMLS_DC)
+{
+    Proxy *obj = (Proxy *)object;
+    BufferParams *bp = (BufferParams*)obj->relay;
+
+    if ( bp ) {
+        GEOSBufferParams_destroy_r(GEOS_G(handle), bp->params);
+        efree(bp);
+    }
+
+    zend_hash_destroy(obj->std.properties);
+    FREE_HASHTABLE(obj->std.properties);
+
+    efree(obj);
+}
+
+static zend_object_value
+BufferParams_create_obj (zend_class_entry *type TSRMLS_DC)
+{
+    return Gen_create_obj(type, BufferParams_dtor, &BufferParams_object_handlers TSRMLS_CC);
+}
+
+/**
+ * GEOSBufferParams p = new GEOSBufferParams([<styleArray>])
+ *
+ * Native buffer parameters built once from a style array
+ * (see GEOSGeometry::buffer for the supported keys) and reusable
+ * by any number of GEOSGeometry::buffer, GEOSGeometry::offsetCurve
+ * and GEOSBatch::buffer calls.
+ */
+PHP_METHOD(BufferParams, __construct)
+{
+    BufferParams *bp;
+    GEOSBufferParams *params;
+    BufferStyle style;
+    zval *style_val = NULL;
+    zval *object = getThis();
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|a",
+            &style_val) == FAILURE) {
+        RETURN_NULL();
+    }
+
+    parseBufferStyle(style_val ? HASH_OF(style_val) : NULL, &style);
+
+    params = createBufferParams(&style TSRMLS_CC);
+    if ( ! params ) {
+        php_error_docref(NULL TSRMLS_CC, E_ERROR,
+                "GEOSBufferParams_create() failed (didn't initGEOS?)");
+    }
+
+    bp = (BufferParams*)emalloc(sizeof(BufferParams));
+    bp->style = style;
+    bp->params = params;
+
+    setRelay(object, bp TSRMLS_CC);
+}
+
+
+/* -- class GEOSGeometry -------------------- */
+
+PHP_METHOD(Geometry, __construct);
+PHP_METHOD(Geometry, __toString);
+PHP_METHOD(Geometry, project);
+PHP_METHOD(Geometry, interpolate);
+PHP_METHOD(Geometry, buffer);
+
+#ifdef HAVE_GEOS_OFFSET_CURVE
+PHP_METHOD(Geometry, offsetCurve);
+#endif
+
+PHP_METHOD(Geometry, envelope);
+PHP_METHOD(Geometry, intersection);
+PHP_METHOD(Geometry, convexHull);
+PHP_METHOD(Geometry, difference);
+PHP_METHOD(Geometry, symDifference);
+PHP_METHOD(Geometry, boundary);
+PHP_METHOD(Geometry, union); /* also does union cascaded */
+PHP_METHOD(Geometry, pointOnSurface);
+PHP_METHOD(Geometry, centroid);
+PHP_METHOD(Geometry, relate);
+
+#ifdef HAVE_GEOS_RELATE_BOUNDARY_NODE_RULE
+PHP_METHOD(Geometry, relateBoundaryNodeRule);
+#endif
+
+PHP_METHOD(Geometry, simplify); /* also does topology-preserving */
+PHP_METHOD(Geometry, normalize);
+
+#ifdef HAVE_GEOS_GEOM_SET_PRECISION
+PHP_METHOD(Geometry, setPrecision);
+#endif
+
+#ifdef HAVE_GEOS_GEOM_GET_PRECISION
+PHP_METHOD(Geometry, getPrecision);
+#endif
+
+#ifdef HAVE_GEOS_GEOM_EXTRACT_UNIQUE_POINTS
+PHP_METHOD(Geometry, extractUniquePoints);
+#endif
+
+PHP_METHOD(Geometry, disjoint);
+PHP_METHOD(Geometry, touches);
+PHP_METHOD(Geometry, intersects);
+PHP_METHOD(Geometry, crosses);
+PHP_METHOD(Geometry, within);
+PHP_METHOD(Geometry, contains);
+PHP_METHOD(Geometry, containsPoints);
+PHP_METHOD(Geometry, rasterize);
+PHP_METHOD(Geometry, overlaps);
+
+#ifdef HAVE_GEOS_COVERS
+PHP_METHOD(Geometry, covers);
+#endif
+
+#ifdef HAVE_GEOS_COVERED_BY
+PHP_METHOD(Geometry, coveredBy);
+#endif
+
+PHP_METHOD(Geometry, equals);
+PHP_METHOD(Geometry, equalsExact);
+PHP_METHOD(Geometry, isEmpty);
+
+#ifdef HAVE_GEOS_IS_VALID_DETAIL
+PHP_METHOD(Geometry, checkValidity);
+#endif
+
+#ifdef HAVE_GEOS_MAKE_VALID
+PHP_METHOD(Geometry, makeValid);
+#endif
+
+PHP_METHOD(Geometry, isSimple);
+PHP_METHOD(Geometry, isRing);
+PHP_METHOD(Geometry, hasZ);
+
+#ifdef HAVE_GEOS_IS_CLOSED
+PHP_METHOD(Geometry, isClosed);
+#endif
+
+PHP_METHOD(Geometry, typeName);
+PHP_METHOD(Geometry, typeId);
+PHP_METHOD(Geometry, getSRID);
+PHP_METHOD(Geometry, setSRID);
+PHP_METHOD(Geometry, numGeometries);
+PHP_METHOD(Geometry, geometryN);
+PHP_METHOD(Geometry, numInteriorRings);
+
+#ifdef HAVE_GEOS_GEOM_GET_NUM_POINTS
+PHP_METHOD(Geometry, numPoints);
+#endif
+
+#ifdef HAVE_GEOS_GEOM_GET_X
+PHP_METHOD(Geometry, getX);
+#endif
+
+#ifdef HAVE_GEOS_GEOM_GET_Y
+PHP_METHOD(Geometry, getY);
+#endif
+
+PHP_METHOD(Geometry, interiorRingN);
+PHP_METHOD(Geometry, exteriorRing);
+PHP_METHOD(Geometry, numCoordinates);
+PHP_METHOD(Geometry, dimension);
+
+#ifdef HAVE_GEOS_GEOM_GET_COORDINATE_DIMENSION
+PHP_METHOD(Geometry, coordinateDimension);
+#endif
+
+#ifdef HAVE_GEOS_GEOM_GET_POINT_N
+PHP_METHOD(Geometry, pointN);
+#endif
+
+#ifdef HAVE_GEOS_GEOM_GET_START_POINT
+PHP_METHOD(Geometry, startPoint);
+#endif
+
+#ifdef HAVE_GEOS_GEOM_GET_END_POINT
+PHP_METHOD(Geometry, endPoint);
+#endif
+
+PHP_METHOD(Geometry, area);
+PHP_METHOD(Geometry, length);
+PHP_METHOD(Geometry, distance);
+PHP_METHOD(Geometry, hausdorffDistance);
+
+#ifdef HAVE_GEOS_SNAP
+PHP_METHOD(Geometry, snapTo);
+#endif
+
+#ifdef HAVE_GEOS_NODE
+PHP_METHOD(Geometry, node);
+#endif
+
+#ifdef HAVE_GEOS_DELAUNAY_TRIANGULATION
+PHP_METHOD(Geometry, delaunayTriangulation);
+#endif
+
+#ifdef HAVE_GEOS_VORONOI_DIAGRAM
+PHP_METHOD(Geometry, voronoiDiagram);
+#endif
+
+#ifdef HAVE_GEOS_CLIP_BY_RECT
+PHP_METHOD(Geometry, clipByRect);
+#endif
+
+PHP_METHOD(Geometry, affine);
+PHP_METHOD(Geometry, translate);
+PHP_METHOD(Geometry, scale);
+PHP_METHOD(Geometry, swapXY);
+PHP_METHOD(Geometry, toWebMercator);
+PHP_METHOD(Geometry, fromWebMercator);
+
+PHP_METHOD(Geometry, hash);
+PHP_METHOD(Geometry, memoryUsage);
+
+static zend_function_entry Geometry_methods[] = {
+    PHP_ME(Geometry, __construct, NULL, 0)
+    PHP_ME(Geometry, __toString, NULL, 0)
+    PHP_ME(Geometry, project, NULL, 0)
+    PHP_ME(Geometry, interpolate, NULL, 0)
+    PHP_ME(Geometry, buffer, NULL, 0)
+
+#   ifdef HAVE_GEOS_OFFSET_CURVE
+    PHP_ME(Geometry, offsetCurve, NULL, 0)
+#   endif
+
+    PHP_ME(Geometry, envelope, NULL, 0)
+    PHP_ME(Geometry, intersection, NULL, 0)
+    PHP_ME(Geometry, convexHull, NULL, 0)
+    PHP_ME(Geometry, difference, NULL, 0)
+    PHP_ME(Geometry, symDifference, NULL, 0)
+    PHP_ME(Geometry, boundary, NULL, 0)
+    PHP_ME(Geometry, union, NULL, 0)
+    PHP_ME(Geometry, pointOnSurface, NULL, 0)
+    PHP_ME(Geometry, centroid, NULL, 0)
+    PHP_ME(Geometry, relate, NULL, 0)
+
+#   ifdef HAVE_GEOS_RELATE_BOUNDARY_NODE_RULE
+    PHP_ME(Geometry, relateBoundaryNodeRule, NULL, 0)
+#   endif
+
+    PHP_ME(Geometry, simplify, NULL, 0)
+    PHP_ME(Geometry, normalize, NULL, 0)
+
+#   ifdef HAVE_GEOS_GEOM_SET_PRECISION
+    PHP_ME(Geometry, setPrecision, NULL, 0)
+#   endif
+
+#   if HAVE_GEOS_GEOM_GET_PRECISION
+    PHP_ME(Geometry, getPrecision, NULL, 0)
+#   endif
+
+#   ifdef HAVE_GEOS_GEOM_EXTRACT_UNIQUE_POINTS
+    PHP_ME(Geometry, extractUniquePoints, NULL, 0)
+#   endif
+
+    PHP_ME(Geometry, disjoint, NULL, 0)
+    PHP_ME(Geometry, touches, NULL, 0)
+    PHP_ME(Geometry, intersects, NULL, 0)
+    PHP_ME(Geometry, crosses, NULL, 0)
+    PHP_ME(Geometry, within, NULL, 0)
+    PHP_ME(Geometry, contains, NULL, 0)
+    PHP_ME(Geometry, containsPoints, NULL, 0)
+    PHP_ME(Geometry, rasterize, NULL, 0)
+    PHP_ME(Geometry, overlaps, NULL, 0)
+
+#   ifdef HAVE_GEOS_COVERS
+    PHP_ME(Geometry, covers, NULL, 0)
+#   endif
+
+#   ifdef HAVE_GEOS_COVERED_BY
+    PHP_ME(Geometry, coveredBy, NULL, 0)
+#   endif
+
+    PHP_ME(Geometry, equals, NULL, 0)
+    PHP_ME(Geometry, equalsExact, NULL, 0)
+    PHP_ME(Geometry, isEmpty, NULL, 0)
+
+#   ifdef HAVE_GEOS_IS_VALID_DETAIL
+    PHP_ME(Geometry, checkValidity, NULL, 0)
+#   endif
+
+#   ifdef HAVE_GEOS_MAKE_VALID
+    PHP_ME(Geometry, makeValid, NULL, 0)
+#   endif
+
+    PHP_ME(Geometry, isSimple, NULL, 0)
+    PHP_ME(Geometry, isRing, NULL, 0)
+    PHP_ME(Geometry, hasZ, NULL, 0)
+
+#   ifdef HAVE_GEOS_IS_CLOSED
+    PHP_ME(Geometry, isClosed, NULL, 0)
+#   endif
+
+    PHP_ME(Geometry, typeName, NULL, 0)
+    PHP_ME(Geometry, typeId, NULL, 0)
+    PHP_ME(Geometry, getSRID, NULL, 0)
+    PHP_ME(Geometry, setSRID, NULL, 0)
+    PHP_ME(Geometry, numGeometries, NULL, 0)
+    PHP_ME(Geometry, geometryN, NULL, 0)
+    PHP_ME(Geometry, numInteriorRings, NULL, 0)
+
+#   ifdef HAVE_GEOS_GEOM_GET_NUM_POINTS
+    PHP_ME(Geometry, numPoints, NULL, 0)
+#   endif
+
+#   ifdef HAVE_GEOS_GEOM_GET_X
+    PHP_ME(Geometry, getX, NULL, 0)
+#   endif
+
+#   ifdef HAVE_GEOS_GEOM_GET_Y
+    PHP_ME(Geometry, getY, NULL, 0)
+#   endif
+
+    PHP_ME(Geometry, interiorRingN, NULL, 0)
+    PHP_ME(Geometry, exteriorRing, NULL, 0)
+    PHP_ME(Geometry, numCoordinates, NULL, 0)
+    PHP_ME(Geometry, dimension, NULL, 0)
+
+#   ifdef HAVE_GEOS_GEOM_GET_COORDINATE_DIMENSION
+    PHP_ME(Geometry, coordinateDimension, NULL, 0)
+#   endif
+
+#   ifdef HAVE_GEOS_GEOM_GET_POINT_N
+    PHP_ME(Geometry, pointN, NULL, 0)
+#   endif
+
+#   ifdef HAVE_GEOS_GEOM_GET_START_POINT
+    PHP_ME(Geometry, startPoint, NULL, 0)
+#   endif
+
+#   ifdef HAVE_GEOS_GEOM_GET_END_POINT
+    PHP_ME(Geometry, endPoint, NULL, 0)
+#   endif
+
+    PHP_ME(Geometry, area, NULL, 0)
+    PHP_ME(Geometry, length, NULL, 0)
+    PHP_ME(Geometry, distance, NULL, 0)
+    PHP_ME(Geometry, hausdorffDistance, NULL, 0)
+
+#   if HAVE_GEOS_SNAP
+    PHP_ME(Geometry, snapTo, NULL, 0)
+#   endif
+
+#   ifdef HAVE_GEOS_NODE
+    PHP_ME(Geometry, node, NULL, 0)
+#   endif
+
+#   ifdef HAVE_GEOS_DELAUNAY_TRIANGULATION
+    PHP_ME(Geometry, delaunayTriangulation, NULL, 0)
+#   endif
+
+#   ifdef HAVE_GEOS_VORONOI_DIAGRAM
+    PHP_ME(Geometry, voronoiDiagram, NULL, 0)
+#   endif
+
+#   ifdef HAVE_GEOS_CLIP_BY_RECT
+    PHP_ME(Geometry, clipByRect, NULL, 0)
+#   endif
+
+    PHP_ME(Geometry, affine, NULL, 0)
+    PHP_ME(Geometry, translate, NULL, 0)
+    PHP_ME(Geometry, scale, NULL, 0)
+    PHP_ME(Geometry, swapXY, NULL, 0)
+    PHP_ME(Geometry, toWebMercator, NULL, 0)
+    PHP_ME(Geometry, fromWebMercator, NULL, 0)
+
+    PHP_ME(Geometry, hash, NULL, 0)
+    PHP_ME(Geometry, memoryUsage, NULL, 0)
+
+    {NULL, NULL, NULL}
+};
+
+static zend_object_handlers Geometry_object_handlers;
+
+/*
+ * Geometry serializer
+ *
+ * EWKB codecs, also used to move geometries in and out of the
+ * caches. They belong to the request context, so they live in
+ * the module globals and are destroyed in RSHUTDOWN.
+ */
+
+static GEOSWKBWriter* getGeometrySerializer(TSRMLS_D)
+{
+    if ( ! GEOS_G(serializer) ) {
+        GEOS_G(serializer) = GEOSWKBWriter_create_r(GEOS_G(handle));
+        if ( ! GEOS_G(serializer) ) return NULL;
+        GEOSWKBWriter_setIncludeSRID_r(GEOS_G(handle), GEOS_G(serializer), 1);
+        GEOSWKBWriter_setOutputDimension_r(GEOS_G(handle), GEOS_G(serializer), 3);
+    }
+    return GEOS_G(serializer);
+}
+
+static void delGeometrySerializer(TSRMLS_D)
+{
+    if ( GEOS_G(serializer) ) {
+        GEOSWKBWriter_destroy_r(GEOS_G(handle), GEOS_G(serializer));
+        GEOS_G(serializer) = NULL;
+    }
+}
+
+/* Geometry deserializer */
+
+static GEOSWKBReader* getGeometryDeserializer(TSRMLS_D)
+{
+    if ( ! GEOS_G(deserializer) ) {
+        GEOS_G(deserializer) = GEOSWKBReader_create_r(GEOS_G(handle));
+    }
+    return GEOS_G(deserializer);
+}
+
+static void delGeometryDeserializer(TSRMLS_D)
+{
+    if ( GEOS_G(deserializer) ) {
+        GEOSWKBReader_destroy_r(GEOS_G(handle), GEOS_G(deserializer));
+        GEOS_G(deserializer) = NULL;
+    }
+}
+
+/* Serializer function for GEOSGeometry */
+
+static int
+Geometry_serialize(zval *object, unsigned char **buffer, zend_uint *buf_len,
+        zend_serialize_data *data TSRMLS_DC)
+{
+    GEOSWKBWriter *serializer;
+    GEOSGeometry *geom;
+    Proxy *lazy;
+    char* ret;
+    size_t retsize;
+
+    /* any WKB we kept reads back the same */
+    lazy = getLazyProxy(object TSRMLS_CC);
+    if ( lazy ) {
+        *buffer = (unsigned char*)encodeHex(lazy->wkb, lazy->wkblen);
+        *buf_len = lazy->wkblen * 2;
+        return SUCCESS;
+    }
+
+    serializer = getGeometrySerializer(TSRMLS_C);
+    geom = (GEOSGeometry*)getRelay(object, Geometry_ce_ptr TSRMLS_CC);
+    if ( ! geom ) return FAILURE;
+
+    /* NOTE: we might be fine using binary here */
+    ret = (char*)GEOSWKBWriter_writeHEX_r(GEOS_G(handle), serializer, geom, &retsize);
+    /* we'll probably get an exception if ret is null */
+    if ( ! ret ) return FAILURE;
+
+    *buffer = (unsigned char*)estrndup(ret, retsize);
+    GEOSFree_r(GEOS_G(handle), ret);
+
+    *buf_len = retsize;
+
+    return SUCCESS;
+}
+
+static int
+Geometry_deserialize(zval **object, zend_class_entry *ce, const unsigned char *buf,
+        zend_uint buf_len, zend_unserialize_data *data TSRMLS_DC)
+{
+    GEOSWKBReader* deserializer;
+    GEOSGeometry* geom;
+
+    deserializer = getGeometryDeserializer(TSRMLS_C);
+    geom = GEOSWKBReader_readHEX_r(GEOS_G(handle), deserializer, buf, buf_len);
+
+    /* TODO: check zend_class_entry being what we expect! */
+    if ( ce != Geometry_ce_ptr ) {
+        php_error_docref(NULL TSRMLS_CC, E_ERROR,
+                "Geometry_deserialize called with unexpected zend_class_entry");
+        return FAILURE;
+    }
+    object_init_ex(*object, ce);
+    setRelay(*object, geom TSRMLS_CC);
+
+    return SUCCESS;
+}
+
+/*
+ * Push components of the given geometry
+ * to the given array zval.
+ * Components geometries are cloned.
+ * NOTE: collection components are not descended into
+ */
+static void
+dumpGeometry(GEOSGeometry* g, zval* array TSRMLS_DC)
+{
+    int ngeoms, i;
+
+    /*
+    MAKE_STD_ZVAL(array);
+    array_init(array);
+    */
+
+    ngeoms = GEOSGetNumGeometries_r(GEOS_G(handle), g);
+    for (i=0; i<ngeoms; ++i)
+    {
+        zval *tmp;
+        GEOSGeometry* cc;
+        const GEOSGeometry* c = GEOSGetGeometryN_r(GEOS_G(handle), g, i);
+        if ( ! c ) continue; /* should get an exception */
+        /* we _need_ to clone as this one is owned by 'g' */
+        cc = GEOSGeom_clone_r(GEOS_G(handle), c);
+        if ( ! cc ) continue; /* should get an exception */
+
+        MAKE_STD_ZVAL(tmp);
+        object_init_ex(tmp, Geometry_ce_ptr);
+        setRelay(tmp, cc TSRMLS_CC);
+        add_next_index_zval(array, tmp);
+    }
+}
+
+
+static void
+Geometry_dtor (void *object TSRMLS_DC)
+{
+    Proxy *obj = (Proxy *)object;
+    if ( obj->relay && ! obj->shared ) {
+        GEOSGeom_destroy_r(GEOS_G(handle), (GEOSGeometry*)obj->relay);
+    }
+    if ( obj->wkb ) efree(obj->wkb);
+    GEOS_G(memory_usage) -= obj->memory;
+
+    zend_hash_destroy(obj->std.properties);
+    FREE_HASHTABLE(obj->std.properties);
+
+    efree(obj);
+}
+
+static zend_object_value
+Geometry_create_obj (zend_class_entry *type TSRMLS_DC)
+{
+    return Gen_create_obj(type, Geometry_dtor, &Geometry_object_handlers TSRMLS_CC);
+}
+
+
+PHP_METHOD(Geometry, __construct)
+{
+    php_error_docref(NULL TSRMLS_CC, E_ERROR,
+            "GEOSGeometry can't be constructed using new, check WKTReader");
+
+}
+
+PHP_METHOD(Geometry, __toString)
+{
+    GEOSGeometry *geom;
+    GEOSWKTWriter *writer;
+    char *wkt;
+    char *ret;
+
+    geom = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! geom ) RETURN_NULL(); /* should get an exception first */
+    writer = GEOSWKTWriter_create_r(GEOS_G(handle));
+    /* NOTE: if we get an exception before reaching
+     *       GEOSWKTWriter_destory below we'll be leaking memory.
+     *       One fix could be storing the object in a refcounted
+     *       zval.
+     */
+#   ifdef HAVE_GEOS_WKT_WRITER_SET_TRIM
+    GEOSWKTWriter_setTrim_r(GEOS_G(handle), writer, 1);
+#   endif
+
+    wkt = GEOSWKTWriter_write_r(GEOS_G(handle), writer, geom);
+    /* we'll probably get an exception if wkt is null */
+    if ( ! wkt ) RETURN_NULL();
+
+    GEOSWKTWriter_destroy_r(GEOS_G(handle), writer);
+
+
+    ret = estrdup(wkt);
+    GEOSFree_r(GEOS_G(handle), wkt);
+
+    RETURN_STRING(ret, 0);
+}
+
+PHP_METHOD(Geometry, project)
+{
+    GEOSGeometry *this;
+    GEOSGeometry *other;
+    zval *zobj;
+    zend_bool normalized = 0;
+    double ret;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o|b", &zobj,
+            &normalized) == FAILURE) {
+        RETURN_NULL();
+    }
+    other = getRelay(zobj, Geometry_ce_ptr TSRMLS_CC);
+    if ( ! other ) RETURN_NULL(); /* should get an exception first */
+
+    if ( normalized ) {
+        ret = GEOSProjectNormalized_r(GEOS_G(handle), this, other);
+    } else {
+        ret = GEOSProject_r(GEOS_G(handle), this, other);
+    }
+    if ( ret < 0 ) RETURN_NULL(); /* should get an exception first */
+
+    RETURN_DOUBLE(ret);
+}
+
+PHP_METHOD(Geometry, interpolate)
+{
+    GEOSGeometry *this;
+    double dist;
+    GEOSGeometry *ret;
+    zend_bool normalized = 0;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "d|b",
+            &dist, &normalized) == FAILURE) {
+        RETURN_NULL();
+    }
+
+    if ( normalized ) {
+        ret = GEOSInterpolateNormalized_r(GEOS_G(handle), this, dist);
+    } else {
+        ret = GEOSInterpolate_r(GEOS_G(handle), this, dist);
+    }
+    if ( ! ret ) RETURN_NULL(); /* should get an exception first */
+
+    /* return_value is a zval */
+    object_init_ex(return_value, Geometry_ce_ptr);
+    setRelay(return_value, ret TSRMLS_CC);
+}
+
+/**
+ * GEOSGeometry::buffer(dist, [<styleArray>|<GEOSBufferParams>])
+ *
+ * Passing a GEOSBufferParams avoids building the native parameters
+ * on every call.
+ *
+ * styleArray keys supported:
+ *  'quad_segs'
+ *       Type: int
+ *       Number of segments used to approximate
+ *       a quarter circle (defaults to 8).
+ *  'endcap'
+ *       Type: long
+ *       Endcap style (defaults to GEOSBUF_CAP_ROUND)
+ *  'join'
+ *       Type: long
+ *       Join style (defaults to GEOSBUF_JOIN_ROUND)
+ *  'mitre_limit'
+ *       Type: double
+ *       mitre ratio limit (only affects joins with GEOSBUF_JOIN_MITRE style)
+ *       'miter_limit' is also accepted as a synonym for 'mitre_limit'.
+ *  'single_sided'
+ *       Type: bool
+ *       If true buffer lines only on one side, so that the input line
+ *       will be a portion of the boundary of the returned polygon.
+ *       Only applies to lineal input. Defaults to false.
+ */
+PHP_METHOD(Geometry, buffer)
+{
+    GEOSGeometry *this;
+    double dist;
+    GEOSGeometry *ret;
+    GEOSBufferParams *params;
+    BufferStyle style;
+    int owned;
+    zval *style_val = NULL;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "d|z",
+            &dist, &style_val) == FAILURE) {
+        RETURN_NULL();
+    }
+
+    if ( getBufferStyle(style_val, &style, &params, &owned TSRMLS_CC)
+            == FAILURE ) {
+        RETURN_NULL();
+    }
+
+    ret = bufferGeometry(this, dist, &style, params TSRMLS_CC);
+    if ( owned ) GEOSBufferParams_destroy_r(GEOS_G(handle), params);
+    if ( ! ret ) RETURN_NULL(); /* should get an exception first */
+
+    /* return_value is a zval */
+    object_init_ex(return_value, Geometry_ce_ptr);
+    setRelay(return_value, ret TSRMLS_CC);
+}
+
+/**
+ * GEOSGeometry::offsetCurve(dist, [<styleArray>|<GEOSBufferParams>])
+ *
+ * styleArray keys supported:
+ *  'quad_segs'
+ *       Type: int
+ *       Number of segments used to approximate
+ *       a quarter circle (defaults to 8).
+ *  'join'
+ *       Type: long
+ *       Join style (defaults to GEOSBUF_JOIN_ROUND)
+ *  'mitre_limit'
+ *       Type: double
+ *       mitre ratio limit (only affects joins with GEOSBUF_JOIN_MITRE style)
+ *       'miter_limit' is also accepted as a synonym for 'mitre_limit'.
+ */
+#ifdef HAVE_GEOS_OFFSET_CURVE
+PHP_METHOD(Geometry, offsetCurve)
+{
+    GEOSGeometry *this;
+    double dist;
+    GEOSGeometry *ret;
+    BufferStyle style;
+    zval *style_val = NULL;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "d|z",
+            &dist, &style_val) == FAILURE) {
+        RETURN_NULL();
+    }
+
+    if ( getBufferStyle(style_val, &style, NULL, NULL TSRMLS_CC) == FAILURE ) {
+        RETURN_NULL();
+    }
+
+    ret = GEOSOffsetCurve_r(GEOS_G(handle), this, dist, style.quadSegs,
+        style.joinStyle, style.mitreLimit);
+    if ( ! ret ) RETURN_NULL(); /* should get an exception first */
+
+    /* return_value is a zval */
+    object_init_ex(return_value, Geometry_ce_ptr);
+    setRelay(return_value, ret TSRMLS_CC);
+}
+#endif
+
+PHP_METHOD(Geometry, envelope)
+{
+    GEOSGeometry *this;
+    GEOSGeometry *ret;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSEnvelope_r(GEOS_G(handle), this);
+    if ( ! ret ) RETURN_NULL(); /* should get an exception first */
+
+    /* return_value is a zval */
+    object_init_ex(return_value, Geometry_ce_ptr);
+    setRelay(return_value, ret TSRMLS_CC);
+}
+
+/*
+ * Check the gridSize argument of overlay operations, throwing
+ * if it is negative or if GEOS can't run fixed precision
+ * overlays (GEOS 3.9 and later can). A zero gridSize keeps
+ * floating precision, but still uses the newer overlay.
+ */
+static int
+checkGridSize(double gridSize TSRMLS_DC)
+{
+#if defined(HAVE_GEOS_INTERSECTION_PREC) && defined(HAVE_GEOS_UNION_PREC) && \
+    defined(HAVE_GEOS_DIFFERENCE_PREC) && defined(HAVE_GEOS_SYM_DIFFERENCE_PREC) && \
+    defined(HAVE_GEOS_UNARY_UNION_PREC)
+    if ( gridSize >= 0 ) return SUCCESS;
+
+    zend_throw_exception_ex(zend_exception_get_default(TSRMLS_C),
+        1 TSRMLS_CC, "Grid size must not be negative");
+#else
+    zend_throw_exception_ex(zend_exception_get_default(TSRMLS_C),
+        1 TSRMLS_CC, "Fixed precision overlay is not supported by GEOS %s",
+        GEOSversion());
+#endif
+    return FAILURE;
+}
+
+/**
+ * GEOSGeometry GEOSGeometry::intersection(otherGeom, [gridSize])
+ *
+ * With a gridSize the overlay runs once with snap rounding
+ * to a grid of that size, see checkGridSize.
+ */
+PHP_METHOD(Geometry, intersection)
+{
+    GEOSGeometry *this;
+    GEOSGeometry *other;
+    GEOSGeometry *ret;
+    zval *zobj;
+    double gridSize = 0.0;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o|d", &zobj,
+            &gridSize) == FAILURE) {
+        RETURN_NULL();
+    }
+    other = getRelay(zobj, Geometry_ce_ptr TSRMLS_CC);
+    if ( ! other ) RETURN_NULL(); /* should get an exception first */
+
+    if ( ZEND_NUM_ARGS() > 1 ) {
+        if ( checkGridSize(gridSize TSRMLS_CC) == FAILURE ) RETURN_NULL();
+#       ifdef HAVE_GEOS_INTERSECTION_PREC
+        ret = GEOSIntersectionPrec_r(GEOS_G(handle), this, other, gridSize);
+#       else
+        RETURN_NULL(); /* checkGridSize threw */
+#       endif
+    } else {
+        ret = GEOSIntersection_r(GEOS_G(handle), this, other);
+    }
+    if ( ! ret ) RETURN_NULL(); /* should get an exception first */
+
+    /* return_value is a zval */
+    object_init_ex(return_value, Geometry_ce_ptr);
+    setRelay(return_value, ret TSRMLS_CC);
+}
+
+/**
+ * GEOSGeometry GEOSGeometry::clipByRect(xmin,ymin,xmax,ymax)
+ */
+#ifdef HAVE_GEOS_CLIP_BY_RECT
+PHP_METHOD(Geometry, clipByRect)
+{
+    GEOSGeometry *this;
+    GEOSGeometry *ret;
+    double xmin,ymin,xmax,ymax;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "dddd",
+            &xmin, &ymin, &xmax, &ymax) == FAILURE) {
+        RETURN_NULL();
+    }
+
+    ret = GEOSClipByRect_r(GEOS_G(handle), this, xmin, ymin, xmax, ymax);
+    if ( ! ret ) RETURN_NULL(); /* should get an exception first */
+
+    /* return_value is a zval */
+    object_init_ex(return_value, Geometry_ce_ptr);
+    setRelay(return_value, ret TSRMLS_CC);
+}
+#endif
+
+PHP_METHOD(Geometry, convexHull)
+{
+    GEOSGeometry *this;
+    GEOSGeometry *ret;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSConvexHull_r(GEOS_G(handle), this);
+    if ( ret == NULL ) RETURN_NULL(); /* should get an exception first */
+
+    /* return_value is a zval */
+    object_init_ex(return_value, Geometry_ce_ptr);
+    setRelay(return_value, ret TSRMLS_CC);
+}
+
+/**
+ * GEOSGeometry GEOSGeometry::difference(otherGeom, [gridSize])
+ *
+ * With a gridSize the overlay runs once with snap rounding
+ * to a grid of that size, see checkGridSize.
+ */
+PHP_METHOD(Geometry, difference)
+{
+    GEOSGeometry *this;
+    GEOSGeometry *other;
+    GEOSGeometry *ret;
+    zval *zobj;
+    double gridSize = 0.0;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o|d", &zobj,
+            &gridSize) == FAILURE) {
+        RETURN_NULL();
+    }
+    other = getRelay(zobj, Geometry_ce_ptr TSRMLS_CC);
+    if ( ! other ) RETURN_NULL(); /* should get an exception first */
+
+    if ( ZEND_NUM_ARGS() > 1 ) {
+        if ( checkGridSize(gridSize TSRMLS_CC) == FAILURE ) RETURN_NULL();
+#       ifdef HAVE_GEOS_DIFFERENCE_PREC
+        ret = GEOSDifferencePrec_r(GEOS_G(handle), this, other, gridSize);
+#       else
+        RETURN_NULL(); /* checkGridSize threw */
+#       endif
+    } else {
+        ret = GEOSDifference_r(GEOS_G(handle), this, other);
+    }
+    if ( ! ret ) RETURN_NULL(); /* should get an exception first */
+
+    /* return_value is a zval */
+    object_init_ex(return_value, Geometry_ce_ptr);
+    setRelay(return_value, ret TSRMLS_CC);
+}
+
+/**
+ * GEOSGeometry GEOSGeometry::symDifference(otherGeom, [gridSize])
+ *
+ * With a gridSize the overlay runs once with snap rounding
+ * to a grid of that size, see checkGridSize.
+ */
+PHP_METHOD(Geometry, symDifference)
+{
+    GEOSGeometry *this;
+    GEOSGeometry *other;
+    GEOSGeometry *ret;
+    zval *zobj;
+    double gridSize = 0.0;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o|d", &zobj,
+            &gridSize) == FAILURE) {
+        RETURN_NULL();
+    }
+    other = getRelay(zobj, Geometry_ce_ptr TSRMLS_CC);
+    if ( ! other ) RETURN_NULL(); /* should get an exception first */
+
+    if ( ZEND_NUM_ARGS() > 1 ) {
+        if ( checkGridSize(gridSize TSRMLS_CC) == FAILURE ) RETURN_NULL();
+#       ifdef HAVE_GEOS_SYM_DIFFERENCE_PREC
+        ret = GEOSSymDifferencePrec_r(GEOS_G(handle), this, other, gridSize);
+#       else
+        RETURN_NULL(); /* checkGridSize threw */
+#       endif
+    } else {
+        ret = GEOSSymDifference_r(GEOS_G(handle), this, other);
+    }
+    if ( ! ret ) RETURN_NULL(); /* should get an exception first */
+
+    /* return_value is a zval */
+    object_init_ex(return_value, Geometry_ce_ptr);
+    setRelay(return_value, ret TSRMLS_CC);
+}
+
+PHP_METHOD(Geometry, boundary)
+{
+    GEOSGeometry *this;
+    GEOSGeometry *ret;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSBoundary_r(GEOS_G(handle), this);
+    if ( ret == NULL ) RETURN_NULL(); /* should get an exception first */
+
+    /* return_value is a zval */
+    object_init_ex(return_value, Geometry_ce_ptr);
+    setRelay(return_value, ret TSRMLS_CC);
+}
+
+/**
+ * GEOSGeometry::union(otherGeom, [gridSize])
+ * GEOSGeometry::union()
+ * GEOSGeometry::union(null, gridSize)
+ *
+ * With a gridSize the overlay runs once with snap rounding
+ * to a grid of that size, see checkGridSize.
+ */
+PHP_METHOD(Geometry, union)
+{
+    GEOSGeometry *this;
+    GEOSGeometry *other;
+    GEOSGeometry *ret;
+    zval *zobj = NULL;
+    double gridSize = 0.0;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|o!d", &zobj,
+            &gridSize) == FAILURE) {
+        RETURN_NULL();
+    }
+
+    if ( ZEND_NUM_ARGS() > 1 &&
+            checkGridSize(gridSize TSRMLS_CC) == FAILURE ) {
+        RETURN_NULL();
+    }
+
+    if ( zobj ) {
+        other = getRelay(zobj, Geometry_ce_ptr TSRMLS_CC);
+        if ( ! other ) RETURN_NULL(); /* should get an exception first */
+        if ( ZEND_NUM_ARGS() > 1 ) {
+#           ifdef HAVE_GEOS_UNION_PREC
+            ret = GEOSUnionPrec_r(GEOS_G(handle), this, other, gridSize);
+#           else
+            RETURN_NULL(); /* checkGridSize threw */
+#           endif
+        } else {
+            ret = GEOSUnion_r(GEOS_G(handle), this, other);
+        }
+    } else if ( ZEND_NUM_ARGS() > 1 ) {
+#       ifdef HAVE_GEOS_UNARY_UNION_PREC
+        ret = GEOSUnaryUnionPrec_r(GEOS_G(handle), this, gridSize);
+#       else
+        RETURN_NULL(); /* checkGridSize threw */
+#       endif
+    } else {
+#       ifdef HAVE_GEOS_UNARY_UNION
+        ret = GEOSUnaryUnion_r(GEOS_G(handle), this);
+#       else
+        ret = GEOSUnionCascaded_r(GEOS_G(handle), this);
+#       endif
+    }
+
+    if ( ! ret ) RETURN_NULL(); /* should get an exception first */
+
+    /* return_value is a zval */
+    object_init_ex(return_value, Geometry_ce_ptr);
+    setRelay(return_value, ret TSRMLS_CC);
+}
+
+/**
+ * GEOSGeometry::pointOnSurface()
+ */
+PHP_METHOD(Geometry, pointOnSurface)
+{
+    GEOSGeometry *this;
+    GEOSGeometry *ret;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSPointOnSurface_r(GEOS_G(handle), this);
+    if ( ret == NULL ) RETURN_NULL(); /* should get an exception first */
+
+    /* return_value is a zval */
+    object_init_ex(return_value, Geometry_ce_ptr);
+    setRelay(return_value, ret TSRMLS_CC);
+}
+
+/**
+ * GEOSGeometry::centroid()
+ */
+PHP_METHOD(Geometry, centroid)
+{
+    GEOSGeometry *this;
+    GEOSGeometry *ret;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSGetCentroid_r(GEOS_G(handle), this);
+    if ( ret == NULL ) RETURN_NULL(); /* should get an exception first */
+
+    /* return_value is a zval */
+    object_init_ex(return_value, Geometry_ce_ptr);
+    setRelay(return_value, ret TSRMLS_CC);
+}
+
+/**
+ * GEOSGeometry::relate(otherGeom)
+ * GEOSGeometry::relate(otherGeom, pattern)
+ */
+PHP_METHOD(Geometry, relate)
+{
+    GEOSGeometry *this;
+    GEOSGeometry *other;
+    zval *zobj;
+    char* pat = NULL;
+    int patlen;
+    int retInt;
+    zend_bool retBool;
+    char* retStr;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o|s",
+        &zobj, &pat, &patlen) == FAILURE)
+    {
+        RETURN_NULL();
+    }
+
+    other = getRelay(zobj, Geometry_ce_ptr TSRMLS_CC);
+    if ( ! other ) RETURN_NULL(); /* should get an exception first */
+
+    if ( ! pat ) {
+        /* we'll compute it */
+        pat = GEOSRelate_r(GEOS_G(handle), this, other);
+        if ( ! pat ) RETURN_NULL(); /* should get an exception first */
+        retStr = estrdup(pat);
+        GEOSFree_r(GEOS_G(handle), pat);
+        RETURN_STRING(retStr, 0);
+    } else {
+        retInt = GEOSRelatePattern_r(GEOS_G(handle), this, other, pat);
+        if ( retInt == 2 ) RETURN_NULL(); /* should get an exception first */
+        retBool = retInt;
+        RETURN_BOOL(retBool);
+    }
+
+}
+
+/**
+ * GEOSGeometry::relateBoundaryNodeRule(otherGeom, rule)
+ */
+#ifdef HAVE_GEOS_RELATE_BOUNDARY_NODE_RULE
+PHP_METHOD(Geometry, relateBoundaryNodeRule)
+{
+    GEOSGeometry *this;
+    GEOSGeometry *other;
+    zval *zobj;
+    char* pat;
+    long int bnr = GEOSRELATE_BNR_OGC;
+    char* retStr;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "ol",
+        &zobj, &bnr) == FAILURE)
+    {
+        RETURN_NULL();
+    }
+
+    other = getRelay(zobj, Geometry_ce_ptr TSRMLS_CC);
+    if ( ! other ) RETURN_NULL(); /* should get an exception first */
+
+    /* we'll compute it */
+    pat = GEOSRelateBoundaryNodeRule_r(GEOS_G(handle), this, other, bnr);
+    if ( ! pat ) RETURN_NULL(); /* should get an exception first */
+    retStr = estrdup(pat);
+    GEOSFree_r(GEOS_G(handle), pat);
+    RETURN_STRING(retStr, 0);
+}
+#endif
+
+/**
+ * GEOSGeometry GEOSGeometry::simplify(tolerance)
+ * GEOSGeometry GEOSGeometry::simplify(tolerance, preserveTopology)
+ */
+PHP_METHOD(Geometry, simplify)
+{
+    GEOSGeometry *this;
+    double tolerance;
+    zend_bool preserveTopology = 0;
+    GEOSGeometry *ret;
+    GeometryCacheKey key;
+    double args[2];
+    int cached;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "d|b",
+            &tolerance, &preserveTopology) == FAILURE) {
+        RETURN_NULL();
+    }
+
+    args[0] = tolerance;
+    args[1] = preserveTopology;
+    cached = GeometryCache_key(&key, GEOSCACHE_OP_SIMPLIFY, args, 2, this
+        TSRMLS_CC) == SUCCESS;
+    ret = cached ? GeometryCache_fetch(&key TSRMLS_CC) : NULL;
+
+    if ( ! ret ) {
+        if ( preserveTopology ) {
+            ret = GEOSTopologyPreserveSimplify_r(GEOS_G(handle), this,
+                tolerance);
+        } else {
+            ret = GEOSSimplify_r(GEOS_G(handle), this, tolerance);
+        }
+        if ( ret && cached ) GeometryCache_store(&key, ret TSRMLS_CC);
+    }
+
+    if ( ! ret ) RETURN_NULL(); /* should get an exception first */
+
+    /* return_value is a zval */
+    object_init_ex(return_value, Geometry_ce_ptr);
+    setRelay(return_value, ret TSRMLS_CC);
+}
+
+/**
+ * GEOSGeometry GEOSGeometry::setPrecision(gridsize, [flags])
+ */
+#ifdef HAVE_GEOS_GEOM_SET_PRECISION
+PHP_METHOD(Geometry, setPrecision)
+{
+    GEOSGeometry *this;
+    double gridSize;
+    long int flags = 0;
+    GEOSGeometry *ret;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "d|l",
+            &gridSize, &flags) == FAILURE) {
+        RETURN_NULL();
+    }
+
+    ret = GEOSGeom_setPrecision_r(GEOS_G(handle), this, gridSize, flags);
+
+    if ( ! ret ) RETURN_NULL(); /* should get an exception first */
+
+    /* return_value is a zval */
+    object_init_ex(return_value, Geometry_ce_ptr);
+    setRelay(return_value, ret TSRMLS_CC);
+}
+#endif
+
+/**
+ * double GEOSGeometry::getPrecision()
+ */
+#ifdef HAVE_GEOS_GEOM_GET_PRECISION
+PHP_METHOD(Geometry, getPrecision)
+{
+    GEOSGeometry *geom;
+    double prec;
+
+    geom = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! geom ) RETURN_NULL(); /* should get an exception first */
+
+    prec = GEOSGeom_getPrecision_r(GEOS_G(handle), geom);
+    if ( prec < 0 ) RETURN_NULL(); /* should get an exception first */
+
+    RETURN_DOUBLE(prec);
+}
+#endif
+
+/**
+ * GEOSGeometry GEOSGeometry::normalize()
+ */
+PHP_METHOD(Geometry, normalize)
+{
+    GEOSGeometry *this;
+    GEOSGeometry *ret;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSGeom_clone_r(GEOS_G(handle), this);
+
+    if ( ! ret ) RETURN_NULL();
+
+    GEOSNormalize_r(GEOS_G(handle), ret); /* exception should be gotten automatically */
+
+    /* return_value is a zval */
+    object_init_ex(return_value, Geometry_ce_ptr);
+    setRelay(return_value, ret TSRMLS_CC);
+}
+
+/**
+ * GEOSGeometry GEOSGeometry::extractUniquePoints()
+ */
+#ifdef HAVE_GEOS_GEOM_EXTRACT_UNIQUE_POINTS
+PHP_METHOD(Geometry, extractUniquePoints)
+{
+    GEOSGeometry *this;
+    GEOSGeometry *ret;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSGeom_extractUniquePoints_r(GEOS_G(handle), this);
+    if ( ret == NULL ) RETURN_NULL(); /* should get an exception first */
+
+    /* return_value is a zval */
+    object_init_ex(return_value, Geometry_ce_ptr);
+    setRelay(return_value, ret TSRMLS_CC);
+}
+#endif
+
+/**
+ * bool GEOSGeometry::disjoint(GEOSGeometry)
+ */
+PHP_METHOD(Geometry, disjoint)
+{
+    GEOSGeometry *this;
+    GEOSGeometry *other;
+    int ret;
+    zend_bool retBool;
+    zval *zobj;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o", &zobj)
+            == FAILURE) {
+        RETURN_NULL();
+    }
+    other = getRelay(zobj, Geometry_ce_ptr TSRMLS_CC);
+    if ( ! other ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSDisjoint_r(GEOS_G(handle), this, other);
+    if ( ret == 2 ) RETURN_NULL(); /* should get an exception first */
+
+    /* return_value is a zval */
+    retBool = ret;
+    RETURN_BOOL(retBool);
+}
+
+/**
+ * bool GEOSGeometry::touches(GEOSGeometry)
+ */
+PHP_METHOD(Geometry, touches)
+{
+    GEOSGeometry *this;
+    GEOSGeometry *other;
+    int ret;
+    zend_bool retBool;
+    zval *zobj;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o", &zobj)
+            == FAILURE) {
+        RETURN_NULL();
+    }
+    other = getRelay(zobj, Geometry_ce_ptr TSRMLS_CC);
+    if ( ! other ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSTouches_r(GEOS_G(handle), this, other);
+    if ( ret == 2 ) RETURN_NULL(); /* should get an exception first */
+
+    /* return_value is a zval */
+    retBool = ret;
+    RETURN_BOOL(retBool);
+}
+
+/**
+ * bool GEOSGeometry::intersects(GEOSGeometry)
+ */
+PHP_METHOD(Geometry, intersects)
+{
+    GEOSGeometry *this;
+    GEOSGeometry *other;
+    int ret;
+    zend_bool retBool;
+    zval *zobj;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o", &zobj)
+            == FAILURE) {
+        RETURN_NULL();
+    }
+    other = getRelay(zobj, Geometry_ce_ptr TSRMLS_CC);
+    if ( ! other ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSIntersects_r(GEOS_G(handle), this, other);
+    if ( ret == 2 ) RETURN_NULL(); /* should get an exception first */
+
+    /* return_value is a zval */
+    retBool = ret;
+    RETURN_BOOL(retBool);
+}
+
+/**
+ * bool GEOSGeometry::crosses(GEOSGeometry)
+ */
+PHP_METHOD(Geometry, crosses)
+{
+    GEOSGeometry *this;
+    GEOSGeometry *other;
+    int ret;
+    zend_bool retBool;
+    zval *zobj;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o", &zobj)
+            == FAILURE) {
+        RETURN_NULL();
+    }
+    other = getRelay(zobj, Geometry_ce_ptr TSRMLS_CC);
+    if ( ! other ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSCrosses_r(GEOS_G(handle), this, other);
+    if ( ret == 2 ) RETURN_NULL(); /* should get an exception first */
+
+    /* return_value is a zval */
+    retBool = ret;
+    RETURN_BOOL(retBool);
+}
+
+/**
+ * bool GEOSGeometry::within(GEOSGeometry)
+ */
+PHP_METHOD(Geometry, within)
+{
+    GEOSGeometry *this;
+    GEOSGeometry *other;
+    int ret;
+    zend_bool retBool;
+    zval *zobj;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o", &zobj)
+            == FAILURE) {
+        RETURN_NULL();
+    }
+    other = getRelay(zobj, Geometry_ce_ptr TSRMLS_CC);
+    if ( ! other ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSWithin_r(GEOS_G(handle), this, other);
+    if ( ret == 2 ) RETURN_NULL(); /* should get an exception first */
+
+    /* return_value is a zval */
+    retBool = ret;
+    RETURN_BOOL(retBool);
+}
+
+/**
+ * bool GEOSGeometry::contains(GEOSGeometry)
+ */
+PHP_METHOD(Geometry, contains)
+{
+    GEOSGeometry *this;
+    GEOSGeometry *other;
+    int ret;
+    zend_bool retBool;
+    zval *zobj;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o", &zobj)
+            == FAILURE) {
+        RETURN_NULL();
+    }
+    other = getRelay(zobj, Geometry_ce_ptr TSRMLS_CC);
+    if ( ! other ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSContains_r(GEOS_G(handle), this, other);
+    if ( ret == 2 ) RETURN_NULL(); /* should get an exception first */
+
+    /* return_value is a zval */
+    retBool = ret;
+    RETURN_BOOL(retBool);
+}
+
+/**
+ * string GEOSGeometry::containsPoints(string packedXY)
+ *
+ * 'packedXY' holds native-endian double X,Y pairs, as produced
+ * by pack('d*', x0, y0, x1, y1, ...). Returns a bitmap with bit
+ * (i & 7) of byte (i >> 3) set when point i is contained.
+ * Use GEOSPreparedGeometry to classify several buffers.
+ */
+PHP_METHOD(Geometry, containsPoints)
+{
+    PreparedGeometry pg;
+    char *packed;
+    int len;
+
+    memset(&pg, 0, sizeof(pg));
+    pg.geom = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! pg.geom ) RETURN_NULL(); /* should get an exception first */
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s", &packed, &len)
+            == FAILURE) {
+        RETURN_NULL();
+    }
+
+    containsPackedPoints(&pg, packed, len, return_value TSRMLS_CC);
+    PreparedGeometry_release(&pg TSRMLS_CC);
+}
+
+/**
+ * string GEOSGeometry::rasterize(originX, originY, cellSize, cols, rows,
+ *                                [mode])
+ *
+ * Rasterize a polygonal geometry on a grid of cols x rows square
+ * cells, (originX, originY) being the top left corner of the grid
+ * and rows going down. Cell i is at row (i / cols), column (i % cols).
+ *
+ * 'mode' is one of the GEOSRASTER_* constants:
+ *
+ *  GEOSRASTER_CENTER (default)
+ *       bit (i & 7) of byte (i >> 3) is set when the centre
+ *       of cell i is inside the geometry.
+ *  GEOSRASTER_TOUCH
+ *       same bitmap, set when cell i touches the geometry.
+ *  GEOSRASTER_FRACTION
+ *       byte i is the fraction of cell i covered by the
+ *       geometry, scaled to 0-255.
+ */
+PHP_METHOD(Geometry, rasterize)
+{
+    GEOSGeometry *this;
+    PointInPolygon *pip;
+    Raster r;
+    unsigned char *out;
+    long mode = GEOSRASTER_CENTER;
+    size_t ncells, nbytes;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    memset(&r, 0, sizeof(r));
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "dddll|l",
+            &r.originX, &r.originY, &r.cellSize, &r.cols, &r.rows, &mode)
+            == FAILURE) {
+        RETURN_NULL();
+    }
+
+    if ( checkGrid(r.cellSize, r.cols, r.rows TSRMLS_CC) == FAILURE ) {
+        RETURN_NULL(); /* should get an exception first */
+    }
+    if ( mode < GEOSRASTER_CENTER || mode > GEOSRASTER_FRACTION ) {
+        zend_throw_exception_ex(zend_exception_get_default(TSRMLS_C), 1
+            TSRMLS_CC, "Unknown raster mode %ld", mode);
+        RETURN_NULL();
+    }
+
+    /* coordinates are checked before any band is computed from them */
+    pip = PointInPolygon_readEdges(this TSRMLS_CC);
+    if ( ! pip ) RETURN_NULL(); /* should get an exception first */
+    if ( Raster_check(&r, pip TSRMLS_CC) == FAILURE ) {
+        PointInPolygon_destroy(pip);
+        RETURN_NULL();
+    }
+    PointInPolygon_index(pip);
+
+    ncells = (size_t)r.cols * r.rows;
+    nbytes = mode == GEOSRASTER_FRACTION ? ncells : (ncells + 7) / 8;
+    out = (unsigned char*)safe_emalloc(nbytes, 1, 1);
+    memset(out, 0, nbytes + 1);
+
+    if ( mode == GEOSRASTER_FRACTION ) {
+        Raster_fillFractions(&r, pip, out);
+    } else {
+        Raster_fillCenters(&r, pip, out);
+        if ( mode == GEOSRASTER_TOUCH ) Raster_traceEdges(&r, pip, out);
+    }
+
+    if ( r.xs ) efree(r.xs);
+    PointInPolygon_destroy(pip);
+
+    RETURN_STRINGL((char*)out, nbytes, 0);
+}
+
+/**
+ * bool GEOSGeometry::overlaps(GEOSGeometry)
+ */
+PHP_METHOD(Geometry, overlaps)
+{
+    GEOSGeometry *this;
+    GEOSGeometry *other;
+    int ret;
+    zend_bool retBool;
+    zval *zobj;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o", &zobj)
+            == FAILURE) {
+        RETURN_NULL();
+    }
+    other = getRelay(zobj, Geometry_ce_ptr TSRMLS_CC);
+    if ( ! other ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSOverlaps_r(GEOS_G(handle), this, other);
+    if ( ret == 2 ) RETURN_NULL(); /* should get an exception first */
+
+    /* return_value is a zval */
+    retBool = ret;
+    RETURN_BOOL(retBool);
+}
+
+/**
+ * bool GEOSGeometry::covers(GEOSGeometry)
+ */
+#ifdef HAVE_GEOS_COVERS
+PHP_METHOD(Geometry, covers)
+{
+    GEOSGeometry *this;
+    GEOSGeometry *other;
+    int ret;
+    zend_bool retBool;
+    zval *zobj;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o", &zobj)
+            == FAILURE) {
+        RETURN_NULL();
+    }
+    other = getRelay(zobj, Geometry_ce_ptr TSRMLS_CC);
+    if ( ! other ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSCovers_r(GEOS_G(handle), this, other);
+    if ( ret == 2 ) RETURN_NULL(); /* should get an exception first */
+
+    /* return_value is a zval */
+    retBool = ret;
+    RETURN_BOOL(retBool);
+}
+#endif
+
+/**
+ * bool GEOSGeometry::coveredBy(GEOSGeometry)
+ */
+#ifdef HAVE_GEOS_COVERED_BY
+PHP_METHOD(Geometry, coveredBy)
+{
+    GEOSGeometry *this;
+    GEOSGeometry *other;
+    int ret;
+    zend_bool retBool;
+    zval *zobj;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o", &zobj)
+            == FAILURE) {
+        RETURN_NULL();
+    }
+    other = getRelay(zobj, Geometry_ce_ptr TSRMLS_CC);
+    if ( ! other ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSCoveredBy_r(GEOS_G(handle), this, other);
+    if ( ret == 2 ) RETURN_NULL(); /* should get an exception first */
+
+    /* return_value is a zval */
+    retBool = ret;
+    RETURN_BOOL(retBool);
+}
+#endif
+
+/**
+ * bool GEOSGeometry::equals(GEOSGeometry)
+ */
+PHP_METHOD(Geometry, equals)
+{
+    GEOSGeometry *this;
+    GEOSGeometry *other;
+    int ret;
+    zend_bool retBool;
+    zval *zobj;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o",
+        &zobj) == FAILURE) {
+        RETURN_NULL();
+    }
+    other = getRelay(zobj, Geometry_ce_ptr TSRMLS_CC);
+    if ( ! other ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSEquals_r(GEOS_G(handle), this, other);
+    if ( ret == 2 ) RETURN_NULL(); /* should get an exception first */
+
+    /* return_value is a zval */
+    retBool = ret;
+    RETURN_BOOL(retBool);
+}
+
+/**
+ * bool GEOSGeometry::equalsExact(GEOSGeometry)
+ * bool GEOSGeometry::equalsExact(GEOSGeometry, double tolerance)
+ */
+PHP_METHOD(Geometry, equalsExact)
+{
+    GEOSGeometry *this;
+    GEOSGeometry *other;
+    int ret;
+    double tolerance = 0;
+    zend_bool retBool;
+    zval *zobj;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o|d",
+        &zobj, &tolerance) == FAILURE) {
+        RETURN_NULL();
+    }
+    other = getRelay(zobj, Geometry_ce_ptr TSRMLS_CC);
+    if ( ! other ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSEqualsExact_r(GEOS_G(handle), this, other, tolerance);
+    if ( ret == 2 ) RETURN_NULL(); /* should get an exception first */
+
+    /* return_value is a zval */
+    retBool = ret;
+    RETURN_BOOL(retBool);
+}
+
+/**
+ * bool GEOSGeometry::isEmpty()
+ */
+PHP_METHOD(Geometry, isEmpty)
+{
+    GEOSGeometry *this;
+    int ret;
+    zend_bool retBool;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSisEmpty_r(GEOS_G(handle), this);
+    if ( ret == 2 ) RETURN_NULL(); /* should get an exception first */
+
+    /* return_value is a zval */
+    retBool = ret;
+    RETURN_BOOL(retBool);
+}
+
+/**
+ * array GEOSGeometry::checkValidity()
+ */
+#ifdef HAVE_GEOS_IS_VALID_DETAIL
+PHP_METHOD(Geometry, checkValidity)
+{
+    GEOSGeometry *this;
+    GEOSGeometry *location = NULL;
+    int ret;
+    char *reason = NULL;
+    zend_bool retBool;
+    char *reasonVal = NULL;
+    zval *locationVal = NULL;
+    long int flags = 0;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|l",
+        &flags) == FAILURE) {
+        RETURN_NULL();
+    }
+
+    ret = GEOSisValidDetail_r(GEOS_G(handle), this, flags, &reason, &location);
+    if ( ret == 2 ) RETURN_NULL(); /* should get an exception first */
+
+    if ( reason ) {
+        reasonVal = estrdup(reason);
+        GEOSFree_r(GEOS_G(handle), reason);
+    }
+
+    if ( location ) {
+        MAKE_STD_ZVAL(locationVal);
+        object_init_ex(locationVal, Geometry_ce_ptr);
+        setRelay(locationVal, location TSRMLS_CC);
+    }
+
+    retBool = ret;
+
+    /* return value is an array */
+    array_init(return_value);
+    add_assoc_bool(return_value, "valid", retBool);
+    if ( reasonVal ) add_assoc_string(return_value, "reason", reasonVal, 0);
+    if ( locationVal ) add_assoc_zval(return_value, "location", locationVal);
+
+}
+#endif
+
+/**
+ * GEOSGeometry GEOSGeometry::makeValid()
+ */
+#ifdef HAVE_GEOS_MAKE_VALID
+PHP_METHOD(Geometry, makeValid)
+{
+    GEOSGeometry *this;
+    GEOSGeometry *ret;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSMakeValid_r(GEOS_G(handle), this);
+    if ( ! ret ) RETURN_NULL(); /* should get an exception first */
+
+    /* return_value is a zval */
+    object_init_ex(return_value, Geometry_ce_ptr);
+    setRelay(return_value, ret TSRMLS_CC);
+}
+#endif
+
+/**
+ * bool GEOSGeometry::isSimple()
+ */
+PHP_METHOD(Geometry, isSimple)
+{
+    GEOSGeometry *this;
+    int ret;
+    zend_bool retBool;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSisSimple_r(GEOS_G(handle), this);
+    if ( ret == 2 ) RETURN_NULL(); /* should get an exception first */
+
+    /* return_value is a zval */
+    retBool = ret;
+    RETURN_BOOL(retBool);
+}
+
+/**
+ * bool GEOSGeometry::isRing()
+ */
+PHP_METHOD(Geometry, isRing)
+{
+    GEOSGeometry *this;
+    int ret;
+    zend_bool retBool;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSisRing_r(GEOS_G(handle), this);
+    if ( ret == 2 ) RETURN_NULL(); /* should get an exception first */
+
+    /* return_value is a zval */
+    retBool = ret;
+    RETURN_BOOL(retBool);
+}
+
+/**
+ * bool GEOSGeometry::hasZ()
+ */
+PHP_METHOD(Geometry, hasZ)
+{
+    GEOSGeometry *this;
+    int ret;
+    zend_bool retBool;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSHasZ_r(GEOS_G(handle), this);
+    if ( ret == 2 ) RETURN_NULL(); /* should get an exception first */
+
+    /* return_value is a zval */
+    retBool = ret;
+    RETURN_BOOL(retBool);
+}
+
+/**
+ * bool GEOSGeometry::isClosed()
+ */
+#ifdef HAVE_GEOS_IS_CLOSED
+PHP_METHOD(Geometry, isClosed)
+{
+    GEOSGeometry *this;
+    int ret;
+    zend_bool retBool;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSisClosed_r(GEOS_G(handle), this);
+    if ( ret == 2 ) RETURN_NULL(); /* should get an exception first */
+
+    /* return_value is a zval */
+    retBool = ret;
+    RETURN_BOOL(retBool);
+}
+#endif
+
+/**
+ * string GEOSGeometry::typeName()
+ */
+PHP_METHOD(Geometry, typeName)
+{
+    static const char *names[] = { NULL, "Point", "LineString", "Polygon",
+        "MultiPoint", "MultiLineString", "MultiPolygon",
+        "GeometryCollection" };
+    GEOSGeometry *this;
+    Proxy *lazy;
+    unsigned long wkbType;
+    long srid;
+    char *typ;
+    char *typVal;
+
+    lazy = getLazyProxy(getThis() TSRMLS_CC);
+    if ( lazy ) {
+        readWKBHeader(lazy->wkb, &wkbType, &srid);
+        RETURN_STRING(names[wkbType], 1);
+    }
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    /* TODO: define constant strings instead... */
+
+    typ = GEOSGeomType_r(GEOS_G(handle), this);
+    if ( ! typ ) RETURN_NULL(); /* should get an exception first */
+
+    typVal = estrdup(typ);
+    GEOSFree_r(GEOS_G(handle), typ);
+
+    RETURN_STRING(typVal, 0);
+}
+
+/**
+ * long GEOSGeometry::typeId()
+ */
+PHP_METHOD(Geometry, typeId)
+{
+    static const long ids[] = { -1, GEOS_POINT, GEOS_LINESTRING,
+        GEOS_POLYGON, GEOS_MULTIPOINT, GEOS_MULTILINESTRING,
+        GEOS_MULTIPOLYGON, GEOS_GEOMETRYCOLLECTION };
+    GEOSGeometry *this;
+    Proxy *lazy;
+    unsigned long wkbType;
+    long srid;
+    long typ;
+
+    lazy = getLazyProxy(getThis() TSRMLS_CC);
+    if ( lazy ) {
+        readWKBHeader(lazy->wkb, &wkbType, &srid);
+        RETURN_LONG(ids[wkbType]);
+    }
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    /* TODO: define constant strings instead... */
+
+    typ = GEOSGeomTypeId_r(GEOS_G(handle), this);
+    if ( typ == -1 ) RETURN_NULL(); /* should get an exception first */
+
+    RETURN_LONG(typ);
+}
+
+/**
+ * long GEOSGeometry::getSRID()
+ */
+PHP_METHOD(Geometry, getSRID)
+{
+    GEOSGeometry *geom;
+    Proxy *lazy;
+    unsigned long wkbType;
+    long int ret;
+
+    lazy = getLazyProxy(getThis() TSRMLS_CC);
+    if ( lazy ) {
+        readWKBHeader(lazy->wkb, &wkbType, &ret);
+        RETURN_LONG(ret);
+    }
+
+    geom = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! geom ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSGetSRID_r(GEOS_G(handle), geom);
+
+    RETURN_LONG(ret);
+}
+
+/**
+ * void GEOSGeometry::setSRID(long)
+ */
+PHP_METHOD(Geometry, setSRID)
+{
+    GEOSGeometry *geom;
+    long int srid;
+
+    geom = getOwnRelay(getThis() TSRMLS_CC);
+    if ( ! geom ) RETURN_NULL(); /* should get an exception first */
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "l",
+        &srid) == FAILURE) {
+        RETURN_NULL();
+    }
+
+    GEOSSetSRID_r(GEOS_G(handle), geom, srid);
+    dropLazyWKB((Proxy*)zend_object_store_get_object(getThis() TSRMLS_CC)
+        TSRMLS_CC);
+}
+
+/**
+ * long GEOSGeometry::numGeometries()
+ */
+PHP_METHOD(Geometry, numGeometries)
+{
+    GEOSGeometry *geom;
+    long int ret;
+
+    geom = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! geom ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSGetNumGeometries_r(GEOS_G(handle), geom);
+    if ( ret == -1 ) RETURN_NULL(); /* should get an exception first */
+
+    RETURN_LONG(ret);
+}
+
+/**
+ * GEOSGeometry GEOSGeometry::geometryN()
+ */
+PHP_METHOD(Geometry, geometryN)
+{
+    GEOSGeometry *geom;
+    const GEOSGeometry *c;
+    GEOSGeometry *cc;
+    long int num;
+
+    geom = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! geom ) RETURN_NULL(); /* should get an exception first */
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "l",
+        &num) == FAILURE) {
+        RETURN_NULL();
+    }
+
+    if ( num >= GEOSGetNumGeometries_r(GEOS_G(handle), geom) ) RETURN_NULL();
+    c = GEOSGetGeometryN_r(GEOS_G(handle), geom, num);
+    if ( ! c ) RETURN_NULL(); /* should get an exception first */
+    cc = GEOSGeom_clone_r(GEOS_G(handle), c);
+    if ( ! cc ) RETURN_NULL(); /* should get an exception first */
+
+    object_init_ex(return_value, Geometry_ce_ptr);
+    setRelay(return_value, cc TSRMLS_CC);
+}
+
+/**
+ * long GEOSGeometry::numInteriorRings()
+ */
+PHP_METHOD(Geometry, numInteriorRings)
+{
+    GEOSGeometry *geom;
+    long int ret;
+
+    geom = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! geom ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSGetNumInteriorRings_r(GEOS_G(handle), geom);
+    if ( ret == -1 ) RETURN_NULL(); /* should get an exception first */
+
+    RETURN_LONG(ret);
+}
+
+/**
+ * long GEOSGeometry::numPoints()
+ */
+#ifdef HAVE_GEOS_GEOM_GET_NUM_POINTS
+PHP_METHOD(Geometry, numPoints)
+{
+    GEOSGeometry *geom;
+    long int ret;
+
+    geom = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! geom ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSGeomGetNumPoints_r(GEOS_G(handle), geom);
+    if ( ret == -1 ) RETURN_NULL(); /* should get an exception first */
+
+    RETURN_LONG(ret);
+}
+#endif
+
+/**
+ * double GEOSGeometry::getX()
+ */
+#ifdef HAVE_GEOS_GEOM_GET_X
+PHP_METHOD(Geometry, getX)
+{
+    GEOSGeometry *geom;
+    int ret;
+    double x;
+
+    geom = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! geom ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSGeomGetX_r(GEOS_G(handle), geom, &x);
+    if ( ret == -1 ) RETURN_NULL(); /* should get an exception first */
+
+    RETURN_DOUBLE(x);
+}
+#endif
+
+/**
+ * double GEOSGeometry::getY()
+ */
+#ifdef HAVE_GEOS_GEOM_GET_Y
+PHP_METHOD(Geometry, getY)
+{
+    GEOSGeometry *geom;
+    int ret;
+    double y;
+
+    geom = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! geom ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSGeomGetY_r(GEOS_G(handle), geom, &y);
+    if ( ret == -1 ) RETURN_NULL(); /* should get an exception first */
+
+    RETURN_DOUBLE(y);
+}
+#endif
+
+/**
+ * GEOSGeometry GEOSGeometry::interiorRingN()
+ */
+PHP_METHOD(Geometry, interiorRingN)
+{
+    GEOSGeometry *geom;
+    const GEOSGeometry *c;
+    GEOSGeometry *cc;
+    long int num;
+
+    geom = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! geom ) RETURN_NULL(); /* should get an exception first */
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "l",
+        &num) == FAILURE) {
+        RETURN_NULL();
+    }
+
+    if ( num >= GEOSGetNumInteriorRings_r(GEOS_G(handle), geom) ) RETURN_NULL();
+    c = GEOSGetInteriorRingN_r(GEOS_G(handle), geom, num);
+    if ( ! c ) RETURN_NULL(); /* should get an exception first */
+    cc = GEOSGeom_clone_r(GEOS_G(handle), c);
+    if ( ! cc ) RETURN_NULL(); /* should get an exception first */
+
+    object_init_ex(return_value, Geometry_ce_ptr);
+    setRelay(return_value, cc TSRMLS_CC);
+}
+
+/**
+ * GEOSGeometry GEOSGeometry::exteriorRing()
+ */
+PHP_METHOD(Geometry, exteriorRing)
+{
+    GEOSGeometry *geom;
+    const GEOSGeometry *c;
+    GEOSGeometry *cc;
+
+    geom = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! geom ) RETURN_NULL(); /* should get an exception first */
+
+    c = GEOSGetExteriorRing_r(GEOS_G(handle), geom);
+    if ( ! c ) RETURN_NULL(); /* should get an exception first */
+    cc = GEOSGeom_clone_r(GEOS_G(handle), c);
+    if ( ! cc ) RETURN_NULL(); /* should get an exception first */
+
+    object_init_ex(return_value, Geometry_ce_ptr);
+    setRelay(return_value, cc TSRMLS_CC);
+}
+
+/**
+ * long GEOSGeometry::numCoordinates()
+ */
+PHP_METHOD(Geometry, numCoordinates)
+{
+    GEOSGeometry *geom;
+    long int ret;
+
+    geom = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! geom ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSGetNumCoordinates_r(GEOS_G(handle), geom);
+    if ( ret == -1 ) RETURN_NULL(); /* should get an exception first */
+
+    RETURN_LONG(ret);
+}
+
+/**
+ * long GEOSGeometry::dimension()
+ * 0:puntual 1:lineal 2:areal
+ */
+PHP_METHOD(Geometry, dimension)
+{
+    GEOSGeometry *geom;
+    long int ret;
+
+    geom = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! geom ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSGeom_getDimensions_r(GEOS_G(handle), geom);
+    if ( ret == -1 ) RETURN_NULL(); /* should get an exception first */
+
+    RETURN_LONG(ret);
+}
+
+/**
+ * long GEOSGeometry::coordinateDimension()
+ */
+#ifdef HAVE_GEOS_GEOM_GET_COORDINATE_DIMENSION
+PHP_METHOD(Geometry, coordinateDimension)
+{
+    GEOSGeometry *geom;
+    long int ret;
+
+    geom = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! geom ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSGeom_getCoordinateDimension_r(GEOS_G(handle), geom);
+    if ( ret == -1 ) RETURN_NULL(); /* should get an exception first */
+
+    RETURN_LONG(ret);
+}
+#endif
+
+/**
+ * GEOSGeometry GEOSGeometry::pointN()
+ */
+#ifdef HAVE_GEOS_GEOM_GET_POINT_N
+PHP_METHOD(Geometry, pointN)
+{
+    GEOSGeometry *geom;
+    GEOSGeometry *c;
+    long int num;
+
+    geom = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! geom ) RETURN_NULL(); /* should get an exception first */
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "l",
+        &num) == FAILURE) {
+        RETURN_NULL();
+    }
+
+    if ( num >= GEOSGeomGetNumPoints_r(GEOS_G(handle), geom) ) RETURN_NULL();
+    c = GEOSGeomGetPointN_r(GEOS_G(handle), geom, num);
+    if ( ! c ) RETURN_NULL(); /* should get an exception first */
+
+    object_init_ex(return_value, Geometry_ce_ptr);
+    setRelay(return_value, c TSRMLS_CC);
+}
+#endif
+
+/**
+ * GEOSGeometry GEOSGeometry::startPoint()
+ */
+PHP_METHOD(Geometry, startPoint)
+{
+    GEOSGeometry *geom;
+    GEOSGeometry *c;
+
+    geom = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! geom ) RETURN_NULL(); /* should get an exception first */
+
+    c = GEOSGeomGetStartPoint_r(GEOS_G(handle), geom);
+    if ( ! c ) RETURN_NULL(); /* should get an exception first */
+
+    object_init_ex(return_value, Geometry_ce_ptr);
+    setRelay(return_value, c TSRMLS_CC);
+}
+
+/**
+ * GEOSGeometry GEOSGeometry::endPoint()
+ */
+PHP_METHOD(Geometry, endPoint)
+{
+    GEOSGeometry *geom;
+    GEOSGeometry *c;
+
+    geom = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! geom ) RETURN_NULL(); /* should get an exception first */
+
+    c = GEOSGeomGetEndPoint_r(GEOS_G(handle), geom);
+    if ( ! c ) RETURN_NULL(); /* should get an exception first */
+
+    object_init_ex(return_value, Geometry_ce_ptr);
+    setRelay(return_value, c TSRMLS_CC);
+}
+
+/**
+ * double GEOSGeometry::area()
+ */
+PHP_METHOD(Geometry, area)
+{
+    GEOSGeometry *geom;
+    double area;
+    int ret;
+
+    geom = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! geom ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSArea_r(GEOS_G(handle), geom, &area);
+    if ( ! ret ) RETURN_NULL(); /* should get an exception first */
+
+    RETURN_DOUBLE(area);
+}
+
+/**
+ * double GEOSGeometry::length()
+ */
+PHP_METHOD(Geometry, length)
+{
+    GEOSGeometry *geom;
+    double length;
+    int ret;
+
+    geom = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! geom ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSLength_r(GEOS_G(handle), geom, &length);
+    if ( ! ret ) RETURN_NULL(); /* should get an exception first */
+
+    RETURN_DOUBLE(length);
+}
+
+/**
+ * double GEOSGeometry::distance(GEOSGeometry)
+ */
+PHP_METHOD(Geometry, distance)
+{
+    GEOSGeometry *this;
+    GEOSGeometry *other;
+    zval *zobj;
+    double dist;
+    int ret;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o",
+        &zobj) == FAILURE)
+    {
+        RETURN_NULL();
+    }
+
+    other = getRelay(zobj, Geometry_ce_ptr TSRMLS_CC);
+    if ( ! other ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSDistance_r(GEOS_G(handle), this, other, &dist);
+    if ( ! ret ) RETURN_NULL(); /* should get an exception first */
+
+    RETURN_DOUBLE(dist);
+}
+
+/**
+ * double GEOSGeometry::hausdorffDistance(GEOSGeometry)
+ */
+PHP_METHOD(Geometry, hausdorffDistance)
+{
+    GEOSGeometry *this;
+    GEOSGeometry *other;
+    zval *zobj;
+    double dist;
+    int ret;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o",
+        &zobj) == FAILURE)
+    {
+        RETURN_NULL();
+    }
+
+    other = getRelay(zobj, Geometry_ce_ptr TSRMLS_CC);
+    if ( ! other ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSHausdorffDistance_r(GEOS_G(handle), this, other, &dist);
+    if ( ! ret ) RETURN_NULL(); /* should get an exception first */
+
+    RETURN_DOUBLE(dist);
+}
+
+#ifdef HAVE_GEOS_SNAP
+PHP_METHOD(Geometry, snapTo)
+{
+    GEOSGeometry *this;
+    GEOSGeometry *other;
+    GEOSGeometry *ret;
+    double tolerance;
+    zval *zobj;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "od", &zobj,
+            &tolerance) == FAILURE) {
+        RETURN_NULL();
+    }
+    other = getRelay(zobj, Geometry_ce_ptr TSRMLS_CC);
+    if ( ! other ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSSnap_r(GEOS_G(handle), this, other, tolerance);
+    if ( ! ret ) RETURN_NULL(); /* should get an exception first */
+
+    /* return_value is a zval */
+    object_init_ex(return_value, Geometry_ce_ptr);
+    setRelay(return_value, ret TSRMLS_CC);
+}
+#endif
+
+#ifdef HAVE_GEOS_NODE
+PHP_METHOD(Geometry, node)
+{
+    GEOSGeometry *this;
+    GEOSGeometry *ret;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSNode_r(GEOS_G(handle), this);
+    if ( ! ret ) RETURN_NULL(); /* should get an exception first */
+
+    /* return_value is a zval */
+    object_init_ex(return_value, Geometry_ce_ptr);
+    setRelay(return_value, ret TSRMLS_CC);
+}
+#endif
+
+/*
+ * Return a transformed copy of 'object', or transform
+ * it in place and return it back when 'inPlace' is set.
+ * The SRID is kept unless 'srid' is not negative.
+ */
+static void
+filterGeometry(zval* object, CoordinateFilter filter, const void* data,
+        long srid, zend_bool inPlace, zval* return_value TSRMLS_DC)
+{
+    GEOSGeometry *this;
+    GEOSGeometry *ret;
+
+    this = (GEOSGeometry*)getRelay(object, Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    ret = transformGeometry(this, filter, data TSRMLS_CC);
+    if ( ! ret ) RETURN_NULL(); /* should get an exception first */
+
+    if ( srid >= 0 ) GEOSSetSRID_r(GEOS_G(handle), ret, srid);
+
+    if ( inPlace ) {
+        replaceRelay(object, ret TSRMLS_CC);
+        RETURN_ZVAL(object, 1, 0);
+    }
+
+    /* return_value is a zval */
+    object_init_ex(return_value, Geometry_ce_ptr);
+    setRelay(return_value, ret TSRMLS_CC);
+}
+
+/**
+ * GEOSGeometry GEOSGeometry::affine(a, b, d, e, xoff, yoff,
+ *                                   [c, f, g, h, i, zoff], [inPlace])
+ *
+ *   x' = a*x + b*y + c*z + xoff
+ *   y' = d*x + e*y + f*z + yoff
+ *   z' = g*x + h*y + i*z + zoff
+ *
+ * The 2D form leaves Z untouched.
+ * With 'inPlace' this geometry is modified and returned.
+ */
+PHP_METHOD(Geometry, affine)
+{
+    /* a, b, c, d, e, f, g, h, i, xoff, yoff, zoff */
+    double m[12] = { 1, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0 };
+    zend_bool inPlace = 0;
+    int ret;
+
+    if ( ZEND_NUM_ARGS() == 7 ) {
+        ret = zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "ddddddb",
+            &m[0], &m[1], &m[3], &m[4], &m[9], &m[10], &inPlace);
+    } else if ( ZEND_NUM_ARGS() == 6 || ZEND_NUM_ARGS() >= 12 ) {
+        ret = zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
+            "dddddd|ddddddb", &m[0], &m[1], &m[3], &m[4], &m[9], &m[10],
+            &m[2], &m[5], &m[6], &m[7], &m[8], &m[11], &inPlace);
+    } else {
+        WRONG_PARAM_COUNT;
+    }
+    if ( ret == FAILURE ) RETURN_NULL();
+
+    filterGeometry(getThis(), affineFilter, m, -1, inPlace, return_value
+        TSRMLS_CC);
+}
+
+/**
+ * GEOSGeometry GEOSGeometry::translate(dx, dy, [dz], [inPlace])
+ */
+PHP_METHOD(Geometry, translate)
+{
+    double m[12] = { 1, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0 };
+    zend_bool inPlace = 0;
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "dd|db",
+            &m[9], &m[10], &m[11], &inPlace) == FAILURE) {
+        RETURN_NULL();
+    }
+
+    filterGeometry(getThis(), affineFilter, m, -1, inPlace, return_value
+        TSRMLS_CC);
+}
+
+/**
+ * GEOSGeometry GEOSGeometry::scale(sx, sy, [sz], [inPlace])
+ *
+ * Scaling is relative to the origin.
+ */
+PHP_METHOD(Geometry, scale)
+{
+    double m[12] = { 1, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0 };
+    zend_bool inPlace = 0;
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "dd|db",
+            &m[0], &m[4], &m[8], &inPlace) == FAILURE) {
+        RETURN_NULL();
+    }
+
+    filterGeometry(getThis(), affineFilter, m, -1, inPlace, return_value
+        TSRMLS_CC);
+}
+
+/**
+ * GEOSGeometry GEOSGeometry::swapXY([inPlace])
+ */
+PHP_METHOD(Geometry, swapXY)
+{
+    zend_bool inPlace = 0;
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|b", &inPlace)
+            == FAILURE) {
+        RETURN_NULL();
+    }
+
+    filterGeometry(getThis(), swapXYFilter, NULL, -1, inPlace, return_value
+        TSRMLS_CC);
+}
+
+/*
+ * Check the SRID of a geometry to be reprojected,
+ * 0 (unknown) is accepted as well.
+ */
+static int
+checkSourceSRID(zval* object, long expected TSRMLS_DC)
+{
+    GEOSGeometry *this;
+    long srid;
+
+    this = (GEOSGeometry*)getRelay(object, Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) return FAILURE;
+    srid = GEOSGetSRID_r(GEOS_G(handle), this);
+
+    if ( srid && srid != expected ) {
+        zend_throw_exception_ex(zend_exception_get_default(TSRMLS_C), 1
+            TSRMLS_CC, "Expected a geometry with SRID %ld, got %ld",
+            expected, srid);
+        return FAILURE;
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * GEOSGeometry GEOSGeometry::toWebMercator([inPlace])
+ *
+ * Reproject from WGS84 longitude/latitude (SRID 4326) to
+ * spherical Web Mercator (SRID 3857). Latitudes are clamped
+ * to +/-85.0511287798 degrees. Z is left untouched.
+ */
+PHP_METHOD(Geometry, toWebMercator)
+{
+    zend_bool inPlace = 0;
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|b", &inPlace)
+            == FAILURE) {
+        RETURN_NULL();
+    }
+
+    if ( checkSourceSRID(getThis(), 4326 TSRMLS_CC) == FAILURE ) {
+        RETURN_NULL();
+    }
+
+    filterGeometry(getThis(), toWebMercatorFilter, NULL, 3857, inPlace,
+        return_value TSRMLS_CC);
+}
+
+/**
+ * GEOSGeometry GEOSGeometry::fromWebMercator([inPlace])
+ *
+ * Reproject from spherical Web Mercator (SRID 3857) to
+ * WGS84 longitude/latitude (SRID 4326).
+ */
+PHP_METHOD(Geometry, fromWebMercator)
+{
+    zend_bool inPlace = 0;
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|b", &inPlace)
+            == FAILURE) {
+        RETURN_NULL();
+    }
+
+    if ( checkSourceSRID(getThis(), 3857 TSRMLS_CC) == FAILURE ) {
+        RETURN_NULL();
+    }
+
+    filterGeometry(getThis(), fromWebMercatorFilter, NULL, 4326, inPlace,
+        return_value TSRMLS_CC);
+}
+
+/**
+ * string GEOSGeometry::hash([normalized])
+ *
+ * 128 bit hash of type, SRID, structure and coordinates as
+ * 32 hex digits. Geometries with the same SRID and the same
+ * coordinates, Z included, share it; equalsExact geometries
+ * differing in Z or dimension do not. With 'normalized' set
+ * (defaults to false) vertex and part order do not matter either.
+ */
+PHP_METHOD(Geometry, hash)
+{
+    GEOSGeometry *this;
+    zend_bool normalized = 0;
+    unsigned char digest[16];
+    char *ret;
+    int i;
+
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|b", &normalized)
+            == FAILURE) {
+        RETURN_NULL();
+    }
+
+    if ( hashGeometry(this, normalized, digest TSRMLS_CC) == FAILURE ) {
+        RETURN_NULL(); /* should get an exception first */
+    }
+
+    ret = (char*)emalloc(33);
+    for (i=0; i<16; ++i) {
+        ret[2 * i] = "0123456789abcdef"[digest[i] >> 4];
+        ret[2 * i + 1] = "0123456789abcdef"[digest[i] & 0x0F];
+    }
+    ret[32] = '\0';
+
+    RETURN_STRINGL(ret, 32, 0);
+}
+
+/**
+ * long GEOSGeometry::memoryUsage()
+ *
+ * Approximate number of bytes of GEOS heap held by this geometry,
+ * as accounted against geos.memory_limit.
+ */
+PHP_METHOD(Geometry, memoryUsage)
+{
+    Proxy *proxy;
+
+    if ( ! getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC) ) {
+        RETURN_NULL(); /* should get an exception first */
+    }
+    proxy = (Proxy*)zend_object_store_get_object(getThis() TSRMLS_CC);
+
+    RETURN_LONG(proxy->memory);
+}
+
+
+
+/* -- class GEOSWKTReader -------------------- */
+
+PHP_METHOD(WKTReader, __construct);
+PHP_METHOD(WKTReader, read);
+
+static zend_function_entry WKTReader_methods[] = {
+    PHP_ME(WKTReader, __construct, NULL, 0)
+    PHP_ME(WKTReader, read, NULL, 0)
+    {NULL, NULL, NULL}
+};
+
+static zend_class_entry *WKTReader_ce_ptr;
+
+static zend_object_handlers WKTReader_object_handlers;
+
+static void
+WKTReader_dtor (void *object TSRMLS_DC)
+{
+    Proxy *obj = (Proxy *)object;
+    GEOSWKTReader_destroy_r(GEOS_G(handle), (GEOSWKTReader*)obj->relay);
+
+    zend_hash_destroy(obj->std.properties);
+    FREE_HASHTABLE(obj->std.properties);
+
+    efree(obj);
+}
+
+static zend_object_value
+WKTReader_create_obj (zend_class_entry *type TSRMLS_DC)
+{
+    return Gen_create_obj(type, WKTReader_dtor, &WKTReader_object_handlers TSRMLS_CC);
+}
+
+
+PHP_METHOD(WKTReader, __construct)
+{
+    GEOSWKTReader* obj;
+    zval *object = getThis();
+
+    obj = GEOSWKTReader_create_r(GEOS_G(handle));
+    if ( ! obj ) {
+        php_error_docref(NULL TSRMLS_CC, E_ERROR,
+                "GEOSWKTReader_create() failed (didn't initGEOS?)");
+    }
+
+    setRelay(object, obj TSRMLS_CC);
+}
+
+PHP_METHOD(WKTReader, read)
+{
+    GEOSWKTReader *reader;
+    GEOSGeometry *geom;
+    char* wkt;
+    int wktlen;
+
+    reader = (GEOSWKTReader*)getRelay(getThis(), WKTReader_ce_ptr TSRMLS_CC);
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s",
+        &wkt, &wktlen) == FAILURE)
+    {
+        RETURN_NULL();
+    }
+
+    geom = GEOSWKTReader_read_r(GEOS_G(handle), reader, wkt);
+    /* we'll probably get an exception if geom is null */
+    if ( ! geom ) RETURN_NULL();
+
+    /* return_value is a zval */
+    object_init_ex(return_value, Geometry_ce_ptr);
+    setRelay(return_value, geom TSRMLS_CC);
+
+}
+
+/* -- class GEOSWKTWriter -------------------- */
+
+PHP_METHOD(WKTWriter, __construct);
+PHP_METHOD(WKTWriter, write);
+PHP_METHOD(WKTWriter, writeMany);
+PHP_METHOD(WKTWriter, writeToStream);
+
+#ifdef HAVE_GEOS_WKT_WRITER_SET_TRIM
+PHP_METHOD(WKTWriter, setTrim);
+#endif
+
+#ifdef HAVE_GEOS_WKT_WRITER_SET_ROUNDING_PRECISION
+PHP_METHOD(WKTWriter, setRoundingPrecision);
+#endif
+
+#ifdef HAVE_GEOS_WKT_WRITER_SET_OUTPUT_DIMENSION
+PHP_METHOD(WKTWriter, setOutputDimension);
+#endif
+
+#ifdef HAVE_GEOS_WKT_WRITER_GET_OUTPUT_DIMENSION
+PHP_METHOD(WKTWriter, getOutputDimension);
+#endif
+
+#ifdef HAVE_GEOS_WKT_WRITER_SET_OLD_3D
+PHP_METHOD(WKTWriter, setOld3D);
+#endif
+
+static zend_function_entry WKTWriter_methods[] = {
+    PHP_ME(WKTWriter, __construct, NULL, 0)
+    PHP_ME(WKTWriter, write, NULL, 0)
+    PHP_ME(WKTWriter, writeMany, NULL, 0)
+    PHP_ME(WKTWriter, writeToStream, NULL, 0)
+
+#   ifdef HAVE_GEOS_WKT_WRITER_SET_TRIM
+    PHP_ME(WKTWriter, setTrim, NULL, 0)
+#   endif
+
+#   ifdef HAVE_GEOS_WKT_WRITER_SET_ROUNDING_PRECISION
+    PHP_ME(WKTWriter, setRoundingPrecision, NULL, 0)
+#   endif
+
+#   ifdef HAVE_GEOS_WKT_WRITER_SET_OUTPUT_DIMENSION
+    PHP_ME(WKTWriter, setOutputDimension, NULL, 0)
+#   endif
+
+#   ifdef HAVE_GEOS_WKT_WRITER_GET_OUTPUT_DIMENSION
+    PHP_ME(WKTWriter, getOutputDimension, NULL, 0)
+#   endif
+
+#   ifdef HAVE_GEOS_WKT_WRITER_SET_OLD_3D
+    PHP_ME(WKTWriter, setOld3D, NULL, 0)
+#   endif
+
+    {NULL, NULL, NULL}
+};
+
+static zend_class_entry *WKTWriter_ce_ptr;
+
+static zend_object_handlers WKTWriter_object_handlers;
+
+static void
+WKTWriter_dtor (void *object TSRMLS_DC)
+{
+    Proxy *obj = (Proxy *)object;
+    GEOSWKTWriter_destroy_r(GEOS_G(handle), (GEOSWKTWriter*)obj->relay);
+
+    zend_hash_destroy(obj->std.properties);
+    FREE_HASHTABLE(obj->std.properties);
+
+    efree(obj);
+}
+
+static zend_object_value
+WKTWriter_create_obj (zend_class_entry *type TSRMLS_DC)
+{
+    return Gen_create_obj(type, WKTWriter_dtor, &WKTWriter_object_handlers TSRMLS_CC);
+}
+
+PHP_METHOD(WKTWriter, __construct)
+{
+    GEOSWKTWriter* obj;
+    zval *object = getThis();
+
+    obj = GEOSWKTWriter_create_r(GEOS_G(handle));
+    if ( ! obj ) {
+        php_error_docref(NULL TSRMLS_CC, E_ERROR,
+                "GEOSWKTWriter_create() failed (didn't initGEOS?)");
+    }
+
+    setRelay(object, obj TSRMLS_CC);
+}
+
+PHP_METHOD(WKTWriter, write)
+{
+    GEOSWKTWriter *writer;
+    zval *zobj;
+    GEOSGeometry *geom;
+    char* wkt;
+    char* retstr;
+
+    writer = (GEOSWKTWriter*)getRelay(getThis(), WKTWriter_ce_ptr TSRMLS_CC);
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o", &zobj)
+        == FAILURE)
+    {
+        RETURN_NULL();
+    }
+
+    geom = getRelay(zobj, Geometry_ce_ptr TSRMLS_CC);
+    if ( ! geom ) RETURN_NULL(); /* should get an exception first */
+
+    wkt = GEOSWKTWriter_write_r(GEOS_G(handle), writer, geom);
+    /* we'll probably get an exception if wkt is null */
+    if ( ! wkt ) RETURN_NULL();
+
+    retstr = estrdup(wkt);
+    GEOSFree_r(GEOS_G(handle), wkt);
+
+    RETURN_STRING(retstr, 0);
+}
+
+/**
+ * array GEOSWKTWriter::writeMany(array geoms, [framing])
+ *
+ * Write all geometries into a single string. Returns
+ * array('data' => string, 'offsets' => array) where 'offsets'
+ * holds the start of each record followed by the total length.
+ * 'framing' is one of the GEOSFRAME_* constants, defaulting
+ * to GEOSFRAME_NONE.
+ */
+PHP_METHOD(WKTWriter, writeMany)
+{
+    GEOSWKTWriter *writer;
+    zval *zarr;
+    long framing = GEOSFRAME_NONE;
+
+    writer = (GEOSWKTWriter*)getRelay(getThis(), WKTWriter_ce_ptr TSRMLS_CC);
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "a|l", &zarr,
+            &framing) == FAILURE)
+    {
+        RETURN_NULL();
+    }
+
+    writeManyRecords(writer, 0, zarr, framing, return_value TSRMLS_CC);
+}
+
+/**
+ * long GEOSWKTWriter::writeToStream(stream, GEOSGeometry|array geoms,
+ *                                   [framing])
+ *
+ * Write one or more geometries straight into a stream, using
+ * one of the GEOSFRAME_* framings (default GEOSFRAME_NONE).
+ * Returns the number of bytes written.
+ */
+PHP_METHOD(WKTWriter, writeToStream)
+{
+    GEOSWKTWriter *writer;
+    php_stream *stream;
+    zval *zstream;
+    zval *zgeoms;
+    long framing = GEOSFRAME_NONE;
+
+    writer = (GEOSWKTWriter*)getRelay(getThis(), WKTWriter_ce_ptr TSRMLS_CC);
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "rz|l", &zstream,
+            &zgeoms, &framing) == FAILURE)
+    {
+        RETURN_NULL();
+    }
+
+    php_stream_from_zval(stream, &zstream);
+
+    writeStreamRecords(writer, 0, stream, zgeoms, framing, return_value
+        TSRMLS_CC);
+}
+
+#ifdef HAVE_GEOS_WKT_WRITER_SET_TRIM
+PHP_METHOD(WKTWriter, setTrim)
+{
+    GEOSWKTWriter *writer;
+    zend_bool trimval;
+    char trim;
+
+    writer = (GEOSWKTWriter*)getRelay(getThis(), WKTWriter_ce_ptr TSRMLS_CC);
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "b", &trimval)
+        == FAILURE)
+    {
+        RETURN_NULL();
+    }
+
+    trim = trimval;
+    GEOSWKTWriter_setTrim_r(GEOS_G(handle), writer, trim);
+}
+#endif
+
+#ifdef HAVE_GEOS_WKT_WRITER_SET_ROUNDING_PRECISION
+PHP_METHOD(WKTWriter, setRoundingPrecision)
+{
+    GEOSWKTWriter *writer;
+    long int prec;
+
+    writer = (GEOSWKTWriter*)getRelay(getThis(), WKTWriter_ce_ptr TSRMLS_CC);
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "l", &prec)
+        == FAILURE)
+    {
+        RETURN_NULL();
+    }
+
+    GEOSWKTWriter_setRoundingPrecision_r(GEOS_G(handle), writer, prec);
+}
+#endif
+
+/**
+ * void GEOSWKTWriter::setOutputDimension()
+ */
+#ifdef HAVE_GEOS_WKT_WRITER_SET_OUTPUT_DIMENSION
+PHP_METHOD(WKTWriter, setOutputDimension)
+{
+    GEOSWKTWriter *writer;
+    long int dim;
+
+    writer = (GEOSWKTWriter*)getRelay(getThis(), WKTWriter_ce_ptr TSRMLS_CC);
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "l", &dim)
+        == FAILURE)
+    {
+        RETURN_NULL();
+    }
+
+    GEOSWKTWriter_setOutputDimension_r(GEOS_G(handle), writer, dim);
+}
+#endif
+
+/**
+ * long GEOSWKTWriter::getOutputDimension()
+ */
+#ifdef HAVE_GEOS_WKT_WRITER_GET_OUTPUT_DIMENSION
+PHP_METHOD(WKTWriter, getOutputDimension)
+{
+    GEOSWKTWriter *writer;
+    long int ret;
+
+    writer = (GEOSWKTWriter*)getRelay(getThis(), WKTWriter_ce_ptr TSRMLS_CC);
+
+    ret = GEOSWKTWriter_getOutputDimension_r(GEOS_G(handle), writer);
+
+    RETURN_LONG(ret);
+}
+#endif
+
+#ifdef HAVE_GEOS_WKT_WRITER_SET_OLD_3D
+PHP_METHOD(WKTWriter, setOld3D)
+{
+    GEOSWKTWriter *writer;
+    zend_bool bval;
+    int val;
+
+    writer = (GEOSWKTWriter*)getRelay(getThis(), WKTWriter_ce_ptr TSRMLS_CC);
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "b", &bval)
+        == FAILURE)
+    {
+        RETURN_NULL();
+    }
+
+    val = bval;
+    GEOSWKTWriter_setOld3D_r(GEOS_G(handle), writer, val);
+}
+#endif
+
+/* -- class GEOSWKBWriter -------------------- */
+
+PHP_METHOD(WKBWriter, __construct);
+PHP_METHOD(WKBWriter, getOutputDimension);
+PHP_METHOD(WKBWriter, setOutputDimension);
+PHP_METHOD(WKBWriter, getByteOrder);
+PHP_METHOD(WKBWriter, setByteOrder);
+PHP_METHOD(WKBWriter, setIncludeSRID);
+PHP_METHOD(WKBWriter, getIncludeSRID);
+PHP_METHOD(WKBWriter, write);
+PHP_METHOD(WKBWriter, writeHEX);
+PHP_METHOD(WKBWriter, writeMany);
+PHP_METHOD(WKBWriter, writeToStream);
+
+static zend_function_entry WKBWriter_methods[] = {
+    PHP_ME(WKBWriter, __construct, NULL, 0)
+    PHP_ME(WKBWriter, getOutputDimension, NULL, 0)
+    PHP_ME(WKBWriter, setOutputDimension, NULL, 0)
+    PHP_ME(WKBWriter, getByteOrder, NULL, 0)
+    PHP_ME(WKBWriter, setByteOrder, NULL, 0)
+    PHP_ME(WKBWriter, getIncludeSRID, NULL, 0)
+    PHP_ME(WKBWriter, setIncludeSRID, NULL, 0)
+    PHP_ME(WKBWriter, write, NULL, 0)
+    PHP_ME(WKBWriter, writeHEX, NULL, 0)
+    PHP_ME(WKBWriter, writeMany, NULL, 0)
+    PHP_ME(WKBWriter, writeToStream, NULL, 0)
+    {NULL, NULL, NULL}
+};
+
+static zend_class_entry *WKBWriter_ce_ptr;
+
+static zend_object_handlers WKBWriter_object_handlers;
+
+static void
+WKBWriter_dtor (void *object TSRMLS_DC)
+{
+    Proxy *obj = (Proxy *)object;
+    GEOSWKBWriter_destroy_r(GEOS_G(handle), (GEOSWKBWriter*)obj->relay);
+
+    zend_hash_destroy(obj->std.properties);
+    FREE_HASHTABLE(obj->std.properties);
+
+    efree(obj);
+}
+
+static zend_object_value
+WKBWriter_create_obj (zend_class_entry *type TSRMLS_DC)
+{
+    return Gen_create_obj(type, WKBWriter_dtor, &WKBWriter_object_handlers TSRMLS_CC);
+}
+
+/**
+ * GEOSWKBWriter w = new GEOSWKBWriter()
+ */
+PHP_METHOD(WKBWriter, __construct)
+{
+    GEOSWKBWriter* obj;
+    zval *object = getThis();
+
+    obj = GEOSWKBWriter_create_r(GEOS_G(handle));
+    if ( ! obj ) {
+        php_error_docref(NULL TSRMLS_CC, E_ERROR,
+                "GEOSWKBWriter_create() failed (didn't initGEOS?)");
+    }
+
+    setRelay(object, obj TSRMLS_CC);
+}
+
+/**
+ * long GEOSWKBWriter::getOutputDimension();
+ */
+PHP_METHOD(WKBWriter, getOutputDimension)
+{
+    GEOSWKBWriter *writer;
+    long int ret;
+
+    writer = (GEOSWKBWriter*)getRelay(getThis(), WKBWriter_ce_ptr TSRMLS_CC);
+
+    ret = GEOSWKBWriter_getOutputDimension_r(GEOS_G(handle), writer);
+
+    RETURN_LONG(ret);
+}
+
+/**
+ * void GEOSWKBWriter::setOutputDimension(dims);
+ */
+PHP_METHOD(WKBWriter, setOutputDimension)
+{
+    GEOSWKBWriter *writer;
+    long int dim;
+
+    writer = (GEOSWKBWriter*)getRelay(getThis(), WKBWriter_ce_ptr TSRMLS_CC);
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "l", &dim)
+        == FAILURE)
+    {
+        RETURN_NULL();
+    }
+
+    GEOSWKBWriter_setOutputDimension_r(GEOS_G(handle), writer, dim);
+
+}
+
+/**
+ * string GEOSWKBWriter::write(GEOSGeometry)
+ */
+PHP_METHOD(WKBWriter, write)
+{
+    GEOSWKBWriter *writer;
+    zval *zobj;
+    GEOSGeometry *geom;
+    const unsigned char *lazy;
+    char *ret;
+    size_t retsize;
+    char* retstr;
+
+    writer = (GEOSWKBWriter*)getRelay(getThis(), WKBWriter_ce_ptr TSRMLS_CC);
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o", &zobj)
+        == FAILURE)
+    {
+        RETURN_NULL();
+    }
+
+    lazy = getPassThroughWKB(zobj, writer, &retsize TSRMLS_CC);
+    if ( lazy ) RETURN_STRINGL((const char*)lazy, retsize, 1);
+
+    geom = getRelay(zobj, Geometry_ce_ptr TSRMLS_CC);
+    if ( ! geom ) RETURN_NULL(); /* should get an exception first */
+
+    ret = (char*)GEOSWKBWriter_write_r(GEOS_G(handle), writer, geom, &retsize);
+    /* we'll probably get an exception if ret is null */
+    if ( ! ret ) RETURN_NULL();
+
+    retstr = estrndup(ret, retsize);
+    GEOSFree_r(GEOS_G(handle), ret);
+
+    RETURN_STRINGL(retstr, retsize, 0);
+}
+
+/**
+ * string GEOSWKBWriter::writeHEX(GEOSGeometry)
+ */
+PHP_METHOD(WKBWriter, writeHEX)
+{
+    GEOSWKBWriter *writer;
+    zval *zobj;
+    GEOSGeometry *geom;
+    const unsigned char *lazy;
+    char *ret;
+    size_t retsize; /* useless... */
+    char* retstr;
+
+    writer = (GEOSWKBWriter*)getRelay(getThis(), WKBWriter_ce_ptr TSRMLS_CC);
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o", &zobj)
+        == FAILURE)
+    {
+        RETURN_NULL();
+    }
+
+    lazy = getPassThroughWKB(zobj, writer, &retsize TSRMLS_CC);
+    if ( lazy ) RETURN_STRING(encodeHex(lazy, retsize), 0);
+
+    geom = getRelay(zobj, Geometry_ce_ptr TSRMLS_CC);
+    if ( ! geom ) RETURN_NULL(); /* should get an exception first */
+
+    ret = (char*)GEOSWKBWriter_writeHEX_r(GEOS_G(handle), writer, geom, &retsize);
+    /* we'll probably get an exception if ret is null */
+    if ( ! ret ) RETURN_NULL();
+
+    retstr = estrndup(ret, retsize);
+    GEOSFree_r(GEOS_G(handle), ret);
+
+    RETURN_STRING(retstr, 0);
+}
+
+/**
+ * array GEOSWKBWriter::writeMany(array geoms, [framing])
+ *
+ * Write all geometries into a single string. Returns
+ * array('data' => string, 'offsets' => array) where 'offsets'
+ * holds the start of each record followed by the total length.
+ * 'framing' is one of the GEOSFRAME_* constants, defaulting
+ * to GEOSFRAME_NONE (WKB records are self-delimiting).
+ */
+PHP_METHOD(WKBWriter, writeMany)
+{
+    GEOSWKBWriter *writer;
+    zval *zarr;
+    long framing = GEOSFRAME_NONE;
+
+    writer = (GEOSWKBWriter*)getRelay(getThis(), WKBWriter_ce_ptr TSRMLS_CC);
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "a|l", &zarr,
+            &framing) == FAILURE)
+    {
+        RETURN_NULL();
+    }
+
+    writeManyRecords(writer, 1, zarr, framing, return_value TSRMLS_CC);
+}
+
+/**
+ * long GEOSWKBWriter::writeToStream(stream, GEOSGeometry|array geoms,
+ *                                   [framing])
+ *
+ * Write one or more geometries straight into a stream, using
+ * one of the GEOSFRAME_* framings (default GEOSFRAME_NONE).
+ * Returns the number of bytes written.
+ */
+PHP_METHOD(WKBWriter, writeToStream)
+{
+    GEOSWKBWriter *writer;
+    php_stream *stream;
+    zval *zstream;
+    zval *zgeoms;
+    long framing = GEOSFRAME_NONE;
+
+    writer = (GEOSWKBWriter*)getRelay(getThis(), WKBWriter_ce_ptr TSRMLS_CC);
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "rz|l", &zstream,
+            &zgeoms, &framing) == FAILURE)
+    {
+        RETURN_NULL();
+    }
+
+    php_stream_from_zval(stream, &zstream);
+
+    writeStreamRecords(writer, 1, stream, zgeoms, framing, return_value
+        TSRMLS_CC);
+}
+
+/**
+ * long GEOSWKBWriter::getByteOrder();
+ */
+PHP_METHOD(WKBWriter, getByteOrder)
+{
+    GEOSWKBWriter *writer;
+    long int ret;
+
+    writer = (GEOSWKBWriter*)getRelay(getThis(), WKBWriter_ce_ptr TSRMLS_CC);
+
+    ret = GEOSWKBWriter_getByteOrder_r(GEOS_G(handle), writer);
+
+    RETURN_LONG(ret);
+}
+
+/**
+ * void GEOSWKBWriter::setByteOrder(dims);
+ */
+PHP_METHOD(WKBWriter, setByteOrder)
+{
+    GEOSWKBWriter *writer;
+    long int dim;
+
+    writer = (GEOSWKBWriter*)getRelay(getThis(), WKBWriter_ce_ptr TSRMLS_CC);
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "l", &dim)
+        == FAILURE)
+    {
+        RETURN_NULL();
+    }
+
+    GEOSWKBWriter_setByteOrder_r(GEOS_G(handle), writer, dim);
+
+}
+
+/**
+ * bool GEOSWKBWriter::getIncludeSRID();
+ */
+PHP_METHOD(WKBWriter, getIncludeSRID)
+{
+    GEOSWKBWriter *writer;
+    int ret;
+    zend_bool retBool;
+
+    writer = (GEOSWKBWriter*)getRelay(getThis(), WKBWriter_ce_ptr TSRMLS_CC);
+
+    ret = GEOSWKBWriter_getIncludeSRID_r(GEOS_G(handle), writer);
+    retBool = ret;
+
+    RETURN_BOOL(retBool);
+}
+
+/**
+ * void GEOSWKBWriter::setIncludeSRID(bool);
+ */
+PHP_METHOD(WKBWriter, setIncludeSRID)
+{
+    GEOSWKBWriter *writer;
+    int inc;
+    zend_bool incVal;
+
+    writer = (GEOSWKBWriter*)getRelay(getThis(), WKBWriter_ce_ptr TSRMLS_CC);
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "b", &incVal)
+        == FAILURE)
+    {
+        RETURN_NULL();
+    }
+
+    inc = incVal;
+    GEOSWKBWriter_setIncludeSRID_r(GEOS_G(handle), writer, inc);
+}
+
+/* -- class GEOSWKBReader -------------------- */
+
+PHP_METHOD(WKBReader, __construct);
+PHP_METHOD(WKBReader, read);
+PHP_METHOD(WKBReader, readHEX);
+PHP_METHOD(WKBReader, readMany);
+PHP_METHOD(WKBReader, readManyHEX);
+PHP_METHOD(WKBReader, setLazy);
+PHP_METHOD(WKBReader, getLazy);
+
+static zend_function_entry WKBReader_methods[] = {
+    PHP_ME(WKBReader, __construct, NULL, 0)
+    PHP_ME(WKBReader, read, NULL, 0)
+    PHP_ME(WKBReader, readHEX, NULL, 0)
+    PHP_ME(WKBReader, readMany, NULL, 0)
+    PHP_ME(WKBReader, readManyHEX, NULL, 0)
+    PHP_ME(WKBReader, setLazy, NULL, 0)
+    PHP_ME(WKBReader, getLazy, NULL, 0)
+    {NULL, NULL, NULL}
+};
+
+static zend_class_entry *WKBReader_ce_ptr;
+
+static zend_object_handlers WKBReader_object_handlers;
+
+typedef struct WKBReader_t {
+    GEOSWKBReader *reader;
+    zend_bool lazy;
+} WKBReader;
+
+static void
+WKBReader_dtor (void *object TSRMLS_DC)
+{
+    Proxy *obj = (Proxy *)object;
+    WKBReader *r = (WKBReader*)obj->relay;
+
+    if ( r ) {
+        GEOSWKBReader_destroy_r(GEOS_G(handle), r->reader);
+        efree(r);
+    }
+
+    zend_hash_destroy(obj->std.properties);
+    FREE_HASHTABLE(obj->std.properties);
+
+    efree(obj);
+}
+
+static zend_object_value
+WKBReader_create_obj (zend_class_entry *type TSRMLS_DC)
+{
+    return Gen_create_obj(type, WKBReader_dtor, &WKBReader_object_handlers TSRMLS_CC);
+}
+
+
+PHP_METHOD(WKBReader, __construct)
+{
+    WKBReader* obj;
+    zval *object = getThis();
+
+    obj = (WKBReader*)ecalloc(1, sizeof(WKBReader));
+    obj->reader = GEOSWKBReader_create_r(GEOS_G(handle));
+    if ( ! obj->reader ) {
+        php_error_docref(NULL TSRMLS_CC, E_ERROR,
+                "GEOSWKBReader_create() failed (didn't initGEOS?)");
+    }
+
+    setRelay(object, obj TSRMLS_CC);
+}
+
+/*
+ * Read a (hex) WKB record into the 'ret' zval, as a lazy
+ * geometry when the reader is lazy and the record allows it.
+ * Returns FAILURE, leaving 'ret' alone, if it can't be parsed.
+ */
+static int
+readWKBRecord(WKBReader* r, const unsigned char* wkb, size_t len,
+        int hex, zval* ret TSRMLS_DC)
+{
+    GEOSGeometry *geom;
+    unsigned char *bin = NULL;
+    size_t binlen;
+    int lazy;
+
+    if ( r->lazy ) {
+        if ( hex ) {
+            bin = decodeHex(wkb, len, &binlen);
+        }
+        lazy = hex ? bin && isLazyWKB(bin, binlen) : isLazyWKB(wkb, len);
+        if ( lazy ) {
+            object_init_ex(ret, Geometry_ce_ptr);
+            lazy = setLazyRelay(ret, hex ? bin : wkb, hex ? binlen : len TSRMLS_CC);
+            if ( bin ) efree(bin);
+            return lazy;
+        }
+        if ( bin ) efree(bin);
+    }
+
+    if ( hex ) {
+        geom = GEOSWKBReader_readHEX_r(GEOS_G(handle), r->reader, wkb, len);
+    } else {
+        geom = GEOSWKBReader_read_r(GEOS_G(handle), r->reader, wkb, len);
+    }
+    if ( ! geom ) return FAILURE; /* should get an exception first */
+
+    object_init_ex(ret, Geometry_ce_ptr);
+    return setRelay(ret, geom TSRMLS_CC);
+}
+
+PHP_METHOD(WKBReader, read)
+{
+    WKBReader *reader;
+    unsigned char* wkb;
+    int wkblen;
+
+    reader = (WKBReader*)getRelay(getThis(), WKBReader_ce_ptr TSRMLS_CC);
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s",
+        &wkb, &wkblen) == FAILURE)
+    {
+        RETURN_NULL();
+    }
+
+    /* we'll probably get an exception if this fails */
+    readWKBRecord(reader, wkb, wkblen, 0, return_value TSRMLS_CC);
+}
+
+PHP_METHOD(WKBReader, readHEX)
+{
+    WKBReader *reader;
+    unsigned char* wkb;
+    int wkblen;
+
+    reader = (WKBReader*)getRelay(getThis(), WKBReader_ce_ptr TSRMLS_CC);
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s",
+        &wkb, &wkblen) == FAILURE)
+    {
+        RETURN_NULL();
+    }
+
+    /* we'll probably get an exception if this fails */
+    readWKBRecord(reader, wkb, wkblen, 1, return_value TSRMLS_CC);
+}
+
+/*
+ * Parse the record at 'wkb' and append it to the 'ret' array.
+ */
+static int
+appendWKBRecord(WKBReader* reader, const unsigned char* wkb, size_t len,
+        int hex, zval* ret TSRMLS_DC)
+{
+    zval *tmp;
+
+    MAKE_STD_ZVAL(tmp);
+    ZVAL_NULL(tmp);
+    if ( readWKBRecord(reader, wkb, len, hex, tmp TSRMLS_CC) == FAILURE ) {
+        zval_ptr_dtor(&tmp);
+        return FAILURE; /* should get an exception first */
+    }
+    add_next_index_zval(ret, tmp);
+
+    return SUCCESS;
+}
+
+/**
+ * array GEOSWKBReader::readMany(string buf, [array offsets])
+ *
+ * Parse consecutive WKB geometries out of 'buf'. Records are
+ * found by scanning their headers, or start at the given
+ * 'offsets' and extend up to the next offset (or the end of
+ * the buffer). The 'offsets' returned by GEOSWKBWriter::writeMany
+ * can be passed back as they are with GEOSFRAME_NONE only: with
+ * the other framings they point at the length prefix or include
+ * the trailing newline, which are not WKB. Use readManyHEX for
+ * GEOSFRAME_HEX.
+ */
+PHP_METHOD(WKBReader, readMany)
+{
+    WKBReader *reader;
+    unsigned char* wkb;
+    int wkblen;
+    zval *zoffsets = NULL;
+    zval **data;
+    HashTable *arr_hash;
+    HashPosition pointer;
+    long start, end;
+    size_t pos, len;
+
+    reader = (WKBReader*)getRelay(getThis(), WKBReader_ce_ptr TSRMLS_CC);
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s|a!",
+        &wkb, &wkblen, &zoffsets) == FAILURE)
+    {
+        RETURN_NULL();
+    }
+
+    array_init(return_value);
+
+    if ( ! zoffsets ) {
+        for (pos = 0; pos < (size_t)wkblen; pos += len) {
+            len = wkbRecordLength(wkb + pos, wkblen - pos, 0);
+            if ( ! len ) {
+                zend_throw_exception_ex(zend_exception_get_default(TSRMLS_C),
+                    1 TSRMLS_CC, "Malformed WKB record at offset %ld",
+                    (long)pos);
+                return;
+            }
+            if ( appendWKBRecord(reader, wkb + pos, len, 0, return_value
+                                 TSRMLS_CC) == FAILURE ) {
+                return;
+            }
+        }
+        return;
+    }
+
+    arr_hash = Z_ARRVAL_P(zoffsets);
+    zend_hash_internal_pointer_reset_ex(arr_hash, &pointer);
+    if ( zend_hash_get_current_data_ex(arr_hash, (void**) &data, &pointer)
+            != SUCCESS ) {
+        return;
+    }
+    start = getZvalAsLong(*data);
+
+    while ( start < wkblen ) {
+        zend_hash_move_forward_ex(arr_hash, &pointer);
+        if ( zend_hash_get_current_data_ex(arr_hash, (void**) &data,
+                                           &pointer) == SUCCESS ) {
+            end = getZvalAsLong(*data);
+        } else {
+            end = wkblen;
+        }
+
+        if ( start < 0 || end <= start || end > wkblen ) {
+            zend_throw_exception_ex(zend_exception_get_default(TSRMLS_C),
+                1 TSRMLS_CC, "Invalid WKB record offsets %ld to %ld",
+                start, end);
+            return;
+        }
+        if ( appendWKBRecord(reader, wkb + start, end - start, 0,
+                             return_value TSRMLS_CC) == FAILURE ) {
+            return;
+        }
+        start = end;
+    }
+}
+
+/**
+ * array GEOSWKBReader::readManyHEX(string buf)
+ *
+ * Parse newline separated hex encoded WKB geometries.
+ * Carriage returns and empty lines are ignored.
+ */
+PHP_METHOD(WKBReader, readManyHEX)
+{
+    WKBReader *reader;
+    unsigned char* wkb;
+    int wkblen;
+    int pos, end, len;
+
+    reader = (WKBReader*)getRelay(getThis(), WKBReader_ce_ptr TSRMLS_CC);
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s",
+        &wkb, &wkblen) == FAILURE)
+    {
+        RETURN_NULL();
+    }
+
+    array_init(return_value);
 
-#   ifdef HAVE_GEOS_IS_CLOSED
-    PHP_ME(Geometry, isClosed, NULL, 0)
-#   endif
+    for (pos = 0; pos < wkblen; pos = end + 1) {
+        for (end = pos; end < wkblen && wkb[end] != '\n'; ++end);
+        len = end - pos;
+        if ( len && wkb[pos + len - 1] == '\r' ) len--;
+        if ( ! len ) continue;
 
-    PHP_ME(Geometry, typeName, NULL, 0)
-    PHP_ME(Geometry, typeId, NULL, 0)
-    PHP_ME(Geometry, getSRID, NULL, 0)
-    PHP_ME(Geometry, setSRID, NULL, 0)
-    PHP_ME(Geometry, numGeometries, NULL, 0)
-    PHP_ME(Geometry, geometryN, NULL, 0)
-    PHP_ME(Geometry, numInteriorRings, NULL, 0)
+        if ( appendWKBRecord(reader, wkb + pos, len, 1, return_value
+                             TSRMLS_CC) == FAILURE ) {
+            return;
+        }
+    }
+}
 
-#   ifdef HAVE_GEOS_GEOM_GET_NUM_POINTS
-    PHP_ME(Geometry, numPoints, NULL, 0)
-#   endif
+/**
+ * void GEOSWKBReader::setLazy(bool)
+ *
+ * In lazy mode geometries keep the bytes they were read from and
+ * only parse them once an operation needs it, which is when records
+ * GEOS rejects throw and the parsed geometry starts counting
+ * against geos.memory_limit. Until they are modified,
+ * GEOSWKBWriter writes those bytes back as they are whenever its
+ * settings produce the same encoding, and type and SRID are
+ * answered from the WKB header.
+ */
+PHP_METHOD(WKBReader, setLazy)
+{
+    WKBReader *reader;
+    zend_bool lazy;
 
-#   ifdef HAVE_GEOS_GEOM_GET_X
-    PHP_ME(Geometry, getX, NULL, 0)
-#   endif
+    reader = (WKBReader*)getRelay(getThis(), WKBReader_ce_ptr TSRMLS_CC);
 
-#   ifdef HAVE_GEOS_GEOM_GET_Y
-    PHP_ME(Geometry, getY, NULL, 0)
-#   endif
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "b", &lazy)
+        == FAILURE)
+    {
+        RETURN_NULL();
+    }
 
-    PHP_ME(Geometry, interiorRingN, NULL, 0)
-    PHP_ME(Geometry, exteriorRing, NULL, 0)
-    PHP_ME(Geometry, numCoordinates, NULL, 0)
-    PHP_ME(Geometry, dimension, NULL, 0)
+    reader->lazy = lazy;
+}
 
-#   ifdef HAVE_GEOS_GEOM_GET_COORDINATE_DIMENSION
-    PHP_ME(Geometry, coordinateDimension, NULL, 0)
-#   endif
+/**
+ * bool GEOSWKBReader::getLazy()
+ */
+PHP_METHOD(WKBReader, getLazy)
+{
+    WKBReader *reader;
 
-#   ifdef HAVE_GEOS_GEOM_GET_POINT_N
-    PHP_ME(Geometry, pointN, NULL, 0)
-#   endif
+    reader = (WKBReader*)getRelay(getThis(), WKBReader_ce_ptr TSRMLS_CC);
 
-#   ifdef HAVE_GEOS_GEOM_GET_START_POINT
-    PHP_ME(Geometry, startPoint, NULL, 0)
-#   endif
+    RETURN_BOOL(reader->lazy);
+}
 
-#   ifdef HAVE_GEOS_GEOM_GET_END_POINT
-    PHP_ME(Geometry, endPoint, NULL, 0)
-#   endif
 
-    PHP_ME(Geometry, area, NULL, 0)
-    PHP_ME(Geometry, length, NULL, 0)
-    PHP_ME(Geometry, distance, NULL, 0)
-    PHP_ME(Geometry, hausdorffDistance, NULL, 0)
+/* -- class GEOSBatch -------------------- */
 
-#   if HAVE_GEOS_SNAP
-    PHP_ME(Geometry, snapTo, NULL, 0)
-#   endif
+/*
+ * Static operations over arrays of GEOSGeometry, keeping
+ * the keys of the input array in the returned one.
+ */
 
-#   ifdef HAVE_GEOS_NODE
-    PHP_ME(Geometry, node, NULL, 0)
-#   endif
+PHP_METHOD(Batch, buffer);
+PHP_METHOD(Batch, validate);
+PHP_METHOD(Batch, unique);
+PHP_METHOD(Batch, hilbertSort);
 
-#   ifdef HAVE_GEOS_DELAUNAY_TRIANGULATION
-    PHP_ME(Geometry, delaunayTriangulation, NULL, 0)
-#   endif
+#ifdef HAVE_GEOS_MAKE_VALID
+PHP_METHOD(Batch, makeValid);
+#endif
 
-#   ifdef HAVE_GEOS_VORONOI_DIAGRAM
-    PHP_ME(Geometry, voronoiDiagram, NULL, 0)
-#   endif
+static zend_function_entry Batch_methods[] = {
+    PHP_ME(Batch, buffer, NULL, ZEND_ACC_PUBLIC|ZEND_ACC_STATIC)
+    PHP_ME(Batch, validate, NULL, ZEND_ACC_PUBLIC|ZEND_ACC_STATIC)
+    PHP_ME(Batch, unique, NULL, ZEND_ACC_PUBLIC|ZEND_ACC_STATIC)
+    PHP_ME(Batch, hilbertSort, NULL, ZEND_ACC_PUBLIC|ZEND_ACC_STATIC)
 
-#   ifdef HAVE_GEOS_CLIP_BY_RECT
-    PHP_ME(Geometry, clipByRect, NULL, 0)
+#   ifdef HAVE_GEOS_MAKE_VALID
+    PHP_ME(Batch, makeValid, NULL, ZEND_ACC_PUBLIC|ZEND_ACC_STATIC)
 #   endif
 
     {NULL, NULL, NULL}
 };
 
-static zend_class_entry *Geometry_ce_ptr;
+static zend_class_entry *Batch_ce_ptr;
 
-static zend_object_handlers Geometry_object_handlers;
+/**
+ * array GEOSBatch::buffer(array geoms, dist, [<styleArray>|<GEOSBufferParams>])
+ *
+ * Buffer every geometry of the array with the same parameters,
+ * which are only set up once.
+ */
+PHP_METHOD(Batch, buffer)
+{
+    zval *zgeoms;
+    zval *style_val = NULL;
+    zval **data;
+    zval *tmp;
+    HashTable *geoms;
+    HashPosition pos;
+    GEOSGeometry *geom;
+    GEOSGeometry *ret;
+    GEOSBufferParams *params;
+    BufferStyle style;
+    int owned;
+    double dist;
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "ad|z",
+            &zgeoms, &dist, &style_val) == FAILURE) {
+        RETURN_NULL();
+    }
+
+    if ( getBufferStyle(style_val, &style, &params, &owned TSRMLS_CC)
+            == FAILURE ) {
+        RETURN_NULL();
+    }
 
-/* Geometry serializer */
+    array_init(return_value);
 
-static GEOSWKBWriter* Geometry_serializer = 0;
+    geoms = Z_ARRVAL_P(zgeoms);
+    for (zend_hash_internal_pointer_reset_ex(geoms, &pos);
+         zend_hash_get_current_data_ex(geoms, (void**)&data, &pos) == SUCCESS;
+         zend_hash_move_forward_ex(geoms, &pos))
+    {
+        geom = getGeometryElement(*data TSRMLS_CC);
+        if ( ! geom ) break;
 
-static GEOSWKBWriter* getGeometrySerializer()
-{
-    TSRMLS_FETCH();
+        ret = bufferGeometry(geom, dist, &style, params TSRMLS_CC);
+        if ( ! ret ) break; /* should get an exception first */
 
-    if ( ! Geometry_serializer ) {
-        Geometry_serializer = GEOSWKBWriter_create_r(GEOS_G(handle));
-        GEOSWKBWriter_setIncludeSRID_r(GEOS_G(handle), Geometry_serializer, 1);
-        GEOSWKBWriter_setOutputDimension_r(GEOS_G(handle), Geometry_serializer, 3);
+        MAKE_STD_ZVAL(tmp);
+        object_init_ex(tmp, Geometry_ce_ptr);
+        if ( setRelay(tmp, ret TSRMLS_CC) == FAILURE ) {
+            zval_ptr_dtor(&tmp);
+            break; /* should get an exception first */
+        }
+        addZvalWithKey(return_value, geoms, &pos, tmp);
     }
-    return Geometry_serializer;
+
+    if ( owned ) GEOSBufferParams_destroy_r(GEOS_G(handle), params);
 }
 
-static void delGeometrySerializer()
+/**
+ * array GEOSBatch::validate(array geoms, [flags])
+ *
+ * Returns the reason of invalidity of the invalid geometries
+ * only, keyed like the input. 'flags' is a combination of the
+ * GEOSVALID_* constants, when GEOS supports them.
+ */
+PHP_METHOD(Batch, validate)
 {
-    TSRMLS_FETCH();
+    zval *zgeoms;
+    zval **data;
+    HashTable *geoms;
+    HashPosition pos;
+    GEOSGeometry *geom;
+    zval *tmp;
+    char *reason;
+    long flags = 0;
+    int ret;
 
-    if ( Geometry_serializer ) {
-        GEOSWKBWriter_destroy_r(GEOS_G(handle), Geometry_serializer);
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "a|l",
+            &zgeoms, &flags) == FAILURE) {
+        RETURN_NULL();
     }
-}
 
-/* Geometry deserializer */
+    array_init(return_value);
 
-static GEOSWKBReader* Geometry_deserializer = 0;
+    geoms = Z_ARRVAL_P(zgeoms);
+    for (zend_hash_internal_pointer_reset_ex(geoms, &pos);
+         zend_hash_get_current_data_ex(geoms, (void**)&data, &pos) == SUCCESS;
+         zend_hash_move_forward_ex(geoms, &pos))
+    {
+        geom = getGeometryElement(*data TSRMLS_CC);
+        if ( ! geom ) break;
 
-static GEOSWKBReader* getGeometryDeserializer()
-{
-    TSRMLS_FETCH();
+        reason = NULL;
+#       ifdef HAVE_GEOS_IS_VALID_DETAIL
+        /* no location wanted, saves building a point per failure */
+        ret = GEOSisValidDetail_r(GEOS_G(handle), geom, flags, &reason, NULL);
+#       else
+        ret = GEOSisValid_r(GEOS_G(handle), geom);
+        if ( ! ret ) reason = GEOSisValidReason_r(GEOS_G(handle), geom);
+#       endif
+        if ( ret == 2 ) break; /* should get an exception first */
+        if ( ret ) continue;
 
-    if ( ! Geometry_deserializer ) {
-        Geometry_deserializer = GEOSWKBReader_create_r(GEOS_G(handle));
+        MAKE_STD_ZVAL(tmp);
+        if ( reason ) {
+            ZVAL_STRING(tmp, reason, 1);
+            GEOSFree_r(GEOS_G(handle), reason);
+        } else {
+            ZVAL_EMPTY_STRING(tmp);
+        }
+        addZvalWithKey(return_value, geoms, &pos, tmp);
     }
-    return Geometry_deserializer;
 }
 
-static void delGeometryDeserializer()
+/**
+ * array GEOSBatch::unique(array geoms)
+ *
+ * Drop geometries identical to an earlier one with the same
+ * SRID, keeping the keys of the first occurrences. Identical
+ * means equalsExact with no tolerance and the same Z values, as
+ * for hash(); geometries differing in Z only are all kept.
+ * Geometries are bucketed by hash(), so this is a single pass.
+ */
+PHP_METHOD(Batch, unique)
 {
-    TSRMLS_FETCH();
-
-    if ( Geometry_deserializer ) {
-        GEOSWKBReader_destroy_r(GEOS_G(handle), Geometry_deserializer);
+    zval *zgeoms;
+    zval **data;
+    HashTable *geoms;
+    HashTable seen;
+    HashPosition pos;
+    GEOSGeometry *geom;
+    GEOSGeometry **kept;
+    long *next; /* chains of kept geometries sharing a hash */
+    long *head;
+    long nkept = 0, i;
+    unsigned char digest[16];
+    int dup;
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "a",
+            &zgeoms) == FAILURE) {
+        RETURN_NULL();
     }
-}
 
-/* Serializer function for GEOSGeometry */
+    geoms = Z_ARRVAL_P(zgeoms);
+    i = zend_hash_num_elements(geoms);
+    kept = (GEOSGeometry**)safe_emalloc(i ? i : 1, sizeof(GEOSGeometry*), 0);
+    next = (long*)safe_emalloc(i ? i : 1, sizeof(long), 0);
+    zend_hash_init(&seen, i, NULL, NULL, 0);
 
-static int
-Geometry_serialize(zval *object, unsigned char **buffer, zend_uint *buf_len,
-        zend_serialize_data *data TSRMLS_DC)
-{
-    GEOSWKBWriter *serializer;
-    GEOSGeometry *geom;
-    char* ret;
-    size_t retsize;
+    array_init(return_value);
 
+    for (zend_hash_internal_pointer_reset_ex(geoms, &pos);
+         zend_hash_get_current_data_ex(geoms, (void**)&data, &pos) == SUCCESS;
+         zend_hash_move_forward_ex(geoms, &pos))
+    {
+        geom = getGeometryElement(*data TSRMLS_CC);
+        if ( ! geom ) break;
+        if ( hashGeometry(geom, 0, digest TSRMLS_CC) == FAILURE ) break;
+
+        dup = 0;
+        if ( zend_hash_find(&seen, (char*)digest, sizeof(digest),
+                            (void**)&head) == SUCCESS ) {
+            for (i=*head; i>=0 && !dup; i=next[i]) {
+                if ( GEOSGetSRID_r(GEOS_G(handle), kept[i])
+                        != GEOSGetSRID_r(GEOS_G(handle), geom) ) continue;
+                dup = equalGeometries(kept[i], geom TSRMLS_CC);
+            }
+            if ( dup == 2 ) break; /* should get an exception first */
+            if ( dup ) continue;
+            next[nkept] = *head;
+            *head = nkept;
+        } else {
+            next[nkept] = -1;
+            zend_hash_add(&seen, (char*)digest, sizeof(digest), &nkept,
+                sizeof(long), NULL);
+        }
+        kept[nkept++] = geom;
 
-    serializer = getGeometrySerializer();
-    geom = (GEOSGeometry*)getRelay(object, Geometry_ce_ptr);
+        addElementWithKey(return_value, geoms, &pos, *data);
+    }
 
-    /* NOTE: we might be fine using binary here */
-    ret = (char*)GEOSWKBWriter_writeHEX_r(GEOS_G(handle), serializer, geom, &retsize);
-    /* we'll probably get an exception if ret is null */
-    if ( ! ret ) return FAILURE;
+    zend_hash_destroy(&seen);
+    efree(kept);
+    efree(next);
+}
 
-    *buffer = (unsigned char*)estrndup(ret, retsize);
-    GEOSFree_r(GEOS_G(handle), ret);
+/* Hilbert curve cells per axis, as a power of two */
+#define GEOSHILBERT_ORDER 16
 
-    *buf_len = retsize;
+typedef struct HilbertItem_t {
+    int empty; /* sorted after all others, every index is a valid one */
+    uint32_t index;
+    long position; /* in the input, to keep the sort stable */
+    HashPosition pos;
+} HilbertItem;
 
-    return SUCCESS;
+/* Distance along the Hilbert curve of cell (x, y) */
+static uint32_t
+hilbertIndex(uint32_t x, uint32_t y)
+{
+    const uint32_t n = (uint32_t)1 << GEOSHILBERT_ORDER;
+    uint32_t rx, ry, s, t, d = 0;
+
+    for (s=n/2; s>0; s/=2) {
+        rx = (x & s) > 0;
+        ry = (y & s) > 0;
+        d += s * s * ((3 * rx) ^ ry);
+
+        /* rotate the quadrant so the curve stays continuous */
+        if ( ! ry ) {
+            if ( rx ) {
+                x = n - 1 - x;
+                y = n - 1 - y;
+            }
+            t = x;
+            x = y;
+            y = t;
+        }
+    }
+
+    return d;
 }
 
-static int
-Geometry_deserialize(zval **object, zend_class_entry *ce, const unsigned char *buf,
-        zend_uint buf_len, zend_unserialize_data *data TSRMLS_DC)
+/* Cell along one axis of a coordinate within [min, max] */
+static uint32_t
+hilbertCell(double v, double min, double max)
 {
-    GEOSWKBReader* deserializer;
-    GEOSGeometry* geom;
-
-    deserializer = getGeometryDeserializer();
-    geom = GEOSWKBReader_readHEX_r(GEOS_G(handle), deserializer, buf, buf_len);
+    const double last = ((uint32_t)1 << GEOSHILBERT_ORDER) - 1;
+    double cell;
+
+    if ( ! (max > min) ) return 0;
+    cell = (v - min) / (max - min) * last;
+    if ( ! (cell > 0) ) return 0;
+    if ( cell > last ) return (uint32_t)last;
+    return (uint32_t)(cell + 0.5);
+}
 
-    /* TODO: check zend_class_entry being what we expect! */
-    if ( ce != Geometry_ce_ptr ) {
-        php_error_docref(NULL TSRMLS_CC, E_ERROR,
-                "Geometry_deserialize called with unexpected zend_class_entry");
-        return FAILURE;
-    }
-    object_init_ex(*object, ce);
-    setRelay(*object, geom);
+static int
+HilbertItem_cmp(const void* a, const void* b)
+{
+    const HilbertItem *ia = (const HilbertItem*)a;
+    const HilbertItem *ib = (const HilbertItem*)b;
 
-    return SUCCESS;
+    if ( ia->empty != ib->empty ) return ia->empty ? 1 : -1;
+    if ( ia->index != ib->index ) return ia->index < ib->index ? -1 : 1;
+    return ia->position < ib->position ? -1 : ia->position > ib->position;
 }
 
-/*
- * Push components of the given geometry
- * to the given array zval.
- * Components geometries are cloned.
- * NOTE: collection components are not descended into
+/**
+ * array GEOSBatch::hilbertSort(array geoms, [extent])
+ *
+ * Returns the keys of the array ordered along a Hilbert curve
+ * through the centres of the geometry envelopes, so that
+ * geometries close in the result are close in space too.
+ * Building indexes or files in this order improves locality.
+ *
+ *  'extent'
+ *       Type: array
+ *       minx, miny, maxx and maxy of the area the curve covers,
+ *       either keyed by these names or in this order. Defaults
+ *       to the extent of the envelope centres. Centres outside
+ *       the extent are clamped to it.
+ *
+ * Empty geometries come last, in their input order.
  */
-static void
-dumpGeometry(GEOSGeometry* g, zval* array)
+PHP_METHOD(Batch, hilbertSort)
 {
-    TSRMLS_FETCH();
-    int ngeoms, i;
+    zval *zgeoms;
+    zval *zextent = NULL;
+    zval **data;
+    HashTable *geoms;
+    HashPosition pos;
+    GEOSGeometry *geom;
+    HilbertItem *items;
+    double *centres;
+    double extent[4] = { 0, 0, 0, 0 };
+    double minx, miny, maxx, maxy;
+    char *key;
+    uint keylen;
+    ulong index;
+    long n = 0, i;
+    int failed = 0, seen = 0;
 
-    /*
-    MAKE_STD_ZVAL(array);
-    array_init(array);
-    */
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "a|a!",
+            &zgeoms, &zextent) == FAILURE) {
+        RETURN_NULL();
+    }
 
-    ngeoms = GEOSGetNumGeometries_r(GEOS_G(handle), g);
-    for (i=0; i<ngeoms; ++i)
+    if ( zextent && getExtentArray(Z_ARRVAL_P(zextent), extent TSRMLS_CC)
+            == FAILURE ) {
+        RETURN_NULL(); /* should get an exception first */
+    }
+
+    geoms = Z_ARRVAL_P(zgeoms);
+    i = zend_hash_num_elements(geoms);
+    items = (HilbertItem*)safe_emalloc(i + 1, sizeof(HilbertItem), 0);
+    centres = (double*)safe_emalloc(i + 1, 2 * sizeof(double), 0);
+
+    for (zend_hash_internal_pointer_reset_ex(geoms, &pos);
+         zend_hash_get_current_data_ex(geoms, (void**)&data, &pos) == SUCCESS;
+         zend_hash_move_forward_ex(geoms, &pos))
     {
-        zval *tmp;
-        GEOSGeometry* cc;
-        const GEOSGeometry* c = GEOSGetGeometryN_r(GEOS_G(handle), g, i);
-        if ( ! c ) continue; /* should get an exception */
-        /* we _need_ to clone as this one is owned by 'g' */
-        cc = GEOSGeom_clone_r(GEOS_G(handle), c);
-        if ( ! cc ) continue; /* should get an exception */
+        geom = getGeometryElement(*data TSRMLS_CC);
+        if ( ! geom ) {
+            failed = 1;
+            break; /* should get an exception first */
+        }
 
-        MAKE_STD_ZVAL(tmp);
-        object_init_ex(tmp, Geometry_ce_ptr);
-        setRelay(tmp, cc);
-        add_next_index_zval(array, tmp);
+        items[n].position = n;
+        items[n].pos = pos;
+        items[n].empty = ! getGeometryExtent(geom, &minx, &miny, &maxx, &maxy
+            TSRMLS_CC);
+        items[n].index = 0;
+        if ( ! items[n].empty ) {
+            centres[2 * n] = (minx + maxx) / 2;
+            centres[2 * n + 1] = (miny + maxy) / 2;
+            if ( ! zextent ) {
+                if ( ! seen || centres[2 * n] < extent[0] ) {
+                    extent[0] = centres[2 * n];
+                }
+                if ( ! seen || centres[2 * n + 1] < extent[1] ) {
+                    extent[1] = centres[2 * n + 1];
+                }
+                if ( ! seen || centres[2 * n] > extent[2] ) {
+                    extent[2] = centres[2 * n];
+                }
+                if ( ! seen || centres[2 * n + 1] > extent[3] ) {
+                    extent[3] = centres[2 * n + 1];
+                }
+                seen = 1;
+            }
+        }
+        ++n;
     }
-}
 
+    if ( failed ) {
+        efree(items);
+        efree(centres);
+        RETURN_NULL();
+    }
 
-static void
-Geometry_dtor (void *object TSRMLS_DC)
-{
-    Proxy *obj = (Proxy *)object;
-    GEOSGeom_destroy_r(GEOS_G(handle), (GEOSGeometry*)obj->relay);
+    for (i=0; i<n; ++i) {
+        if ( items[i].empty ) continue;
+        items[i].index = hilbertIndex(
+            hilbertCell(centres[2 * i], extent[0], extent[2]),
+            hilbertCell(centres[2 * i + 1], extent[1], extent[3]));
+    }
+    qsort(items, n, sizeof(HilbertItem), HilbertItem_cmp);
 
-    zend_hash_destroy(obj->std.properties);
-    FREE_HASHTABLE(obj->std.properties);
+    array_init(return_value);
+    for (i=0; i<n; ++i) {
+        if ( zend_hash_get_current_key_ex(geoms, &key, &keylen, &index, 0,
+                &items[i].pos) == HASH_KEY_IS_STRING ) {
+            add_next_index_stringl(return_value, key, keylen - 1, 1);
+        } else {
+            add_next_index_long(return_value, index);
+        }
+    }
 
-    efree(obj);
+    efree(items);
+    efree(centres);
 }
 
-static zend_object_value
-Geometry_create_obj (zend_class_entry *type TSRMLS_DC)
+/**
+ * array GEOSBatch::makeValid(array geoms)
+ *
+ * Valid geometries are passed through as they are, only
+ * invalid ones are repaired.
+ */
+#ifdef HAVE_GEOS_MAKE_VALID
+PHP_METHOD(Batch, makeValid)
 {
-    return Gen_create_obj(type, Geometry_dtor, &Geometry_object_handlers);
+    zval *zgeoms;
+    zval **data;
+    zval *tmp;
+    HashTable *geoms;
+    HashPosition pos;
+    GEOSGeometry *geom;
+    GEOSGeometry *ret;
+    int valid;
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "a",
+            &zgeoms) == FAILURE) {
+        RETURN_NULL();
+    }
+
+    array_init(return_value);
+
+    geoms = Z_ARRVAL_P(zgeoms);
+    for (zend_hash_internal_pointer_reset_ex(geoms, &pos);
+         zend_hash_get_current_data_ex(geoms, (void**)&data, &pos) == SUCCESS;
+         zend_hash_move_forward_ex(geoms, &pos))
+    {
+        geom = getGeometryElement(*data TSRMLS_CC);
+        if ( ! geom ) break;
+
+        valid = GEOSisValid_r(GEOS_G(handle), geom);
+        if ( valid == 2 ) break; /* should get an exception first */
+
+        if ( valid ) {
+            addElementWithKey(return_value, geoms, &pos, *data);
+            continue;
+        }
+
+        ret = GEOSMakeValid_r(GEOS_G(handle), geom);
+        if ( ! ret ) break; /* should get an exception first */
+
+        MAKE_STD_ZVAL(tmp);
+        object_init_ex(tmp, Geometry_ce_ptr);
+        if ( setRelay(tmp, ret TSRMLS_CC) == FAILURE ) {
+            zval_ptr_dtor(&tmp);
+            break; /* should get an exception first */
+        }
+        addZvalWithKey(return_value, geoms, &pos, tmp);
+    }
 }
+#endif
 
+/* -- class GEOSCoverage -------------------- */
 
-PHP_METHOD(Geometry, __construct)
-{
-    php_error_docref(NULL TSRMLS_CC, E_ERROR,
-            "GEOSGeometry can't be constructed using new, check WKTReader");
+/*
+ * Static operations over polygonal coverages: arrays of
+ * GEOSGeometry which don't overlap and share their edges
+ * exactly, like administrative boundaries.
+ */
 
-}
+PHP_METHOD(Coverage, union);
 
-PHP_METHOD(Geometry, __toString)
-{
-    GEOSGeometry *geom;
-    GEOSWKTWriter *writer;
-    char *wkt;
-    char *ret;
+#ifdef HAVE_GEOS_COVERAGE_SIMPLIFY_VW
+PHP_METHOD(Coverage, simplify);
+#endif
 
-    geom = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
-    writer = GEOSWKTWriter_create_r(GEOS_G(handle));
-    /* NOTE: if we get an exception before reaching
-     *       GEOSWKTWriter_destory below we'll be leaking memory.
-     *       One fix could be storing the object in a refcounted
-     *       zval.
-     */
-#   ifdef HAVE_GEOS_WKT_WRITER_SET_TRIM
-    GEOSWKTWriter_setTrim_r(GEOS_G(handle), writer, 1);
-#   endif
+#ifdef HAVE_GEOS_COVERAGE_IS_VALID
+PHP_METHOD(Coverage, isValid);
+PHP_METHOD(Coverage, validate);
+#endif
 
-    wkt = GEOSWKTWriter_write_r(GEOS_G(handle), writer, geom);
-    /* we'll probably get an exception if wkt is null */
-    if ( ! wkt ) RETURN_NULL();
+static zend_function_entry Coverage_methods[] = {
+    PHP_ME(Coverage, union, NULL, ZEND_ACC_PUBLIC|ZEND_ACC_STATIC)
 
-    GEOSWKTWriter_destroy_r(GEOS_G(handle), writer);
+#   ifdef HAVE_GEOS_COVERAGE_SIMPLIFY_VW
+    PHP_ME(Coverage, simplify, NULL, ZEND_ACC_PUBLIC|ZEND_ACC_STATIC)
+#   endif
 
+#   ifdef HAVE_GEOS_COVERAGE_IS_VALID
+    PHP_ME(Coverage, isValid, NULL, ZEND_ACC_PUBLIC|ZEND_ACC_STATIC)
+    PHP_ME(Coverage, validate, NULL, ZEND_ACC_PUBLIC|ZEND_ACC_STATIC)
+#   endif
 
-    ret = estrdup(wkt);
-    GEOSFree_r(GEOS_G(handle), wkt);
+    {NULL, NULL, NULL}
+};
 
-    RETURN_STRING(ret, 0);
-}
+static zend_class_entry *Coverage_ce_ptr;
 
-PHP_METHOD(Geometry, project)
+/*
+ * Collect copies of the geometries of an array, in order, with
+ * the SRID of the first one. NULL after an exception otherwise.
+ */
+static GEOSGeometry*
+createCoverage(HashTable* geoms TSRMLS_DC)
 {
-    GEOSGeometry *this;
-    GEOSGeometry *other;
-    zval *zobj;
-    zend_bool normalized = 0;
-    double ret;
+    GEOSGeometry **parts;
+    GEOSGeometry *geom;
+    GEOSGeometry *ret = NULL;
+    HashPosition pos;
+    zval **data;
+    int n = 0, srid = 0, failed = 0;
 
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    parts = (GEOSGeometry**)safe_emalloc(zend_hash_num_elements(geoms) + 1,
+        sizeof(GEOSGeometry*), 0);
 
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o|b", &zobj,
-            &normalized) == FAILURE) {
-        RETURN_NULL();
+    for (zend_hash_internal_pointer_reset_ex(geoms, &pos);
+         zend_hash_get_current_data_ex(geoms, (void**)&data, &pos) == SUCCESS;
+         zend_hash_move_forward_ex(geoms, &pos))
+    {
+        geom = getGeometryElement(*data TSRMLS_CC);
+        if ( geom ) geom = GEOSGeom_clone_r(GEOS_G(handle), geom);
+        if ( ! geom ) {
+            failed = 1;
+            break; /* should get an exception first */
+        }
+        if ( ! n ) srid = GEOSGetSRID_r(GEOS_G(handle), geom);
+        parts[n++] = geom;
     }
-    other = getRelay(zobj, Geometry_ce_ptr);
 
-    if ( normalized ) {
-        ret = GEOSProjectNormalized_r(GEOS_G(handle), this, other);
+    if ( ! failed ) {
+        /* on success the collection takes ownership of the parts */
+        ret = GEOSGeom_createCollection_r(GEOS_G(handle),
+            GEOS_GEOMETRYCOLLECTION, parts, n);
+    }
+    if ( ret ) {
+        GEOSSetSRID_r(GEOS_G(handle), ret, srid);
     } else {
-        ret = GEOSProject_r(GEOS_G(handle), this, other);
+        while ( n-- ) GEOSGeom_destroy_r(GEOS_G(handle), parts[n]);
     }
-    if ( ret < 0 ) RETURN_NULL(); /* should get an exception first */
+    efree(parts);
 
-    RETURN_DOUBLE(ret);
+    return ret;
 }
 
-PHP_METHOD(Geometry, interpolate)
+/**
+ * GEOSGeometry GEOSCoverage::union(array geoms)
+ *
+ * Dissolve the coverage by removing the shared edges, which
+ * is much faster than a full overlay. The result is undefined
+ * if the geometries do not form a valid coverage. With GEOS
+ * versions lacking coverage union this is a plain unary union.
+ */
+PHP_METHOD(Coverage, union)
 {
-    GEOSGeometry *this;
-    double dist;
+    zval *zgeoms;
+    GEOSGeometry *coll;
     GEOSGeometry *ret;
-    zend_bool normalized = 0;
 
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
-
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "d|b",
-            &dist, &normalized) == FAILURE) {
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "a", &zgeoms)
+            == FAILURE) {
         RETURN_NULL();
     }
 
-    if ( normalized ) {
-        ret = GEOSInterpolateNormalized_r(GEOS_G(handle), this, dist);
-    } else {
-        ret = GEOSInterpolate_r(GEOS_G(handle), this, dist);
+    coll = createCoverage(Z_ARRVAL_P(zgeoms) TSRMLS_CC);
+    if ( ! coll ) RETURN_NULL(); /* should get an exception first */
+
+#   if defined(HAVE_GEOS_COVERAGE_UNION)
+    ret = GEOSCoverageUnion_r(GEOS_G(handle), coll);
+#   elif defined(HAVE_GEOS_UNARY_UNION)
+    ret = GEOSUnaryUnion_r(GEOS_G(handle), coll);
+#   else
+    ret = GEOSUnionCascaded_r(GEOS_G(handle), coll);
+#   endif
+    if ( ret ) {
+        GEOSSetSRID_r(GEOS_G(handle), ret,
+            GEOSGetSRID_r(GEOS_G(handle), coll));
     }
+    GEOSGeom_destroy_r(GEOS_G(handle), coll);
     if ( ! ret ) RETURN_NULL(); /* should get an exception first */
 
     /* return_value is a zval */
     object_init_ex(return_value, Geometry_ce_ptr);
-    setRelay(return_value, ret);
+    setRelay(return_value, ret TSRMLS_CC);
 }
 
 /**
- * GEOSGeometry::buffer(dist, [<styleArray>])
+ * array GEOSCoverage::simplify(array geoms, tolerance, [preserveBoundary])
  *
- * styleArray keys supported:
- *  'quad_segs'
- *       Type: int
- *       Number of segments used to approximate
- *       a quarter circle (defaults to 8).
- *  'endcap'
- *       Type: long
- *       Endcap style (defaults to GEOSBUF_CAP_ROUND)
- *  'join'
- *       Type: long
- *       Join style (defaults to GEOSBUF_JOIN_ROUND)
- *  'mitre_limit'
- *       Type: double
- *       mitre ratio limit (only affects joins with GEOSBUF_JOIN_MITRE style)
- *       'miter_limit' is also accepted as a synonym for 'mitre_limit'.
- *  'single_sided'
+ * Simplify the coverage with Visvalingam-Whyatt, simplifying
+ * each shared edge once so that the geometries still share
+ * their edges afterwards. Keys of the input are kept.
+ *
+ *  'preserveBoundary'
  *       Type: bool
- *       If true buffer lines only on one side, so that the input line
- *       will be a portion of the boundary of the returned polygon.
- *       Only applies to lineal input. Defaults to false.
+ *       if true the outer boundary of the coverage is
+ *       left untouched, defaults to false.
  */
-PHP_METHOD(Geometry, buffer)
+#ifdef HAVE_GEOS_COVERAGE_SIMPLIFY_VW
+PHP_METHOD(Coverage, simplify)
 {
-    GEOSGeometry *this;
-    double dist;
-    GEOSGeometry *ret;
-    GEOSBufferParams *params;
-    static const double default_mitreLimit = 5.0;
-    static const int default_endCapStyle = GEOSBUF_CAP_ROUND;
-    static const int default_joinStyle = GEOSBUF_JOIN_ROUND;
-    static const int default_quadSegs = 8;
-    long int quadSegs = default_quadSegs;
-    long int endCapStyle = default_endCapStyle;
-    long int joinStyle = default_joinStyle;
-    double mitreLimit = default_mitreLimit;
-    long singleSided = 0;
-    zval *style_val = NULL;
+    zval *zgeoms;
+    zval *tmp;
+    HashTable *geoms;
+    HashPosition pos;
+    GEOSGeometry *coll;
+    GEOSGeometry *simplified;
+    GEOSGeometry *geom;
     zval **data;
-    HashTable *style;
-    char *key;
-    ulong index;
-
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    double tolerance;
+    zend_bool preserve = 0;
+    int srid, i = 0;
 
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "d|a",
-            &dist, &style_val) == FAILURE) {
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "ad|b",
+            &zgeoms, &tolerance, &preserve) == FAILURE) {
         RETURN_NULL();
     }
 
-    params = GEOSBufferParams_create_r(GEOS_G(handle));
+    geoms = Z_ARRVAL_P(zgeoms);
+    coll = createCoverage(geoms TSRMLS_CC);
+    if ( ! coll ) RETURN_NULL(); /* should get an exception first */
+
+    srid = GEOSGetSRID_r(GEOS_G(handle), coll);
+    simplified = GEOSCoverageSimplifyVW_r(GEOS_G(handle), coll, tolerance,
+        preserve ? 1 : 0);
+    GEOSGeom_destroy_r(GEOS_G(handle), coll);
+    if ( ! simplified ) RETURN_NULL(); /* should get an exception first */
 
-    if ( style_val )
+    array_init(return_value);
+
+    /* one component per input geometry, in order */
+    for (zend_hash_internal_pointer_reset_ex(geoms, &pos);
+         zend_hash_get_current_data_ex(geoms, (void**)&data, &pos) == SUCCESS;
+         zend_hash_move_forward_ex(geoms, &pos), ++i)
     {
-        style = HASH_OF(style_val);
-        while(zend_hash_get_current_key(style, &key, &index, 0)
-              == HASH_KEY_IS_STRING)
-        {
-            if(!strcmp(key, "quad_segs"))
-            {
-                zend_hash_get_current_data(style, (void**)&data);
-                quadSegs = getZvalAsLong(*data);
-                GEOSBufferParams_setQuadrantSegments_r(GEOS_G(handle), params, quadSegs);
-            }
-            else if(!strcmp(key, "endcap"))
-            {
-                zend_hash_get_current_data(style, (void**)&data);
-                endCapStyle = getZvalAsLong(*data);
-                GEOSBufferParams_setEndCapStyle_r(GEOS_G(handle), params, endCapStyle);
-            }
-            else if(!strcmp(key, "join"))
-            {
-                zend_hash_get_current_data(style, (void**)&data);
-                joinStyle = getZvalAsLong(*data);
-                GEOSBufferParams_setJoinStyle_r(GEOS_G(handle), params, joinStyle);
-            }
-            else if(!strcmp(key, "mitre_limit"))
-            {
-                zend_hash_get_current_data(style, (void**)&data);
-                mitreLimit = getZvalAsDouble(*data);
-                GEOSBufferParams_setMitreLimit_r(GEOS_G(handle), params, mitreLimit);
-            }
-            else if(!strcmp(key, "single_sided"))
-            {
-                zend_hash_get_current_data(style, (void**)&data);
-                singleSided = getZvalAsLong(*data);
-                GEOSBufferParams_setSingleSided_r(GEOS_G(handle), params, singleSided);
-            }
+        geom = GEOSGeom_clone_r(GEOS_G(handle),
+            GEOSGetGeometryN_r(GEOS_G(handle), simplified, i));
+        if ( ! geom ) break; /* should get an exception first */
+        GEOSSetSRID_r(GEOS_G(handle), geom, srid);
 
-            zend_hash_move_forward(style);
+        MAKE_STD_ZVAL(tmp);
+        object_init_ex(tmp, Geometry_ce_ptr);
+        if ( setRelay(tmp, geom TSRMLS_CC) == FAILURE ) {
+            zval_ptr_dtor(&tmp);
+            break; /* should get an exception first */
         }
+        addZvalWithKey(return_value, geoms, &pos, tmp);
     }
 
-    ret = GEOSBufferWithParams_r(GEOS_G(handle), this, params, dist);
-    GEOSBufferParams_destroy_r(GEOS_G(handle), params);
-    if ( ! ret ) RETURN_NULL(); /* should get an exception first */
+    GEOSGeom_destroy_r(GEOS_G(handle), simplified);
+}
+#endif
 
-    /* return_value is a zval */
-    object_init_ex(return_value, Geometry_ce_ptr);
-    setRelay(return_value, ret);
+#ifdef HAVE_GEOS_COVERAGE_IS_VALID
+
+/*
+ * Check a coverage, with gaps narrower than gapWidth counting
+ * as invalid. Return 1 if valid, 0 if not and 2 on exception.
+ * Unless NULL, invalid gets a collection with, for each input,
+ * the edges making it invalid.
+ */
+static int
+checkCoverage(HashTable* geoms, double gapWidth, GEOSGeometry** invalid
+        TSRMLS_DC)
+{
+    GEOSGeometry *coll;
+    int ret;
+
+    coll = createCoverage(geoms TSRMLS_CC);
+    if ( ! coll ) return 2; /* should get an exception first */
+
+    ret = GEOSCoverageIsValid_r(GEOS_G(handle), coll, gapWidth, invalid);
+    GEOSGeom_destroy_r(GEOS_G(handle), coll);
+
+    return ret;
 }
 
 /**
- * GEOSGeometry::offsetCurve(dist, [<styleArray>])
+ * bool GEOSCoverage::isValid(array geoms, [gapWidth])
  *
- * styleArray keys supported:
- *  'quad_segs'
- *       Type: int
- *       Number of segments used to approximate
- *       a quarter circle (defaults to 8).
- *  'join'
- *       Type: long
- *       Join style (defaults to GEOSBUF_JOIN_ROUND)
- *  'mitre_limit'
- *       Type: double
- *       mitre ratio limit (only affects joins with GEOSBUF_JOIN_MITRE style)
- *       'miter_limit' is also accepted as a synonym for 'mitre_limit'.
+ * False if the geometries overlap, don't share their edges
+ * exactly or leave gaps narrower than gapWidth.
  */
-#ifdef HAVE_GEOS_OFFSET_CURVE
-PHP_METHOD(Geometry, offsetCurve)
+PHP_METHOD(Coverage, isValid)
 {
-    GEOSGeometry *this;
-    double dist;
-    GEOSGeometry *ret;
-    static const double default_mitreLimit = 5.0;
-    static const int default_joinStyle = GEOSBUF_JOIN_ROUND;
-    static const int default_quadSegs = 8;
-    long int quadSegs = default_quadSegs;
-    long int joinStyle = default_joinStyle;
-    double mitreLimit = default_mitreLimit;
-    zval *style_val = NULL;
-    zval **data;
-    HashTable *style;
-    char *key;
-    ulong index;
+    zval *zgeoms;
+    double gapWidth = 0.0;
+    int ret;
 
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "a|d",
+            &zgeoms, &gapWidth) == FAILURE) {
+        RETURN_NULL();
+    }
 
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "d|a",
-            &dist, &style_val) == FAILURE) {
+    ret = checkCoverage(Z_ARRVAL_P(zgeoms), gapWidth, NULL TSRMLS_CC);
+    if ( ret == 2 ) RETURN_NULL(); /* should get an exception first */
+
+    RETURN_BOOL(ret);
+}
+
+/**
+ * array GEOSCoverage::validate(array geoms, [gapWidth])
+ *
+ * Returns the edges of the geometries which make the coverage
+ * invalid, for the invalid geometries only, keyed like the input.
+ */
+PHP_METHOD(Coverage, validate)
+{
+    zval *zgeoms;
+    zval *tmp;
+    HashTable *geoms;
+    HashPosition pos;
+    GEOSGeometry *invalid = NULL;
+    const GEOSGeometry *edges;
+    GEOSGeometry *geom;
+    zval **data;
+    double gapWidth = 0.0;
+    int ret, i = 0;
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "a|d",
+            &zgeoms, &gapWidth) == FAILURE) {
         RETURN_NULL();
     }
 
-    if ( style_val )
+    geoms = Z_ARRVAL_P(zgeoms);
+    ret = checkCoverage(geoms, gapWidth, &invalid TSRMLS_CC);
+    if ( ret == 2 ) RETURN_NULL(); /* should get an exception first */
+
+    array_init(return_value);
+    if ( ! invalid ) return;
+
+    for (zend_hash_internal_pointer_reset_ex(geoms, &pos);
+         zend_hash_get_current_data_ex(geoms, (void**)&data, &pos) == SUCCESS;
+         zend_hash_move_forward_ex(geoms, &pos), ++i)
     {
-        style = HASH_OF(style_val);
-        while(zend_hash_get_current_key(style, &key, &index, 0)
-              == HASH_KEY_IS_STRING)
-        {
-            if(!strcmp(key, "quad_segs"))
-            {
-                zend_hash_get_current_data(style, (void**)&data);
-                quadSegs = getZvalAsLong(*data);
-            }
-            else if(!strcmp(key, "join"))
-            {
-                zend_hash_get_current_data(style, (void**)&data);
-                joinStyle = getZvalAsLong(*data);
-            }
-            else if(!strcmp(key, "mitre_limit"))
-            {
-                zend_hash_get_current_data(style, (void**)&data);
-                mitreLimit = getZvalAsDouble(*data);
-            }
+        edges = GEOSGetGeometryN_r(GEOS_G(handle), invalid, i);
+        if ( ! edges || GEOSisEmpty_r(GEOS_G(handle), edges) ) continue;
+
+        geom = GEOSGeom_clone_r(GEOS_G(handle), edges);
+        if ( ! geom ) break; /* should get an exception first */
 
-            zend_hash_move_forward(style);
+        MAKE_STD_ZVAL(tmp);
+        object_init_ex(tmp, Geometry_ce_ptr);
+        if ( setRelay(tmp, geom TSRMLS_CC) == FAILURE ) {
+            zval_ptr_dtor(&tmp);
+            break; /* should get an exception first */
         }
+        addZvalWithKey(return_value, geoms, &pos, tmp);
     }
 
-    ret = GEOSOffsetCurve_r(GEOS_G(handle), this, dist, quadSegs, joinStyle, mitreLimit);
-    if ( ! ret ) RETURN_NULL(); /* should get an exception first */
-
-    /* return_value is a zval */
-    object_init_ex(return_value, Geometry_ce_ptr);
-    setRelay(return_value, ret);
+    GEOSGeom_destroy_r(GEOS_G(handle), invalid);
 }
-#endif
 
-PHP_METHOD(Geometry, envelope)
-{
-    GEOSGeometry *this;
-    GEOSGeometry *ret;
+#endif /* HAVE_GEOS_COVERAGE_IS_VALID */
 
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+/* -- class GEOSUnionAggregator -------------------- */
 
-    ret = GEOSEnvelope_r(GEOS_G(handle), this);
-    if ( ! ret ) RETURN_NULL(); /* should get an exception first */
+PHP_METHOD(UnionAggregator, __construct);
+PHP_METHOD(UnionAggregator, add);
+PHP_METHOD(UnionAggregator, result);
+PHP_METHOD(UnionAggregator, count);
+PHP_METHOD(UnionAggregator, memoryUsage);
 
-    /* return_value is a zval */
-    object_init_ex(return_value, Geometry_ce_ptr);
-    setRelay(return_value, ret);
+static zend_function_entry UnionAggregator_methods[] = {
+    PHP_ME(UnionAggregator, __construct, NULL, 0)
+    PHP_ME(UnionAggregator, add, NULL, 0)
+    PHP_ME(UnionAggregator, result, NULL, 0)
+    PHP_ME(UnionAggregator, count, NULL, 0)
+    PHP_ME(UnionAggregator, memoryUsage, NULL, 0)
+    {NULL, NULL, NULL}
+};
+
+static zend_class_entry *UnionAggregator_ce_ptr;
+
+static zend_object_handlers UnionAggregator_object_handlers;
+
+/* Aggregation modes */
+#define GEOSAGG_UNION 0
+#define GEOSAGG_ENVELOPE 1
+#define GEOSAGG_CONVEX_HULL 2
+
+#define GEOSAGG_DEFAULT_CHUNK 256
+#define GEOSAGG_LEVELS 64
+
+/*
+ * Inputs are cloned into 'pending' until a chunk is full, which
+ * then gets cascade-unioned. Chunk results are merged like the
+ * digits of a binary counter: levels[i] holds the union of
+ * chunkSize * 2^i inputs, so only O(log n) partial results are
+ * ever held and every union is between geometries of similar size.
+ *
+ * The convex hull mode only ever keeps the current hull in
+ * levels[0], while the envelope mode keeps no geometry at all.
+ * Pending geometries are only released once folded, a failed
+ * fold leaves them pending.
+ */
+typedef struct UnionAggregator_t {
+    long mode;
+    long chunkSize;
+    GEOSGeometry **pending;
+    long npending;
+    GEOSGeometry *levels[GEOSAGG_LEVELS];
+    double minx, miny, maxx, maxy;
+    long count;
+    long srid;
+    long memory; /* GEOS heap held by pending and levels */
+} UnionAggregator;
+
+/* Recompute memory held by the aggregator and update the request total */
+static void
+UnionAggregator_account(UnionAggregator* agg TSRMLS_DC)
+{
+    long memory = 0;
+    int i;
+
+    for (i=0; i<agg->npending; ++i) {
+        memory += geometryMemorySize(agg->pending[i] TSRMLS_CC);
+    }
+    for (i=0; i<GEOSAGG_LEVELS; ++i) {
+        if ( agg->levels[i] ) {
+            memory += geometryMemorySize(agg->levels[i] TSRMLS_CC);
+        }
+    }
+
+    GEOS_G(memory_usage) += memory - agg->memory;
+    agg->memory = memory;
 }
 
-PHP_METHOD(Geometry, intersection)
+/* Fold pending geometries into the partial results */
+static int
+UnionAggregator_flush(UnionAggregator* agg TSRMLS_DC)
 {
-    GEOSGeometry *this;
-    GEOSGeometry *other;
-    GEOSGeometry *ret;
-    zval *zobj;
+    GEOSGeometry **parts;
+    GEOSGeometry *coll;
+    GEOSGeometry *part;
+    GEOSGeometry *merged;
+    int hull = 0;
+    int i;
+
+    if ( ! agg->npending ) return SUCCESS;
+
+    if ( agg->mode == GEOSAGG_CONVEX_HULL && agg->levels[0] ) {
+        /* there is always room for it, see UnionAggregator::__construct */
+        agg->pending[agg->npending++] = agg->levels[0];
+        agg->levels[0] = NULL;
+        hull = 1;
+    }
 
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    /* the collection owns clones, the pending geometries stay ours */
+    parts = (GEOSGeometry**)safe_emalloc(agg->npending,
+        sizeof(GEOSGeometry*), 0);
+    for (i=0; i<agg->npending; ++i) {
+        parts[i] = GEOSGeom_clone_r(GEOS_G(handle), agg->pending[i]);
+        if ( ! parts[i] ) break;
+    }
+    coll = i < agg->npending ? NULL
+        : GEOSGeom_createCollection_r(GEOS_G(handle),
+            GEOS_GEOMETRYCOLLECTION, parts, agg->npending);
+    if ( ! coll ) {
+        while ( i-- > 0 ) GEOSGeom_destroy_r(GEOS_G(handle), parts[i]);
+    }
+    efree(parts);
 
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o", &zobj)
-            == FAILURE) {
-        RETURN_NULL();
+    if ( ! coll ) {
+        part = NULL;
+    } else if ( agg->mode == GEOSAGG_CONVEX_HULL ) {
+        part = GEOSConvexHull_r(GEOS_G(handle), coll);
+    } else {
+#       ifdef HAVE_GEOS_UNARY_UNION
+        part = GEOSUnaryUnion_r(GEOS_G(handle), coll);
+#       else
+        part = GEOSUnionCascaded_r(GEOS_G(handle), coll);
+#       endif
     }
-    other = getRelay(zobj, Geometry_ce_ptr);
+    if ( coll ) GEOSGeom_destroy_r(GEOS_G(handle), coll);
 
-    ret = GEOSIntersection_r(GEOS_G(handle), this, other);
-    if ( ! ret ) RETURN_NULL(); /* should get an exception first */
+    if ( ! part ) {
+        /* kept pending, the previous hull back in place */
+        if ( hull ) agg->levels[0] = agg->pending[--agg->npending];
+        return FAILURE; /* should get an exception first */
+    }
 
-    /* return_value is a zval */
-    object_init_ex(return_value, Geometry_ce_ptr);
-    setRelay(return_value, ret);
+    for (i=0; i<agg->npending; ++i) {
+        GEOSGeom_destroy_r(GEOS_G(handle), agg->pending[i]);
+    }
+    agg->npending = 0;
+
+    if ( agg->mode == GEOSAGG_CONVEX_HULL ) {
+        agg->levels[0] = part;
+    } else {
+        for (i=0; agg->levels[i] && i < GEOSAGG_LEVELS - 1; ++i) {
+            merged = GEOSUnion_r(GEOS_G(handle), agg->levels[i], part);
+            if ( ! merged ) {
+                /* kept pending, to be merged again by the next flush */
+                agg->pending[agg->npending++] = part;
+                UnionAggregator_account(agg TSRMLS_CC);
+                return FAILURE; /* should get an exception first */
+            }
+            GEOSGeom_destroy_r(GEOS_G(handle), agg->levels[i]);
+            GEOSGeom_destroy_r(GEOS_G(handle), part);
+            agg->levels[i] = NULL;
+            part = merged;
+        }
+        agg->levels[i] = part;
+    }
+
+    UnionAggregator_account(agg TSRMLS_CC);
+
+    return SUCCESS;
 }
 
-/**
- * GEOSGeometry GEOSGeometry::clipByRect(xmin,ymin,xmax,ymax)
+/*
+ * Merge all partial results into the topmost level, or levels[0]
+ * for the convex hull so that later flushes fold it in again.
  */
-#ifdef HAVE_GEOS_CLIP_BY_RECT
-PHP_METHOD(Geometry, clipByRect)
+static GEOSGeometry*
+UnionAggregator_collapse(UnionAggregator* agg TSRMLS_DC)
 {
-    GEOSGeometry *this;
-    GEOSGeometry *ret;
-    double xmin,ymin,xmax,ymax;
-
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
-
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "dddd",
-            &xmin, &ymin, &xmax, &ymax) == FAILURE) {
-        RETURN_NULL();
+    GEOSGeometry *part = NULL;
+    GEOSGeometry *merged;
+    int i;
+
+    if ( UnionAggregator_flush(agg TSRMLS_CC) == FAILURE ) return NULL;
+
+    for (i=0; i<GEOSAGG_LEVELS; ++i) {
+        if ( ! agg->levels[i] ) continue;
+        if ( ! part ) {
+            part = agg->levels[i];
+        } else {
+            merged = GEOSUnion_r(GEOS_G(handle), agg->levels[i], part);
+            if ( ! merged ) {
+                /* levels below i were emptied into part, put it back */
+                agg->levels[i - 1] = part;
+                UnionAggregator_account(agg TSRMLS_CC);
+                return NULL; /* should get an exception first */
+            }
+            GEOSGeom_destroy_r(GEOS_G(handle), agg->levels[i]);
+            GEOSGeom_destroy_r(GEOS_G(handle), part);
+            part = merged;
+        }
+        agg->levels[i] = NULL;
     }
 
-    ret = GEOSClipByRect_r(GEOS_G(handle), this, xmin, ymin, xmax, ymax);
-    if ( ! ret ) RETURN_NULL(); /* should get an exception first */
+    if ( part ) {
+        agg->levels[agg->mode == GEOSAGG_CONVEX_HULL ? 0
+            : GEOSAGG_LEVELS - 1] = part;
+    }
+    UnionAggregator_account(agg TSRMLS_CC);
 
-    /* return_value is a zval */
-    object_init_ex(return_value, Geometry_ce_ptr);
-    setRelay(return_value, ret);
+    return part;
 }
-#endif
 
-PHP_METHOD(Geometry, convexHull)
+static void
+UnionAggregator_dtor (void *object TSRMLS_DC)
 {
-    GEOSGeometry *this;
-    GEOSGeometry *ret;
+    Proxy *obj = (Proxy *)object;
+    UnionAggregator *agg = (UnionAggregator*)obj->relay;
+    int i;
 
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    if ( agg ) {
+        for (i=0; i<agg->npending; ++i) {
+            GEOSGeom_destroy_r(GEOS_G(handle), agg->pending[i]);
+        }
+        for (i=0; i<GEOSAGG_LEVELS; ++i) {
+            if ( agg->levels[i] ) {
+                GEOSGeom_destroy_r(GEOS_G(handle), agg->levels[i]);
+            }
+        }
+        GEOS_G(memory_usage) -= agg->memory;
+        efree(agg->pending);
+        efree(agg);
+    }
 
-    ret = GEOSConvexHull_r(GEOS_G(handle), this);
-    if ( ret == NULL ) RETURN_NULL(); /* should get an exception first */
+    zend_hash_destroy(obj->std.properties);
+    FREE_HASHTABLE(obj->std.properties);
 
-    /* return_value is a zval */
-    object_init_ex(return_value, Geometry_ce_ptr);
-    setRelay(return_value, ret);
+    efree(obj);
 }
 
-PHP_METHOD(Geometry, difference)
+static zend_object_value
+UnionAggregator_create_obj (zend_class_entry *type TSRMLS_DC)
 {
-    GEOSGeometry *this;
-    GEOSGeometry *other;
-    GEOSGeometry *ret;
-    zval *zobj;
+    return Gen_create_obj(type, UnionAggregator_dtor,
+        &UnionAggregator_object_handlers TSRMLS_CC);
+}
 
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+/**
+ * GEOSUnionAggregator a = new GEOSUnionAggregator([mode], [chunkSize])
+ *
+ *  'mode'
+ *       Type: long
+ *       GEOSAGG_UNION (the default) to dissolve the inputs,
+ *       GEOSAGG_ENVELOPE to compute their overall extent or
+ *       GEOSAGG_CONVEX_HULL to compute their overall convex hull.
+ *  'chunkSize'
+ *       Type: long
+ *       Number of inputs buffered before they are folded into
+ *       the partial result (defaults to 256).
+ */
+PHP_METHOD(UnionAggregator, __construct)
+{
+    UnionAggregator *agg;
+    long mode = GEOSAGG_UNION;
+    long chunkSize = GEOSAGG_DEFAULT_CHUNK;
+    zval *object = getThis();
 
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o", &zobj)
-            == FAILURE) {
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|ll",
+            &mode, &chunkSize) == FAILURE) {
         RETURN_NULL();
     }
-    other = getRelay(zobj, Geometry_ce_ptr);
 
-    ret = GEOSDifference_r(GEOS_G(handle), this, other);
-    if ( ! ret ) RETURN_NULL(); /* should get an exception first */
-
-    /* return_value is a zval */
-    object_init_ex(return_value, Geometry_ce_ptr);
-    setRelay(return_value, ret);
+    if ( mode != GEOSAGG_UNION && mode != GEOSAGG_ENVELOPE
+            && mode != GEOSAGG_CONVEX_HULL ) {
+        php_error_docref(NULL TSRMLS_CC, E_WARNING,
+            "Unknown aggregation mode %ld", mode);
+        mode = GEOSAGG_UNION;
+    }
+    if ( chunkSize < 1 ) chunkSize = GEOSAGG_DEFAULT_CHUNK;
+
+    agg = (UnionAggregator*)ecalloc(1, sizeof(UnionAggregator));
+    agg->mode = mode;
+    agg->chunkSize = chunkSize;
+    /* an inverted extent stands for "nothing seen yet" */
+    agg->minx = agg->miny = 1;
+    agg->maxx = agg->maxy = -1;
+    /* one extra slot for the current hull */
+    agg->pending = (GEOSGeometry**)safe_emalloc(chunkSize + 1,
+        sizeof(GEOSGeometry*), 0);
+
+    setRelay(object, agg TSRMLS_CC);
 }
 
-PHP_METHOD(Geometry, symDifference)
+/**
+ * void GEOSUnionAggregator::add(GEOSGeometry)
+ */
+PHP_METHOD(UnionAggregator, add)
 {
-    GEOSGeometry *this;
-    GEOSGeometry *other;
-    GEOSGeometry *ret;
+    UnionAggregator *agg;
+    GEOSGeometry *geom;
+    GEOSGeometry *clone;
     zval *zobj;
+    double minx, miny, maxx, maxy;
+    long size;
 
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    agg = (UnionAggregator*)getRelay(getThis(), UnionAggregator_ce_ptr TSRMLS_CC);
 
     if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o", &zobj)
             == FAILURE) {
         RETURN_NULL();
     }
-    other = getRelay(zobj, Geometry_ce_ptr);
-
-    ret = GEOSSymDifference_r(GEOS_G(handle), this, other);
-    if ( ! ret ) RETURN_NULL(); /* should get an exception first */
-
-    /* return_value is a zval */
-    object_init_ex(return_value, Geometry_ce_ptr);
-    setRelay(return_value, ret);
-}
+    geom = getRelay(zobj, Geometry_ce_ptr TSRMLS_CC);
+    if ( ! geom ) RETURN_NULL(); /* should get an exception first */
+
+    if ( agg->mode == GEOSAGG_ENVELOPE ) {
+        if ( ! agg->count++ ) agg->srid = GEOSGetSRID_r(GEOS_G(handle), geom);
+        if ( getGeometryExtent(geom, &minx, &miny, &maxx, &maxy TSRMLS_CC) ) {
+            if ( agg->minx > agg->maxx ) {
+                /* first non-empty input */
+                agg->minx = minx; agg->miny = miny;
+                agg->maxx = maxx; agg->maxy = maxy;
+            } else {
+                if ( minx < agg->minx ) agg->minx = minx;
+                if ( miny < agg->miny ) agg->miny = miny;
+                if ( maxx > agg->maxx ) agg->maxx = maxx;
+                if ( maxy > agg->maxy ) agg->maxy = maxy;
+            }
+        }
+        return;
+    }
 
-PHP_METHOD(Geometry, boundary)
-{
-    GEOSGeometry *this;
-    GEOSGeometry *ret;
+    size = geometryMemorySize(geom TSRMLS_CC);
+    if ( checkMemoryLimit(size TSRMLS_CC) == FAILURE ) return;
 
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    clone = GEOSGeom_clone_r(GEOS_G(handle), geom);
+    if ( ! clone ) return; /* should get an exception first */
 
-    ret = GEOSBoundary_r(GEOS_G(handle), this);
-    if ( ret == NULL ) RETURN_NULL(); /* should get an exception first */
+    agg->pending[agg->npending++] = clone;
+    agg->memory += size;
+    GEOS_G(memory_usage) += size;
+    if ( ! agg->count++ ) agg->srid = GEOSGetSRID_r(GEOS_G(handle), geom);
 
-    /* return_value is a zval */
-    object_init_ex(return_value, Geometry_ce_ptr);
-    setRelay(return_value, ret);
+    if ( agg->npending >= agg->chunkSize ) {
+        UnionAggregator_flush(agg TSRMLS_CC);
+    }
 }
 
 /**
- * GEOSGeometry::union(otherGeom)
- * GEOSGeometry::union()
+ * GEOSGeometry GEOSUnionAggregator::result()
+ *
+ * Aggregate of all geometries added so far. More geometries
+ * can still be added afterwards.
  */
-PHP_METHOD(Geometry, union)
+PHP_METHOD(UnionAggregator, result)
 {
-    GEOSGeometry *this;
-    GEOSGeometry *other;
+    UnionAggregator *agg;
+    GEOSGeometry *part;
     GEOSGeometry *ret;
-    zval *zobj = NULL;
 
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
-
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|o", &zobj)
-            == FAILURE) {
-        RETURN_NULL();
-    }
+    agg = (UnionAggregator*)getRelay(getThis(), UnionAggregator_ce_ptr TSRMLS_CC);
 
-    if ( zobj ) {
-        other = getRelay(zobj, Geometry_ce_ptr);
-        ret = GEOSUnion_r(GEOS_G(handle), this, other);
+    if ( agg->mode == GEOSAGG_ENVELOPE && agg->minx <= agg->maxx ) {
+        ret = createExtentGeometry(agg->minx, agg->miny,
+            agg->maxx, agg->maxy TSRMLS_CC);
+    } else if ( agg->mode == GEOSAGG_ENVELOPE ) {
+        ret = GEOSGeom_createCollection_r(GEOS_G(handle),
+            GEOS_GEOMETRYCOLLECTION, NULL, 0);
     } else {
-#       ifdef HAVE_GEOS_UNARY_UNION
-        ret = GEOSUnaryUnion_r(GEOS_G(handle), this);
-#       else
-        ret = GEOSUnionCascaded_r(GEOS_G(handle), this);
-#       endif
+        part = UnionAggregator_collapse(agg TSRMLS_CC);
+        if ( part ) {
+            ret = GEOSGeom_clone_r(GEOS_G(handle), part);
+        } else if ( ! agg->npending ) {
+            ret = GEOSGeom_createCollection_r(GEOS_G(handle),
+                GEOS_GEOMETRYCOLLECTION, NULL, 0);
+        } else {
+            ret = NULL;
+        }
     }
-
     if ( ! ret ) RETURN_NULL(); /* should get an exception first */
 
+    GEOSSetSRID_r(GEOS_G(handle), ret, agg->srid);
+
     /* return_value is a zval */
     object_init_ex(return_value, Geometry_ce_ptr);
-    setRelay(return_value, ret);
+    setRelay(return_value, ret TSRMLS_CC);
 }
 
 /**
- * GEOSGeometry::pointOnSurface()
+ * long GEOSUnionAggregator::count()
+ *
+ * Number of geometries added so far.
  */
-PHP_METHOD(Geometry, pointOnSurface)
+PHP_METHOD(UnionAggregator, count)
 {
-    GEOSGeometry *this;
-    GEOSGeometry *ret;
+    UnionAggregator *agg;
 
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
-
-    ret = GEOSPointOnSurface_r(GEOS_G(handle), this);
-    if ( ret == NULL ) RETURN_NULL(); /* should get an exception first */
+    agg = (UnionAggregator*)getRelay(getThis(), UnionAggregator_ce_ptr TSRMLS_CC);
 
-    /* return_value is a zval */
-    object_init_ex(return_value, Geometry_ce_ptr);
-    setRelay(return_value, ret);
+    RETURN_LONG(agg->count);
 }
 
 /**
- * GEOSGeometry::centroid()
+ * long GEOSUnionAggregator::memoryUsage()
+ *
+ * Approximate number of bytes of GEOS heap held by the
+ * buffered inputs and partial results.
  */
-PHP_METHOD(Geometry, centroid)
+PHP_METHOD(UnionAggregator, memoryUsage)
 {
-    GEOSGeometry *this;
-    GEOSGeometry *ret;
+    UnionAggregator *agg;
 
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    agg = (UnionAggregator*)getRelay(getThis(), UnionAggregator_ce_ptr TSRMLS_CC);
 
-    ret = GEOSGetCentroid_r(GEOS_G(handle), this);
-    if ( ret == NULL ) RETURN_NULL(); /* should get an exception first */
-
-    /* return_value is a zval */
-    object_init_ex(return_value, Geometry_ce_ptr);
-    setRelay(return_value, ret);
+    RETURN_LONG(agg->memory);
 }
 
-/**
- * GEOSGeometry::relate(otherGeom)
- * GEOSGeometry::relate(otherGeom, pattern)
- */
-PHP_METHOD(Geometry, relate)
-{
-    GEOSGeometry *this;
-    GEOSGeometry *other;
-    zval *zobj;
-    char* pat = NULL;
-    int patlen;
-    int retInt;
-    zend_bool retBool;
-    char* retStr;
+/* -- class GEOSNearestIndex -------------------- */
 
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+PHP_METHOD(NearestIndex, __construct);
+PHP_METHOD(NearestIndex, knn);
+PHP_METHOD(NearestIndex, knnMany);
+PHP_METHOD(NearestIndex, count);
 
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o|s",
-        &zobj, &pat, &patlen) == FAILURE)
-    {
-        RETURN_NULL();
-    }
+static zend_function_entry NearestIndex_methods[] = {
+    PHP_ME(NearestIndex, __construct, NULL, 0)
+    PHP_ME(NearestIndex, knn, NULL, 0)
+    PHP_ME(NearestIndex, knnMany, NULL, 0)
+    PHP_ME(NearestIndex, count, NULL, 0)
+    {NULL, NULL, NULL}
+};
 
-    other = getRelay(zobj, Geometry_ce_ptr);
+static zend_class_entry *NearestIndex_ce_ptr;
 
-    if ( ! pat ) {
-        /* we'll compute it */
-        pat = GEOSRelate_r(GEOS_G(handle), this, other);
-        if ( ! pat ) RETURN_NULL(); /* should get an exception first */
-        retStr = estrdup(pat);
-        GEOSFree_r(GEOS_G(handle), pat);
-        RETURN_STRING(retStr, 0);
-    } else {
-        retInt = GEOSRelatePattern_r(GEOS_G(handle), this, other, pat);
-        if ( retInt == 2 ) RETURN_NULL(); /* should get an exception first */
-        retBool = retInt;
-        RETURN_BOOL(retBool);
-    }
+static zend_object_handlers NearestIndex_object_handlers;
+
+typedef struct NearestIndex_t {
+    STRTree tree;
+    GEOSGeometry **geoms; /* clones of the indexed geometries */
+    long ngeoms;
+    long memory; /* GEOS heap held by the clones */
+} NearestIndex;
 
+/* Best-first search queue element */
+typedef struct NearestCandidate_t {
+    double distance;
+    long entry;
+    long item; /* item id for exact distances, for stable ordering */
+    int exact; /* distance is the real one, not an extent bound */
+} NearestCandidate;
+
+typedef struct NearestQueue_t {
+    NearestCandidate *items;
+    long size;
+    long capacity;
+} NearestQueue;
+
+/* Closer first; on ties exact distances first, then lowest item id */
+static int
+NearestCandidate_before(const NearestCandidate* a, const NearestCandidate* b)
+{
+    if ( a->distance != b->distance ) return a->distance < b->distance;
+    if ( a->exact != b->exact ) return a->exact;
+    if ( a->exact ) return a->item < b->item;
+    return a->entry < b->entry;
 }
 
-/**
- * GEOSGeometry::relateBoundaryNodeRule(otherGeom, rule)
- */
-#ifdef HAVE_GEOS_RELATE_BOUNDARY_NODE_RULE
-PHP_METHOD(Geometry, relateBoundaryNodeRule)
+static void
+NearestQueue_push(NearestQueue* q, double distance, long entry, long item,
+        int exact)
 {
-    GEOSGeometry *this;
-    GEOSGeometry *other;
-    zval *zobj;
-    char* pat;
-    long int bnr = GEOSRELATE_BNR_OGC;
-    char* retStr;
+    NearestCandidate c, tmp;
+    long i, parent;
 
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    if ( q->size == q->capacity ) {
+        q->capacity = q->capacity ? q->capacity * 2 : 64;
+        q->items = (NearestCandidate*)safe_erealloc(q->items, q->capacity,
+            sizeof(NearestCandidate), 0);
+    }
 
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "ol",
-        &zobj, &bnr) == FAILURE)
-    {
-        RETURN_NULL();
+    c.distance = distance;
+    c.entry = entry;
+    c.item = item;
+    c.exact = exact;
+    i = q->size++;
+    q->items[i] = c;
+    while ( i ) {
+        parent = (i - 1) / 2;
+        if ( ! NearestCandidate_before(&q->items[i], &q->items[parent]) ) {
+            break;
+        }
+        tmp = q->items[parent];
+        q->items[parent] = q->items[i];
+        q->items[i] = tmp;
+        i = parent;
     }
+}
 
-    other = getRelay(zobj, Geometry_ce_ptr);
+static NearestCandidate
+NearestQueue_pop(NearestQueue* q)
+{
+    NearestCandidate top = q->items[0];
+    NearestCandidate tmp;
+    long i = 0, child;
+
+    q->items[0] = q->items[--q->size];
+    for (;;) {
+        child = 2 * i + 1;
+        if ( child >= q->size ) break;
+        if ( child + 1 < q->size
+                && NearestCandidate_before(&q->items[child + 1],
+                                           &q->items[child]) ) {
+            child++;
+        }
+        if ( ! NearestCandidate_before(&q->items[child], &q->items[i]) ) {
+            break;
+        }
+        tmp = q->items[child];
+        q->items[child] = q->items[i];
+        q->items[i] = tmp;
+        i = child;
+    }
 
-    /* we'll compute it */
-    pat = GEOSRelateBoundaryNodeRule_r(GEOS_G(handle), this, other, bnr);
-    if ( ! pat ) RETURN_NULL(); /* should get an exception first */
-    retStr = estrdup(pat);
-    GEOSFree_r(GEOS_G(handle), pat);
-    RETURN_STRING(retStr, 0);
+    return top;
 }
-#endif
 
-/**
- * GEOSGeometry GEOSGeometry::simplify(tolerance)
- * GEOSGeometry GEOSGeometry::simplify(tolerance, preserveTopology)
+/*
+ * Find up to 'k' nearest geometries to 'query', no farther than
+ * 'maxDistance' if it is not negative, and store them into
+ * return_value as array('indices' => array, 'distances' => array).
+ * Returns FAILURE if GEOS failed computing a distance.
  */
-PHP_METHOD(Geometry, simplify)
+static int
+NearestIndex_knn(NearestIndex* index, const GEOSGeometry* query, long k,
+        double maxDistance, zval* return_value TSRMLS_DC)
 {
-    GEOSGeometry *this;
-    double tolerance;
-    zend_bool preserveTopology = 0;
-    GEOSGeometry *ret;
+    NearestQueue queue = { NULL, 0, 0 };
+    NearestCandidate c;
+    const STREntry *e;
+    zval *indices;
+    zval *distances;
+    double minx, miny, maxx, maxy;
+    double dist;
+    long i, found = 0;
+    int ret = SUCCESS;
 
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    MAKE_STD_ZVAL(indices);
+    array_init(indices);
+    MAKE_STD_ZVAL(distances);
+    array_init(distances);
 
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "d|b",
-            &tolerance, &preserveTopology) == FAILURE) {
-        RETURN_NULL();
+    array_init(return_value);
+    add_assoc_zval(return_value, "indices", indices);
+    add_assoc_zval(return_value, "distances", distances);
+
+    if ( k < 1 || index->tree.root < 0 ) return SUCCESS;
+    if ( ! getGeometryExtent(query, &minx, &miny, &maxx, &maxy TSRMLS_CC) ) {
+        return SUCCESS;
     }
 
-    if ( preserveTopology ) {
-        ret = GEOSTopologyPreserveSimplify_r(GEOS_G(handle), this, tolerance);
-    } else {
-        ret = GEOSSimplify_r(GEOS_G(handle), this, tolerance);
+    e = &index->tree.entries[index->tree.root];
+    NearestQueue_push(&queue, STREntry_distance(e, minx, miny, maxx, maxy),
+        index->tree.root, -1, 0);
+
+    while ( queue.size && found < k ) {
+        c = NearestQueue_pop(&queue);
+        if ( maxDistance >= 0 && c.distance > maxDistance ) break;
+
+        e = &index->tree.entries[c.entry];
+        if ( c.exact ) {
+            add_next_index_long(indices, e->child);
+            add_next_index_double(distances, c.distance);
+            found++;
+        } else if ( ! e->count ) {
+            /* refine extent distance with the actual one */
+            if ( ! GEOSDistance_r(GEOS_G(handle), index->geoms[e->child],
+                                  query, &dist) ) {
+                ret = FAILURE; /* should get an exception first */
+                break;
+            }
+            NearestQueue_push(&queue, dist, c.entry, e->child, 1);
+        } else {
+            for (i=e->child; i<e->child + e->count; ++i) {
+                NearestQueue_push(&queue,
+                    STREntry_distance(&index->tree.entries[i],
+                                      minx, miny, maxx, maxy),
+                    i, -1, 0);
+            }
+        }
     }
 
-    if ( ! ret ) RETURN_NULL(); /* should get an exception first */
+    if ( queue.items ) efree(queue.items);
 
-    /* return_value is a zval */
-    object_init_ex(return_value, Geometry_ce_ptr);
-    setRelay(return_value, ret);
+    return ret;
 }
 
-/**
- * GEOSGeometry GEOSGeometry::setPrecision(gridsize, [flags])
- */
-#ifdef HAVE_GEOS_GEOM_SET_PRECISION
-PHP_METHOD(Geometry, setPrecision)
+static void
+NearestIndex_dtor (void *object TSRMLS_DC)
 {
-    GEOSGeometry *this;
-    double gridSize;
-    long int flags = 0;
-    GEOSGeometry *ret;
-
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    Proxy *obj = (Proxy *)object;
+    NearestIndex *index = (NearestIndex*)obj->relay;
+    long i;
 
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "d|l",
-            &gridSize, &flags) == FAILURE) {
-        RETURN_NULL();
+    if ( index ) {
+        for (i=0; i<index->ngeoms; ++i) {
+            GEOSGeom_destroy_r(GEOS_G(handle), index->geoms[i]);
+        }
+        GEOS_G(memory_usage) -= index->memory;
+        if ( index->geoms ) efree(index->geoms);
+        STRTree_destroy(&index->tree);
+        efree(index);
     }
 
-    ret = GEOSGeom_setPrecision_r(GEOS_G(handle), this, gridSize, flags);
-
-    if ( ! ret ) RETURN_NULL(); /* should get an exception first */
+    zend_hash_destroy(obj->std.properties);
+    FREE_HASHTABLE(obj->std.properties);
 
-    /* return_value is a zval */
-    object_init_ex(return_value, Geometry_ce_ptr);
-    setRelay(return_value, ret);
+    efree(obj);
 }
-#endif
 
-/**
- * double GEOSGeometry::getPrecision()
- */
-#ifdef HAVE_GEOS_GEOM_GET_PRECISION
-PHP_METHOD(Geometry, getPrecision)
+static zend_object_value
+NearestIndex_create_obj (zend_class_entry *type TSRMLS_DC)
 {
-    GEOSGeometry *geom;
-    double prec;
-
-    geom = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
-
-    prec = GEOSGeom_getPrecision_r(GEOS_G(handle), geom);
-    if ( prec < 0 ) RETURN_NULL(); /* should get an exception first */
-
-    RETURN_DOUBLE(prec);
+    return Gen_create_obj(type, NearestIndex_dtor,
+        &NearestIndex_object_handlers TSRMLS_CC);
 }
-#endif
 
 /**
- * GEOSGeometry GEOSGeometry::normalize()
+ * GEOSNearestIndex idx = new GEOSNearestIndex(array geometries)
+ *
+ * Indices returned by the queries are positions in
+ * the 'geometries' array.
  */
-PHP_METHOD(Geometry, normalize)
+PHP_METHOD(NearestIndex, __construct)
 {
-    GEOSGeometry *this;
-    GEOSGeometry *ret;
+    NearestIndex *index;
+    STREntry *items;
+    GEOSGeometry *geom;
+    zval *zarr;
+    zval **data;
+    HashTable *arr_hash;
+    HashPosition pointer;
+    long n, nitems = 0, size;
+    zval *object = getThis();
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "a", &zarr)
+            == FAILURE) {
+        php_error_docref(NULL TSRMLS_CC, E_ERROR,
+                "Parameter must be an array of GEOSGeometry objects");
+        return;
+    }
 
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    arr_hash = Z_ARRVAL_P(zarr);
+    n = zend_hash_num_elements(arr_hash);
 
-    ret = GEOSGeom_clone_r(GEOS_G(handle), this);
+    index = (NearestIndex*)ecalloc(1, sizeof(NearestIndex));
+    index->tree.root = -1;
+    index->geoms = (GEOSGeometry**)safe_emalloc(n ? n : 1,
+        sizeof(GEOSGeometry*), 0);
+    items = (STREntry*)safe_emalloc(n ? n : 1, sizeof(STREntry), 0);
 
-    if ( ! ret ) RETURN_NULL();
+    /* the object owns whatever got cloned so far, even on failure */
+    setRelay(object, index TSRMLS_CC);
 
-    GEOSNormalize_r(GEOS_G(handle), ret); /* exception should be gotten automatically */
+    for (zend_hash_internal_pointer_reset_ex(arr_hash, &pointer);
+         zend_hash_get_current_data_ex(arr_hash, (void**) &data,
+                                       &pointer) == SUCCESS;
+         zend_hash_move_forward_ex(arr_hash, &pointer))
+    {
+        geom = getGeometryElement(*data TSRMLS_CC);
+        if ( ! geom ) break; /* should get an exception first */
+
+        size = geometryMemorySize(geom TSRMLS_CC);
+        if ( checkMemoryLimit(size TSRMLS_CC) == FAILURE ) break;
+
+        index->geoms[index->ngeoms] = GEOSGeom_clone_r(GEOS_G(handle), geom);
+        if ( ! index->geoms[index->ngeoms] ) break;
+        index->memory += size;
+        GEOS_G(memory_usage) += size;
+
+        /* empty geometries are never a neighbour */
+        if ( getGeometryExtent(geom, &items[nitems].minx, &items[nitems].miny,
+                &items[nitems].maxx, &items[nitems].maxy TSRMLS_CC) ) {
+            items[nitems].child = index->ngeoms;
+            nitems++;
+        }
+        index->ngeoms++;
+    }
 
-    /* return_value is a zval */
-    object_init_ex(return_value, Geometry_ce_ptr);
-    setRelay(return_value, ret);
+    STRTree_build(&index->tree, items, nitems, 0);
+    efree(items);
 }
 
 /**
- * GEOSGeometry GEOSGeometry::extractUniquePoints()
+ * array GEOSNearestIndex::knn(GEOSGeometry query, k, [maxDistance])
+ *
+ * Returns array('indices' => array, 'distances' => array),
+ * both ordered by increasing distance.
  */
-#ifdef HAVE_GEOS_GEOM_EXTRACT_UNIQUE_POINTS
-PHP_METHOD(Geometry, extractUniquePoints)
+PHP_METHOD(NearestIndex, knn)
 {
-    GEOSGeometry *this;
-    GEOSGeometry *ret;
+    NearestIndex *index;
+    GEOSGeometry *query;
+    zval *zobj;
+    zval *zmax = NULL;
+    long k;
+    double maxDistance = -1;
 
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    index = (NearestIndex*)getRelay(getThis(), NearestIndex_ce_ptr TSRMLS_CC);
 
-    ret = GEOSGeom_extractUniquePoints_r(GEOS_G(handle), this);
-    if ( ret == NULL ) RETURN_NULL(); /* should get an exception first */
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "ol|z!", &zobj, &k,
+            &zmax) == FAILURE) {
+        RETURN_NULL();
+    }
+    query = getRelay(zobj, Geometry_ce_ptr TSRMLS_CC);
+    if ( ! query ) RETURN_NULL(); /* should get an exception first */
+    if ( zmax ) maxDistance = getZvalAsDouble(zmax);
 
-    /* return_value is a zval */
-    object_init_ex(return_value, Geometry_ce_ptr);
-    setRelay(return_value, ret);
+    NearestIndex_knn(index, query, k, maxDistance, return_value TSRMLS_CC);
 }
-#endif
 
 /**
- * bool GEOSGeometry::disjoint(GEOSGeometry)
+ * array GEOSNearestIndex::knnMany(array queries, k, [maxDistance])
+ *
+ * Returns an array with the same keys as 'queries', holding
+ * the result of knn() for each of them.
  */
-PHP_METHOD(Geometry, disjoint)
+PHP_METHOD(NearestIndex, knnMany)
 {
-    GEOSGeometry *this;
-    GEOSGeometry *other;
-    int ret;
-    zend_bool retBool;
-    zval *zobj;
+    NearestIndex *index;
+    GEOSGeometry *query;
+    zval *zarr;
+    zval *zmax = NULL;
+    zval **data;
+    zval *result;
+    HashTable *arr_hash;
+    HashPosition pointer;
+    long k;
+    double maxDistance = -1;
 
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    index = (NearestIndex*)getRelay(getThis(), NearestIndex_ce_ptr TSRMLS_CC);
 
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o", &zobj)
-            == FAILURE) {
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "al|z!", &zarr, &k,
+            &zmax) == FAILURE) {
         RETURN_NULL();
     }
-    other = getRelay(zobj, Geometry_ce_ptr);
+    if ( zmax ) maxDistance = getZvalAsDouble(zmax);
 
-    ret = GEOSDisjoint_r(GEOS_G(handle), this, other);
-    if ( ret == 2 ) RETURN_NULL(); /* should get an exception first */
+    array_init(return_value);
+    arr_hash = Z_ARRVAL_P(zarr);
 
-    /* return_value is a zval */
-    retBool = ret;
-    RETURN_BOOL(retBool);
+    for (zend_hash_internal_pointer_reset_ex(arr_hash, &pointer);
+         zend_hash_get_current_data_ex(arr_hash, (void**) &data,
+                                       &pointer) == SUCCESS;
+         zend_hash_move_forward_ex(arr_hash, &pointer))
+    {
+        query = getGeometryElement(*data TSRMLS_CC);
+        if ( ! query ) return; /* should get an exception first */
+
+        MAKE_STD_ZVAL(result);
+        if ( NearestIndex_knn(index, query, k, maxDistance, result TSRMLS_CC)
+                == FAILURE ) {
+            zval_ptr_dtor(&result);
+            return; /* should get an exception first */
+        }
+        addZvalWithKey(return_value, arr_hash, &pointer, result);
+    }
 }
 
 /**
- * bool GEOSGeometry::touches(GEOSGeometry)
+ * long GEOSNearestIndex::count()
+ *
+ * Number of indexed geometries.
  */
-PHP_METHOD(Geometry, touches)
+PHP_METHOD(NearestIndex, count)
 {
-    GEOSGeometry *this;
-    GEOSGeometry *other;
-    int ret;
-    zend_bool retBool;
-    zval *zobj;
+    NearestIndex *index;
 
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    index = (NearestIndex*)getRelay(getThis(), NearestIndex_ce_ptr TSRMLS_CC);
 
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o", &zobj)
-            == FAILURE) {
-        RETURN_NULL();
+    RETURN_LONG(index->ngeoms);
+}
+
+/* -- class GEOSPointGrid -------------------- */
+
+/*
+ * Uniform grid over a point set, for radius, box and nearest
+ * queries without a GEOS object per point. Points are sorted
+ * by cell with a counting sort, so each point costs its two
+ * coordinates and an id. Ids are positions in the input.
+ */
+typedef struct PointGrid_t {
+    long npoints;
+    double *xy; /* x, y of each point, in cell order */
+    uint32_t *ids;
+    long *cellStart; /* ncols * nrows + 1 offsets into xy and ids */
+    long ncols, nrows;
+    double minx, miny, cellSize;
+} PointGrid;
+
+/* Nearest queries keep the best candidates sorted in one of these */
+typedef struct PointGridHit_t {
+    double dist2;
+    uint32_t id;
+} PointGridHit;
+
+PHP_METHOD(PointGrid, __construct);
+PHP_METHOD(PointGrid, withinDistance);
+PHP_METHOD(PointGrid, bbox);
+PHP_METHOD(PointGrid, nearest);
+PHP_METHOD(PointGrid, count);
+
+static zend_function_entry PointGrid_methods[] = {
+    PHP_ME(PointGrid, __construct, NULL, 0)
+    PHP_ME(PointGrid, withinDistance, NULL, 0)
+    PHP_ME(PointGrid, bbox, NULL, 0)
+    PHP_ME(PointGrid, nearest, NULL, 0)
+    PHP_ME(PointGrid, count, NULL, 0)
+    {NULL, NULL, NULL}
+};
+
+static zend_class_entry *PointGrid_ce_ptr;
+
+static zend_object_handlers PointGrid_object_handlers;
+
+/* Cells per point, at most, when choosing or capping the cell size */
+#define GEOSPOINTGRID_CELLS_PER_POINT 4
+
+/* false for NaN and infinities, points left out of the grid */
+#define POINTGRID_FINITE(x) ((x) - (x) == 0)
+
+static void
+PointGrid_dtor (void *object TSRMLS_DC)
+{
+    Proxy *obj = (Proxy *)object;
+    PointGrid *grid = (PointGrid*)obj->relay;
+
+    if ( grid ) {
+        if ( grid->xy ) efree(grid->xy);
+        if ( grid->ids ) efree(grid->ids);
+        if ( grid->cellStart ) efree(grid->cellStart);
+        efree(grid);
     }
-    other = getRelay(zobj, Geometry_ce_ptr);
 
-    ret = GEOSTouches_r(GEOS_G(handle), this, other);
-    if ( ret == 2 ) RETURN_NULL(); /* should get an exception first */
+    zend_hash_destroy(obj->std.properties);
+    FREE_HASHTABLE(obj->std.properties);
 
-    /* return_value is a zval */
-    retBool = ret;
-    RETURN_BOOL(retBool);
+    efree(obj);
 }
 
-/**
- * bool GEOSGeometry::intersects(GEOSGeometry)
- */
-PHP_METHOD(Geometry, intersects)
+static zend_object_value
+PointGrid_create_obj (zend_class_entry *type TSRMLS_DC)
 {
-    GEOSGeometry *this;
-    GEOSGeometry *other;
-    int ret;
-    zend_bool retBool;
-    zval *zobj;
-
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    return Gen_create_obj(type, PointGrid_dtor,
+        &PointGrid_object_handlers TSRMLS_CC);
+}
 
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o", &zobj)
-            == FAILURE) {
-        RETURN_NULL();
+/*
+ * Append the coordinates of a point, or of the points of a
+ * multipoint, to xy. Empty points are kept as NaN so that ids
+ * stay positions. Throws for any other geometry type.
+ */
+static int
+PointGrid_addGeometry(const GEOSGeometry* g, double** xy, long* n,
+        long* capacity TSRMLS_DC)
+{
+    const GEOSGeometry *point;
+    const GEOSCoordSequence *seq;
+    int type, ngeoms, i;
+
+    type = GEOSGeomTypeId_r(GEOS_G(handle), g);
+    if ( type != GEOS_POINT && type != GEOS_MULTIPOINT ) {
+        zend_throw_exception_ex(zend_exception_get_default(TSRMLS_C), 1
+            TSRMLS_CC, "Only points are supported, expected POINT or"
+            " MULTIPOINT geometries");
+        return FAILURE;
     }
-    other = getRelay(zobj, Geometry_ce_ptr);
 
-    ret = GEOSIntersects_r(GEOS_G(handle), this, other);
-    if ( ret == 2 ) RETURN_NULL(); /* should get an exception first */
+    ngeoms = GEOSGetNumGeometries_r(GEOS_G(handle), g);
+    for (i=0; i<ngeoms; ++i) {
+        if ( *n == *capacity ) {
+            *capacity = *capacity ? *capacity * 2 : 64;
+            *xy = (double*)safe_erealloc(*xy, *capacity,
+                2 * sizeof(double), 0);
+        }
+        (*xy)[2 * *n] = (*xy)[2 * *n + 1] = NAN;
+
+        point = GEOSGetGeometryN_r(GEOS_G(handle), g, i);
+        if ( ! GEOSisEmpty_r(GEOS_G(handle), point) ) {
+            seq = GEOSGeom_getCoordSeq_r(GEOS_G(handle), point);
+            if ( ! seq ) return FAILURE; /* should get an exception first */
+            GEOSCoordSeq_getX_r(GEOS_G(handle), seq, 0, &(*xy)[2 * *n]);
+            GEOSCoordSeq_getY_r(GEOS_G(handle), seq, 0, &(*xy)[2 * *n + 1]);
+        }
+        ++*n;
+    }
 
-    /* return_value is a zval */
-    retBool = ret;
-    RETURN_BOOL(retBool);
+    return SUCCESS;
 }
 
-/**
- * bool GEOSGeometry::crosses(GEOSGeometry)
+/*
+ * Read points given either as a string of packed native-endian
+ * double X,Y pairs, a POINT or MULTIPOINT GEOSGeometry or an
+ * array of them into a new xy array, empty points being NaN.
  */
-PHP_METHOD(Geometry, crosses)
+static int
+readPoints(zval* zpoints, double** xy, long* n TSRMLS_DC)
 {
-    GEOSGeometry *this;
-    GEOSGeometry *other;
-    int ret;
-    zend_bool retBool;
-    zval *zobj;
-
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    GEOSGeometry *geom;
+    zval **data;
+    HashTable *arr_hash;
+    HashPosition pointer;
+    long capacity = 0;
+
+    *xy = NULL;
+    *n = 0;
+
+    if ( Z_TYPE_P(zpoints) == IS_STRING ) {
+        if ( Z_STRLEN_P(zpoints) % (2 * sizeof(double)) ) {
+            zend_throw_exception_ex(zend_exception_get_default(TSRMLS_C), 1
+                TSRMLS_CC, "Packed coordinates length must be a multiple of %d",
+                (int)(2 * sizeof(double)));
+            return FAILURE;
+        }
+        *n = Z_STRLEN_P(zpoints) / (2 * sizeof(double));
+        /* copied, the string is not necessarily aligned */
+        *xy = (double*)safe_emalloc(*n + 1, 2 * sizeof(double), 0);
+        memcpy(*xy, Z_STRVAL_P(zpoints), Z_STRLEN_P(zpoints));
+        return SUCCESS;
+    }
 
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o", &zobj)
-            == FAILURE) {
-        RETURN_NULL();
+    if ( Z_TYPE_P(zpoints) == IS_ARRAY ) {
+        arr_hash = Z_ARRVAL_P(zpoints);
+        for (zend_hash_internal_pointer_reset_ex(arr_hash, &pointer);
+             zend_hash_get_current_data_ex(arr_hash, (void**) &data,
+                                           &pointer) == SUCCESS;
+             zend_hash_move_forward_ex(arr_hash, &pointer))
+        {
+            geom = getGeometryElement(*data TSRMLS_CC);
+            if ( ! geom || PointGrid_addGeometry(geom, xy, n, &capacity
+                    TSRMLS_CC) == FAILURE ) {
+                if ( *xy ) efree(*xy);
+                return FAILURE; /* should get an exception first */
+            }
+        }
+    } else {
+        geom = getGeometryElement(zpoints TSRMLS_CC);
+        if ( ! geom || PointGrid_addGeometry(geom, xy, n, &capacity
+                TSRMLS_CC) == FAILURE ) {
+            if ( *xy ) efree(*xy);
+            return FAILURE; /* should get an exception first */
+        }
     }
-    other = getRelay(zobj, Geometry_ce_ptr);
 
-    ret = GEOSCrosses_r(GEOS_G(handle), this, other);
-    if ( ret == 2 ) RETURN_NULL(); /* should get an exception first */
+    return SUCCESS;
+}
 
-    /* return_value is a zval */
-    retBool = ret;
-    RETURN_BOOL(retBool);
+/* Column of x, clamped to the grid. NaN goes to the first */
+static long
+PointGrid_col(const PointGrid* grid, double x)
+{
+    double col = floor((x - grid->minx) / grid->cellSize);
+    if ( ! (col >= 0) ) return 0;
+    if ( col >= grid->ncols ) return grid->ncols - 1;
+    return (long)col;
 }
 
-/**
- * bool GEOSGeometry::within(GEOSGeometry)
+static long
+PointGrid_row(const PointGrid* grid, double y)
+{
+    double row = floor((y - grid->miny) / grid->cellSize);
+    if ( ! (row >= 0) ) return 0;
+    if ( row >= grid->nrows ) return grid->nrows - 1;
+    return (long)row;
+}
+
+/*
+ * Bucket n points of xy into a new grid. NaN and infinite
+ * coordinates are left out. A cellSize of zero picks one giving
+ * a couple of points per cell; any cell size is enlarged if needed
+ * to keep the grid within GEOSPOINTGRID_CELLS_PER_POINT cells per
+ * point. cellSize must be finite.
  */
-PHP_METHOD(Geometry, within)
+static PointGrid*
+PointGrid_create(const double* xy, long n, double cellSize)
 {
-    GEOSGeometry *this;
-    GEOSGeometry *other;
-    int ret;
-    zend_bool retBool;
-    zval *zobj;
+    PointGrid *grid;
+    double maxx = 0, maxy = 0, width, height, x, y;
+    long i, j, cell, ncells, nvalid = 0, maxcells;
+    long *fill;
+
+    grid = (PointGrid*)ecalloc(1, sizeof(PointGrid));
+
+    for (i=0; i<n; ++i) {
+        x = xy[2 * i];
+        y = xy[2 * i + 1];
+        if ( ! POINTGRID_FINITE(x) || ! POINTGRID_FINITE(y) ) continue;
+        if ( ! nvalid || x < grid->minx ) grid->minx = x;
+        if ( ! nvalid || y < grid->miny ) grid->miny = y;
+        if ( ! nvalid || x > maxx ) maxx = x;
+        if ( ! nvalid || y > maxy ) maxy = y;
+        ++nvalid;
+    }
 
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    width = maxx - grid->minx;
+    height = maxy - grid->miny;
+    if ( ! POINTGRID_FINITE(width) || ! POINTGRID_FINITE(height) ) {
+        /* the extent overflows a double, a single cell then */
+        width = height = 0;
+        cellSize = HUGE_VAL;
+    }
+    maxcells = GEOSPOINTGRID_CELLS_PER_POINT * nvalid + 1;
+    if ( cellSize <= 0 ) cellSize = sqrt(width * height / (nvalid / 2 + 1));
+    if ( cellSize <= 0 ) cellSize = MAX(width, height) / (nvalid + 1);
+    if ( cellSize <= 0 ) cellSize = 1;
+    while ( (width / cellSize + 1) * (height / cellSize + 1) > maxcells ) {
+        cellSize *= 2;
+    }
 
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o", &zobj)
-            == FAILURE) {
-        RETURN_NULL();
+    grid->cellSize = cellSize;
+    grid->ncols = (long)(width / cellSize) + 1;
+    grid->nrows = (long)(height / cellSize) + 1;
+    ncells = grid->ncols * grid->nrows;
+
+    /* counting pass, then fill */
+    grid->cellStart = (long*)ecalloc(ncells + 1, sizeof(long));
+    for (i=0; i<n; ++i) {
+        x = xy[2 * i];
+        y = xy[2 * i + 1];
+        if ( ! POINTGRID_FINITE(x) || ! POINTGRID_FINITE(y) ) continue;
+        cell = PointGrid_row(grid, y) * grid->ncols + PointGrid_col(grid, x);
+        grid->cellStart[cell + 1]++;
+    }
+    for (cell=0; cell<ncells; ++cell) {
+        grid->cellStart[cell + 1] += grid->cellStart[cell];
     }
-    other = getRelay(zobj, Geometry_ce_ptr);
 
-    ret = GEOSWithin_r(GEOS_G(handle), this, other);
-    if ( ret == 2 ) RETURN_NULL(); /* should get an exception first */
+    grid->npoints = nvalid;
+    grid->xy = (double*)safe_emalloc(nvalid + 1, 2 * sizeof(double), 0);
+    grid->ids = (uint32_t*)safe_emalloc(nvalid + 1, sizeof(uint32_t), 0);
+    fill = (long*)safe_emalloc(ncells, sizeof(long), 0);
+    memcpy(fill, grid->cellStart, ncells * sizeof(long));
+
+    for (i=0; i<n; ++i) {
+        x = xy[2 * i];
+        y = xy[2 * i + 1];
+        if ( ! POINTGRID_FINITE(x) || ! POINTGRID_FINITE(y) ) continue;
+        cell = PointGrid_row(grid, y) * grid->ncols + PointGrid_col(grid, x);
+        j = fill[cell]++;
+        grid->xy[2 * j] = x;
+        grid->xy[2 * j + 1] = y;
+        grid->ids[j] = (uint32_t)i;
+    }
+    efree(fill);
 
-    /* return_value is a zval */
-    retBool = ret;
-    RETURN_BOOL(retBool);
+    return grid;
 }
 
-/**
- * bool GEOSGeometry::contains(GEOSGeometry)
- */
-PHP_METHOD(Geometry, contains)
+static int
+PointGrid_cmpIds(const void* a, const void* b)
 {
-    GEOSGeometry *this;
-    GEOSGeometry *other;
-    int ret;
-    zend_bool retBool;
-    zval *zobj;
+    long ia = *(const long*)a;
+    long ib = *(const long*)b;
+    return ia < ib ? -1 : ia > ib ? 1 : 0;
+}
 
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+/*
+ * Set return_value to the ids of the points within the given
+ * box and, if radius is not negative, within radius of (x, y),
+ * in increasing order.
+ */
+static void
+PointGrid_search(const PointGrid* grid, double minx, double miny,
+        double maxx, double maxy, double x, double y, double radius,
+        zval* return_value)
+{
+    long col0, col1, row0, row1, col, row, cell, i, n = 0, capacity = 0;
+    long *found = NULL;
+    double px, py;
 
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o", &zobj)
-            == FAILURE) {
-        RETURN_NULL();
+    /* written so that NaN bounds find nothing */
+    array_init(return_value);
+    if ( ! grid->npoints || ! (minx <= maxx && miny <= maxy) ) return;
+
+    col0 = PointGrid_col(grid, minx);
+    col1 = PointGrid_col(grid, maxx);
+    row0 = PointGrid_row(grid, miny);
+    row1 = PointGrid_row(grid, maxy);
+
+    for (row=row0; row<=row1; ++row) {
+        for (col=col0; col<=col1; ++col) {
+            cell = row * grid->ncols + col;
+            for (i=grid->cellStart[cell]; i<grid->cellStart[cell + 1]; ++i) {
+                px = grid->xy[2 * i];
+                py = grid->xy[2 * i + 1];
+                if ( px < minx || px > maxx || py < miny || py > maxy ) {
+                    continue;
+                }
+                if ( radius >= 0 &&
+                        (px - x) * (px - x) + (py - y) * (py - y)
+                            > radius * radius ) {
+                    continue;
+                }
+                if ( n == capacity ) {
+                    capacity = capacity ? capacity * 2 : 64;
+                    found = (long*)safe_erealloc(found, capacity,
+                        sizeof(long), 0);
+                }
+                found[n++] = grid->ids[i];
+            }
+        }
     }
-    other = getRelay(zobj, Geometry_ce_ptr);
 
-    ret = GEOSContains_r(GEOS_G(handle), this, other);
-    if ( ret == 2 ) RETURN_NULL(); /* should get an exception first */
+    if ( ! found ) return;
 
-    /* return_value is a zval */
-    retBool = ret;
-    RETURN_BOOL(retBool);
+    qsort(found, n, sizeof(long), PointGrid_cmpIds);
+    for (i=0; i<n; ++i) add_next_index_long(return_value, found[i]);
+    efree(found);
 }
 
-/**
- * bool GEOSGeometry::overlaps(GEOSGeometry)
+/* Closer first, then lowest id */
+static int
+PointGridHit_before(const PointGridHit* a, const PointGridHit* b)
+{
+    if ( a->dist2 != b->dist2 ) return a->dist2 < b->dist2;
+    return a->id < b->id;
+}
+
+/*
+ * Set return_value to the ids of the k points closest to (x, y),
+ * no farther than maxDistance if it is not negative, closest
+ * first. Cells are visited in growing square rings around the
+ * cell of (x, y) until no unvisited cell can hold a closer point.
  */
-PHP_METHOD(Geometry, overlaps)
+static void
+PointGrid_nearest(const PointGrid* grid, double x, double y, long k,
+        double maxDistance, zval* return_value)
 {
-    GEOSGeometry *this;
-    GEOSGeometry *other;
-    int ret;
-    zend_bool retBool;
-    zval *zobj;
+    PointGridHit *hits, hit;
+    long qcol, qrow, ring, col, row, cell, i, j, nhits = 0;
+    double bound, px, py, left, right, bottom, top;
+    int covered;
 
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    array_init(return_value);
+    if ( k < 1 || ! grid->npoints || x != x || y != y ) return;
+    if ( k > grid->npoints ) k = grid->npoints;
+
+    hits = (PointGridHit*)safe_emalloc(k, sizeof(PointGridHit), 0);
+    qcol = PointGrid_col(grid, x);
+    qrow = PointGrid_row(grid, y);
+
+    for (ring=0; ; ++ring) {
+        for (row=qrow - ring; row<=qrow + ring; ++row) {
+            if ( row < 0 || row >= grid->nrows ) continue;
+            for (col=qcol - ring; col<=qcol + ring; ++col) {
+                if ( col < 0 || col >= grid->ncols ) continue;
+                /* only the outline of the ring is new */
+                if ( row != qrow - ring && row != qrow + ring &&
+                        col != qcol - ring && col != qcol + ring ) {
+                    col = qcol + ring - 1;
+                    continue;
+                }
+                cell = row * grid->ncols + col;
+                for (i=grid->cellStart[cell]; i<grid->cellStart[cell + 1];
+                        ++i) {
+                    px = grid->xy[2 * i] - x;
+                    py = grid->xy[2 * i + 1] - y;
+                    hit.dist2 = px * px + py * py;
+                    hit.id = grid->ids[i];
+                    if ( maxDistance >= 0 &&
+                            hit.dist2 > maxDistance * maxDistance ) {
+                        continue;
+                    }
+                    if ( nhits == k && ! PointGridHit_before(&hit,
+                            &hits[k - 1]) ) {
+                        continue;
+                    }
+                    /* insertion into the sorted hits */
+                    j = nhits < k ? nhits++ : k - 1;
+                    while ( j && PointGridHit_before(&hit, &hits[j - 1]) ) {
+                        hits[j] = hits[j - 1];
+                        --j;
+                    }
+                    hits[j] = hit;
+                }
+            }
+        }
 
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o", &zobj)
-            == FAILURE) {
-        RETURN_NULL();
+        /* anything outside the rings so far is at least this far */
+        left = x - (grid->minx + (qcol - ring) * grid->cellSize);
+        right = grid->minx + (qcol + ring + 1) * grid->cellSize - x;
+        bottom = y - (grid->miny + (qrow - ring) * grid->cellSize);
+        top = grid->miny + (qrow + ring + 1) * grid->cellSize - y;
+        bound = MIN(MIN(left, right), MIN(bottom, top));
+
+        covered = qcol - ring <= 0 && qrow - ring <= 0 &&
+            qcol + ring >= grid->ncols - 1 && qrow + ring >= grid->nrows - 1;
+        if ( covered ) break;
+        if ( bound > 0 && maxDistance >= 0 && bound > maxDistance ) break;
+        if ( bound > 0 && nhits == k && bound * bound > hits[k - 1].dist2 ) {
+            break;
+        }
     }
-    other = getRelay(zobj, Geometry_ce_ptr);
 
-    ret = GEOSOverlaps_r(GEOS_G(handle), this, other);
-    if ( ret == 2 ) RETURN_NULL(); /* should get an exception first */
-
-    /* return_value is a zval */
-    retBool = ret;
-    RETURN_BOOL(retBool);
+    for (i=0; i<nhits; ++i) add_next_index_long(return_value, hits[i].id);
+    efree(hits);
 }
 
 /**
- * bool GEOSGeometry::covers(GEOSGeometry)
+ * GEOSPointGrid grid = new GEOSPointGrid(points, [cellSize])
+ *
+ * 'points' is either a string of packed native-endian double
+ * X,Y pairs, as produced by pack('d*', x0, y0, x1, y1, ...),
+ * a POINT or MULTIPOINT GEOSGeometry, or an array of them.
+ * Ids returned by the queries are positions of the points in
+ * the input; empty points are never returned.
+ *
+ * 'cellSize' defaults to one giving a couple of points per cell.
+ * Queries are fastest with cells about the size of the usual
+ * search radius.
  */
-#ifdef HAVE_GEOS_COVERS
-PHP_METHOD(Geometry, covers)
+PHP_METHOD(PointGrid, __construct)
 {
-    GEOSGeometry *this;
-    GEOSGeometry *other;
-    int ret;
-    zend_bool retBool;
-    zval *zobj;
+    PointGrid *grid;
+    zval *zpoints;
+    double *xy = NULL;
+    double cellSize = 0;
+    long n = 0;
+    zval *object = getThis();
 
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "z|d", &zpoints,
+            &cellSize) == FAILURE) {
+        return;
+    }
 
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o", &zobj)
-            == FAILURE) {
-        RETURN_NULL();
+    if ( ! POINTGRID_FINITE(cellSize) ) {
+        zend_throw_exception_ex(zend_exception_get_default(TSRMLS_C), 1
+            TSRMLS_CC, "Cell size must be a finite number");
+        return;
     }
-    other = getRelay(zobj, Geometry_ce_ptr);
 
-    ret = GEOSCovers_r(GEOS_G(handle), this, other);
-    if ( ret == 2 ) RETURN_NULL(); /* should get an exception first */
+    if ( readPoints(zpoints, &xy, &n TSRMLS_CC) == FAILURE ) {
+        return; /* should get an exception first */
+    }
 
-    /* return_value is a zval */
-    retBool = ret;
-    RETURN_BOOL(retBool);
+    if ( n > UINT32_MAX ) {
+        efree(xy);
+        zend_throw_exception_ex(zend_exception_get_default(TSRMLS_C), 1
+            TSRMLS_CC, "Too many points for GEOSPointGrid");
+        return;
+    }
+
+    grid = PointGrid_create(xy, n, cellSize);
+    if ( xy ) efree(xy);
+
+    setRelay(object, grid TSRMLS_CC);
 }
-#endif
 
 /**
- * bool GEOSGeometry::coveredBy(GEOSGeometry)
+ * array GEOSPointGrid::withinDistance(x, y, radius)
+ *
+ * Ids of the points at most 'radius' away from (x, y),
+ * in increasing order.
  */
-#ifdef HAVE_GEOS_COVERED_BY
-PHP_METHOD(Geometry, coveredBy)
+PHP_METHOD(PointGrid, withinDistance)
 {
-    GEOSGeometry *this;
-    GEOSGeometry *other;
-    int ret;
-    zend_bool retBool;
-    zval *zobj;
+    PointGrid *grid;
+    double x, y, radius;
 
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    grid = (PointGrid*)getRelay(getThis(), PointGrid_ce_ptr TSRMLS_CC);
 
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o", &zobj)
-            == FAILURE) {
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "ddd", &x, &y,
+            &radius) == FAILURE) {
         RETURN_NULL();
     }
-    other = getRelay(zobj, Geometry_ce_ptr);
 
-    ret = GEOSCoveredBy_r(GEOS_G(handle), this, other);
-    if ( ret == 2 ) RETURN_NULL(); /* should get an exception first */
+    if ( radius < 0 ) {
+        array_init(return_value);
+        return;
+    }
 
-    /* return_value is a zval */
-    retBool = ret;
-    RETURN_BOOL(retBool);
+    PointGrid_search(grid, x - radius, y - radius, x + radius, y + radius,
+        x, y, radius, return_value);
 }
-#endif
 
 /**
- * bool GEOSGeometry::equals(GEOSGeometry)
+ * array GEOSPointGrid::bbox(minx, miny, maxx, maxy)
+ *
+ * Ids of the points within the box, boundary included,
+ * in increasing order.
  */
-PHP_METHOD(Geometry, equals)
+PHP_METHOD(PointGrid, bbox)
 {
-    GEOSGeometry *this;
-    GEOSGeometry *other;
-    int ret;
-    zend_bool retBool;
-    zval *zobj;
+    PointGrid *grid;
+    double minx, miny, maxx, maxy;
 
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    grid = (PointGrid*)getRelay(getThis(), PointGrid_ce_ptr TSRMLS_CC);
 
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o",
-        &zobj) == FAILURE) {
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "dddd",
+            &minx, &miny, &maxx, &maxy) == FAILURE) {
         RETURN_NULL();
     }
-    other = getRelay(zobj, Geometry_ce_ptr);
 
-    ret = GEOSEquals_r(GEOS_G(handle), this, other);
-    if ( ret == 2 ) RETURN_NULL(); /* should get an exception first */
-
-    /* return_value is a zval */
-    retBool = ret;
-    RETURN_BOOL(retBool);
+    PointGrid_search(grid, minx, miny, maxx, maxy, 0, 0, -1, return_value);
 }
 
 /**
- * bool GEOSGeometry::equalsExact(GEOSGeometry)
- * bool GEOSGeometry::equalsExact(GEOSGeometry, double tolerance)
+ * array GEOSPointGrid::nearest(x, y, [k], [maxDistance])
+ *
+ * Ids of the 'k' (default 1) points closest to (x, y), closest
+ * first, ties broken by lowest id. Points farther than
+ * 'maxDistance' are left out when it is given.
  */
-PHP_METHOD(Geometry, equalsExact)
+PHP_METHOD(PointGrid, nearest)
 {
-    GEOSGeometry *this;
-    GEOSGeometry *other;
-    int ret;
-    double tolerance = 0;
-    zend_bool retBool;
-    zval *zobj;
+    PointGrid *grid;
+    zval *zmax = NULL;
+    double x, y;
+    double maxDistance = -1;
+    long k = 1;
 
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    grid = (PointGrid*)getRelay(getThis(), PointGrid_ce_ptr TSRMLS_CC);
 
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o|d",
-        &zobj, &tolerance) == FAILURE) {
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "dd|lz!", &x, &y,
+            &k, &zmax) == FAILURE) {
         RETURN_NULL();
     }
-    other = getRelay(zobj, Geometry_ce_ptr);
-
-    ret = GEOSEqualsExact_r(GEOS_G(handle), this, other, tolerance);
-    if ( ret == 2 ) RETURN_NULL(); /* should get an exception first */
+    if ( zmax ) maxDistance = getZvalAsDouble(zmax);
 
-    /* return_value is a zval */
-    retBool = ret;
-    RETURN_BOOL(retBool);
+    PointGrid_nearest(grid, x, y, k, maxDistance, return_value);
 }
 
 /**
- * bool GEOSGeometry::isEmpty()
+ * long GEOSPointGrid::count()
+ *
+ * Number of indexed points, empty ones excluded.
  */
-PHP_METHOD(Geometry, isEmpty)
+PHP_METHOD(PointGrid, count)
 {
-    GEOSGeometry *this;
-    int ret;
-    zend_bool retBool;
+    PointGrid *grid;
 
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
-
-    ret = GEOSisEmpty_r(GEOS_G(handle), this);
-    if ( ret == 2 ) RETURN_NULL(); /* should get an exception first */
+    grid = (PointGrid*)getRelay(getThis(), PointGrid_ce_ptr TSRMLS_CC);
 
-    /* return_value is a zval */
-    retBool = ret;
-    RETURN_BOOL(retBool);
+    RETURN_LONG(grid->npoints);
 }
 
-/**
- * array GEOSGeometry::checkValidity()
+/* -- class GEOSBinning -------------------- */
+
+/*
+ * Static aggregation of points into the cells of a grid. Cells
+ * are numbered like those of GEOSGeometry::rasterize: cell i is
+ * at row (i / cols), column (i % cols), rows going down.
  */
-#ifdef HAVE_GEOS_IS_VALID_DETAIL
-PHP_METHOD(Geometry, checkValidity)
+
+PHP_METHOD(Binning, squares);
+PHP_METHOD(Binning, hexagons);
+
+static zend_function_entry Binning_methods[] = {
+    PHP_ME(Binning, squares, NULL, ZEND_ACC_PUBLIC|ZEND_ACC_STATIC)
+    PHP_ME(Binning, hexagons, NULL, ZEND_ACC_PUBLIC|ZEND_ACC_STATIC)
+    {NULL, NULL, NULL}
+};
+
+static zend_class_entry *Binning_ce_ptr;
+
+typedef struct Binning_t {
+    double originX, originY;
+    double cellSize; /* side of squares, circumradius of hexagons */
+    long cols, rows;
+    int hexagonal;
+} Binning;
+
+/* Cell of a point, -1 if outside the grid */
+static long
+Binning_cell(const Binning* b, double x, double y)
 {
-    GEOSGeometry *this;
-    GEOSGeometry *location = NULL;
-    int ret;
-    char *reason = NULL;
-    zend_bool retBool;
-    char *reasonVal = NULL;
-    zval *locationVal = NULL;
-    long int flags = 0;
+    double px, py, q, r, s, rq, rr, rs, col, row;
 
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    if ( ! b->hexagonal ) {
+        col = floor((x - b->originX) / b->cellSize);
+        row = floor((b->originY - y) / b->cellSize);
+    } else {
+        /* axial coordinates of pointy-top hexagons, rounded as cube ones */
+        px = (x - b->originX) / b->cellSize;
+        py = (b->originY - y) / b->cellSize;
+        q = px * sqrt(3.0) / 3 - py / 3;
+        r = py * 2 / 3;
+        s = -q - r;
+        rq = floor(q + 0.5);
+        rr = floor(r + 0.5);
+        rs = floor(s + 0.5);
+        if ( fabs(rq - q) > fabs(rr - r) && fabs(rq - q) > fabs(rs - s) ) {
+            rq = -rr - rs;
+        } else if ( fabs(rr - r) > fabs(rs - s) ) {
+            rr = -rq - rs;
+        }
+        /* odd rows are shifted right by half a hexagon */
+        row = rr;
+        col = rq + floor(rr / 2);
+    }
 
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|l",
-        &flags) == FAILURE) {
-        RETURN_NULL();
+    /* also false for NaN, empty points */
+    if ( ! (col >= 0 && col < b->cols && row >= 0 && row < b->rows) ) {
+        return -1;
     }
+    return (long)row * b->cols + (long)col;
+}
 
-    ret = GEOSisValidDetail_r(GEOS_G(handle), this, flags, &reason, &location);
-    if ( ret == 2 ) RETURN_NULL(); /* should get an exception first */
+/* Polygon of a cell */
+static GEOSGeometry*
+Binning_cellGeometry(const Binning* b, long cell TSRMLS_DC)
+{
+    GEOSCoordSequence *seq;
+    GEOSGeometry *shell;
+    long row = cell / b->cols, col = cell % b->cols;
+    double cx, cy, a;
+    int i;
+
+    if ( ! b->hexagonal ) {
+        return createExtentGeometry(
+            b->originX + col * b->cellSize,
+            b->originY - (row + 1) * b->cellSize,
+            b->originX + (col + 1) * b->cellSize,
+            b->originY - row * b->cellSize TSRMLS_CC);
+    }
 
-    if ( reason ) {
-        reasonVal = estrdup(reason);
-        GEOSFree_r(GEOS_G(handle), reason);
+    cx = b->originX + (col + 0.5 * (row & 1)) * sqrt(3.0) * b->cellSize;
+    cy = b->originY - row * 1.5 * b->cellSize;
+
+    seq = GEOSCoordSeq_create_r(GEOS_G(handle), 7, 2);
+    if ( ! seq ) return NULL; /* should get an exception first */
+    for (i=0; i<7; ++i) {
+        a = M_PI / 6 + (i % 6) * M_PI / 3;
+        GEOSCoordSeq_setX_r(GEOS_G(handle), seq, i, cx + b->cellSize * cos(a));
+        GEOSCoordSeq_setY_r(GEOS_G(handle), seq, i, cy + b->cellSize * sin(a));
     }
 
-    if ( location ) {
-        MAKE_STD_ZVAL(locationVal);
-        object_init_ex(locationVal, Geometry_ce_ptr);
-        setRelay(locationVal, location);
+    shell = GEOSGeom_createLinearRing_r(GEOS_G(handle), seq);
+    if ( ! shell ) return NULL; /* should get an exception first */
+    return GEOSGeom_createPolygon_r(GEOS_G(handle), shell, NULL, 0);
+}
+
+/*
+ * Count, and sum the weights of, the points of each cell into
+ * the 'counts', 'sums' and 'cells' entries of return_value.
+ */
+static void
+binPoints(const Binning* b, zval* zpoints, const char* weights, int wlen,
+        zend_bool polygons, zval* return_value TSRMLS_DC)
+{
+    double *xy;
+    double *sums = NULL;
+    uint32_t *counts;
+    GEOSGeometry *geom;
+    zval *cells;
+    zval *tmp;
+    double w;
+    long n, i, cell, ncells;
+
+    if ( checkGrid(b->cellSize, b->cols, b->rows TSRMLS_CC) == FAILURE ) {
+        RETURN_NULL(); /* should get an exception first */
+    }
+    if ( readPoints(zpoints, &xy, &n TSRMLS_CC) == FAILURE ) {
+        RETURN_NULL(); /* should get an exception first */
+    }
+    if ( weights && (size_t)wlen != n * sizeof(double) ) {
+        if ( xy ) efree(xy);
+        zend_throw_exception_ex(zend_exception_get_default(TSRMLS_C), 1
+            TSRMLS_CC, "Expected %ld packed weights, got %d bytes", n, wlen);
+        RETURN_NULL();
     }
 
-    retBool = ret;
+    ncells = b->cols * b->rows;
+    counts = (uint32_t*)safe_emalloc(ncells, sizeof(uint32_t), 1);
+    memset(counts, 0, ncells * sizeof(uint32_t) + 1);
+    if ( weights ) {
+        sums = (double*)safe_emalloc(ncells, sizeof(double), 1);
+        memset(sums, 0, ncells * sizeof(double) + 1);
+    }
+
+    for (i=0; i<n; ++i) {
+        cell = Binning_cell(b, xy[2 * i], xy[2 * i + 1]);
+        if ( cell < 0 ) continue;
+        counts[cell]++;
+        if ( sums ) {
+            /* copied, the string is not necessarily aligned */
+            memcpy(&w, weights + i * sizeof(double), sizeof(double));
+            sums[cell] += w;
+        }
+    }
+    if ( xy ) efree(xy);
 
-    /* return value is an array */
     array_init(return_value);
-    add_assoc_bool(return_value, "valid", retBool);
-    if ( reasonVal ) add_assoc_string(return_value, "reason", reasonVal, 0);
-    if ( locationVal ) add_assoc_zval(return_value, "location", locationVal);
+    add_assoc_stringl(return_value, "counts", (char*)counts,
+        ncells * sizeof(uint32_t), 0);
+    if ( sums ) {
+        add_assoc_stringl(return_value, "sums", (char*)sums,
+            ncells * sizeof(double), 0);
+    }
+    if ( ! polygons ) return;
 
+    MAKE_STD_ZVAL(cells);
+    array_init(cells);
+    for (cell=0; cell<ncells; ++cell) {
+        if ( ! counts[cell] ) continue;
+        geom = Binning_cellGeometry(b, cell TSRMLS_CC);
+        if ( ! geom ) break; /* should get an exception first */
+
+        MAKE_STD_ZVAL(tmp);
+        object_init_ex(tmp, Geometry_ce_ptr);
+        if ( setRelay(tmp, geom TSRMLS_CC) == FAILURE ) {
+            zval_ptr_dtor(&tmp);
+            break; /* should get an exception first */
+        }
+        add_index_zval(cells, cell, tmp);
+    }
+    add_assoc_zval(return_value, "cells", cells);
 }
-#endif
 
 /**
- * bool GEOSGeometry::isSimple()
+ * array GEOSBinning::squares(points, originX, originY, cellSize, cols, rows,
+ *                            [weights], [polygons])
+ *
+ * Count the points falling in each cell of a grid of cols x rows
+ * square cells, (originX, originY) being the top left corner of
+ * the grid. Points outside the grid, and empty points, are left out.
+ *
+ * 'points' is a string of packed native-endian double X,Y pairs,
+ * as produced by pack('d*', x0, y0, x1, y1, ...), a POINT or
+ * MULTIPOINT GEOSGeometry or an array of them.
+ *
+ * The returned array has:
+ *
+ *  'counts'
+ *       Type: string
+ *       the native uint32 point count of each cell,
+ *       see unpack('L*').
+ *  'sums'
+ *       Type: string
+ *       only with 'weights', a string of packed native doubles
+ *       holding one weight per point: the native double sum
+ *       of the weights of the points of each cell.
+ *  'cells'
+ *       Type: array
+ *       only if 'polygons' is true, the polygon of each
+ *       non-empty cell, keyed by cell number.
  */
-PHP_METHOD(Geometry, isSimple)
+PHP_METHOD(Binning, squares)
 {
-    GEOSGeometry *this;
-    int ret;
-    zend_bool retBool;
+    Binning b;
+    zval *zpoints;
+    char *weights = NULL;
+    int wlen = 0;
+    zend_bool polygons = 0;
+
+    memset(&b, 0, sizeof(b));
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "zdddll|s!b",
+            &zpoints, &b.originX, &b.originY, &b.cellSize, &b.cols, &b.rows,
+            &weights, &wlen, &polygons) == FAILURE) {
+        RETURN_NULL();
+    }
 
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    binPoints(&b, zpoints, weights, wlen, polygons, return_value TSRMLS_CC);
+}
 
-    ret = GEOSisSimple_r(GEOS_G(handle), this);
-    if ( ret == 2 ) RETURN_NULL(); /* should get an exception first */
+/**
+ * array GEOSBinning::hexagons(points, originX, originY, cellSize, cols, rows,
+ *                             [weights], [polygons])
+ *
+ * Same as GEOSBinning::squares, with pointy-top hexagons whose
+ * vertices are cellSize away from their centre. (originX, originY)
+ * is the centre of the top left hexagon. Rows are 1.5 * cellSize
+ * apart and odd rows are shifted right by half a hexagon.
+ */
+PHP_METHOD(Binning, hexagons)
+{
+    Binning b;
+    zval *zpoints;
+    char *weights = NULL;
+    int wlen = 0;
+    zend_bool polygons = 0;
+
+    memset(&b, 0, sizeof(b));
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "zdddll|s!b",
+            &zpoints, &b.originX, &b.originY, &b.cellSize, &b.cols, &b.rows,
+            &weights, &wlen, &polygons) == FAILURE) {
+        RETURN_NULL();
+    }
+    b.hexagonal = 1;
 
-    /* return_value is a zval */
-    retBool = ret;
-    RETURN_BOOL(retBool);
+    binPoints(&b, zpoints, weights, wlen, polygons, return_value TSRMLS_CC);
+}
+
+/* -- class GEOSPreparedGeometry -------------------- */
+
+PHP_METHOD(PreparedGeometry, __construct);
+PHP_METHOD(PreparedGeometry, contains);
+PHP_METHOD(PreparedGeometry, intersects);
+PHP_METHOD(PreparedGeometry, containsPoints);
+
+static zend_function_entry PreparedGeometry_methods[] = {
+    PHP_ME(PreparedGeometry, __construct, NULL, 0)
+    PHP_ME(PreparedGeometry, contains, NULL, 0)
+    PHP_ME(PreparedGeometry, intersects, NULL, 0)
+    PHP_ME(PreparedGeometry, containsPoints, NULL, 0)
+    {NULL, NULL, NULL}
+};
+
+static zend_class_entry *PreparedGeometry_ce_ptr;
+
+static zend_object_handlers PreparedGeometry_object_handlers;
+
+static void
+PreparedGeometry_dtor (void *object TSRMLS_DC)
+{
+    Proxy *obj = (Proxy *)object;
+    PreparedGeometry *pg = (PreparedGeometry*)obj->relay;
+
+    if ( pg ) {
+        PreparedGeometry_release(pg TSRMLS_CC);
+        GEOS_G(memory_usage) -= obj->memory;
+        efree(pg);
+    }
+
+    zend_hash_destroy(obj->std.properties);
+    FREE_HASHTABLE(obj->std.properties);
+
+    efree(obj);
+}
+
+static zend_object_value
+PreparedGeometry_create_obj (zend_class_entry *type TSRMLS_DC)
+{
+    return Gen_create_obj(type, PreparedGeometry_dtor,
+        &PreparedGeometry_object_handlers TSRMLS_CC);
+}
+
+/* Get the prepared geometry, preparing it on first use */
+static const GEOSPreparedGeometry*
+getPreparedGeometry(PreparedGeometry* pg TSRMLS_DC)
+{
+    if ( ! pg->prepared ) {
+        pg->prepared = GEOSPrepare_r(GEOS_G(handle), pg->geom);
+    }
+    return pg->prepared;
 }
 
 /**
- * bool GEOSGeometry::isRing()
+ * GEOSPreparedGeometry p = new GEOSPreparedGeometry(GEOSGeometry)
+ *
+ * The geometry is copied, changing the original afterwards
+ * does not affect the prepared one.
  */
-PHP_METHOD(Geometry, isRing)
+PHP_METHOD(PreparedGeometry, __construct)
 {
-    GEOSGeometry *this;
-    int ret;
-    zend_bool retBool;
+    PreparedGeometry *pg;
+    GEOSGeometry *geom;
+    zval *zobj;
+    zval *object = getThis();
+    long size;
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o", &zobj)
+            == FAILURE) {
+        php_error_docref(NULL TSRMLS_CC, E_ERROR,
+                "Parameter must be a GEOSGeometry object");
+        return;
+    }
+    geom = getRelay(zobj, Geometry_ce_ptr TSRMLS_CC);
+    if ( ! geom ) RETURN_NULL(); /* should get an exception first */
 
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    size = geometryMemorySize(geom TSRMLS_CC);
+    if ( checkMemoryLimit(size TSRMLS_CC) == FAILURE ) return;
 
-    ret = GEOSisRing_r(GEOS_G(handle), this);
-    if ( ret == 2 ) RETURN_NULL(); /* should get an exception first */
+    pg = (PreparedGeometry*)ecalloc(1, sizeof(PreparedGeometry));
+    pg->owned = 1;
+    pg->geom = GEOSGeom_clone_r(GEOS_G(handle), geom);
+    setRelay(object, pg TSRMLS_CC);
+    if ( ! pg->geom ) return; /* should get an exception first */
 
-    /* return_value is a zval */
-    retBool = ret;
-    RETURN_BOOL(retBool);
+    ((Proxy*)zend_object_store_get_object(object TSRMLS_CC))->memory = size;
+    GEOS_G(memory_usage) += size;
 }
 
 /**
- * bool GEOSGeometry::hasZ()
+ * bool GEOSPreparedGeometry::contains(GEOSGeometry)
  */
-PHP_METHOD(Geometry, hasZ)
+PHP_METHOD(PreparedGeometry, contains)
 {
-    GEOSGeometry *this;
+    PreparedGeometry *pg;
+    const GEOSPreparedGeometry *prepared;
+    GEOSGeometry *other;
     int ret;
     zend_bool retBool;
+    zval *zobj;
 
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    pg = (PreparedGeometry*)getRelay(getThis(), PreparedGeometry_ce_ptr TSRMLS_CC);
 
-    ret = GEOSHasZ_r(GEOS_G(handle), this);
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o", &zobj)
+            == FAILURE) {
+        RETURN_NULL();
+    }
+    other = getRelay(zobj, Geometry_ce_ptr TSRMLS_CC);
+    if ( ! other ) RETURN_NULL(); /* should get an exception first */
+
+    prepared = getPreparedGeometry(pg TSRMLS_CC);
+    if ( ! prepared ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSPreparedContains_r(GEOS_G(handle), prepared, other);
     if ( ret == 2 ) RETURN_NULL(); /* should get an exception first */
 
     /* return_value is a zval */
@@ -1741,525 +9160,840 @@ PHP_METHOD(Geometry, hasZ)
 }
 
 /**
- * bool GEOSGeometry::isClosed()
+ * bool GEOSPreparedGeometry::intersects(GEOSGeometry)
  */
-#ifdef HAVE_GEOS_IS_CLOSED
-PHP_METHOD(Geometry, isClosed)
+PHP_METHOD(PreparedGeometry, intersects)
 {
-    GEOSGeometry *this;
+    PreparedGeometry *pg;
+    const GEOSPreparedGeometry *prepared;
+    GEOSGeometry *other;
     int ret;
     zend_bool retBool;
+    zval *zobj;
 
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    pg = (PreparedGeometry*)getRelay(getThis(), PreparedGeometry_ce_ptr TSRMLS_CC);
 
-    ret = GEOSisClosed_r(GEOS_G(handle), this);
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o", &zobj)
+            == FAILURE) {
+        RETURN_NULL();
+    }
+    other = getRelay(zobj, Geometry_ce_ptr TSRMLS_CC);
+    if ( ! other ) RETURN_NULL(); /* should get an exception first */
+
+    prepared = getPreparedGeometry(pg TSRMLS_CC);
+    if ( ! prepared ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSPreparedIntersects_r(GEOS_G(handle), prepared, other);
     if ( ret == 2 ) RETURN_NULL(); /* should get an exception first */
 
     /* return_value is a zval */
     retBool = ret;
     RETURN_BOOL(retBool);
 }
-#endif
 
 /**
- * string GEOSGeometry::typeName()
+ * string GEOSPreparedGeometry::containsPoints(string packedXY)
+ *
+ * See GEOSGeometry::containsPoints. The point index is built
+ * on first use and kept for later calls.
  */
-PHP_METHOD(Geometry, typeName)
+PHP_METHOD(PreparedGeometry, containsPoints)
 {
-    GEOSGeometry *this;
-    char *typ;
-    char *typVal;
-
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    PreparedGeometry *pg;
+    char *packed;
+    int len;
 
-    /* TODO: define constant strings instead... */
-
-    typ = GEOSGeomType_r(GEOS_G(handle), this);
-    if ( ! typ ) RETURN_NULL(); /* should get an exception first */
+    pg = (PreparedGeometry*)getRelay(getThis(), PreparedGeometry_ce_ptr TSRMLS_CC);
 
-    typVal = estrdup(typ);
-    GEOSFree_r(GEOS_G(handle), typ);
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s", &packed, &len)
+            == FAILURE) {
+        RETURN_NULL();
+    }
 
-    RETURN_STRING(typVal, 0);
+    containsPackedPoints(pg, packed, len, return_value TSRMLS_CC);
 }
 
-/**
- * long GEOSGeometry::typeId()
- */
-PHP_METHOD(Geometry, typeId)
-{
-    GEOSGeometry *this;
-    long typ;
+/* -- class GEOSCache -------------------- */
 
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+PHP_METHOD(Cache, clear);
+PHP_METHOD(Cache, stats);
 
-    /* TODO: define constant strings instead... */
+static zend_function_entry Cache_methods[] = {
+    PHP_ME(Cache, clear, NULL, ZEND_ACC_PUBLIC|ZEND_ACC_STATIC)
+    PHP_ME(Cache, stats, NULL, ZEND_ACC_PUBLIC|ZEND_ACC_STATIC)
+    {NULL, NULL, NULL}
+};
 
-    typ = GEOSGeomTypeId_r(GEOS_G(handle), this);
-    if ( typ == -1 ) RETURN_NULL(); /* should get an exception first */
+static zend_class_entry *Cache_ce_ptr;
 
-    RETURN_LONG(typ);
+/**
+ * void GEOSCache::clear()
+ *
+ * Drop all entries of the result cache of this process.
+ * Hit and miss counters are reset too.
+ */
+PHP_METHOD(Cache, clear)
+{
+    GeometryCache_clear(TSRMLS_C);
+    GEOS_G(cache_hits) = 0;
+    GEOS_G(cache_misses) = 0;
 }
 
 /**
- * long GEOSGeometry::getSRID()
+ * array GEOSCache::stats()
+ *
+ * Return an array with the following keys:
+ *  'hits'
+ *       Type: int
+ *       Number of operations answered from the cache
+ *  'misses'
+ *       Type: int
+ *       Number of cacheable operations which had to be computed
+ *  'entries'
+ *       Type: int
+ *       Number of cached results
+ *  'bytes'
+ *       Type: int
+ *       Memory held by cached results
+ *  'capacity'
+ *       Type: int
+ *       Current geos.cache_size
  */
-PHP_METHOD(Geometry, getSRID)
+PHP_METHOD(Cache, stats)
 {
-    GEOSGeometry *geom;
-    long int ret;
+    array_init(return_value);
+    add_assoc_long(return_value, "hits", GEOS_G(cache_hits));
+    add_assoc_long(return_value, "misses", GEOS_G(cache_misses));
+    add_assoc_long(return_value, "entries",
+        zend_hash_num_elements(&GEOS_G(cache_table)));
+    add_assoc_long(return_value, "bytes", GEOS_G(cache_bytes));
+    add_assoc_long(return_value, "capacity", GEOS_G(cache_size));
+}
+
+/* -- class GEOSSharedCache -------------------- */
 
-    geom = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+#ifdef HAVE_MMAP
 
-    ret = GEOSGetSRID_r(GEOS_G(handle), geom);
+PHP_METHOD(SharedCache, store);
+PHP_METHOD(SharedCache, fetch);
+PHP_METHOD(SharedCache, has);
+PHP_METHOD(SharedCache, envelope);
+PHP_METHOD(SharedCache, stats);
 
-    RETURN_LONG(ret);
+static zend_function_entry SharedCache_methods[] = {
+    PHP_ME(SharedCache, store, NULL, ZEND_ACC_PUBLIC|ZEND_ACC_STATIC)
+    PHP_ME(SharedCache, fetch, NULL, ZEND_ACC_PUBLIC|ZEND_ACC_STATIC)
+    PHP_ME(SharedCache, has, NULL, ZEND_ACC_PUBLIC|ZEND_ACC_STATIC)
+    PHP_ME(SharedCache, envelope, NULL, ZEND_ACC_PUBLIC|ZEND_ACC_STATIC)
+    PHP_ME(SharedCache, stats, NULL, ZEND_ACC_PUBLIC|ZEND_ACC_STATIC)
+    {NULL, NULL, NULL}
+};
+
+static zend_class_entry *SharedCache_ce_ptr;
+
+static int
+checkSharedCache(TSRMLS_D)
+{
+    if ( sharedCache ) return SUCCESS;
+    zend_throw_exception_ex(zend_exception_get_default(TSRMLS_C), 1 TSRMLS_CC,
+        "Shared cache is not available, see geos.shm_path");
+    return FAILURE;
 }
 
 /**
- * void GEOSGeometry::setSRID(long)
+ * bool GEOSSharedCache::store(key, geom)
+ *
+ * Store the geometry under the given key, for every process
+ * using the same geos.shm_path. Returns false if the segment
+ * is full. Storing a key again replaces its geometry.
  */
-PHP_METHOD(Geometry, setSRID)
+PHP_METHOD(SharedCache, store)
 {
+    zval *zgeom;
     GEOSGeometry *geom;
-    long int srid;
-
-    geom = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    GEOSWKBWriter *writer;
+    unsigned char *wkb;
+    size_t wkblen;
+    char *key;
+    int keylen, ret;
+    double extent[4] = { 1, 1, -1, -1 };
 
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "l",
-        &srid) == FAILURE) {
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "so", &key, &keylen,
+            &zgeom) == FAILURE) {
         RETURN_NULL();
     }
 
-    GEOSSetSRID_r(GEOS_G(handle), geom, srid);
-}
+    geom = (GEOSGeometry*)getRelay(zgeom, Geometry_ce_ptr TSRMLS_CC);
+    if ( ! geom ) RETURN_NULL(); /* should get an exception first */
+    if ( checkSharedCache(TSRMLS_C) == FAILURE ) RETURN_NULL();
 
-/**
- * long GEOSGeometry::numGeometries()
- */
-PHP_METHOD(Geometry, numGeometries)
-{
-    GEOSGeometry *geom;
-    long int ret;
+    writer = getGeometrySerializer(TSRMLS_C);
+    if ( ! writer ) RETURN_NULL(); /* should get an exception first */
 
-    geom = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    wkb = GEOSWKBWriter_write_r(GEOS_G(handle), writer, geom, &wkblen);
+    if ( ! wkb ) RETURN_NULL(); /* should get an exception first */
 
-    ret = GEOSGetNumGeometries_r(GEOS_G(handle), geom);
-    if ( ret == -1 ) RETURN_NULL(); /* should get an exception first */
+    getGeometryExtent(geom, &extent[0], &extent[1], &extent[2], &extent[3]
+        TSRMLS_CC);
+    ret = SharedCache_store(key, keylen, wkb, wkblen, extent);
+    GEOSFree_r(GEOS_G(handle), wkb);
 
-    RETURN_LONG(ret);
+    RETURN_BOOL(ret == SUCCESS);
 }
 
 /**
- * GEOSGeometry GEOSGeometry::geometryN()
+ * GEOSGeometry GEOSSharedCache::fetch(key)
+ *
+ * Return the geometry stored under the key, or null if there
+ * is none. An entry is only parsed once per worker; the returned
+ * object shares that geometry, is not counted against
+ * geos.memory_limit and gets its own copy once modified.
  */
-PHP_METHOD(Geometry, geometryN)
+PHP_METHOD(SharedCache, fetch)
 {
-    GEOSGeometry *geom;
-    const GEOSGeometry *c;
-    GEOSGeometry *cc;
-    long int num;
-
-    geom = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    const SharedCacheEntry *entry;
+    const GEOSGeometry *geom;
+    Proxy *proxy;
+    char *key;
+    int keylen;
 
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "l",
-        &num) == FAILURE) {
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s", &key, &keylen)
+            == FAILURE) {
         RETURN_NULL();
     }
 
-    if ( num >= GEOSGetNumGeometries_r(GEOS_G(handle), geom) ) RETURN_NULL();
-    c = GEOSGetGeometryN_r(GEOS_G(handle), geom, num);
-    if ( ! c ) RETURN_NULL(); /* should get an exception first */
-    cc = GEOSGeom_clone_r(GEOS_G(handle), c);
-    if ( ! cc ) RETURN_NULL(); /* should get an exception first */
+    if ( checkSharedCache(TSRMLS_C) == FAILURE ) RETURN_NULL();
+
+    entry = SharedCache_find(key, keylen);
+    if ( ! entry ) RETURN_NULL();
+
+    geom = SharedCache_geometry(entry TSRMLS_CC);
+    if ( ! geom ) RETURN_NULL(); /* should get an exception first */
 
+    /* return_value is a zval, lent the geometry until modified */
     object_init_ex(return_value, Geometry_ce_ptr);
-    setRelay(return_value, cc);
+    proxy = (Proxy*)zend_object_store_get_object(return_value TSRMLS_CC);
+    proxy->relay = (GEOSGeometry*)geom;
+    proxy->shared = 1;
 }
 
 /**
- * long GEOSGeometry::numInteriorRings()
+ * bool GEOSSharedCache::has(key)
  */
-PHP_METHOD(Geometry, numInteriorRings)
+PHP_METHOD(SharedCache, has)
 {
-    GEOSGeometry *geom;
-    long int ret;
+    char *key;
+    int keylen;
 
-    geom = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s", &key, &keylen)
+            == FAILURE) {
+        RETURN_NULL();
+    }
 
-    ret = GEOSGetNumInteriorRings_r(GEOS_G(handle), geom);
-    if ( ret == -1 ) RETURN_NULL(); /* should get an exception first */
+    if ( checkSharedCache(TSRMLS_C) == FAILURE ) RETURN_NULL();
 
-    RETURN_LONG(ret);
+    RETURN_BOOL(SharedCache_find(key, keylen) != NULL);
 }
 
 /**
- * long GEOSGeometry::numPoints()
+ * array GEOSSharedCache::envelope(key)
+ *
+ * Return the extent of the geometry stored under the key as
+ * array('minx', 'miny', 'maxx', 'maxy') without reading it,
+ * or null if there is none or the geometry is empty.
  */
-#ifdef HAVE_GEOS_GEOM_GET_NUM_POINTS
-PHP_METHOD(Geometry, numPoints)
+PHP_METHOD(SharedCache, envelope)
 {
-    GEOSGeometry *geom;
-    long int ret;
+    const SharedCacheEntry *entry;
+    char *key;
+    int keylen;
 
-    geom = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s", &key, &keylen)
+            == FAILURE) {
+        RETURN_NULL();
+    }
 
-    ret = GEOSGeomGetNumPoints_r(GEOS_G(handle), geom);
-    if ( ret == -1 ) RETURN_NULL(); /* should get an exception first */
+    if ( checkSharedCache(TSRMLS_C) == FAILURE ) RETURN_NULL();
 
-    RETURN_LONG(ret);
+    entry = SharedCache_find(key, keylen);
+    if ( ! entry || entry->minx > entry->maxx ) RETURN_NULL();
+
+    array_init(return_value);
+    add_assoc_double(return_value, "minx", entry->minx);
+    add_assoc_double(return_value, "miny", entry->miny);
+    add_assoc_double(return_value, "maxx", entry->maxx);
+    add_assoc_double(return_value, "maxy", entry->maxy);
 }
-#endif
 
 /**
- * double GEOSGeometry::getX()
+ * array GEOSSharedCache::stats()
+ *
+ * Return an array with the following keys:
+ *  'entries'
+ *       Type: int
+ *       Number of stored entries, including replaced ones
+ *  'used'
+ *       Type: int
+ *       Bytes of the segment in use
+ *  'size'
+ *       Type: int
+ *       Size of the segment, 0 if there is none
  */
-#ifdef HAVE_GEOS_GEOM_GET_X
-PHP_METHOD(Geometry, getX)
+PHP_METHOD(SharedCache, stats)
 {
-    GEOSGeometry *geom;
-    int ret;
-    double x;
-
-    geom = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    uint64_t used = 0, size = 0, entries = 0;
 
-    ret = GEOSGeomGetX_r(GEOS_G(handle), geom, &x);
-    if ( ret == -1 ) RETURN_NULL(); /* should get an exception first */
+    if ( sharedCache ) {
+        size = sharedCacheSize;
+        used = sharedCache->top < size ? sharedCache->top : size;
+        entries = sharedCache->entries;
+    }
 
-    RETURN_DOUBLE(x);
+    array_init(return_value);
+    add_assoc_long(return_value, "entries", (long)entries);
+    add_assoc_long(return_value, "used", (long)used);
+    add_assoc_long(return_value, "size", (long)size);
 }
-#endif
 
-/**
- * double GEOSGeometry::getY()
+#endif /* HAVE_MMAP */
+
+/* -- class GEOSPersistentIndex -------------------- */
+
+/*
+ * Indexes listed in geos.persistent_indexes as "name=path;..." are
+ * loaded once at module startup and shared, read-only, by every
+ * request. Index files are a sequence of records made of a little
+ * endian 64 bit id, a little endian 32 bit length and as many bytes
+ * of WKB.
+ *
+ * The geometries belong to a module lifetime context. Prepared
+ * geometries build their point locator and segment index lazily,
+ * so both are built at load time: afterwards the predicates only
+ * read them and requests can run them concurrently, unlocked.
  */
-#ifdef HAVE_GEOS_GEOM_GET_Y
-PHP_METHOD(Geometry, getY)
-{
-    GEOSGeometry *geom;
-    int ret;
-    double y;
+typedef struct PersistentIndex_t {
+    long count;
+    long *ids;
+    GEOSGeometry **geoms;
+    const GEOSPreparedGeometry **prepared;
+    STRTree tree;
+} PersistentIndex;
+
+PHP_METHOD(PersistentIndex, get);
+PHP_METHOD(PersistentIndex, query);
+PHP_METHOD(PersistentIndex, contains);
+PHP_METHOD(PersistentIndex, count);
+
+static zend_function_entry PersistentIndex_methods[] = {
+    PHP_ME(PersistentIndex, get, NULL, ZEND_ACC_PUBLIC|ZEND_ACC_STATIC)
+    PHP_ME(PersistentIndex, query, NULL, 0)
+    PHP_ME(PersistentIndex, contains, NULL, 0)
+    PHP_ME(PersistentIndex, count, NULL, 0)
+    {NULL, NULL, NULL}
+};
 
-    geom = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+static zend_class_entry *PersistentIndex_ce_ptr;
 
-    ret = GEOSGeomGetY_r(GEOS_G(handle), geom, &y);
-    if ( ret == -1 ) RETURN_NULL(); /* should get an exception first */
+static zend_object_handlers PersistentIndex_object_handlers;
 
-    RETURN_DOUBLE(y);
-}
-#endif
+static GEOSContextHandle_t persistentHandle = NULL;
+static HashTable persistentIndexes;
+static int persistentIndexesReady = 0;
 
-/**
- * GEOSGeometry GEOSGeometry::interiorRingN()
+/*
+ * Free an index, loaded or not: the arrays are only allocated
+ * once a record was read and the tree once all of them were.
  */
-PHP_METHOD(Geometry, interiorRingN)
+static void
+PersistentIndex_destroy(PersistentIndex* idx)
 {
-    GEOSGeometry *geom;
-    const GEOSGeometry *c;
-    GEOSGeometry *cc;
-    long int num;
+    long i;
 
-    geom = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
-
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "l",
-        &num) == FAILURE) {
-        RETURN_NULL();
+    for (i=0; i<idx->count; ++i) {
+        if ( idx->prepared[i] ) {
+            GEOSPreparedGeom_destroy_r(persistentHandle, idx->prepared[i]);
+        }
+        GEOSGeom_destroy_r(persistentHandle, idx->geoms[i]);
     }
-
-    if ( num >= GEOSGetNumInteriorRings_r(GEOS_G(handle), geom) ) RETURN_NULL();
-    c = GEOSGetInteriorRingN_r(GEOS_G(handle), geom, num);
-    if ( ! c ) RETURN_NULL(); /* should get an exception first */
-    cc = GEOSGeom_clone_r(GEOS_G(handle), c);
-    if ( ! cc ) RETURN_NULL(); /* should get an exception first */
-
-    object_init_ex(return_value, Geometry_ce_ptr);
-    setRelay(return_value, cc);
+    if ( idx->tree.entries ) STRTree_destroy(&idx->tree);
+    if ( idx->ids ) pefree(idx->ids, 1);
+    if ( idx->geoms ) pefree(idx->geoms, 1);
+    if ( idx->prepared ) pefree(idx->prepared, 1);
+    pefree(idx, 1);
 }
 
-/**
- * GEOSGeometry GEOSGeometry::exteriorRing()
- */
-PHP_METHOD(Geometry, exteriorRing)
+/* hash table destructor, gets a pointer to the stored index pointer */
+static void
+PersistentIndex_free(void* data)
 {
-    GEOSGeometry *geom;
-    const GEOSGeometry *c;
-    GEOSGeometry *cc;
-
-    geom = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
-
-    c = GEOSGetExteriorRing_r(GEOS_G(handle), geom);
-    if ( ! c ) RETURN_NULL(); /* should get an exception first */
-    cc = GEOSGeom_clone_r(GEOS_G(handle), c);
-    if ( ! cc ) RETURN_NULL(); /* should get an exception first */
-
-    object_init_ex(return_value, Geometry_ce_ptr);
-    setRelay(return_value, cc);
+    PersistentIndex_destroy(*(PersistentIndex**)data);
 }
 
-/**
- * long GEOSGeometry::numCoordinates()
- */
-PHP_METHOD(Geometry, numCoordinates)
+static uint64_t
+readLittleEndian(const unsigned char* buf, int len)
 {
-    GEOSGeometry *geom;
-    long int ret;
-
-    geom = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    uint64_t ret = 0;
 
-    ret = GEOSGetNumCoordinates_r(GEOS_G(handle), geom);
-    if ( ret == -1 ) RETURN_NULL(); /* should get an exception first */
-
-    RETURN_LONG(ret);
+    while ( len-- ) ret = (ret << 8) | buf[len];
+    return ret;
 }
 
-/**
- * long GEOSGeometry::dimension()
- * 0:puntual 1:lineal 2:areal
+/*
+ * Build the lazy parts of a prepared geometry: a point inside it
+ * builds the point locator, a line from there to outside the
+ * extent the segment index, whatever the geometry type.
  */
-PHP_METHOD(Geometry, dimension)
+static void
+PersistentIndex_warm(const GEOSPreparedGeometry* prepared,
+        const GEOSGeometry* geom TSRMLS_DC)
 {
-    GEOSGeometry *geom;
-    long int ret;
-
-    geom = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    const GEOSCoordSequence *pseq;
+    GEOSCoordSequence *seq;
+    GEOSGeometry *point, *line = NULL;
+    double minx, miny, maxx, maxy, x, y;
 
-    ret = GEOSGeom_getDimensions_r(GEOS_G(handle), geom);
-    if ( ret == -1 ) RETURN_NULL(); /* should get an exception first */
+    if ( ! getGeometryExtent(geom, &minx, &miny, &maxx, &maxy TSRMLS_CC) ) {
+        return;
+    }
+    point = GEOSPointOnSurface_r(GEOS_G(handle), geom);
+    if ( ! point ) return;
+
+    pseq = GEOSGeom_getCoordSeq_r(GEOS_G(handle), point);
+    if ( pseq && GEOSCoordSeq_getX_r(GEOS_G(handle), pseq, 0, &x)
+            && GEOSCoordSeq_getY_r(GEOS_G(handle), pseq, 0, &y) ) {
+        seq = GEOSCoordSeq_create_r(GEOS_G(handle), 2, 2);
+        if ( seq ) {
+            GEOSCoordSeq_setX_r(GEOS_G(handle), seq, 0, x);
+            GEOSCoordSeq_setY_r(GEOS_G(handle), seq, 0, y);
+            GEOSCoordSeq_setX_r(GEOS_G(handle), seq, 1, maxx + 1);
+            GEOSCoordSeq_setY_r(GEOS_G(handle), seq, 1, maxy + 1);
+            line = GEOSGeom_createLineString_r(GEOS_G(handle), seq);
+        }
+    }
 
-    RETURN_LONG(ret);
+    GEOSPreparedContains_r(GEOS_G(handle), prepared, point);
+    GEOSPreparedIntersects_r(GEOS_G(handle), prepared, point);
+    if ( line ) {
+        GEOSPreparedContains_r(GEOS_G(handle), prepared, line);
+        GEOSPreparedIntersects_r(GEOS_G(handle), prepared, line);
+        GEOSGeom_destroy_r(GEOS_G(handle), line);
+    }
+    GEOSGeom_destroy_r(GEOS_G(handle), point);
 }
 
-/**
- * long GEOSGeometry::coordinateDimension()
+/*
+ * Read the records of an index file, returning NULL after a
+ * warning if it can't be read. GEOS_G(handle) must be the
+ * module lifetime context.
  */
-#ifdef HAVE_GEOS_GEOM_GET_COORDINATE_DIMENSION
-PHP_METHOD(Geometry, coordinateDimension)
+static PersistentIndex*
+PersistentIndex_load(const char* path TSRMLS_DC)
 {
+    PersistentIndex *idx;
+    GEOSWKBReader *reader;
     GEOSGeometry *geom;
-    long int ret;
+    STREntry *items;
+    unsigned char header[12], *wkb = NULL;
+    size_t wkbcap = 0, len;
+    int64_t id;
+    long size;
+    long capacity = 0, nitems = 0, i;
+    int failed = 0;
+    FILE *f;
+
+    f = fopen(path, "rb");
+    if ( ! f ) {
+        php_error_docref(NULL TSRMLS_CC, E_WARNING,
+            "Cannot open persistent index %s: %s", path, strerror(errno));
+        return NULL;
+    }
 
-    geom = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    /* record lengths are checked against it before allocating */
+    if ( fseek(f, 0, SEEK_END) || (size = ftell(f)) < 0
+            || fseek(f, 0, SEEK_SET) ) {
+        php_error_docref(NULL TSRMLS_CC, E_WARNING,
+            "Cannot read persistent index %s: %s", path, strerror(errno));
+        fclose(f);
+        return NULL;
+    }
 
-    ret = GEOSGeom_getCoordinateDimension_r(GEOS_G(handle), geom);
-    if ( ret == -1 ) RETURN_NULL(); /* should get an exception first */
+    reader = GEOSWKBReader_create_r(GEOS_G(handle));
+    idx = pecalloc(1, sizeof(PersistentIndex), 1);
 
-    RETURN_LONG(ret);
-}
-#endif
+    while ( reader && (len = fread(header, 1, 12, f)) ) {
+        if ( len != 12 ) {
+            failed = 1;
+            break;
+        }
+        /* ids are stored as 64 bits, long may be narrower */
+        id = (int64_t)readLittleEndian(header, 8);
+        if ( id < LONG_MIN || id > LONG_MAX ) {
+            failed = 1;
+            break;
+        }
+        len = (size_t)readLittleEndian(header + 8, 4);
+        if ( len > (size_t)(size - ftell(f)) ) {
+            failed = 1;
+            break;
+        }
+        if ( len > wkbcap ) {
+            wkbcap = len;
+            wkb = perealloc(wkb, wkbcap, 1);
+        }
+        if ( fread(wkb, 1, len, f) != len ) {
+            failed = 1;
+            break;
+        }
+        geom = GEOSWKBReader_read_r(GEOS_G(handle), reader, wkb, len);
+        if ( ! geom ) {
+            failed = 1;
+            break;
+        }
 
-/**
- * GEOSGeometry GEOSGeometry::pointN()
- */
-#ifdef HAVE_GEOS_GEOM_GET_POINT_N
-PHP_METHOD(Geometry, pointN)
-{
-    GEOSGeometry *geom;
-    GEOSGeometry *c;
-    long int num;
+        if ( idx->count == capacity ) {
+            capacity = capacity ? capacity * 2 : 64;
+            idx->ids = safe_perealloc(idx->ids, capacity, sizeof(long), 0, 1);
+            idx->geoms = safe_perealloc(idx->geoms, capacity,
+                sizeof(GEOSGeometry*), 0, 1);
+            idx->prepared = safe_perealloc(idx->prepared, capacity,
+                sizeof(GEOSPreparedGeometry*), 0, 1);
+        }
+        idx->ids[idx->count] = (long)id;
+        idx->geoms[idx->count] = geom;
+        idx->prepared[idx->count] = GEOSPrepare_r(GEOS_G(handle), geom);
+        if ( idx->prepared[idx->count] ) {
+            PersistentIndex_warm(idx->prepared[idx->count], geom TSRMLS_CC);
+        }
 
-    geom = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+        ++idx->count;
+    }
 
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "l",
-        &num) == FAILURE) {
-        RETURN_NULL();
+    fclose(f);
+    if ( wkb ) pefree(wkb, 1);
+    if ( reader ) GEOSWKBReader_destroy_r(GEOS_G(handle), reader);
+
+    if ( failed || ! reader ) {
+        php_error_docref(NULL TSRMLS_CC, E_WARNING,
+            "Invalid persistent index %s at record %ld", path, idx->count);
+        PersistentIndex_destroy(idx);
+        return NULL;
     }
 
-    if ( num >= GEOSGeomGetNumPoints_r(GEOS_G(handle), geom) ) RETURN_NULL();
-    c = GEOSGeomGetPointN_r(GEOS_G(handle), geom, num);
-    if ( ! c ) RETURN_NULL(); /* should get an exception first */
+    /* empty geometries are not indexed */
+    items = (STREntry*)safe_pemalloc(idx->count ? idx->count : 1,
+        sizeof(STREntry), 0, 1);
+    for (i=0; i<idx->count; ++i) {
+        STREntry *e = &items[nitems];
+        if ( ! getGeometryExtent(idx->geoms[i], &e->minx, &e->miny,
+                &e->maxx, &e->maxy TSRMLS_CC) ) {
+            continue;
+        }
+        e->child = i;
+        ++nitems;
+    }
+    STRTree_build(&idx->tree, items, nitems, 1);
+    pefree(items, 1);
 
-    object_init_ex(return_value, Geometry_ce_ptr);
-    setRelay(return_value, c);
+    return idx;
 }
-#endif
 
-/**
- * GEOSGeometry GEOSGeometry::startPoint()
+/*
+ * Load every index of geos.persistent_indexes, at module startup.
  */
-PHP_METHOD(Geometry, startPoint)
+static void
+loadPersistentIndexes(const char* spec TSRMLS_DC)
 {
-    GEOSGeometry *geom;
-    GEOSGeometry *c;
-
-    geom = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    GEOSContextHandle_t requestHandle;
+    PersistentIndex *idx;
+    const char *p, *end, *eq;
+    char *name, *path;
+
+    zend_hash_init(&persistentIndexes, 0, NULL, PersistentIndex_free, 1);
+    persistentIndexesReady = 1;
+
+    if ( ! spec || ! *spec ) return;
+
+    persistentHandle = createContext(1 TSRMLS_CC);
+    requestHandle = GEOS_G(handle);
+    GEOS_G(handle) = persistentHandle;
+
+    for (p = spec; *p; p = *end ? end + 1 : end) {
+        end = strchr(p, ';');
+        if ( ! end ) end = p + strlen(p);
+        if ( end == p ) continue;
+
+        eq = memchr(p, '=', end - p);
+        if ( ! eq || eq == p || eq + 1 == end ) {
+            php_error_docref(NULL TSRMLS_CC, E_WARNING,
+                "Invalid geos.persistent_indexes entry, expected name=path");
+            continue;
+        }
 
-    c = GEOSGeomGetStartPoint_r(GEOS_G(handle), geom);
-    if ( ! c ) RETURN_NULL(); /* should get an exception first */
+        name = estrndup(p, eq - p);
+        path = estrndup(eq + 1, end - eq - 1);
+        idx = PersistentIndex_load(path TSRMLS_CC);
+        if ( idx && zend_hash_update(&persistentIndexes, name, eq - p + 1,
+                &idx, sizeof(PersistentIndex*), NULL) == FAILURE ) {
+            PersistentIndex_destroy(idx);
+        }
+        efree(name);
+        efree(path);
+    }
 
-    object_init_ex(return_value, Geometry_ce_ptr);
-    setRelay(return_value, c);
+    GEOS_G(handle) = requestHandle;
 }
 
-/**
- * GEOSGeometry GEOSGeometry::endPoint()
- */
-PHP_METHOD(Geometry, endPoint)
+static void
+freePersistentIndexes(void)
 {
-    GEOSGeometry *geom;
-    GEOSGeometry *c;
-
-    geom = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
-
-    c = GEOSGeomGetEndPoint_r(GEOS_G(handle), geom);
-    if ( ! c ) RETURN_NULL(); /* should get an exception first */
+    if ( ! persistentIndexesReady ) return;
 
-    object_init_ex(return_value, Geometry_ce_ptr);
-    setRelay(return_value, c);
+    zend_hash_destroy(&persistentIndexes);
+    if ( persistentHandle ) finishGEOS_r(persistentHandle);
+    persistentHandle = NULL;
+    persistentIndexesReady = 0;
 }
 
-/**
- * double GEOSGeometry::area()
- */
-PHP_METHOD(Geometry, area)
+static void
+PersistentIndex_dtor (void *object TSRMLS_DC)
 {
-    GEOSGeometry *geom;
-    double area;
-    int ret;
+    Proxy *obj = (Proxy *)object;
+
+    /* the index itself lives until module shutdown */
 
-    geom = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    zend_hash_destroy(obj->std.properties);
+    FREE_HASHTABLE(obj->std.properties);
 
-    ret = GEOSArea_r(GEOS_G(handle), geom, &area);
-    if ( ! ret ) RETURN_NULL(); /* should get an exception first */
+    efree(obj);
+}
 
-    RETURN_DOUBLE(area);
+static zend_object_value
+PersistentIndex_create_obj (zend_class_entry *type TSRMLS_DC)
+{
+    return Gen_create_obj(type, PersistentIndex_dtor,
+        &PersistentIndex_object_handlers TSRMLS_CC);
 }
 
-/**
- * double GEOSGeometry::length()
+static int
+PersistentIndex_cmpItems(const void* a, const void* b)
+{
+    long ia = *(const long*)a;
+    long ib = *(const long*)b;
+    return ia < ib ? -1 : ia > ib ? 1 : 0;
+}
+
+/*
+ * Set return_value to the ids of the geometries of the index
+ * intersecting, or containing, the given one, in file order.
  */
-PHP_METHOD(Geometry, length)
+static void
+queryPersistentIndex(const PersistentIndex* idx, const GEOSGeometry* geom,
+        int contains, zval* return_value TSRMLS_DC)
 {
-    GEOSGeometry *geom;
-    double length;
-    int ret;
+    double minx, miny, maxx, maxy;
+    long *items, nitems, i;
+    char ret;
 
-    geom = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    array_init(return_value);
+    if ( ! getGeometryExtent(geom, &minx, &miny, &maxx, &maxy TSRMLS_CC) ) {
+        return;
+    }
 
-    ret = GEOSLength_r(GEOS_G(handle), geom, &length);
-    if ( ! ret ) RETURN_NULL(); /* should get an exception first */
+    nitems = STRTree_query(&idx->tree, minx, miny, maxx, maxy, &items);
+    qsort(items, nitems, sizeof(long), PersistentIndex_cmpItems);
+
+    for (i=0; i<nitems; ++i) {
+        if ( ! idx->prepared[items[i]] ) continue;
+        if ( contains ) {
+            ret = GEOSPreparedContains_r(GEOS_G(handle),
+                idx->prepared[items[i]], geom);
+        } else {
+            ret = GEOSPreparedIntersects_r(GEOS_G(handle),
+                idx->prepared[items[i]], geom);
+        }
+        if ( ret == 2 ) break; /* should get an exception first */
+        if ( ret ) add_next_index_long(return_value, idx->ids[items[i]]);
+    }
 
-    RETURN_DOUBLE(length);
+    efree(items);
 }
 
 /**
- * double GEOSGeometry::distance(GEOSGeometry)
+ * GEOSPersistentIndex GEOSPersistentIndex::get(name)
+ *
+ * Return the index loaded at startup under the given name
+ * in geos.persistent_indexes.
  */
-PHP_METHOD(Geometry, distance)
+PHP_METHOD(PersistentIndex, get)
 {
-    GEOSGeometry *this;
-    GEOSGeometry *other;
-    zval *zobj;
-    double dist;
-    int ret;
+    PersistentIndex **found;
+    char *name;
+    int namelen;
 
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
-
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o",
-        &zobj) == FAILURE)
-    {
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s", &name, &namelen)
+            == FAILURE) {
         RETURN_NULL();
     }
 
-    other = getRelay(zobj, Geometry_ce_ptr);
-
-    ret = GEOSDistance_r(GEOS_G(handle), this, other, &dist);
-    if ( ! ret ) RETURN_NULL(); /* should get an exception first */
+    if ( ! persistentIndexesReady || zend_hash_find(&persistentIndexes,
+            name, namelen + 1, (void**)&found) == FAILURE ) {
+        zend_throw_exception_ex(zend_exception_get_default(TSRMLS_C),
+            1 TSRMLS_CC, "No persistent index named '%s'", name);
+        RETURN_NULL();
+    }
 
-    RETURN_DOUBLE(dist);
+    /* return_value is a zval */
+    object_init_ex(return_value, PersistentIndex_ce_ptr);
+    setRelay(return_value, *found TSRMLS_CC);
 }
 
 /**
- * double GEOSGeometry::hausdorffDistance(GEOSGeometry)
+ * array GEOSPersistentIndex::query(GEOSGeometry)
+ *
+ * Return the ids of the indexed geometries intersecting
+ * the given one.
  */
-PHP_METHOD(Geometry, hausdorffDistance)
+PHP_METHOD(PersistentIndex, query)
 {
-    GEOSGeometry *this;
-    GEOSGeometry *other;
+    PersistentIndex *idx;
+    GEOSGeometry *geom;
     zval *zobj;
-    double dist;
-    int ret;
 
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    idx = (PersistentIndex*)getRelay(getThis(), PersistentIndex_ce_ptr TSRMLS_CC);
 
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o",
-        &zobj) == FAILURE)
-    {
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o", &zobj)
+            == FAILURE) {
         RETURN_NULL();
     }
+    geom = getRelay(zobj, Geometry_ce_ptr TSRMLS_CC);
+    if ( ! geom ) RETURN_NULL(); /* should get an exception first */
 
-    other = getRelay(zobj, Geometry_ce_ptr);
-
-    ret = GEOSHausdorffDistance_r(GEOS_G(handle), this, other, &dist);
-    if ( ! ret ) RETURN_NULL(); /* should get an exception first */
-
-    RETURN_DOUBLE(dist);
+    queryPersistentIndex(idx, geom, 0, return_value TSRMLS_CC);
 }
 
-#ifdef HAVE_GEOS_SNAP
-PHP_METHOD(Geometry, snapTo)
+/**
+ * array GEOSPersistentIndex::contains(GEOSGeometry)
+ *
+ * Return the ids of the indexed geometries containing
+ * the given one.
+ */
+PHP_METHOD(PersistentIndex, contains)
 {
-    GEOSGeometry *this;
-    GEOSGeometry *other;
-    GEOSGeometry *ret;
-    double tolerance;
+    PersistentIndex *idx;
+    GEOSGeometry *geom;
     zval *zobj;
 
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    idx = (PersistentIndex*)getRelay(getThis(), PersistentIndex_ce_ptr TSRMLS_CC);
 
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "od", &zobj,
-            &tolerance) == FAILURE) {
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o", &zobj)
+            == FAILURE) {
         RETURN_NULL();
     }
-    other = getRelay(zobj, Geometry_ce_ptr);
+    geom = getRelay(zobj, Geometry_ce_ptr TSRMLS_CC);
+    if ( ! geom ) RETURN_NULL(); /* should get an exception first */
 
-    ret = GEOSSnap_r(GEOS_G(handle), this, other, tolerance);
-    if ( ! ret ) RETURN_NULL(); /* should get an exception first */
-
-    /* return_value is a zval */
-    object_init_ex(return_value, Geometry_ce_ptr);
-    setRelay(return_value, ret);
+    queryPersistentIndex(idx, geom, 1, return_value TSRMLS_CC);
 }
-#endif
 
-#ifdef HAVE_GEOS_NODE
-PHP_METHOD(Geometry, node)
+/**
+ * int GEOSPersistentIndex::count()
+ */
+PHP_METHOD(PersistentIndex, count)
 {
-    GEOSGeometry *this;
-    GEOSGeometry *ret;
+    PersistentIndex *idx;
 
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    idx = (PersistentIndex*)getRelay(getThis(), PersistentIndex_ce_ptr TSRMLS_CC);
 
-    ret = GEOSNode_r(GEOS_G(handle), this);
-    if ( ! ret ) RETURN_NULL(); /* should get an exception first */
-
-    /* return_value is a zval */
-    object_init_ex(return_value, Geometry_ce_ptr);
-    setRelay(return_value, ret);
+    RETURN_LONG(idx->count);
 }
-#endif
 
+/* -- class GEOSPartitioner -------------------- */
 
+/*
+ * Spatial partitioning of datasets too large to be handled in
+ * one place. Envelope centres of the geometries are sampled,
+ * then split into balanced rectangular partitions tiling the
+ * extent of every envelope seen. Geometries are assigned to each
+ * partition their envelope intersects, partitions on the border
+ * of the extent reaching out to infinity.
+ *
+ * The splits building the partitions are kept as a tree, and
+ * geometries are assigned by descending it, a point on a split
+ * going to its upper side. A point thus belongs to a single
+ * partition, even when repeated centres give partitions of zero
+ * width.
+ */
 
-/* -- class GEOSWKTReader -------------------- */
+/* Partitioning methods */
+#define GEOSPART_KDTREE 0   /* alternate median splits, exactly n parts */
+#define GEOSPART_QUADTREE 1 /* quadrants of the most crowded part */
 
-PHP_METHOD(WKTReader, __construct);
-PHP_METHOD(WKTReader, read);
+/* Envelope centres kept for partitioning, at most */
+#define GEOSPARTITIONER_SAMPLE_SIZE 65536
 
-static zend_function_entry WKTReader_methods[] = {
-    PHP_ME(WKTReader, __construct, NULL, 0)
-    PHP_ME(WKTReader, read, NULL, 0)
+/* Axis of the splits cutting a cell into its four quadrants */
+#define GEOSPARTITIONER_QUAD 2
+
+/*
+ * Split of a cell, at x for axis 0, y for axis 1 or both for
+ * GEOSPARTITIONER_QUAD. Children, lower side first or quadrants
+ * in Z order, are split numbers or -1 - partition number.
+ */
+typedef struct PartitionSplit_t {
+    double x, y;
+    int axis;
+    long child[4];
+} PartitionSplit;
+
+typedef struct Partitioner_t {
+    long npartitions;
+    long method;
+    double *sample; /* x, y of the sampled centres */
+    long nsample;
+    long capacity;
+    long nseen; /* centres offered to the sample */
+    uint64_t rng; /* xorshift state, fixed seed for reproducibility */
+    double minx, miny, maxx, maxy; /* of all envelopes seen */
+    STREntry *parts; /* NULL until built, child is the partition number */
+    long nparts;
+    PartitionSplit *splits;
+    long nsplits;
+    long root; /* split number, or -1 - partition number */
+} Partitioner;
+
+PHP_METHOD(Partitioner, __construct);
+PHP_METHOD(Partitioner, sample);
+PHP_METHOD(Partitioner, boundaries);
+PHP_METHOD(Partitioner, assign);
+PHP_METHOD(Partitioner, writePartitions);
+PHP_METHOD(Partitioner, count);
+
+static zend_function_entry Partitioner_methods[] = {
+    PHP_ME(Partitioner, __construct, NULL, 0)
+    PHP_ME(Partitioner, sample, NULL, 0)
+    PHP_ME(Partitioner, boundaries, NULL, 0)
+    PHP_ME(Partitioner, assign, NULL, 0)
+    PHP_ME(Partitioner, writePartitions, NULL, 0)
+    PHP_ME(Partitioner, count, NULL, 0)
     {NULL, NULL, NULL}
 };
 
-static zend_class_entry *WKTReader_ce_ptr;
+static zend_class_entry *Partitioner_ce_ptr;
 
-static zend_object_handlers WKTReader_object_handlers;
+static zend_object_handlers Partitioner_object_handlers;
 
 static void
-WKTReader_dtor (void *object TSRMLS_DC)
+Partitioner_dtor (void *object TSRMLS_DC)
 {
     Proxy *obj = (Proxy *)object;
-    GEOSWKTReader_destroy_r(GEOS_G(handle), (GEOSWKTReader*)obj->relay);
+    Partitioner *part = (Partitioner*)obj->relay;
+
+    if ( part ) {
+        if ( part->sample ) efree(part->sample);
+        if ( part->parts ) efree(part->parts);
+        if ( part->splits ) efree(part->splits);
+        efree(part);
+    }
 
     zend_hash_destroy(obj->std.properties);
     FREE_HASHTABLE(obj->std.properties);
@@ -2268,521 +10002,1069 @@ WKTReader_dtor (void *object TSRMLS_DC)
 }
 
 static zend_object_value
-WKTReader_create_obj (zend_class_entry *type TSRMLS_DC)
+Partitioner_create_obj (zend_class_entry *type TSRMLS_DC)
 {
-    return Gen_create_obj(type, WKTReader_dtor, &WKTReader_object_handlers);
+    return Gen_create_obj(type, Partitioner_dtor,
+        &Partitioner_object_handlers TSRMLS_CC);
 }
 
-
-PHP_METHOD(WKTReader, __construct)
+static uint64_t
+Partitioner_random(Partitioner* part)
 {
-    GEOSWKTReader* obj;
-    zval *object = getThis();
-
-    obj = GEOSWKTReader_create_r(GEOS_G(handle));
-    if ( ! obj ) {
-        php_error_docref(NULL TSRMLS_CC, E_ERROR,
-                "GEOSWKTReader_create() failed (didn't initGEOS?)");
-    }
-
-    setRelay(object, obj);
+    part->rng ^= part->rng << 13;
+    part->rng ^= part->rng >> 7;
+    part->rng ^= part->rng << 17;
+    return part->rng;
 }
 
-PHP_METHOD(WKTReader, read)
+/* Reservoir sampling of the envelope centre of a geometry */
+static void
+Partitioner_addGeometry(Partitioner* part, const GEOSGeometry* g TSRMLS_DC)
 {
-    GEOSWKTReader *reader;
-    GEOSGeometry *geom;
-    char* wkt;
-    int wktlen;
+    double minx, miny, maxx, maxy;
+    long slot;
 
-    reader = (GEOSWKTReader*)getRelay(getThis(), WKTReader_ce_ptr);
+    if ( ! getGeometryExtent(g, &minx, &miny, &maxx, &maxy TSRMLS_CC) ) {
+        return;
+    }
 
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s",
-        &wkt, &wktlen) == FAILURE)
-    {
-        RETURN_NULL();
+    if ( ! part->nseen || minx < part->minx ) part->minx = minx;
+    if ( ! part->nseen || miny < part->miny ) part->miny = miny;
+    if ( ! part->nseen || maxx > part->maxx ) part->maxx = maxx;
+    if ( ! part->nseen || maxy > part->maxy ) part->maxy = maxy;
+
+    if ( part->nsample < GEOSPARTITIONER_SAMPLE_SIZE ) {
+        if ( part->nsample == part->capacity ) {
+            part->capacity = part->capacity ? part->capacity * 2 : 1024;
+            part->sample = (double*)safe_erealloc(part->sample,
+                part->capacity, 2 * sizeof(double), 0);
+        }
+        slot = part->nsample++;
+    } else {
+        slot = (long)(Partitioner_random(part) % (part->nseen + 1));
+        if ( slot >= GEOSPARTITIONER_SAMPLE_SIZE ) slot = -1;
     }
+    if ( slot >= 0 ) {
+        part->sample[2 * slot] = (minx + maxx) / 2;
+        part->sample[2 * slot + 1] = (miny + maxy) / 2;
+    }
+    ++part->nseen;
+}
 
-    geom = GEOSWKTReader_read_r(GEOS_G(handle), reader, wkt);
-    /* we'll probably get an exception if geom is null */
-    if ( ! geom ) RETURN_NULL();
+static void
+Partitioner_addPart(Partitioner* part, double minx, double miny,
+        double maxx, double maxy)
+{
+    STREntry *e = &part->parts[part->nparts];
+
+    e->minx = minx;
+    e->miny = miny;
+    e->maxx = maxx;
+    e->maxy = maxy;
+    e->child = part->nparts++;
+    e->count = 0;
+}
 
-    /* return_value is a zval */
-    object_init_ex(return_value, Geometry_ce_ptr);
-    setRelay(return_value, geom);
+static int
+Partitioner_cmpX(const void* a, const void* b)
+{
+    double da = ((const double*)a)[0];
+    double db = ((const double*)b)[0];
+    return da < db ? -1 : da > db ? 1 : 0;
+}
 
+static int
+Partitioner_cmpY(const void* a, const void* b)
+{
+    double da = ((const double*)a)[1];
+    double db = ((const double*)b)[1];
+    return da < db ? -1 : da > db ? 1 : 0;
 }
 
-/* -- class GEOSWKTWriter -------------------- */
+/*
+ * Split the cell into k parts, cutting its longer side so that
+ * each side gets its share of the sampled centres. Returns the
+ * split number, or -1 - partition number if not split.
+ */
+static long
+Partitioner_splitKD(Partitioner* part, double* pts, long npts, long k,
+        double minx, double miny, double maxx, double maxy)
+{
+    PartitionSplit *s;
+    long kl, idx, node, lower, upper;
+    double split;
+    int axis;
+
+    if ( k == 1 ) {
+        Partitioner_addPart(part, minx, miny, maxx, maxy);
+        return -part->nparts;
+    }
 
-PHP_METHOD(WKTWriter, __construct);
-PHP_METHOD(WKTWriter, write);
+    kl = k / 2;
+    axis = maxx - minx >= maxy - miny ? 0 : 1;
+    qsort(pts, npts, 2 * sizeof(double),
+        axis ? Partitioner_cmpY : Partitioner_cmpX);
+    idx = (long)((double)npts * kl / k);
+    if ( idx > 0 && idx < npts ) {
+        split = (pts[2 * (idx - 1) + axis] + pts[2 * idx + axis]) / 2;
+    } else {
+        split = axis ? (miny + maxy) / 2 : (minx + maxx) / 2;
+    }
 
-#ifdef HAVE_GEOS_WKT_WRITER_SET_TRIM
-PHP_METHOD(WKTWriter, setTrim);
-#endif
+    node = part->nsplits++;
+    if ( axis ) {
+        lower = Partitioner_splitKD(part, pts, idx, kl, minx, miny, maxx,
+            split);
+        upper = Partitioner_splitKD(part, pts + 2 * idx, npts - idx, k - kl,
+            minx, split, maxx, maxy);
+    } else {
+        lower = Partitioner_splitKD(part, pts, idx, kl, minx, miny, split,
+            maxy);
+        upper = Partitioner_splitKD(part, pts + 2 * idx, npts - idx, k - kl,
+            split, miny, maxx, maxy);
+    }
 
-#ifdef HAVE_GEOS_WKT_WRITER_SET_ROUNDING_PRECISION
-PHP_METHOD(WKTWriter, setRoundingPrecision);
-#endif
+    s = &part->splits[node];
+    s->x = s->y = split;
+    s->axis = axis;
+    s->child[0] = lower;
+    s->child[1] = upper;
+    return node;
+}
 
-#ifdef HAVE_GEOS_WKT_WRITER_SET_OUTPUT_DIMENSION
-PHP_METHOD(WKTWriter, setOutputDimension);
-#endif
+/*
+ * Split the part holding the most sampled centres into quadrants,
+ * until there are at least n parts. Parts stay in Z order.
+ * 'ranges' holds the offset and count of the centres of each part,
+ * the child of each part its slot in the splits, 4 * split number
+ * + quadrant or -1 for the root, until numbered at the end.
+ */
+static void
+Partitioner_splitQuad(Partitioner* part, long n)
+{
+    long *ranges;
+    double *tmp;
+    STREntry *e;
+    PartitionSplit *s;
+    long i, j, best, start, count, slot, node, offset[5];
+    double cx, cy, minx, miny, maxx, maxy;
+    int q;
+
+    ranges = (long*)safe_emalloc(n + 3, 2 * sizeof(long), 0);
+    tmp = (double*)safe_emalloc(part->nsample + 1, 2 * sizeof(double), 0);
+
+    Partitioner_addPart(part, part->minx, part->miny, part->maxx, part->maxy);
+    part->parts[0].child = -1;
+    ranges[0] = 0;
+    ranges[1] = part->nsample;
+
+    while ( part->nparts < n ) {
+        for (i=1, best=0; i<part->nparts; ++i) {
+            if ( ranges[2 * i + 1] > ranges[2 * best + 1] ) best = i;
+        }
 
-#ifdef HAVE_GEOS_WKT_WRITER_GET_OUTPUT_DIMENSION
-PHP_METHOD(WKTWriter, getOutputDimension);
-#endif
+        e = &part->parts[best];
+        minx = e->minx; miny = e->miny; maxx = e->maxx; maxy = e->maxy;
+        cx = (minx + maxx) / 2;
+        cy = (miny + maxy) / 2;
+        start = ranges[2 * best];
+        count = ranges[2 * best + 1];
+        slot = e->child;
+
+        node = part->nsplits++;
+        s = &part->splits[node];
+        s->x = cx;
+        s->y = cy;
+        s->axis = GEOSPARTITIONER_QUAD;
+        if ( slot < 0 ) part->root = node;
+        else part->splits[slot / 4].child[slot % 4] = node;
+
+        /* group the centres by quadrant, lower left first */
+        memset(offset, 0, sizeof(offset));
+        for (i=start; i<start+count; ++i) {
+            q = (part->sample[2 * i] >= cx) + 2 * (part->sample[2 * i + 1] >= cy);
+            offset[q + 1]++;
+        }
+        for (q=0; q<4; ++q) offset[q + 1] += offset[q];
+        for (i=start; i<start+count; ++i) {
+            q = (part->sample[2 * i] >= cx) + 2 * (part->sample[2 * i + 1] >= cy);
+            j = offset[q]++;
+            tmp[2 * j] = part->sample[2 * i];
+            tmp[2 * j + 1] = part->sample[2 * i + 1];
+        }
+        memcpy(part->sample + 2 * start, tmp, count * 2 * sizeof(double));
+
+        /* the quadrants replace the part */
+        memmove(part->parts + best + 4, part->parts + best + 1,
+            (part->nparts - best - 1) * sizeof(STREntry));
+        memmove(ranges + 2 * (best + 4), ranges + 2 * (best + 1),
+            (part->nparts - best - 1) * 2 * sizeof(long));
+        part->nparts += 3;
+        for (q=0; q<4; ++q) {
+            e = &part->parts[best + q];
+            e->minx = q & 1 ? cx : minx;
+            e->maxx = q & 1 ? maxx : cx;
+            e->miny = q & 2 ? cy : miny;
+            e->maxy = q & 2 ? maxy : cy;
+            e->child = 4 * node + q;
+            e->count = 0;
+            ranges[2 * (best + q)] = start + (q ? offset[q - 1] : 0);
+            ranges[2 * (best + q) + 1] = offset[q] - (q ? offset[q - 1] : 0);
+        }
+    }
 
-#ifdef HAVE_GEOS_WKT_WRITER_SET_OLD_3D
-PHP_METHOD(WKTWriter, setOld3D);
-#endif
+    for (i=0; i<part->nparts; ++i) {
+        slot = part->parts[i].child;
+        if ( slot < 0 ) part->root = -1 - i;
+        else part->splits[slot / 4].child[slot % 4] = -1 - i;
+        part->parts[i].child = i;
+    }
 
-static zend_function_entry WKTWriter_methods[] = {
-    PHP_ME(WKTWriter, __construct, NULL, 0)
-    PHP_ME(WKTWriter, write, NULL, 0)
+    efree(ranges);
+    efree(tmp);
+}
 
-#   ifdef HAVE_GEOS_WKT_WRITER_SET_TRIM
-    PHP_ME(WKTWriter, setTrim, NULL, 0)
-#   endif
+/* Build the partitions from the sample, once. Throws if nothing was seen */
+static int
+Partitioner_build(Partitioner* part TSRMLS_DC)
+{
+    long capacity;
 
-#   ifdef HAVE_GEOS_WKT_WRITER_SET_ROUNDING_PRECISION
-    PHP_ME(WKTWriter, setRoundingPrecision, NULL, 0)
-#   endif
+    if ( part->parts ) return SUCCESS;
 
-#   ifdef HAVE_GEOS_WKT_WRITER_SET_OUTPUT_DIMENSION
-    PHP_ME(WKTWriter, setOutputDimension, NULL, 0)
-#   endif
+    if ( ! part->nseen ) {
+        zend_throw_exception_ex(zend_exception_get_default(TSRMLS_C), 1
+            TSRMLS_CC, "GEOSPartitioner has no sampled geometries");
+        return FAILURE;
+    }
 
-#   ifdef HAVE_GEOS_WKT_WRITER_GET_OUTPUT_DIMENSION
-    PHP_ME(WKTWriter, getOutputDimension, NULL, 0)
-#   endif
+    capacity = part->method == GEOSPART_QUADTREE ? part->npartitions + 3
+        : part->npartitions;
+    part->parts = (STREntry*)safe_emalloc(capacity, sizeof(STREntry), 0);
+    part->nparts = 0;
+    part->splits = (PartitionSplit*)safe_emalloc(capacity,
+        sizeof(PartitionSplit), 0);
+    part->nsplits = 0;
 
-#   ifdef HAVE_GEOS_WKT_WRITER_SET_OLD_3D
-    PHP_ME(WKTWriter, setOld3D, NULL, 0)
-#   endif
+    if ( part->method == GEOSPART_QUADTREE ) {
+        Partitioner_splitQuad(part, part->npartitions);
+    } else {
+        part->root = Partitioner_splitKD(part, part->sample, part->nsample,
+            part->npartitions, part->minx, part->miny, part->maxx,
+            part->maxy);
+    }
 
-    {NULL, NULL, NULL}
-};
+    /* the sample is of no further use */
+    if ( part->sample ) efree(part->sample);
+    part->sample = NULL;
 
-static zend_class_entry *WKTWriter_ce_ptr;
+    return SUCCESS;
+}
 
-static zend_object_handlers WKTWriter_object_handlers;
+static int
+Partitioner_cmpLong(const void* a, const void* b)
+{
+    long la = *(const long*)a;
+    long lb = *(const long*)b;
+    return la < lb ? -1 : la > lb;
+}
 
+/*
+ * Descend the splits from 'node' into the partitions the envelope
+ * intersects, the envelope going to the lower side of a split if
+ * it starts below it and to the upper side if it ends on or above
+ * it. Border partitions thus reach out to infinity.
+ */
 static void
-WKTWriter_dtor (void *object TSRMLS_DC)
+Partitioner_collect(const Partitioner* part, long node, double minx,
+        double miny, double maxx, double maxy, long* parts, long* n)
 {
-    Proxy *obj = (Proxy *)object;
-    GEOSWKTWriter_destroy_r(GEOS_G(handle), (GEOSWKTWriter*)obj->relay);
+    const PartitionSplit *s;
+    int q;
 
-    zend_hash_destroy(obj->std.properties);
-    FREE_HASHTABLE(obj->std.properties);
+    if ( node < 0 ) {
+        parts[(*n)++] = -1 - node;
+        return;
+    }
 
-    efree(obj);
-}
+    s = &part->splits[node];
+    if ( s->axis == GEOSPARTITIONER_QUAD ) {
+        for (q=0; q<4; ++q) {
+            if ( (q & 1 ? maxx >= s->x : minx < s->x)
+                    && (q & 2 ? maxy >= s->y : miny < s->y) ) {
+                Partitioner_collect(part, s->child[q], minx, miny, maxx,
+                    maxy, parts, n);
+            }
+        }
+        return;
+    }
 
-static zend_object_value
-WKTWriter_create_obj (zend_class_entry *type TSRMLS_DC)
-{
-    return Gen_create_obj(type, WKTWriter_dtor, &WKTWriter_object_handlers);
+    if ( s->axis ? miny < s->y : minx < s->x ) {
+        Partitioner_collect(part, s->child[0], minx, miny, maxx, maxy,
+            parts, n);
+    }
+    if ( s->axis ? maxy >= s->y : maxx >= s->x ) {
+        Partitioner_collect(part, s->child[1], minx, miny, maxx, maxy,
+            parts, n);
+    }
 }
 
-PHP_METHOD(WKTWriter, __construct)
+/*
+ * Collect the numbers of the partitions a geometry belongs to,
+ * in increasing order, into a newly emalloc'ed array. Empty
+ * geometries belong to none.
+ */
+static long
+Partitioner_assign(const Partitioner* part, const GEOSGeometry* g,
+        long** parts TSRMLS_DC)
 {
-    GEOSWKTWriter* obj;
-    zval *object = getThis();
-
-    obj = GEOSWKTWriter_create_r(GEOS_G(handle));
-    if ( ! obj ) {
-        php_error_docref(NULL TSRMLS_CC, E_ERROR,
-                "GEOSWKTWriter_create() failed (didn't initGEOS?)");
+    double minx, miny, maxx, maxy;
+    long n = 0;
+
+    *parts = NULL;
+    if ( ! getGeometryExtent(g, &minx, &miny, &maxx, &maxy TSRMLS_CC) ) {
+        return 0;
     }
 
-    setRelay(object, obj);
+    *parts = (long*)safe_emalloc(part->nparts, sizeof(long), 0);
+    Partitioner_collect(part, part->root, minx, miny, maxx, maxy, *parts,
+        &n);
+    qsort(*parts, n, sizeof(long), Partitioner_cmpLong);
+
+    return n;
 }
 
-PHP_METHOD(WKTWriter, write)
+/**
+ * GEOSPartitioner part = new GEOSPartitioner(n, [method])
+ *
+ * 'method' is GEOSPART_KDTREE (default), giving exactly 'n'
+ * partitions holding about as many sampled geometries each, or
+ * GEOSPART_QUADTREE, splitting the most crowded partition into
+ * quadrants until there are at least 'n' of them.
+ */
+PHP_METHOD(Partitioner, __construct)
 {
-    GEOSWKTWriter *writer;
-    zval *zobj;
-    GEOSGeometry *geom;
-    char* wkt;
-    char* retstr;
-
-    writer = (GEOSWKTWriter*)getRelay(getThis(), WKTWriter_ce_ptr);
+    Partitioner *part;
+    long n, method = GEOSPART_KDTREE;
+    zval *object = getThis();
 
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o", &zobj)
-        == FAILURE)
-    {
-        RETURN_NULL();
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "l|l", &n, &method)
+            == FAILURE) {
+        return;
     }
 
-    geom = getRelay(zobj, Geometry_ce_ptr);
-
-    wkt = GEOSWKTWriter_write_r(GEOS_G(handle), writer, geom);
-    /* we'll probably get an exception if wkt is null */
-    if ( ! wkt ) RETURN_NULL();
+    if ( n < 1 || n > GEOSPARTITIONER_SAMPLE_SIZE ) {
+        zend_throw_exception_ex(zend_exception_get_default(TSRMLS_C), 1
+            TSRMLS_CC, "Number of partitions must be between 1 and %d",
+            GEOSPARTITIONER_SAMPLE_SIZE);
+        return;
+    }
+    if ( method != GEOSPART_KDTREE && method != GEOSPART_QUADTREE ) {
+        zend_throw_exception_ex(zend_exception_get_default(TSRMLS_C), 1
+            TSRMLS_CC, "Unknown partitioning method %ld", method);
+        return;
+    }
 
-    retstr = estrdup(wkt);
-    GEOSFree_r(GEOS_G(handle), wkt);
+    part = (Partitioner*)ecalloc(1, sizeof(Partitioner));
+    part->npartitions = n;
+    part->method = method;
+    part->rng = 0x9E3779B97F4A7C15ULL;
 
-    RETURN_STRING(retstr, 0);
+    setRelay(object, part TSRMLS_CC);
 }
 
-#ifdef HAVE_GEOS_WKT_WRITER_SET_TRIM
-PHP_METHOD(WKTWriter, setTrim)
+/**
+ * void GEOSPartitioner::sample(array geoms)
+ *
+ * Sample the envelopes of the geometries. Datasets can be
+ * streamed through several calls; the sample is uniform over
+ * all of them. Partitions are built on first use, no more
+ * geometries can be sampled after that.
+ */
+PHP_METHOD(Partitioner, sample)
 {
-    GEOSWKTWriter *writer;
-    zend_bool trimval;
-    char trim;
+    Partitioner *part;
+    zval *zgeoms;
+    zval **data;
+    HashTable *geoms;
+    HashPosition pos;
+    GEOSGeometry *geom;
 
-    writer = (GEOSWKTWriter*)getRelay(getThis(), WKTWriter_ce_ptr);
+    part = (Partitioner*)getRelay(getThis(), Partitioner_ce_ptr TSRMLS_CC);
 
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "b", &trimval)
-        == FAILURE)
-    {
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "a", &zgeoms)
+            == FAILURE) {
         RETURN_NULL();
     }
 
-    trim = trimval;
-    GEOSWKTWriter_setTrim_r(GEOS_G(handle), writer, trim);
+    if ( part->parts ) {
+        zend_throw_exception_ex(zend_exception_get_default(TSRMLS_C), 1
+            TSRMLS_CC, "GEOSPartitioner partitions are already built");
+        RETURN_NULL();
+    }
+
+    geoms = Z_ARRVAL_P(zgeoms);
+    for (zend_hash_internal_pointer_reset_ex(geoms, &pos);
+         zend_hash_get_current_data_ex(geoms, (void**)&data, &pos) == SUCCESS;
+         zend_hash_move_forward_ex(geoms, &pos))
+    {
+        geom = getGeometryElement(*data TSRMLS_CC);
+        if ( ! geom ) RETURN_NULL(); /* should get an exception first */
+        Partitioner_addGeometry(part, geom TSRMLS_CC);
+    }
 }
-#endif
 
-#ifdef HAVE_GEOS_WKT_WRITER_SET_ROUNDING_PRECISION
-PHP_METHOD(WKTWriter, setRoundingPrecision)
+/**
+ * array GEOSPartitioner::boundaries()
+ *
+ * Extent of each partition, keyed by partition number, as
+ * arrays with 'minx', 'miny', 'maxx' and 'maxy' keys. Together
+ * they tile the extent of all the sampled envelopes.
+ */
+PHP_METHOD(Partitioner, boundaries)
 {
-    GEOSWKTWriter *writer;
-    long int prec;
+    Partitioner *part;
+    zval *extent;
+    long i;
 
-    writer = (GEOSWKTWriter*)getRelay(getThis(), WKTWriter_ce_ptr);
-
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "l", &prec)
-        == FAILURE)
-    {
-        RETURN_NULL();
+    part = (Partitioner*)getRelay(getThis(), Partitioner_ce_ptr TSRMLS_CC);
+    if ( Partitioner_build(part TSRMLS_CC) == FAILURE ) {
+        RETURN_NULL(); /* should get an exception first */
     }
 
-    GEOSWKTWriter_setRoundingPrecision_r(GEOS_G(handle), writer, prec);
+    array_init(return_value);
+    for (i=0; i<part->nparts; ++i) {
+        MAKE_STD_ZVAL(extent);
+        array_init(extent);
+        add_assoc_double(extent, "minx", part->parts[i].minx);
+        add_assoc_double(extent, "miny", part->parts[i].miny);
+        add_assoc_double(extent, "maxx", part->parts[i].maxx);
+        add_assoc_double(extent, "maxy", part->parts[i].maxy);
+        add_index_zval(return_value, i, extent);
+    }
 }
-#endif
 
 /**
- * void GEOSWKTWriter::setOutputDimension()
+ * array GEOSPartitioner::assign(array geoms)
+ *
+ * Array of the numbers of the partitions each geometry belongs
+ * to, keyed like the input. Geometries whose envelope crosses
+ * partition boundaries belong to several, empty ones to none.
  */
-#ifdef HAVE_GEOS_WKT_WRITER_SET_OUTPUT_DIMENSION
-PHP_METHOD(WKTWriter, setOutputDimension)
+PHP_METHOD(Partitioner, assign)
 {
-    GEOSWKTWriter *writer;
-    long int dim;
+    Partitioner *part;
+    zval *zgeoms;
+    zval **data;
+    zval *tmp;
+    HashTable *geoms;
+    HashPosition pos;
+    GEOSGeometry *geom;
+    long *parts;
+    long n, i;
 
-    writer = (GEOSWKTWriter*)getRelay(getThis(), WKTWriter_ce_ptr);
+    part = (Partitioner*)getRelay(getThis(), Partitioner_ce_ptr TSRMLS_CC);
 
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "l", &dim)
-        == FAILURE)
-    {
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "a", &zgeoms)
+            == FAILURE) {
         RETURN_NULL();
     }
 
-    GEOSWKTWriter_setOutputDimension_r(GEOS_G(handle), writer, dim);
+    if ( Partitioner_build(part TSRMLS_CC) == FAILURE ) {
+        RETURN_NULL(); /* should get an exception first */
+    }
+
+    array_init(return_value);
+
+    geoms = Z_ARRVAL_P(zgeoms);
+    for (zend_hash_internal_pointer_reset_ex(geoms, &pos);
+         zend_hash_get_current_data_ex(geoms, (void**)&data, &pos) == SUCCESS;
+         zend_hash_move_forward_ex(geoms, &pos))
+    {
+        geom = getGeometryElement(*data TSRMLS_CC);
+        if ( ! geom ) break; /* should get an exception first */
+
+        n = Partitioner_assign(part, geom, &parts TSRMLS_CC);
+        MAKE_STD_ZVAL(tmp);
+        array_init(tmp);
+        for (i=0; i<n; ++i) add_next_index_long(tmp, parts[i]);
+        if ( parts ) efree(parts);
+        addZvalWithKey(return_value, geoms, &pos, tmp);
+    }
 }
-#endif
 
 /**
- * long GEOSWKTWriter::getOutputDimension()
+ * array GEOSPartitioner::writePartitions(array geoms, pathPattern)
+ *
+ * Append the geometries to one file per partition, in the
+ * format read by geos.persistent_indexes: a little endian
+ * 64 bit id, here the integer key of the geometry, a little
+ * endian 32 bit length and the WKB. Datasets can be streamed
+ * through several calls; remove the files to start afresh.
+ *
+ * 'pathPattern' must contain a single %d, replaced by the
+ * partition number. Files are only created for partitions
+ * getting geometries. Returns the number of records written
+ * to each of them, keyed by partition number.
  */
-#ifdef HAVE_GEOS_WKT_WRITER_GET_OUTPUT_DIMENSION
-PHP_METHOD(WKTWriter, getOutputDimension)
+PHP_METHOD(Partitioner, writePartitions)
 {
-    GEOSWKTWriter *writer;
-    long int ret;
-
-    writer = (GEOSWKTWriter*)getRelay(getThis(), WKTWriter_ce_ptr);
-
-    ret = GEOSWKTWriter_getOutputDimension_r(GEOS_G(handle), writer);
+    Partitioner *part;
+    zval *zgeoms;
+    zval **data;
+    HashTable *geoms;
+    HashPosition pos;
+    GEOSGeometry *geom;
+    GEOSWKBWriter *writer;
+    php_stream **streams;
+    long *written;
+    long *parts;
+    const unsigned char *lazy;
+    unsigned char *wkb;
+    unsigned char header[12];
+    char *pattern, *marker, *path, *key;
+    int patternlen, j;
+    uint keylen;
+    ulong index;
+    size_t wkblen;
+    long n, i, p, failed = -1; /* partition that couldn't be written */
 
-    RETURN_LONG(ret);
-}
-#endif
+    part = (Partitioner*)getRelay(getThis(), Partitioner_ce_ptr TSRMLS_CC);
 
-#ifdef HAVE_GEOS_WKT_WRITER_SET_OLD_3D
-PHP_METHOD(WKTWriter, setOld3D)
-{
-    GEOSWKTWriter *writer;
-    zend_bool bval;
-    int val;
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "as", &zgeoms,
+            &pattern, &patternlen) == FAILURE) {
+        RETURN_NULL();
+    }
 
-    writer = (GEOSWKTWriter*)getRelay(getThis(), WKTWriter_ce_ptr);
+    marker = strstr(pattern, "%d");
+    if ( ! marker || strstr(marker + 2, "%d")
+            || (int)strlen(pattern) != patternlen ) {
+        zend_throw_exception_ex(zend_exception_get_default(TSRMLS_C), 1
+            TSRMLS_CC, "Path pattern must contain a single %%d");
+        RETURN_NULL();
+    }
 
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "b", &bval)
-        == FAILURE)
+    geoms = Z_ARRVAL_P(zgeoms);
+    for (zend_hash_internal_pointer_reset_ex(geoms, &pos);
+         zend_hash_get_current_data_ex(geoms, (void**)&data, &pos) == SUCCESS;
+         zend_hash_move_forward_ex(geoms, &pos))
     {
-        RETURN_NULL();
+        if ( zend_hash_get_current_key_ex(geoms, &key, &keylen, &index, 0,
+                &pos) == HASH_KEY_IS_STRING ) {
+            zend_throw_exception_ex(zend_exception_get_default(TSRMLS_C), 1
+                TSRMLS_CC, "Partition files need integer keys, got '%s'", key);
+            RETURN_NULL();
+        }
     }
 
-    val = bval;
-    GEOSWKTWriter_setOld3D_r(GEOS_G(handle), writer, val);
-}
-#endif
+    if ( Partitioner_build(part TSRMLS_CC) == FAILURE ) {
+        RETURN_NULL(); /* should get an exception first */
+    }
 
-/* -- class GEOSWKBWriter -------------------- */
+    writer = getGeometrySerializer(TSRMLS_C);
+    if ( ! writer ) RETURN_NULL(); /* should get an exception first */
 
-PHP_METHOD(WKBWriter, __construct);
-PHP_METHOD(WKBWriter, getOutputDimension);
-PHP_METHOD(WKBWriter, setOutputDimension);
-PHP_METHOD(WKBWriter, getByteOrder);
-PHP_METHOD(WKBWriter, setByteOrder);
-PHP_METHOD(WKBWriter, setIncludeSRID);
-PHP_METHOD(WKBWriter, getIncludeSRID);
-PHP_METHOD(WKBWriter, write);
-PHP_METHOD(WKBWriter, writeHEX);
+    streams = (php_stream**)ecalloc(part->nparts, sizeof(php_stream*));
+    written = (long*)ecalloc(part->nparts, sizeof(long));
+    path = (char*)emalloc(patternlen + MAX_LENGTH_OF_LONG);
 
-static zend_function_entry WKBWriter_methods[] = {
-    PHP_ME(WKBWriter, __construct, NULL, 0)
-    PHP_ME(WKBWriter, getOutputDimension, NULL, 0)
-    PHP_ME(WKBWriter, setOutputDimension, NULL, 0)
-    PHP_ME(WKBWriter, getByteOrder, NULL, 0)
-    PHP_ME(WKBWriter, setByteOrder, NULL, 0)
-    PHP_ME(WKBWriter, getIncludeSRID, NULL, 0)
-    PHP_ME(WKBWriter, setIncludeSRID, NULL, 0)
-    PHP_ME(WKBWriter, write, NULL, 0)
-    PHP_ME(WKBWriter, writeHEX, NULL, 0)
-    {NULL, NULL, NULL}
-};
+    for (zend_hash_internal_pointer_reset_ex(geoms, &pos);
+         failed < 0 && zend_hash_get_current_data_ex(geoms, (void**)&data, &pos)
+            == SUCCESS;
+         zend_hash_move_forward_ex(geoms, &pos))
+    {
+        geom = getGeometryElement(*data TSRMLS_CC);
+        if ( ! geom ) break; /* should get an exception first */
 
-static zend_class_entry *WKBWriter_ce_ptr;
+        n = Partitioner_assign(part, geom, &parts TSRMLS_CC);
+        if ( ! n ) {
+            if ( parts ) efree(parts);
+            continue;
+        }
 
-static zend_object_handlers WKBWriter_object_handlers;
+        lazy = getPassThroughWKB(*data, writer, &wkblen TSRMLS_CC);
+        wkb = lazy ? NULL
+            : GEOSWKBWriter_write_r(GEOS_G(handle), writer, geom, &wkblen);
+        if ( ! lazy && ! wkb ) {
+            efree(parts);
+            break; /* should get an exception first */
+        }
+        if ( wkblen > UINT32_MAX ) {
+            if ( wkb ) GEOSFree_r(GEOS_G(handle), wkb);
+            efree(parts);
+            zend_throw_exception_ex(zend_exception_get_default(TSRMLS_C), 1
+                TSRMLS_CC, "Geometry of %lu bytes is too large for a "
+                "partition file", (unsigned long)wkblen);
+            break;
+        }
 
-static void
-WKBWriter_dtor (void *object TSRMLS_DC)
-{
-    Proxy *obj = (Proxy *)object;
-    GEOSWKBWriter_destroy_r(GEOS_G(handle), (GEOSWKBWriter*)obj->relay);
+        zend_hash_get_current_key_ex(geoms, &key, &keylen, &index, 0, &pos);
+        for (j=0; j<8; ++j) header[j] = (unsigned char)(index >> (8 * j));
+        for (j=0; j<4; ++j) header[8 + j] = (unsigned char)(wkblen >> (8 * j));
+
+        for (i=0; i<n; ++i) {
+            p = parts[i];
+            if ( ! streams[p] ) {
+                sprintf(path, "%.*s%ld%s", (int)(marker - pattern), pattern,
+                    p, marker + 2);
+                streams[p] = php_stream_open_wrapper(path, "ab",
+                    REPORT_ERRORS, NULL);
+                if ( ! streams[p] ) {
+                    failed = p; /* should get a warning first */
+                    break;
+                }
+            }
+            if ( php_stream_write(streams[p], (char*)header, 12) != 12
+                    || php_stream_write(streams[p],
+                        lazy ? (const char*)lazy : (const char*)wkb, wkblen)
+                        != wkblen ) {
+                failed = p;
+                break;
+            }
+            written[p]++;
+        }
 
-    zend_hash_destroy(obj->std.properties);
-    FREE_HASHTABLE(obj->std.properties);
+        if ( wkb ) GEOSFree_r(GEOS_G(handle), wkb);
+        efree(parts);
+    }
 
-    efree(obj);
-}
+    array_init(return_value);
+    for (p=0; p<part->nparts; ++p) {
+        if ( ! streams[p] ) continue;
+        php_stream_close(streams[p]);
+        add_index_long(return_value, p, written[p]);
+    }
 
-static zend_object_value
-WKBWriter_create_obj (zend_class_entry *type TSRMLS_DC)
-{
-    return Gen_create_obj(type, WKBWriter_dtor, &WKBWriter_object_handlers);
+    efree(streams);
+    efree(written);
+    efree(path);
+
+    if ( failed >= 0 ) {
+        zval_dtor(return_value);
+        zend_throw_exception_ex(zend_exception_get_default(TSRMLS_C), 1
+            TSRMLS_CC, "Cannot write the file of partition %ld", failed);
+        RETURN_NULL();
+    }
 }
 
 /**
- * GEOSWKBWriter w = new GEOSWKBWriter()
+ * long GEOSPartitioner::count()
+ *
+ * Number of partitions, building them if needed.
  */
-PHP_METHOD(WKBWriter, __construct)
+PHP_METHOD(Partitioner, count)
 {
-    GEOSWKBWriter* obj;
-    zval *object = getThis();
+    Partitioner *part;
 
-    obj = GEOSWKBWriter_create_r(GEOS_G(handle));
-    if ( ! obj ) {
-        php_error_docref(NULL TSRMLS_CC, E_ERROR,
-                "GEOSWKBWriter_create() failed (didn't initGEOS?)");
+    part = (Partitioner*)getRelay(getThis(), Partitioner_ce_ptr TSRMLS_CC);
+    if ( Partitioner_build(part TSRMLS_CC) == FAILURE ) {
+        RETURN_NULL(); /* should get an exception first */
     }
 
-    setRelay(object, obj);
+    RETURN_LONG(part->nparts);
 }
 
-/**
- * long GEOSWKBWriter::getOutputDimension();
- */
-PHP_METHOD(WKBWriter, getOutputDimension)
-{
-    GEOSWKBWriter *writer;
-    long int ret;
-
-    writer = (GEOSWKBWriter*)getRelay(getThis(), WKBWriter_ce_ptr);
-
-    ret = GEOSWKBWriter_getOutputDimension_r(GEOS_G(handle), writer);
+/* -- Worker pool -------------------- */
 
-    RETURN_LONG(ret);
-}
+#ifdef HAVE_GEOS_ASYNC
 
-/**
- * void GEOSWKBWriter::setOutputDimension(dims);
+/*
+ * GEOSAsync::submit hands operations to a pool of native threads,
+ * started on first use in each process and joined at module
+ * shutdown. Workers have a GEOS context of their own and only
+ * see WKB: inputs are written by the submitting request and the
+ * result is read back into the request context by GEOSFuture.
+ *
+ * A job is shared by the queue (or the worker running it) and
+ * its GEOSFuture, and freed by whichever lets go last. Queue,
+ * states and reference counts are guarded by asyncMutex, which
+ * fork() handlers take so that a child never inherits it locked.
  */
-PHP_METHOD(WKBWriter, setOutputDimension)
-{
-    GEOSWKBWriter *writer;
-    long int dim;
 
-    writer = (GEOSWKBWriter*)getRelay(getThis(), WKBWriter_ce_ptr);
+enum {
+    ASYNC_UNION,
+    ASYNC_UNARY_UNION,
+    ASYNC_INTERSECTION,
+    ASYNC_DIFFERENCE,
+    ASYNC_SYM_DIFFERENCE,
+    ASYNC_BUFFER,
+    ASYNC_SIMPLIFY,
+    ASYNC_CONVEX_HULL
+};
 
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "l", &dim)
-        == FAILURE)
-    {
-        RETURN_NULL();
-    }
+enum {
+    ASYNC_QUEUED,
+    ASYNC_RUNNING,
+    ASYNC_DONE,
+    ASYNC_FAILED,
+    ASYNC_CANCELLED
+};
 
-    GEOSWKBWriter_setOutputDimension_r(GEOS_G(handle), writer, dim);
+typedef struct AsyncJob_t {
+    int op;
+    int state;
+    int refcount;
+    volatile int cancel;
+    pid_t pid; /* of the submitting process */
+    double param; /* buffer distance or simplify tolerance */
+    int ninputs;
+    unsigned char **inputs; /* WKB */
+    size_t *inputlens;
+    unsigned char *result; /* WKB, malloc'd by the worker */
+    size_t resultlen;
+    char error[256];
+    struct AsyncJob_t *next;
+} AsyncJob;
+
+typedef struct AsyncWorker_t {
+    pthread_t thread;
+    AsyncJob *job; /* being run, set and cleared with asyncMutex held */
+} AsyncWorker;
+
+static pthread_mutex_t asyncMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t asyncQueued = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t asyncFinished = PTHREAD_COND_INITIALIZER;
+static AsyncJob *asyncHead = NULL;
+static AsyncJob *asyncTail = NULL;
+static AsyncWorker *asyncWorkers = NULL;
+static long asyncNumWorkers = 0;
+static pid_t asyncPid = 0;
+static int asyncStopping = 0;
+static pthread_once_t asyncForkOnce = PTHREAD_ONCE_INIT;
+
+/* drop a reference, with asyncMutex held unless the job is unshared */
+static void
+AsyncJob_release(AsyncJob* job)
+{
+    int i;
+
+    if ( --job->refcount > 0 ) return;
 
+    for (i=0; i<job->ninputs; ++i) pefree(job->inputs[i], 1);
+    if ( job->inputs ) pefree(job->inputs, 1);
+    if ( job->inputlens ) pefree(job->inputlens, 1);
+    if ( job->result ) free(job->result);
+    pefree(job, 1);
 }
 
-/**
- * string GEOSWKBWriter::write(GEOSGeometry)
- */
-PHP_METHOD(WKBWriter, write)
+static void
+asyncNoticeHandler(const char *message, void *userdata)
 {
-    GEOSWKBWriter *writer;
-    zval *zobj;
-    GEOSGeometry *geom;
-    char *ret;
-    size_t retsize;
-    char* retstr;
+    /* nobody to tell */
+}
 
-    writer = (GEOSWKBWriter*)getRelay(getThis(), WKBWriter_ce_ptr);
+static void
+asyncErrorHandler(const char *message, void *userdata)
+{
+    AsyncWorker *worker = (AsyncWorker*)userdata;
 
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o", &zobj)
-        == FAILURE)
-    {
-        RETURN_NULL();
+    if ( worker->job ) {
+        snprintf(worker->job->error, sizeof(worker->job->error), "%s",
+            message);
     }
+}
 
-    geom = getRelay(zobj, Geometry_ce_ptr);
-
-    ret = (char*)GEOSWKBWriter_write_r(GEOS_G(handle), writer, geom, &retsize);
-    /* we'll probably get an exception if ret is null */
-    if ( ! ret ) RETURN_NULL();
-
-    retstr = estrndup(ret, retsize);
-    GEOSFree_r(GEOS_G(handle), ret);
+#ifdef HAVE_GEOS_CONTEXT_SET_INTERRUPT_CALLBACK
+/* polled by GEOS from within long running operations */
+static int
+asyncInterrupt(void *userdata)
+{
+    AsyncWorker *worker = (AsyncWorker*)userdata;
 
-    RETURN_STRINGL(retstr, retsize, 0);
+    return worker->job && worker->job->cancel;
 }
+#endif
 
-/**
- * string GEOSWKBWriter::writeHEX(GEOSGeometry)
+/*
+ * Run a job in the worker context, setting its result.
+ * Return the state the job ends up in.
  */
-PHP_METHOD(WKBWriter, writeHEX)
+static int
+AsyncJob_run(AsyncJob* job, GEOSContextHandle_t handle,
+        GEOSWKBReader* reader, GEOSWKBWriter* writer)
 {
-    GEOSWKBWriter *writer;
-    zval *zobj;
-    GEOSGeometry *geom;
-    char *ret;
-    size_t retsize; /* useless... */
-    char* retstr;
+    GEOSGeometry **geoms, *ret = NULL;
+    unsigned char *wkb;
+    size_t wkblen;
+    int i, srid = 0, ngeoms = 0;
+
+    geoms = calloc(job->ninputs, sizeof(GEOSGeometry*));
+    if ( ! geoms ) {
+        snprintf(job->error, sizeof(job->error), "Out of memory");
+        return ASYNC_FAILED;
+    }
+
+    for (i=0; i<job->ninputs; ++i) {
+        geoms[i] = GEOSWKBReader_read_r(handle, reader, job->inputs[i],
+            job->inputlens[i]);
+        if ( ! geoms[i] ) break;
+        ++ngeoms;
+    }
 
-    writer = (GEOSWKBWriter*)getRelay(getThis(), WKBWriter_ce_ptr);
+    if ( ngeoms ) srid = GEOSGetSRID_r(handle, geoms[0]);
 
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o", &zobj)
-        == FAILURE)
+    if ( ngeoms == job->ninputs ) switch (job->op)
     {
-        RETURN_NULL();
+        case ASYNC_UNION:
+            ret = GEOSUnion_r(handle, geoms[0], geoms[1]);
+            break;
+#       ifdef HAVE_GEOS_UNARY_UNION
+        case ASYNC_UNARY_UNION:
+            if ( ngeoms > 1 ) {
+                /* the collection takes ownership of the inputs */
+                geoms[0] = GEOSGeom_createCollection_r(handle,
+                    GEOS_GEOMETRYCOLLECTION, geoms, ngeoms);
+                ngeoms = geoms[0] ? 1 : 0;
+                if ( ! ngeoms ) break;
+            }
+            ret = GEOSUnaryUnion_r(handle, geoms[0]);
+            break;
+#       endif
+        case ASYNC_INTERSECTION:
+            ret = GEOSIntersection_r(handle, geoms[0], geoms[1]);
+            break;
+        case ASYNC_DIFFERENCE:
+            ret = GEOSDifference_r(handle, geoms[0], geoms[1]);
+            break;
+        case ASYNC_SYM_DIFFERENCE:
+            ret = GEOSSymDifference_r(handle, geoms[0], geoms[1]);
+            break;
+        case ASYNC_BUFFER:
+            ret = GEOSBuffer_r(handle, geoms[0], job->param, 8);
+            break;
+        case ASYNC_SIMPLIFY:
+            ret = GEOSSimplify_r(handle, geoms[0], job->param);
+            break;
+        case ASYNC_CONVEX_HULL:
+            ret = GEOSConvexHull_r(handle, geoms[0]);
+            break;
     }
 
-    geom = getRelay(zobj, Geometry_ce_ptr);
-
-    ret = (char*)GEOSWKBWriter_writeHEX_r(GEOS_G(handle), writer, geom, &retsize);
-    /* we'll probably get an exception if ret is null */
-    if ( ! ret ) RETURN_NULL();
+    if ( ret ) {
+        GEOSSetSRID_r(handle, ret, srid);
+        wkb = GEOSWKBWriter_write_r(handle, writer, ret, &wkblen);
+        if ( wkb ) {
+            job->result = malloc(wkblen);
+            if ( job->result ) {
+                memcpy(job->result, wkb, wkblen);
+                job->resultlen = wkblen;
+            } else {
+                snprintf(job->error, sizeof(job->error), "Out of memory");
+            }
+            GEOSFree_r(handle, wkb);
+        }
+        GEOSGeom_destroy_r(handle, ret);
+    }
 
-    retstr = estrndup(ret, retsize);
-    GEOSFree_r(GEOS_G(handle), ret);
+    for (i=0; i<ngeoms; ++i) GEOSGeom_destroy_r(handle, geoms[i]);
+    free(geoms);
 
-    RETURN_STRING(retstr, 0);
+    if ( job->result ) return ASYNC_DONE;
+    return job->cancel ? ASYNC_CANCELLED : ASYNC_FAILED;
 }
 
-/**
- * long GEOSWKBWriter::getByteOrder();
- */
-PHP_METHOD(WKBWriter, getByteOrder)
+static void*
+asyncWorkerMain(void* arg)
 {
+    AsyncWorker *worker = (AsyncWorker*)arg;
+    GEOSContextHandle_t handle;
+    GEOSWKBReader *reader;
     GEOSWKBWriter *writer;
-    long int ret;
+    AsyncJob *job;
+    int state;
+
+    handle = GEOS_init_r();
+    GEOSContext_setNoticeMessageHandler_r(handle, asyncNoticeHandler, worker);
+    GEOSContext_setErrorMessageHandler_r(handle, asyncErrorHandler, worker);
+#   ifdef HAVE_GEOS_CONTEXT_SET_INTERRUPT_CALLBACK
+    GEOSContext_setInterruptCallback_r(handle, asyncInterrupt, worker);
+#   endif
+    reader = GEOSWKBReader_create_r(handle);
+    writer = GEOSWKBWriter_create_r(handle);
+    GEOSWKBWriter_setIncludeSRID_r(handle, writer, 1);
+    GEOSWKBWriter_setOutputDimension_r(handle, writer, 3);
+
+    pthread_mutex_lock(&asyncMutex);
+    for (;;) {
+        while ( ! asyncHead && ! asyncStopping ) {
+            pthread_cond_wait(&asyncQueued, &asyncMutex);
+        }
+        if ( asyncStopping ) break;
 
-    writer = (GEOSWKBWriter*)getRelay(getThis(), WKBWriter_ce_ptr);
+        job = asyncHead;
+        asyncHead = job->next;
+        if ( ! asyncHead ) asyncTail = NULL;
 
-    ret = GEOSWKBWriter_getByteOrder_r(GEOS_G(handle), writer);
+        /* its GEOSFuture is gone, nobody wants the result */
+        if ( job->cancel ) {
+            job->state = ASYNC_CANCELLED;
+            AsyncJob_release(job);
+            continue;
+        }
 
-    RETURN_LONG(ret);
+        job->state = ASYNC_RUNNING;
+        worker->job = job;
+        pthread_mutex_unlock(&asyncMutex);
+
+        state = AsyncJob_run(job, handle, reader, writer);
+
+        pthread_mutex_lock(&asyncMutex);
+        worker->job = NULL;
+        job->state = state;
+        pthread_cond_broadcast(&asyncFinished);
+        AsyncJob_release(job);
+    }
+    pthread_mutex_unlock(&asyncMutex);
+
+    GEOSWKBReader_destroy_r(handle, reader);
+    GEOSWKBWriter_destroy_r(handle, writer);
+    GEOS_finish_r(handle);
+    return NULL;
 }
 
-/**
- * void GEOSWKBWriter::setByteOrder(dims);
- */
-PHP_METHOD(WKBWriter, setByteOrder)
+/* fork() handlers, so that the child gets asyncMutex unlocked */
+static void
+asyncPrepareFork(void)
 {
-    GEOSWKBWriter *writer;
-    long int dim;
-
-    writer = (GEOSWKBWriter*)getRelay(getThis(), WKBWriter_ce_ptr);
+    pthread_mutex_lock(&asyncMutex);
+}
 
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "l", &dim)
-        == FAILURE)
-    {
-        RETURN_NULL();
-    }
+static void
+asyncParentFork(void)
+{
+    pthread_mutex_unlock(&asyncMutex);
+}
 
-    GEOSWKBWriter_setByteOrder_r(GEOS_G(handle), writer, dim);
+/*
+ * Threads don't survive fork(), so the pool inherited by a child
+ * is forgotten, along with its queue, and started again on first
+ * use. Workers may have been waiting on the conditions.
+ */
+static void
+asyncChildFork(void)
+{
+    pthread_cond_init(&asyncQueued, NULL);
+    pthread_cond_init(&asyncFinished, NULL);
+    asyncWorkers = NULL;
+    asyncNumWorkers = 0;
+    asyncHead = asyncTail = NULL;
+    asyncPid = getpid();
+    pthread_mutex_unlock(&asyncMutex); /* taken by asyncPrepareFork */
+}
 
+static void
+registerAsyncFork(void)
+{
+    pthread_atfork(asyncPrepareFork, asyncParentFork, asyncChildFork);
 }
 
-/**
- * bool GEOSWKBWriter::getIncludeSRID();
+/*
+ * Make sure the pool of this process is running, with asyncMutex
+ * held. A pool inherited from a parent process, forked without
+ * the handlers above, is forgotten and started again.
  */
-PHP_METHOD(WKBWriter, getIncludeSRID)
+static int
+startAsyncWorkers(long n)
 {
-    GEOSWKBWriter *writer;
-    int ret;
-    zend_bool retBool;
+    long i;
 
-    writer = (GEOSWKBWriter*)getRelay(getThis(), WKBWriter_ce_ptr);
+    pthread_once(&asyncForkOnce, registerAsyncFork);
 
-    ret = GEOSWKBWriter_getIncludeSRID_r(GEOS_G(handle), writer);
-    retBool = ret;
+    if ( asyncPid != getpid() ) {
+        asyncWorkers = NULL;
+        asyncNumWorkers = 0;
+        asyncHead = asyncTail = NULL;
+        asyncPid = getpid();
+    }
+    if ( asyncNumWorkers ) return SUCCESS;
 
-    RETURN_BOOL(retBool);
+    if ( n < 1 ) n = 1;
+    asyncWorkers = calloc(n, sizeof(AsyncWorker));
+    if ( ! asyncWorkers ) return FAILURE;
+
+    for (i=0; i<n; ++i) {
+        if ( pthread_create(&asyncWorkers[i].thread, NULL, asyncWorkerMain,
+                &asyncWorkers[i]) ) {
+            break;
+        }
+    }
+    asyncNumWorkers = i;
+
+    if ( ! asyncNumWorkers ) {
+        free(asyncWorkers);
+        asyncWorkers = NULL;
+        return FAILURE;
+    }
+    return SUCCESS;
 }
 
-/**
- * void GEOSWKBWriter::setIncludeSRID(bool);
+/*
+ * Join the pool at module shutdown, interrupting running jobs
+ * and dropping those still queued.
  */
-PHP_METHOD(WKBWriter, setIncludeSRID)
+static void
+stopAsyncWorkers(void)
 {
-    GEOSWKBWriter *writer;
-    int inc;
-    zend_bool incVal;
+    AsyncJob *job;
+    long i;
 
-    writer = (GEOSWKBWriter*)getRelay(getThis(), WKBWriter_ce_ptr);
+    if ( ! asyncNumWorkers || asyncPid != getpid() ) return;
 
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "b", &incVal)
-        == FAILURE)
-    {
-        RETURN_NULL();
+    pthread_mutex_lock(&asyncMutex);
+    asyncStopping = 1;
+    for (i=0; i<asyncNumWorkers; ++i) {
+        if ( asyncWorkers[i].job ) asyncWorkers[i].job->cancel = 1;
     }
+    pthread_cond_broadcast(&asyncQueued);
+    pthread_mutex_unlock(&asyncMutex);
 
-    inc = incVal;
-    GEOSWKBWriter_setIncludeSRID_r(GEOS_G(handle), writer, inc);
+    for (i=0; i<asyncNumWorkers; ++i) {
+        pthread_join(asyncWorkers[i].thread, NULL);
+    }
+    free(asyncWorkers);
+    asyncWorkers = NULL;
+    asyncNumWorkers = 0;
+
+    while ( asyncHead ) {
+        job = asyncHead;
+        asyncHead = job->next;
+        job->state = ASYNC_CANCELLED;
+        AsyncJob_release(job);
+    }
+    asyncTail = NULL;
+    asyncStopping = 0;
 }
 
-/* -- class GEOSWKBReader -------------------- */
+/* -- class GEOSFuture -------------------- */
 
-PHP_METHOD(WKBReader, __construct);
-PHP_METHOD(WKBReader, read);
-PHP_METHOD(WKBReader, readHEX);
+PHP_METHOD(Future, wait);
+PHP_METHOD(Future, isReady);
+PHP_METHOD(Future, cancel);
 
-static zend_function_entry WKBReader_methods[] = {
-    PHP_ME(WKBReader, __construct, NULL, 0)
-    PHP_ME(WKBReader, read, NULL, 0)
-    PHP_ME(WKBReader, readHEX, NULL, 0)
+static zend_function_entry Future_methods[] = {
+    PHP_ME(Future, wait, NULL, 0)
+    PHP_ME(Future, isReady, NULL, 0)
+    PHP_ME(Future, cancel, NULL, 0)
     {NULL, NULL, NULL}
 };
 
-static zend_class_entry *WKBReader_ce_ptr;
+static zend_class_entry *Future_ce_ptr;
 
-static zend_object_handlers WKBReader_object_handlers;
+static zend_object_handlers Future_object_handlers;
 
 static void
-WKBReader_dtor (void *object TSRMLS_DC)
+Future_dtor (void *object TSRMLS_DC)
 {
     Proxy *obj = (Proxy *)object;
-    GEOSWKBReader_destroy_r(GEOS_G(handle), (GEOSWKBReader*)obj->relay);
+    AsyncJob *job = (AsyncJob*)obj->relay;
+
+    /* nobody will look at the result anymore, workers skip it */
+    if ( job ) {
+        pthread_mutex_lock(&asyncMutex);
+        job->cancel = 1;
+        AsyncJob_release(job);
+        pthread_mutex_unlock(&asyncMutex);
+    }
 
     zend_hash_destroy(obj->std.properties);
     FREE_HASHTABLE(obj->std.properties);
@@ -2791,76 +11073,334 @@ WKBReader_dtor (void *object TSRMLS_DC)
 }
 
 static zend_object_value
-WKBReader_create_obj (zend_class_entry *type TSRMLS_DC)
+Future_create_obj (zend_class_entry *type TSRMLS_DC)
 {
-    return Gen_create_obj(type, WKBReader_dtor, &WKBReader_object_handlers);
+    return Gen_create_obj(type, Future_dtor, &Future_object_handlers TSRMLS_CC);
 }
 
-
-PHP_METHOD(WKBReader, __construct)
+/**
+ * GEOSGeometry GEOSFuture::wait([timeout])
+ *
+ * Block until the operation is over and return its result,
+ * throwing an exception if it failed or was cancelled.
+ * With a timeout, in seconds, null is returned if the
+ * operation is still pending when it expires.
+ */
+PHP_METHOD(Future, wait)
 {
-    GEOSWKBReader* obj;
-    zval *object = getThis();
+    AsyncJob *job;
+    GEOSWKBReader *reader;
+    GEOSGeometry *ret;
+    struct timeval now;
+    struct timespec deadline = { 0, 0 };
+    double timeout = -1;
+    int state;
 
-    obj = GEOSWKBReader_create_r(GEOS_G(handle));
-    if ( ! obj ) {
-        php_error_docref(NULL TSRMLS_CC, E_ERROR,
-                "GEOSWKBReader_create() failed (didn't initGEOS?)");
+    job = (AsyncJob*)getRelay(getThis(), Future_ce_ptr TSRMLS_CC);
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|d", &timeout)
+            == FAILURE) {
+        RETURN_NULL();
     }
 
-    setRelay(object, obj);
-}
+    if ( job->pid != getpid() ) {
+        zend_throw_exception_ex(zend_exception_get_default(TSRMLS_C),
+            1 TSRMLS_CC, "Operation was submitted by another process");
+        RETURN_NULL();
+    }
 
-PHP_METHOD(WKBReader, read)
-{
-    GEOSWKBReader *reader;
-    GEOSGeometry *geom;
-    unsigned char* wkb;
-    int wkblen;
+    if ( timeout >= 0 ) {
+        gettimeofday(&now, NULL);
+        timeout += now.tv_sec + now.tv_usec / 1e6;
+        deadline.tv_sec = (time_t)timeout;
+        deadline.tv_nsec = (long)((timeout - deadline.tv_sec) * 1e9);
+    }
 
-    reader = (GEOSWKBReader*)getRelay(getThis(), WKBReader_ce_ptr);
+    pthread_mutex_lock(&asyncMutex);
+    while ( job->state < ASYNC_DONE ) {
+        if ( timeout < 0 ) {
+            pthread_cond_wait(&asyncFinished, &asyncMutex);
+        } else if ( pthread_cond_timedwait(&asyncFinished, &asyncMutex,
+                &deadline) == ETIMEDOUT ) {
+            break;
+        }
+    }
+    state = job->state;
+    pthread_mutex_unlock(&asyncMutex);
 
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s",
-        &wkb, &wkblen) == FAILURE)
+    switch (state)
     {
-        RETURN_NULL();
+        case ASYNC_DONE:
+            break;
+        case ASYNC_CANCELLED:
+            zend_throw_exception_ex(zend_exception_get_default(TSRMLS_C),
+                1 TSRMLS_CC, "Operation was cancelled");
+            RETURN_NULL();
+        case ASYNC_FAILED:
+            zend_throw_exception_ex(zend_exception_get_default(TSRMLS_C),
+                1 TSRMLS_CC, "%s",
+                *job->error ? job->error : "Operation failed");
+            RETURN_NULL();
+        default:
+            RETURN_NULL(); /* timed out */
     }
 
-    geom = GEOSWKBReader_read_r(GEOS_G(handle), reader, wkb, wkblen);
-    /* we'll probably get an exception if geom is null */
-    if ( ! geom ) RETURN_NULL();
+    reader = getGeometryDeserializer(TSRMLS_C);
+    if ( ! reader ) RETURN_NULL(); /* should get an exception first */
+
+    ret = GEOSWKBReader_read_r(GEOS_G(handle), reader, job->result,
+        job->resultlen);
+    if ( ! ret ) RETURN_NULL(); /* should get an exception first */
 
     /* return_value is a zval */
     object_init_ex(return_value, Geometry_ce_ptr);
-    setRelay(return_value, geom);
+    setRelay(return_value, ret TSRMLS_CC);
+}
+
+/**
+ * bool GEOSFuture::isReady()
+ *
+ * True once wait() would not block.
+ */
+PHP_METHOD(Future, isReady)
+{
+    AsyncJob *job;
+    int state;
+
+    job = (AsyncJob*)getRelay(getThis(), Future_ce_ptr TSRMLS_CC);
 
+    pthread_mutex_lock(&asyncMutex);
+    state = job->state;
+    pthread_mutex_unlock(&asyncMutex);
+
+    RETURN_BOOL(state >= ASYNC_DONE);
 }
 
-PHP_METHOD(WKBReader, readHEX)
+/**
+ * bool GEOSFuture::cancel()
+ *
+ * Drop the operation if it is still queued, or ask GEOS to
+ * interrupt it if it is running. Return false if it is over
+ * already or can't be interrupted; wait() tells the outcome.
+ */
+PHP_METHOD(Future, cancel)
+{
+    AsyncJob *job, *cur, *prev = NULL;
+    int ret = 0;
+
+    job = (AsyncJob*)getRelay(getThis(), Future_ce_ptr TSRMLS_CC);
+
+    pthread_mutex_lock(&asyncMutex);
+    if ( job->state == ASYNC_QUEUED ) {
+        for (cur = asyncHead; cur && cur != job; cur = cur->next) prev = cur;
+        if ( cur ) {
+            if ( prev ) prev->next = job->next;
+            else asyncHead = job->next;
+            if ( asyncTail == job ) asyncTail = prev;
+        }
+        job->state = ASYNC_CANCELLED;
+        pthread_cond_broadcast(&asyncFinished);
+        AsyncJob_release(job); /* the queue reference */
+        ret = 1;
+    } else if ( job->state == ASYNC_RUNNING ) {
+        job->cancel = 1;
+#       ifdef HAVE_GEOS_CONTEXT_SET_INTERRUPT_CALLBACK
+        ret = 1;
+#       endif
+    }
+    pthread_mutex_unlock(&asyncMutex);
+
+    RETURN_BOOL(ret);
+}
+
+/* -- class GEOSAsync -------------------- */
+
+PHP_METHOD(Async, submit);
+
+static zend_function_entry Async_methods[] = {
+    PHP_ME(Async, submit, NULL, ZEND_ACC_PUBLIC|ZEND_ACC_STATIC)
+    {NULL, NULL, NULL}
+};
+
+static zend_class_entry *Async_ce_ptr;
+
+/* Add the WKB of a geometry to the inputs of a job */
+static int
+addAsyncInput(AsyncJob* job, zval* zgeom TSRMLS_DC)
 {
-    GEOSWKBReader *reader;
     GEOSGeometry *geom;
-    unsigned char* wkb;
-    int wkblen;
+    GEOSWKBWriter *writer;
+    const unsigned char *lazy;
+    unsigned char *wkb = NULL;
+    size_t wkblen;
+
+    writer = getGeometrySerializer(TSRMLS_C);
+    if ( ! writer ) return FAILURE;
+
+    lazy = getPassThroughWKB(zgeom, writer, &wkblen TSRMLS_CC);
+    if ( ! lazy ) {
+        geom = (GEOSGeometry*)getRelay(zgeom, Geometry_ce_ptr TSRMLS_CC);
+        if ( ! geom ) return FAILURE;
+        wkb = GEOSWKBWriter_write_r(GEOS_G(handle), writer, geom, &wkblen);
+        if ( ! wkb ) return FAILURE;
+        lazy = wkb;
+    }
 
-    reader = (GEOSWKBReader*)getRelay(getThis(), WKBReader_ce_ptr);
+    job->inputs = safe_perealloc(job->inputs, job->ninputs + 1,
+        sizeof(unsigned char*), 0, 1);
+    job->inputlens = safe_perealloc(job->inputlens, job->ninputs + 1,
+        sizeof(size_t), 0, 1);
+    job->inputs[job->ninputs] = pemalloc(wkblen, 1);
+    memcpy(job->inputs[job->ninputs], lazy, wkblen);
+    job->inputlens[job->ninputs] = wkblen;
+    ++job->ninputs;
 
-    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s",
-        &wkb, &wkblen) == FAILURE)
-    {
+    if ( wkb ) GEOSFree_r(GEOS_G(handle), wkb);
+    return SUCCESS;
+}
+
+/**
+ * GEOSFuture GEOSAsync::submit(op, args)
+ *
+ * Run an operation on the worker pool, see geos.async_workers.
+ * Supported operations, and their arguments, are:
+ *
+ *  - 'union', 'intersection', 'difference', 'symDifference'
+ *      two GEOSGeometry
+ *  - 'unaryUnion'
+ *      any number of GEOSGeometry, or an array of them
+ *  - 'buffer'
+ *      a GEOSGeometry and a distance
+ *  - 'simplify'
+ *      a GEOSGeometry and a tolerance
+ *  - 'convexHull'
+ *      a GEOSGeometry
+ *
+ * Geometries are copied, changing them afterwards does not
+ * affect the operation.
+ */
+PHP_METHOD(Async, submit)
+{
+    AsyncJob *job;
+    HashTable *args, *list;
+    HashPosition pos, listpos;
+    zval **data, **elem;
+    char *op;
+    int oplen, ngeoms = 1, nparams = 0, params = 0, invalid = 0;
+    int ret = SUCCESS;
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "sa", &op, &oplen,
+            &args) == FAILURE) {
         RETURN_NULL();
     }
 
-    geom = GEOSWKBReader_readHEX_r(GEOS_G(handle), reader, wkb, wkblen);
-    /* we'll probably get an exception if geom is null */
-    if ( ! geom ) RETURN_NULL();
+    job = pecalloc(1, sizeof(AsyncJob), 1);
+    job->refcount = 1;
+    job->pid = getpid();
+
+    if ( ! strcmp(op, "union") ) {
+        job->op = ASYNC_UNION;
+        ngeoms = 2;
+    } else if ( ! strcmp(op, "intersection") ) {
+        job->op = ASYNC_INTERSECTION;
+        ngeoms = 2;
+    } else if ( ! strcmp(op, "difference") ) {
+        job->op = ASYNC_DIFFERENCE;
+        ngeoms = 2;
+    } else if ( ! strcmp(op, "symDifference") ) {
+        job->op = ASYNC_SYM_DIFFERENCE;
+        ngeoms = 2;
+#   ifdef HAVE_GEOS_UNARY_UNION
+    } else if ( ! strcmp(op, "unaryUnion") ) {
+        job->op = ASYNC_UNARY_UNION;
+        ngeoms = -1;
+#   endif
+    } else if ( ! strcmp(op, "buffer") ) {
+        job->op = ASYNC_BUFFER;
+        params = 1;
+    } else if ( ! strcmp(op, "simplify") ) {
+        job->op = ASYNC_SIMPLIFY;
+        params = 1;
+    } else if ( ! strcmp(op, "convexHull") ) {
+        job->op = ASYNC_CONVEX_HULL;
+    } else {
+        AsyncJob_release(job);
+        zend_throw_exception_ex(zend_exception_get_default(TSRMLS_C),
+            1 TSRMLS_CC, "Unsupported asynchronous operation '%s'", op);
+        RETURN_NULL();
+    }
 
-    /* return_value is a zval */
-    object_init_ex(return_value, Geometry_ce_ptr);
-    setRelay(return_value, geom);
+    for (zend_hash_internal_pointer_reset_ex(args, &pos);
+         ret == SUCCESS &&
+            zend_hash_get_current_data_ex(args, (void**)&data, &pos) == SUCCESS;
+         zend_hash_move_forward_ex(args, &pos))
+    {
+        if ( Z_TYPE_PP(data) == IS_OBJECT &&
+                instanceof_function(Z_OBJCE_PP(data), Geometry_ce_ptr
+                    TSRMLS_CC) ) {
+            ret = addAsyncInput(job, *data TSRMLS_CC);
+        } else if ( Z_TYPE_PP(data) == IS_ARRAY && ngeoms < 0 ) {
+            list = Z_ARRVAL_PP(data);
+            for (zend_hash_internal_pointer_reset_ex(list, &listpos);
+                 ret == SUCCESS && zend_hash_get_current_data_ex(list,
+                    (void**)&elem, &listpos) == SUCCESS;
+                 zend_hash_move_forward_ex(list, &listpos))
+            {
+                if ( Z_TYPE_PP(elem) != IS_OBJECT ||
+                        ! instanceof_function(Z_OBJCE_PP(elem),
+                            Geometry_ce_ptr TSRMLS_CC) ) {
+                    invalid = 1;
+                    ret = FAILURE;
+                } else {
+                    ret = addAsyncInput(job, *elem TSRMLS_CC);
+                }
+            }
+        } else if ( (Z_TYPE_PP(data) == IS_LONG ||
+                Z_TYPE_PP(data) == IS_DOUBLE) && nparams < params ) {
+            job->param = Z_TYPE_PP(data) == IS_LONG ?
+                (double)Z_LVAL_PP(data) : Z_DVAL_PP(data);
+            ++nparams;
+        } else {
+            invalid = 1;
+            ret = FAILURE;
+        }
+    }
+
+    if ( ret == SUCCESS && ( nparams != params ||
+            ( ngeoms < 0 ? ! job->ninputs : job->ninputs != ngeoms ) ) ) {
+        invalid = 1;
+        ret = FAILURE;
+    }
+    if ( ret == FAILURE ) {
+        AsyncJob_release(job);
+        if ( invalid ) {
+            zend_throw_exception_ex(zend_exception_get_default(TSRMLS_C),
+                1 TSRMLS_CC, "Invalid arguments for asynchronous '%s'", op);
+        }
+        RETURN_NULL(); /* should get an exception first otherwise */
+    }
+
+    pthread_mutex_lock(&asyncMutex);
+    if ( startAsyncWorkers(GEOS_G(async_workers)) == FAILURE ) {
+        pthread_mutex_unlock(&asyncMutex);
+        AsyncJob_release(job);
+        zend_throw_exception_ex(zend_exception_get_default(TSRMLS_C),
+            1 TSRMLS_CC, "Cannot start GEOS worker threads");
+        RETURN_NULL();
+    }
+    ++job->refcount; /* one for the queue, one for the future */
+    if ( asyncTail ) asyncTail->next = job;
+    else asyncHead = job;
+    asyncTail = job;
+    pthread_cond_signal(&asyncQueued);
+    pthread_mutex_unlock(&asyncMutex);
 
+    /* return_value is a zval */
+    object_init_ex(return_value, Future_ce_ptr);
+    setRelay(return_value, job TSRMLS_CC);
 }
 
+#endif /* HAVE_GEOS_ASYNC */
 
 /* -- Free functions ------------------------- */
 
@@ -2875,6 +11415,18 @@ PHP_FUNCTION(GEOSVersion)
     RETURN_STRING(str, 0);
 }
 
+/**
+ * long GEOSMemoryUsage()
+ *
+ * Approximate number of bytes of GEOS heap held by all live
+ * objects of the current request. This memory is not seen by
+ * memory_get_usage().
+ */
+PHP_FUNCTION(GEOSMemoryUsage)
+{
+    RETURN_LONG(GEOS_G(memory_usage));
+}
+
 /**
  * array GEOSPolygonize(GEOSGeometry $geom)
  *
@@ -2913,7 +11465,8 @@ PHP_FUNCTION(GEOSPolygonize)
     {
         RETURN_NULL();
     }
-    this = getRelay(zobj, Geometry_ce_ptr);
+    this = getRelay(zobj, Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
 
     rings = GEOSPolygonize_full_r(GEOS_G(handle), this, &cut_edges, &dangles, &invalid_rings);
     if ( ! rings ) RETURN_NULL(); /* should get an exception first */
@@ -2923,25 +11476,25 @@ PHP_FUNCTION(GEOSPolygonize)
 
     MAKE_STD_ZVAL(array_elem);
     array_init(array_elem);
-    dumpGeometry(rings, array_elem);
+    dumpGeometry(rings, array_elem TSRMLS_CC);
     GEOSGeom_destroy_r(GEOS_G(handle), rings);
     add_assoc_zval(return_value, "rings", array_elem);
 
     MAKE_STD_ZVAL(array_elem);
     array_init(array_elem);
-    dumpGeometry(cut_edges, array_elem);
+    dumpGeometry(cut_edges, array_elem TSRMLS_CC);
     GEOSGeom_destroy_r(GEOS_G(handle), cut_edges);
     add_assoc_zval(return_value, "cut_edges", array_elem);
 
     MAKE_STD_ZVAL(array_elem);
     array_init(array_elem);
-    dumpGeometry(dangles, array_elem);
+    dumpGeometry(dangles, array_elem TSRMLS_CC);
     GEOSGeom_destroy_r(GEOS_G(handle), dangles);
     add_assoc_zval(return_value, "dangles", array_elem);
 
     MAKE_STD_ZVAL(array_elem);
     array_init(array_elem);
-    dumpGeometry(invalid_rings, array_elem);
+    dumpGeometry(invalid_rings, array_elem TSRMLS_CC);
     GEOSGeom_destroy_r(GEOS_G(handle), invalid_rings);
     add_assoc_zval(return_value, "invalid_rings", array_elem);
 
@@ -2961,14 +11514,15 @@ PHP_FUNCTION(GEOSLineMerge)
     {
         RETURN_NULL();
     }
-    geom_in = getRelay(zobj, Geometry_ce_ptr);
+    geom_in = getRelay(zobj, Geometry_ce_ptr TSRMLS_CC);
+    if ( ! geom_in ) RETURN_NULL(); /* should get an exception first */
 
     geom_out = GEOSLineMerge_r(GEOS_G(handle), geom_in);
     if ( ! geom_out ) RETURN_NULL(); /* should get an exception first */
 
     /* return value should be an array */
     array_init(return_value);
-    dumpGeometry(geom_out, return_value);
+    dumpGeometry(geom_out, return_value TSRMLS_CC);
     GEOSGeom_destroy_r(GEOS_G(handle), geom_out);
 }
 
@@ -2988,15 +11542,17 @@ PHP_FUNCTION(GEOSSharedPaths)
     {
         RETURN_NULL();
     }
-    geom_in_1 = getRelay(zobj1, Geometry_ce_ptr);
-    geom_in_2 = getRelay(zobj2, Geometry_ce_ptr);
+    geom_in_1 = getRelay(zobj1, Geometry_ce_ptr TSRMLS_CC);
+    if ( ! geom_in_1 ) RETURN_NULL(); /* should get an exception first */
+    geom_in_2 = getRelay(zobj2, Geometry_ce_ptr TSRMLS_CC);
+    if ( ! geom_in_2 ) RETURN_NULL(); /* should get an exception first */
 
     geom_out = GEOSSharedPaths_r(GEOS_G(handle), geom_in_1, geom_in_2);
     if ( ! geom_out ) RETURN_NULL(); /* should get an exception first */
 
     /* return_value is a zval */
     object_init_ex(return_value, Geometry_ce_ptr);
-    setRelay(return_value, geom_out);
+    setRelay(return_value, geom_out TSRMLS_CC);
 }
 #endif
 
@@ -3019,7 +11575,8 @@ PHP_METHOD(Geometry, delaunayTriangulation)
     double tolerance = 0.0;
     zend_bool edgeonly = 0;
 
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
 
     if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|db",
             &tolerance, &edgeonly) == FAILURE) {
@@ -3031,7 +11588,7 @@ PHP_METHOD(Geometry, delaunayTriangulation)
 
     /* return_value is a zval */
     object_init_ex(return_value, Geometry_ce_ptr);
-    setRelay(return_value, ret);
+    setRelay(return_value, ret TSRMLS_CC);
 }
 #endif
 
@@ -3059,20 +11616,22 @@ PHP_METHOD(Geometry, voronoiDiagram)
     double tolerance = 0.0;
     zend_bool edgeonly = 0;
 
-    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr);
+    this = (GEOSGeometry*)getRelay(getThis(), Geometry_ce_ptr TSRMLS_CC);
+    if ( ! this ) RETURN_NULL(); /* should get an exception first */
 
     if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|dbo",
             &tolerance, &edgeonly, &zobj) == FAILURE) {
         RETURN_NULL();
     }
 
-    if ( zobj ) env = getRelay(zobj, Geometry_ce_ptr);
+    if ( zobj ) env = getRelay(zobj, Geometry_ce_ptr TSRMLS_CC);
+    if ( zobj && ! env ) RETURN_NULL(); /* should get an exception first */
     ret = GEOSVoronoiDiagram_r(GEOS_G(handle), this, env, tolerance, edgeonly ? 1 : 0);
     if ( ! ret ) RETURN_NULL(); /* should get an exception first */
 
     /* return_value is a zval */
     object_init_ex(return_value, Geometry_ce_ptr);
-    setRelay(return_value, ret);
+    setRelay(return_value, ret TSRMLS_CC);
 }
 #endif
 
@@ -3111,6 +11670,16 @@ PHP_MINIT_FUNCTION(geos)
 {
     zend_class_entry ce;
 
+    REGISTER_INI_ENTRIES();
+
+    /* BufferParams */
+    INIT_CLASS_ENTRY(ce, "GEOSBufferParams", BufferParams_methods);
+    BufferParams_ce_ptr = zend_register_internal_class(&ce TSRMLS_CC);
+    BufferParams_ce_ptr->create_object = BufferParams_create_obj;
+    memcpy(&BufferParams_object_handlers,
+        zend_get_std_object_handlers(), sizeof(zend_object_handlers));
+    BufferParams_object_handlers.clone_obj = NULL;
+
     /* WKTReader */
     INIT_CLASS_ENTRY(ce, "GEOSWKTReader", WKTReader_methods);
     WKTReader_ce_ptr = zend_register_internal_class(&ce TSRMLS_CC);
@@ -3154,6 +11723,92 @@ PHP_MINIT_FUNCTION(geos)
         zend_get_std_object_handlers(), sizeof(zend_object_handlers));
     WKBReader_object_handlers.clone_obj = NULL;
 
+    /* Batch */
+    INIT_CLASS_ENTRY(ce, "GEOSBatch", Batch_methods);
+    Batch_ce_ptr = zend_register_internal_class(&ce TSRMLS_CC);
+
+    /* Coverage */
+    INIT_CLASS_ENTRY(ce, "GEOSCoverage", Coverage_methods);
+    Coverage_ce_ptr = zend_register_internal_class(&ce TSRMLS_CC);
+
+    /* UnionAggregator */
+    INIT_CLASS_ENTRY(ce, "GEOSUnionAggregator", UnionAggregator_methods);
+    UnionAggregator_ce_ptr = zend_register_internal_class(&ce TSRMLS_CC);
+    UnionAggregator_ce_ptr->create_object = UnionAggregator_create_obj;
+    memcpy(&UnionAggregator_object_handlers,
+        zend_get_std_object_handlers(), sizeof(zend_object_handlers));
+    UnionAggregator_object_handlers.clone_obj = NULL;
+
+    /* NearestIndex */
+    INIT_CLASS_ENTRY(ce, "GEOSNearestIndex", NearestIndex_methods);
+    NearestIndex_ce_ptr = zend_register_internal_class(&ce TSRMLS_CC);
+    NearestIndex_ce_ptr->create_object = NearestIndex_create_obj;
+    memcpy(&NearestIndex_object_handlers,
+        zend_get_std_object_handlers(), sizeof(zend_object_handlers));
+    NearestIndex_object_handlers.clone_obj = NULL;
+
+    /* PointGrid */
+    INIT_CLASS_ENTRY(ce, "GEOSPointGrid", PointGrid_methods);
+    PointGrid_ce_ptr = zend_register_internal_class(&ce TSRMLS_CC);
+    PointGrid_ce_ptr->create_object = PointGrid_create_obj;
+    memcpy(&PointGrid_object_handlers,
+        zend_get_std_object_handlers(), sizeof(zend_object_handlers));
+    PointGrid_object_handlers.clone_obj = NULL;
+
+    /* Binning */
+    INIT_CLASS_ENTRY(ce, "GEOSBinning", Binning_methods);
+    Binning_ce_ptr = zend_register_internal_class(&ce TSRMLS_CC);
+
+    /* PreparedGeometry */
+    INIT_CLASS_ENTRY(ce, "GEOSPreparedGeometry", PreparedGeometry_methods);
+    PreparedGeometry_ce_ptr = zend_register_internal_class(&ce TSRMLS_CC);
+    PreparedGeometry_ce_ptr->create_object = PreparedGeometry_create_obj;
+    memcpy(&PreparedGeometry_object_handlers,
+        zend_get_std_object_handlers(), sizeof(zend_object_handlers));
+    PreparedGeometry_object_handlers.clone_obj = NULL;
+
+    /* Cache */
+    INIT_CLASS_ENTRY(ce, "GEOSCache", Cache_methods);
+    Cache_ce_ptr = zend_register_internal_class(&ce TSRMLS_CC);
+
+#   ifdef HAVE_MMAP
+    /* SharedCache */
+    INIT_CLASS_ENTRY(ce, "GEOSSharedCache", SharedCache_methods);
+    SharedCache_ce_ptr = zend_register_internal_class(&ce TSRMLS_CC);
+    SharedCache_attach(GEOS_G(shm_path), GEOS_G(shm_size) TSRMLS_CC);
+#   endif
+
+    /* PersistentIndex */
+    INIT_CLASS_ENTRY(ce, "GEOSPersistentIndex", PersistentIndex_methods);
+    PersistentIndex_ce_ptr = zend_register_internal_class(&ce TSRMLS_CC);
+    PersistentIndex_ce_ptr->create_object = PersistentIndex_create_obj;
+    memcpy(&PersistentIndex_object_handlers,
+        zend_get_std_object_handlers(), sizeof(zend_object_handlers));
+    PersistentIndex_object_handlers.clone_obj = NULL;
+    loadPersistentIndexes(GEOS_G(persistent_indexes) TSRMLS_CC);
+
+    /* Partitioner */
+    INIT_CLASS_ENTRY(ce, "GEOSPartitioner", Partitioner_methods);
+    Partitioner_ce_ptr = zend_register_internal_class(&ce TSRMLS_CC);
+    Partitioner_ce_ptr->create_object = Partitioner_create_obj;
+    memcpy(&Partitioner_object_handlers,
+        zend_get_std_object_handlers(), sizeof(zend_object_handlers));
+    Partitioner_object_handlers.clone_obj = NULL;
+
+#   ifdef HAVE_GEOS_ASYNC
+    /* Future */
+    INIT_CLASS_ENTRY(ce, "GEOSFuture", Future_methods);
+    Future_ce_ptr = zend_register_internal_class(&ce TSRMLS_CC);
+    Future_ce_ptr->create_object = Future_create_obj;
+    memcpy(&Future_object_handlers,
+        zend_get_std_object_handlers(), sizeof(zend_object_handlers));
+    Future_object_handlers.clone_obj = NULL;
+
+    /* Async */
+    INIT_CLASS_ENTRY(ce, "GEOSAsync", Async_methods);
+    Async_ce_ptr = zend_register_internal_class(&ce TSRMLS_CC);
+#   endif
+
 
     /* Constants */
     REGISTER_LONG_CONSTANT("GEOSBUF_CAP_ROUND",  GEOSBUF_CAP_ROUND,
@@ -3213,27 +11868,64 @@ PHP_MINIT_FUNCTION(geos)
         GEOSRELATE_BNR_MONOVALENT_ENDPOINT,
         CONST_CS|CONST_PERSISTENT);
 
+    REGISTER_LONG_CONSTANT("GEOSAGG_UNION", GEOSAGG_UNION,
+        CONST_CS|CONST_PERSISTENT);
+    REGISTER_LONG_CONSTANT("GEOSAGG_ENVELOPE", GEOSAGG_ENVELOPE,
+        CONST_CS|CONST_PERSISTENT);
+    REGISTER_LONG_CONSTANT("GEOSAGG_CONVEX_HULL", GEOSAGG_CONVEX_HULL,
+        CONST_CS|CONST_PERSISTENT);
+
+    REGISTER_LONG_CONSTANT("GEOSFRAME_NONE", GEOSFRAME_NONE,
+        CONST_CS|CONST_PERSISTENT);
+    REGISTER_LONG_CONSTANT("GEOSFRAME_LENGTH", GEOSFRAME_LENGTH,
+        CONST_CS|CONST_PERSISTENT);
+    REGISTER_LONG_CONSTANT("GEOSFRAME_NEWLINE", GEOSFRAME_NEWLINE,
+        CONST_CS|CONST_PERSISTENT);
+    REGISTER_LONG_CONSTANT("GEOSFRAME_HEX", GEOSFRAME_HEX,
+        CONST_CS|CONST_PERSISTENT);
+
+    REGISTER_LONG_CONSTANT("GEOSRASTER_CENTER", GEOSRASTER_CENTER,
+        CONST_CS|CONST_PERSISTENT);
+    REGISTER_LONG_CONSTANT("GEOSRASTER_TOUCH", GEOSRASTER_TOUCH,
+        CONST_CS|CONST_PERSISTENT);
+    REGISTER_LONG_CONSTANT("GEOSRASTER_FRACTION", GEOSRASTER_FRACTION,
+        CONST_CS|CONST_PERSISTENT);
+
+    REGISTER_LONG_CONSTANT("GEOSPART_KDTREE", GEOSPART_KDTREE,
+        CONST_CS|CONST_PERSISTENT);
+    REGISTER_LONG_CONSTANT("GEOSPART_QUADTREE", GEOSPART_QUADTREE,
+        CONST_CS|CONST_PERSISTENT);
+
     return SUCCESS;
 }
 
 /* per-module shutdown */
 PHP_MSHUTDOWN_FUNCTION(geos)
 {
-    delGeometrySerializer();
-    delGeometryDeserializer();
+#   ifdef HAVE_MMAP
+    SharedCache_detach();
+#   endif
+    freePersistentIndexes();
+#   ifdef HAVE_GEOS_ASYNC
+    stopAsyncWorkers();
+#   endif
+    UNREGISTER_INI_ENTRIES();
     return SUCCESS;
 }
 
 /* per-request initialization */
 PHP_RINIT_FUNCTION(geos)
 {
-    GEOS_G(handle) = initGEOS_r(noticeHandler, errorHandler);
+    GEOS_G(handle) = createContext(0 TSRMLS_CC);
+    GEOS_G(memory_usage) = 0;
     return SUCCESS;
 }
 
 /* pre-request destruction */
 PHP_RSHUTDOWN_FUNCTION(geos)
 {
+    delGeometrySerializer(TSRMLS_C);
+    delGeometryDeserializer(TSRMLS_C);
     finishGEOS_r(GEOS_G(handle));
     return SUCCESS;
 }
@@ -3242,6 +11934,44 @@ PHP_RSHUTDOWN_FUNCTION(geos)
 PHP_GINIT_FUNCTION(geos)
 {
     geos_globals->handle = NULL;
+    geos_globals->memory_usage = 0;
+    geos_globals->memory_limit = 0;
+    geos_globals->serializer = NULL;
+    geos_globals->deserializer = NULL;
+    geos_globals->cache_size = 0;
+    geos_globals->cache_bytes = 0;
+    geos_globals->cache_hits = 0;
+    geos_globals->cache_misses = 0;
+    zend_hash_init(&geos_globals->cache_table, 0, NULL,
+        GeometryCache_freeEntry, 1);
+    geos_globals->cache_head = NULL;
+    geos_globals->cache_tail = NULL;
+    geos_globals->shm_path = NULL;
+    geos_globals->shm_size = 0;
+    zend_hash_init(&geos_globals->shm_memo, 0, NULL, NULL, 1);
+    geos_globals->shm_handle = NULL;
+    geos_globals->persistent_indexes = NULL;
+    geos_globals->async_workers = 0;
+}
+
+/* global destruction */
+PHP_GSHUTDOWN_FUNCTION(geos)
+{
+    GEOSGeometry **geom;
+    HashPosition pos;
+
+    zend_hash_destroy(&geos_globals->cache_table);
+
+    /* geometries fetched from the shared cache, see SharedCache_geometry */
+    for (zend_hash_internal_pointer_reset_ex(&geos_globals->shm_memo, &pos);
+         zend_hash_get_current_data_ex(&geos_globals->shm_memo,
+            (void**)&geom, &pos) == SUCCESS;
+         zend_hash_move_forward_ex(&geos_globals->shm_memo, &pos))
+    {
+        GEOSGeom_destroy_r(geos_globals->shm_handle, *geom);
+    }
+    zend_hash_destroy(&geos_globals->shm_memo);
+    if ( geos_globals->shm_handle ) finishGEOS_r(geos_globals->shm_handle);
 }
 
 /* module info */
@@ -3255,4 +11985,6 @@ PHP_MINFO_FUNCTION(geos)
     php_info_print_table_row(2,
         "GEOS Version", GEOSversion());
     php_info_print_table_end();
+
+    DISPLAY_INI_ENTRIES();
 }
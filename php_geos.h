@@ -50,6 +50,23 @@ extern zend_module_entry geos_module_entry;
 
 ZEND_BEGIN_MODULE_GLOBALS(geos)
 GEOSContextHandle_t handle;
+long memory_usage; /* approximate GEOS heap held by live objects */
+long memory_limit; /* geos.memory_limit, 0 for none, -1 to share memory_limit */
+GEOSWKBWriter *serializer; /* per request, created on first use */
+GEOSWKBReader *deserializer; /* per request, created on first use */
+long cache_size; /* geos.cache_size, in bytes, 0 to disable the cache */
+long cache_bytes; /* bytes held by cache entries */
+long cache_hits;
+long cache_misses;
+HashTable cache_table; /* persistent, outlives requests */
+struct GeometryCacheEntry_t *cache_head; /* most recently used */
+struct GeometryCacheEntry_t *cache_tail; /* least recently used */
+char *shm_path; /* geos.shm_path, file backing the shared cache */
+long shm_size; /* geos.shm_size, in bytes */
+HashTable shm_memo; /* persistent, geometries fetched, by entry offset */
+GEOSContextHandle_t shm_handle; /* worker lifetime, owns shm_memo */
+char *persistent_indexes; /* geos.persistent_indexes, name=path;... */
+long async_workers; /* geos.async_workers, threads of the GEOSAsync pool */
 ZEND_END_MODULE_GLOBALS(geos)
 
 #endif /* PHP_GEOS_H */
@@ -40,6 +40,15 @@ class GeneralTest extends GEOSTest
         $this->assertEquals(2, GEOSRELATE_BNR_ENDPOINT);
         $this->assertEquals(3, GEOSRELATE_BNR_MULTIVALENT_ENDPOINT);
         $this->assertEquals(4, GEOSRELATE_BNR_MONOVALENT_ENDPOINT);
+
+        $this->assertEquals(0, GEOSAGG_UNION);
+        $this->assertEquals(1, GEOSAGG_ENVELOPE);
+        $this->assertEquals(2, GEOSAGG_CONVEX_HULL);
+
+        $this->assertEquals(0, GEOSFRAME_NONE);
+        $this->assertEquals(1, GEOSFRAME_LENGTH);
+        $this->assertEquals(2, GEOSFRAME_NEWLINE);
+        $this->assertEquals(3, GEOSFRAME_HEX);
     }
 }
 
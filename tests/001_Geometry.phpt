@@ -691,6 +691,39 @@ class GeometryTest extends GEOSTest
         $this->assertEquals('GEOMETRYCOLLECTION (POINT (-10 -10), LINESTRING (-8 8, -8 6), POLYGON ((1 0, 0 0, 0 1, 0 11, 10 11, 10 14, 14 14, 14 10, 11 10, 11 0, 1 0), (11 12, 11 11, 12 11, 12 12, 11 12)))', $writer->write($gu));
     }
 
+    public function testGeometry_gridSize()
+    {
+        $reader = new GEOSWKTReader();
+
+        $g = $reader->read('POLYGON((0 0, 10 0, 10 10, 0 10, 0 0))');
+        $g2 = $reader->read('POLYGON((5.1 5.1, 15.2 5.1, 15.2 15.2, 5.1 15.2, 5.1 5.1))');
+
+        try {
+            $gi = $g->intersection($g2, 1);
+        } catch (Exception $e) {
+            $this->assertContains('not supported', $e->getMessage());
+            return;
+        }
+
+        /* g2 snaps to POLYGON((5 5, 15 5, 15 15, 5 15, 5 5)) */
+        $this->assertEquals(25, $gi->area());
+        $this->assertEquals(75, $g->difference($g2, 1)->area());
+        $this->assertEquals(150, $g->symDifference($g2, 1)->area());
+        $this->assertEquals(175, $g->union($g2, 1)->area());
+
+        $g = $reader->read('GEOMETRYCOLLECTION(
+            POLYGON((0 0, 10 0, 10 10, 0 10, 0 0)),
+            POLYGON((5.1 5.1, 15.2 5.1, 15.2 15.2, 5.1 15.2, 5.1 5.1)))');
+        $this->assertEquals(175, $g->union(null, 1)->area());
+
+        try {
+            $g->union(null, -1);
+            $this->assertTrue(FALSE);
+        } catch (Exception $e) {
+            $this->assertContains('negative', $e->getMessage());
+        }
+    }
+
     public function testGeometry_pointOnSurface()
     {
         $reader = new GEOSWKTReader();
@@ -1875,6 +1908,330 @@ class GeometryTest extends GEOSTest
         $this->assertEquals('MULTILINESTRING ((0 0, 5 0), (5 0, 10 0, 5 -5, 5 0), (5 0, 5 5))', $writer->write($noded));
 
     }
+
+    public function testGeometry_memoryUsage()
+    {
+        $reader = new GEOSWKTReader();
+
+        $before = GEOSMemoryUsage();
+
+        $g = $reader->read('POINT(0 0)');
+        $this->assertTrue($g->memoryUsage() > 0);
+        $this->assertEquals($before + $g->memoryUsage(), GEOSMemoryUsage());
+
+        $g2 = $g->buffer(10, array('quad_segs' => 64));
+        $this->assertTrue($g2->memoryUsage() > $g->memoryUsage());
+        $this->assertEquals($before + $g->memoryUsage() + $g2->memoryUsage(),
+            GEOSMemoryUsage());
+
+        $g2 = null;
+        $this->assertEquals($before + $g->memoryUsage(), GEOSMemoryUsage());
+
+        $old = ini_set('geos.memory_limit', GEOSMemoryUsage() + 1024);
+        try {
+            $g->buffer(10, array('quad_segs' => 64));
+            $this->assertTrue(FALSE);
+        } catch (Exception $e) {
+            $this->assertContains('memory limit', $e->getMessage());
+        }
+        ini_set('geos.memory_limit', $old);
+
+        $this->assertEquals($before + $g->memoryUsage(), GEOSMemoryUsage());
+    }
+
+    public function testGeometry_bufferParams()
+    {
+        $reader = new GEOSWKTReader();
+        $writer = new GEOSWKTWriter();
+
+        if (method_exists(GEOSWKTWriter::class, 'setRoundingPrecision')) {
+            $writer->setRoundingPrecision(0);
+        }
+
+        $params = new GEOSBufferParams(array(
+            'quad_segs' => 1,
+            'endcap' => GEOSBUF_CAP_FLAT
+        ));
+
+        $g = $reader->read('LINESTRING(0 0, 100 0)');
+        $b = $g->buffer(10, $params);
+        $this->assertEquals('POLYGON ((100 10, 100 -10, 0 -10, 0 10, 100 10))', $writer->write($b));
+
+        # same params, reused
+        $b = $g->buffer(5, $params);
+        $this->assertEquals('POLYGON ((100 5, 100 -5, 0 -5, 0 5, 100 5))', $writer->write($b));
+
+        $params = new GEOSBufferParams(array(
+            'quad_segs' => 2,
+            'join' => GEOSBUF_JOIN_MITRE,
+            'mitre_limit' => 1.0
+        ));
+
+        $g = $reader->read('LINESTRING(0 0, 100 0, 100 100)');
+        $b = $g->buffer(10, $params);
+        $this->assertEquals('POLYGON ((90 10, 90 100, 93 107, 100 110, 107 107, 110 100, 109 -5, 105 -9, 0 -10, -7 -7, -10 0, -7 7, 0 10, 90 10))', $writer->write($b));
+
+        # defaults
+        $g = $reader->read('POINT(0 0)');
+        $b = $g->buffer(10, new GEOSBufferParams());
+        $this->assertEquals('POLYGON ((10 0, 10 -2, 9 -4, 8 -6, 7 -7, 6 -8, 4 -9, 2 -10, 0 -10, -2 -10, -4 -9, -6 -8, -7 -7, -8 -6, -9 -4, -10 -2, -10 -0, -10 2, -9 4, -8 6, -7 7, -6 8, -4 9, -2 10, -0 10, 2 10, 4 9, 6 8, 7 7, 8 6, 9 4, 10 2, 10 0))', $writer->write($b));
+
+        if (method_exists(GEOSGeometry::class, 'offsetCurve')) {
+            $g = $reader->read('LINESTRING(0 0, 10 0)');
+            $params = new GEOSBufferParams(array('quad_segs' => 1));
+            $b = $g->offsetCurve(1, $params);
+            $this->assertEquals('LINESTRING (0 1, 10 1)', $writer->write($b));
+        }
+    }
+
+    public function testGeometry_containsPoints()
+    {
+        $reader = new GEOSWKTReader();
+
+        /* square with a hole, plus a separate square */
+        $g = $reader->read('MULTIPOLYGON(((0 0, 10 0, 10 10, 0 10, 0 0),
+            (4 4, 6 4, 6 6, 4 6, 4 4)), ((20 0, 30 0, 30 10, 20 10, 20 0)))');
+
+        $bits = $g->containsPoints(pack('d*',
+            1, 1,     /* inside */
+            5, 5,     /* in the hole */
+            10, 5,    /* on the boundary */
+            15, 5,    /* between the squares */
+            25, 5,    /* in the second square */
+            -1, -1,   /* outside the extent */
+            9.5, 9.5, /* inside */
+            4, 5,     /* on the hole boundary */
+            3, 4      /* inside, level with a hole vertex */
+        ));
+        $this->assertEquals(2, strlen($bits));
+        $this->assertEquals(0x51, ord($bits[0]));
+        $this->assertEquals(0x01, ord($bits[1]));
+
+        $this->assertEquals('', $g->containsPoints(''));
+
+        try {
+            $g->containsPoints('abc');
+            $this->assertTrue(FALSE);
+        } catch (Exception $e) {
+            $this->assertContains('multiple of', $e->getMessage());
+        }
+
+        try {
+            $reader->read('POINT(1 1)')->containsPoints(pack('d*', 1, 1));
+            $this->assertTrue(FALSE);
+        } catch (Exception $e) {
+            $this->assertContains('polygonal', $e->getMessage());
+        }
+    }
+
+    public function testGeometry_rasterize()
+    {
+        $reader = new GEOSWKTReader();
+
+        /* 4 x 4 cells of size 1, top left corner at (0, 4) */
+        $g = $reader->read('POLYGON((0.8 0.8, 2.6 0.8, 2.6 2.6, 0.8 2.6,
+            0.8 0.8))');
+
+        /* centres of cells 5, 6, 9 and 10 are inside */
+        $bits = $g->rasterize(0, 4, 1, 4, 4);
+        $this->assertEquals(2, strlen($bits));
+        $this->assertEquals(0x60, ord($bits[0]));
+        $this->assertEquals(0x06, ord($bits[1]));
+        $this->assertEquals($bits,
+            $g->rasterize(0, 4, 1, 4, 4, GEOSRASTER_CENTER));
+
+        /* rows 1 to 3, columns 0 to 2 */
+        $bits = $g->rasterize(0, 4, 1, 4, 4, GEOSRASTER_TOUCH);
+        $this->assertEquals(0x70, ord($bits[0]));
+        $this->assertEquals(0x77, ord($bits[1]));
+
+        $fractions = $g->rasterize(0, 4, 1, 4, 4, GEOSRASTER_FRACTION);
+        $this->assertEquals(16, strlen($fractions));
+        $this->assertEquals(0, ord($fractions[0]));
+        $this->assertEquals(255, ord($fractions[9]));
+        $this->assertEquals(0, ord($fractions[15]));
+        $area = array_sum(unpack('C*', $fractions)) / 255;
+        $this->assertTrue(abs($area - $g->area()) < 0.1);
+
+        /* grid partly outside the geometry extent */
+        $bits = $g->rasterize(2, 2, 1, 2, 2, GEOSRASTER_TOUCH);
+        $this->assertEquals(0x05, ord($bits[0]));
+
+        $this->assertEquals('', $g->rasterize(0, 4, 1, 0, 4));
+
+        /* far outside the grid, on either side */
+        $far = $reader->read('POLYGON((1e300 0, 2e300 0, 2e300 4, 1e300 4,
+            1e300 0))');
+        $this->assertEquals("\0\0", $far->rasterize(0, 4, 1, 4, 4));
+        $far = $reader->read('POLYGON((-2e300 0, -1e300 0, -1e300 4, -2e300 4,
+            -2e300 0))');
+        $this->assertEquals("\0\0", $far->rasterize(0, 4, 1, 4, 4));
+
+        try {
+            $g->rasterize(NAN, 4, 1, 4, 4);
+            $this->assertTrue(FALSE);
+        } catch (Exception $e) {
+            $this->assertContains('non-finite', $e->getMessage());
+        }
+
+        try {
+            $far->rasterize(0, 4, 1e-300, 4, 4);
+            $this->assertTrue(FALSE);
+        } catch (Exception $e) {
+            $this->assertContains('non-finite', $e->getMessage());
+        }
+
+        try {
+            $g->rasterize(0, 4, 0, 4, 4);
+            $this->assertTrue(FALSE);
+        } catch (Exception $e) {
+            $this->assertContains('must be positive', $e->getMessage());
+        }
+
+        try {
+            $g->rasterize(0, 4, 1, 4, 4, 7);
+            $this->assertTrue(FALSE);
+        } catch (Exception $e) {
+            $this->assertContains('Unknown raster mode', $e->getMessage());
+        }
+
+        try {
+            $reader->read('POINT(1 1)')->rasterize(0, 4, 1, 4, 4);
+            $this->assertTrue(FALSE);
+        } catch (Exception $e) {
+            $this->assertContains('polygonal', $e->getMessage());
+        }
+    }
+
+    public function testGeometry_affine()
+    {
+        $reader = new GEOSWKTReader();
+        $writer = new GEOSWKTWriter();
+
+        if (method_exists(GEOSWKTWriter::class, 'setRoundingPrecision')) {
+            $writer->setRoundingPrecision(0);
+        }
+
+        $g = $reader->read('POLYGON((0 0, 10 0, 10 10, 0 10, 0 0),
+            (2 2, 4 2, 4 4, 2 4, 2 2))');
+        $g->setSRID(4326);
+
+        /* rotate by 90 degrees and shift */
+        $b = $g->affine(0, -1, 1, 0, 100, 200);
+        $this->assertEquals('POLYGON ((100 200, 100 210, 90 210, 90 200, 100 200), (98 202, 98 204, 96 204, 96 202, 98 202))',
+            $writer->write($b));
+        $this->assertEquals(4326, $b->getSRID());
+        $this->assertEquals('POLYGON ((0 0, 10 0, 10 10, 0 10, 0 0), (2 2, 4 2, 4 4, 2 4, 2 2))',
+            $writer->write($g));
+
+        $g = $reader->read('MULTIPOINT(1 2, 3 4)');
+        $b = $g->translate(10, 20);
+        $this->assertEquals('MULTIPOINT (11 22, 13 24)', $writer->write($b));
+
+        $b = $g->scale(2, 3);
+        $this->assertEquals('MULTIPOINT (2 6, 6 12)', $writer->write($b));
+
+        $b = $g->swapXY();
+        $this->assertEquals('MULTIPOINT (2 1, 4 3)', $writer->write($b));
+
+        /* in place returns the same object */
+        $b = $g->translate(1, 1, 0, true);
+        $this->assertTrue($b === $g);
+        $this->assertEquals('MULTIPOINT (2 3, 4 5)', $writer->write($g));
+
+        $g = $reader->read('POINT(1 2 3)');
+        $b = $g->affine(1, 0, 0, 1, 0, 0, 0, 0, 0, 0, 2, 1);
+        if (method_exists(GEOSWKTWriter::class, 'setOutputDimension')) {
+            $writer->setOutputDimension(3);
+            $this->assertEquals('POINT Z (1 2 7)', $writer->write($b));
+        }
+
+        $g = $reader->read('GEOMETRYCOLLECTION(POINT EMPTY, LINESTRING(0 0, 1 1))');
+        $b = $g->translate(1, 0);
+        $this->assertEquals('GEOMETRYCOLLECTION (POINT EMPTY, LINESTRING (1 0, 2 1))',
+            $writer->write($b));
+    }
+
+    public function testGeometry_webMercator()
+    {
+        $reader = new GEOSWKTReader();
+
+        $g = $reader->read('LINESTRING(0 0, 180 0, 10 50, -180 90)');
+        $g->setSRID(4326);
+
+        $m = $g->toWebMercator();
+        $this->assertEquals(3857, $m->getSRID());
+        $this->assertEquals(4326, $g->getSRID());
+        $this->assertEquals(20037508.34, round($m->pointN(1)->getX(), 2));
+        $this->assertEquals(1113194.91, round($m->pointN(2)->getX(), 2));
+        $this->assertEquals(6446275.84, round($m->pointN(2)->getY(), 2));
+        /* clamped */
+        $this->assertEquals(20037508.34, round($m->pointN(3)->getY(), 2));
+
+        $b = $m->fromWebMercator();
+        $this->assertEquals(4326, $b->getSRID());
+        $this->assertEquals(10, round($b->pointN(2)->getX(), 9));
+        $this->assertEquals(50, round($b->pointN(2)->getY(), 9));
+        $this->assertEquals(85.05, round($b->pointN(3)->getY(), 2));
+
+        $g->toWebMercator(true);
+        $this->assertEquals(3857, $g->getSRID());
+
+        try {
+            $g->toWebMercator();
+            $this->assertTrue(FALSE);
+        } catch (Exception $e) {
+            $this->assertContains('SRID 4326', $e->getMessage());
+        }
+    }
+
+    public function testGeometry_makeValid()
+    {
+        if (!method_exists(GEOSGeometry::class, 'makeValid')) {
+            return;
+        }
+
+        $reader = new GEOSWKTReader();
+
+        /* bow tie */
+        $g = $reader->read('POLYGON((0 0, 10 10, 10 0, 0 10, 0 0))');
+        $this->assertEquals(1, count(GEOSBatch::validate(array($g))));
+        $v = $g->makeValid();
+        $this->assertEquals(0, count(GEOSBatch::validate(array($v))));
+        $this->assertEquals('MultiPolygon', $v->typeName());
+        $this->assertEquals(50, $v->area());
+    }
+
+    public function testGeometry_hash()
+    {
+        $reader = new GEOSWKTReader();
+
+        $a = $reader->read('POLYGON((0 0, 10 0, 10 10, 0 0))');
+        $b = $reader->read('POLYGON((0 0, 10 0, 10 10, 0 0))');
+        $c = $reader->read('POLYGON((10 0, 10 10, 0 0, 10 0))');
+
+        $this->assertEquals(32, strlen($a->hash()));
+        $this->assertTrue(ctype_xdigit($a->hash()));
+        $this->assertEquals($a->hash(), $b->hash());
+        $this->assertTrue($a->hash() != $c->hash());
+        $this->assertEquals($a->hash(true), $c->hash(true));
+
+        $b->setSRID(4326);
+        $this->assertTrue($a->hash() != $b->hash());
+
+        $this->assertEquals($reader->read('POINT(0 0)')->hash(),
+            $reader->read('POINT(-0 0)')->hash());
+        $this->assertTrue($reader->read('POINT(0 1)')->hash()
+            != $reader->read('POINT(1 0)')->hash());
+        $this->assertTrue($reader->read('MULTIPOINT(0 0, 1 1)')->hash()
+            != $reader->read('LINESTRING(0 0, 1 1)')->hash());
+        $this->assertTrue($reader->read('POINT EMPTY')->hash()
+            != $reader->read('LINESTRING EMPTY')->hash());
+        $this->assertTrue($reader->read('POINT(1 2 3)')->hash()
+            != $reader->read('POINT(1 2 4)')->hash());
+        $this->assertTrue($reader->read('POINT(1 2 3)')->hash()
+            != $reader->read('POINT(1 2)')->hash());
+    }
 }
 
 GeometryTest::run();
@@ -1895,6 +2252,7 @@ GeometryTest->testGeometry_symdifference	OK
 GeometryTest->testGeometry_boundary	OK
 GeometryTest->testGeometry_union	OK
 GeometryTest->testGeometry_unaryunion	OK
+GeometryTest->testGeometry_gridSize	OK
 GeometryTest->testGeometry_pointOnSurface	OK
 GeometryTest->testGeometry_centroid	OK
 GeometryTest->testGeometry_relate	OK
@@ -1932,4 +2290,12 @@ GeometryTest->testGeometry_hausdorffDistance	OK
 GeometryTest->testGeometry_delaunayTriangulation	OK
 GeometryTest->testGeometry_voronoiDiagram	OK
 GeometryTest->testGeometry_snapTo	OK
-GeometryTest->testGeometry_node	OK
\ No newline at end of file
+GeometryTest->testGeometry_node	OK
+GeometryTest->testGeometry_memoryUsage	OK
+GeometryTest->testGeometry_bufferParams	OK
+GeometryTest->testGeometry_containsPoints	OK
+GeometryTest->testGeometry_rasterize	OK
+GeometryTest->testGeometry_affine	OK
+GeometryTest->testGeometry_webMercator	OK
+GeometryTest->testGeometry_makeValid	OK
+GeometryTest->testGeometry_hash	OK
\ No newline at end of file
@@ -193,6 +193,76 @@ class WKTWriterTest extends GEOSTest
         $this->assertEquals('POINT Z (1 2 3)', $writer->write($g3d));
 
     }
+
+    public function testWKTWriter_writeMany()
+    {
+        $writer = new GEOSWKTWriter();
+        $reader = new GEOSWKTReader();
+
+        if (method_exists(GEOSWKTWriter::class, 'setTrim')) {
+            $writer->setTrim(TRUE);
+        } else {
+            return;
+        }
+
+        $geoms = array(
+            'a' => $reader->read('POINT(6 7)'),
+            'b' => $reader->read('LINESTRING(0 0, 1 1)'),
+        );
+
+        $res = $writer->writeMany($geoms);
+        $this->assertEquals('POINT (6 7)LINESTRING (0 0, 1 1)', $res['data']);
+        $this->assertEquals(array(0, 11, 32), $res['offsets']);
+
+        $res = $writer->writeMany($geoms, GEOSFRAME_NEWLINE);
+        $this->assertEquals("POINT (6 7)\nLINESTRING (0 0, 1 1)\n", $res['data']);
+        $this->assertEquals(array(0, 12, 34), $res['offsets']);
+
+        $res = $writer->writeMany($geoms, GEOSFRAME_LENGTH);
+        $this->assertEquals(pack('V', 11).'POINT (6 7)'.pack('V', 21).'LINESTRING (0 0, 1 1)',
+            $res['data']);
+
+        $res = $writer->writeMany(array());
+        $this->assertEquals('', $res['data']);
+        $this->assertEquals(array(0), $res['offsets']);
+
+        try {
+            $writer->writeMany($geoms, 42);
+            $this->assertTrue(FALSE);
+        } catch (Exception $e) {
+            $this->assertContains('Unknown framing', $e->getMessage());
+        }
+
+        try {
+            $writer->writeMany(array(1));
+            $this->assertTrue(FALSE);
+        } catch (Exception $e) {
+            $this->assertContains('GEOSGeometry', $e->getMessage());
+        }
+    }
+
+    public function testWKTWriter_writeToStream()
+    {
+        $writer = new GEOSWKTWriter();
+        $reader = new GEOSWKTReader();
+
+        if (method_exists(GEOSWKTWriter::class, 'setTrim')) {
+            $writer->setTrim(TRUE);
+        } else {
+            return;
+        }
+
+        $a = $reader->read('POINT(6 7)');
+        $b = $reader->read('POINT(8 9)');
+
+        $stream = fopen('php://memory', 'w+');
+        $this->assertEquals(12, $writer->writeToStream($stream, $a, GEOSFRAME_NEWLINE));
+        $this->assertEquals(24, $writer->writeToStream($stream, array($a, $b), GEOSFRAME_NEWLINE));
+        rewind($stream);
+        $this->assertEquals("POINT (6 7)\nPOINT (6 7)\nPOINT (8 9)\n",
+            stream_get_contents($stream));
+        fclose($stream);
+    }
 }
 
 WKTWriterTest::run();
@@ -206,4 +276,6 @@ WKTWriterTest->testWKT_roundTrip	OK
 WKTWriterTest->testWKTWriter_setRoundingPrecision	OK
 WKTWriterTest->testWKTWriter_getOutputDimension	OK
 WKTWriterTest->testWKTWriter_setOutputDimension	OK
-WKTWriterTest->testWKTWriter_setOld3D	OK
\ No newline at end of file
+WKTWriterTest->testWKTWriter_setOld3D	OK
+WKTWriterTest->testWKTWriter_writeMany	OK
+WKTWriterTest->testWKTWriter_writeToStream	OK
\ No newline at end of file
@@ -154,6 +154,52 @@ class WKBWriterTest extends GEOSTest
             $this->assertContains('expects parameter 1 to be object, integer given', $e->getMessage());
         }
     }
+
+    public function testWKBWriter_writeMany()
+    {
+        $writer = new GEOSWKBWriter();
+        $reader = new GEOSWKTReader();
+
+        $a = $reader->read('POINT(6 7)');
+        $b = $reader->read('POINT(8 9)');
+
+        $res = $writer->writeMany(array($a, $b));
+        $this->assertEquals($writer->write($a).$writer->write($b), $res['data']);
+        $this->assertEquals(array(0, 21, 42), $res['offsets']);
+
+        $res = $writer->writeMany(array($a, $b), GEOSFRAME_HEX);
+        $this->assertEquals($writer->writeHEX($a)."\n".$writer->writeHEX($b)."\n",
+            $res['data']);
+        $this->assertEquals(array(0, 43, 86), $res['offsets']);
+
+        $res = $writer->writeMany(array($a), GEOSFRAME_LENGTH);
+        $this->assertEquals(pack('V', 21).$writer->write($a), $res['data']);
+    }
+
+    public function testWKBWriter_writeToStream()
+    {
+        $writer = new GEOSWKBWriter();
+        $reader = new GEOSWKTReader();
+
+        $a = $reader->read('POINT(6 7)');
+        $b = $reader->read('POINT(8 9)');
+        $res = $writer->writeMany(array($a, $b), GEOSFRAME_LENGTH);
+
+        $stream = fopen('php://memory', 'w+');
+        $this->assertEquals(50, $writer->writeToStream($stream, array($a, $b), GEOSFRAME_LENGTH));
+        $this->assertEquals(43, $writer->writeToStream($stream, $a, GEOSFRAME_HEX));
+        rewind($stream);
+        $this->assertEquals($res['data'].$writer->writeHEX($a)."\n",
+            stream_get_contents($stream));
+
+        try {
+            $writer->writeToStream($stream, 'POINT(0 0)');
+            $this->assertTrue(FALSE);
+        } catch (Exception $e) {
+            $this->assertContains('GEOSGeometry', $e->getMessage());
+        }
+        fclose($stream);
+    }
 }
 
 WKBWriterTest::run();
@@ -167,4 +213,6 @@ WKBWriterTest->testWKBWriter_getsetByteOrder	OK
 WKBWriterTest->testWKBWriter_getsetIncludeSRID	OK
 WKBWriterTest->testWKBWriter_write	OK
 WKBWriterTest->testInvalidWriteThrowsException	OK
-WKBWriterTest->testInvalidWriteHEXThrowsException	OK
\ No newline at end of file
+WKBWriterTest->testInvalidWriteHEXThrowsException	OK
+WKBWriterTest->testWKBWriter_writeMany	OK
+WKBWriterTest->testWKBWriter_writeToStream	OK
\ No newline at end of file
@@ -0,0 +1,186 @@
+--TEST--
+Batch tests
+--SKIPIF--
+<?php if (!extension_loaded('geos')) print 'skip'; ?>
+--FILE--
+<?php
+
+require './tests/TestHelper.php';
+
+class BatchTest extends GEOSTest
+{
+    public function testBatch_buffer()
+    {
+        $reader = new GEOSWKTReader();
+        $writer = new GEOSWKTWriter();
+
+        if (method_exists(GEOSWKTWriter::class, 'setRoundingPrecision')) {
+            $writer->setRoundingPrecision(0);
+        }
+
+        $geoms = array(
+            'a' => $reader->read('LINESTRING(0 0, 100 0)'),
+            7 => $reader->read('LINESTRING(0 0, 0 100)')
+        );
+
+        $params = new GEOSBufferParams(array(
+            'quad_segs' => 1,
+            'endcap' => GEOSBUF_CAP_FLAT
+        ));
+
+        $res = GEOSBatch::buffer($geoms, 10, $params);
+        $this->assertEquals(2, count($res));
+        $this->assertEquals('POLYGON ((100 10, 100 -10, 0 -10, 0 10, 100 10))', $writer->write($res['a']));
+        $this->assertEquals('POLYGON ((-10 100, 10 100, 10 0, -10 0, -10 100))', $writer->write($res[7]));
+
+        # style arrays are accepted too
+        $res = GEOSBatch::buffer($geoms, 10, array('quad_segs' => 1, 'endcap' => GEOSBUF_CAP_FLAT));
+        $this->assertEquals('POLYGON ((100 10, 100 -10, 0 -10, 0 10, 100 10))', $writer->write($res['a']));
+
+        $res = GEOSBatch::buffer(array(), 10);
+        $this->assertEquals(0, count($res));
+
+        try {
+            GEOSBatch::buffer(array('not a geometry'), 10);
+            $this->assertTrue(FALSE);
+        } catch (Exception $e) {
+            $this->assertContains('GEOSGeometry', $e->getMessage());
+        }
+    }
+
+    public function testBatch_validate()
+    {
+        $reader = new GEOSWKTReader();
+
+        $res = GEOSBatch::validate(array(
+            'ok' => $reader->read('POINT(0 0)'),
+            'nan' => $reader->read('POINT(0 NaN)'),
+            'ring' => $reader->read('POLYGON((0 0, 10 10, 10 0, 0 10, 0 0))'),
+            'also ok' => $reader->read('POLYGON((0 0, 10 0, 10 10, 0 0))'),
+        ));
+        $this->assertEquals(array('nan', 'ring'), array_keys($res));
+        $this->assertContains('Invalid Coordinate', $res['nan']);
+        $this->assertContains('Self-intersection', $res['ring']);
+
+        $this->assertEquals(array(), GEOSBatch::validate(array()));
+
+        if (defined('GEOSVALID_ALLOW_SELFTOUCHING_RING_FORMING_HOLE')
+            && method_exists(GEOSGeometry::class, 'checkValidity')) {
+            $g = $reader->read('POLYGON((0 0, -10 10, 10 10, 0 0, 4 5, -4 5, 0 0))');
+            $this->assertEquals(1, count(GEOSBatch::validate(array($g))));
+            $this->assertEquals(0, count(GEOSBatch::validate(array($g),
+                GEOSVALID_ALLOW_SELFTOUCHING_RING_FORMING_HOLE)));
+        }
+    }
+
+    public function testBatch_makeValid()
+    {
+        if (!method_exists(GEOSBatch::class, 'makeValid')) {
+            return;
+        }
+
+        $reader = new GEOSWKTReader();
+
+        $ok = $reader->read('POINT(0 0)');
+        $res = GEOSBatch::makeValid(array(
+            'a' => $ok,
+            'b' => $reader->read('POLYGON((0 0, 10 10, 10 0, 0 10, 0 0))'),
+        ));
+        $this->assertEquals(array('a', 'b'), array_keys($res));
+        $this->assertTrue($res['a'] === $ok);
+        $this->assertEquals(array(), GEOSBatch::validate($res));
+        $this->assertEquals(50, $res['b']->area());
+
+        /* references in the input are not shared with the result */
+        $geoms = array($ok);
+        $ref = &$geoms[0];
+        $res = GEOSBatch::makeValid($geoms);
+        $ref = NULL;
+        $this->assertTrue($res[0] === $ok);
+    }
+
+    public function testBatch_unique()
+    {
+        $reader = new GEOSWKTReader();
+
+        $a = $reader->read('POINT(1 2)');
+        $srid = $reader->read('POINT(1 2)');
+        $srid->setSRID(4326);
+
+        $res = GEOSBatch::unique(array(
+            'a' => $a,
+            'b' => $reader->read('LINESTRING(0 0, 1 1)'),
+            'c' => $reader->read('POINT(1 2)'),
+            'd' => $srid,
+            'e' => $reader->read('LINESTRING(0 0, 1 1)'),
+            'f' => $reader->read('LINESTRING(1 1, 0 0)'),
+        ));
+        $this->assertEquals(array('a', 'b', 'd', 'f'), array_keys($res));
+        $this->assertTrue($res['a'] === $a);
+
+        /* Z counts */
+        $res = GEOSBatch::unique(array(
+            $reader->read('POINT(1 2 3)'),
+            $reader->read('POINT(1 2 4)'),
+            $reader->read('POINT(1 2)'),
+            $reader->read('POINT(1 2 3)'),
+        ));
+        $this->assertEquals(array(0, 1, 2), array_keys($res));
+
+        $this->assertEquals(array(), GEOSBatch::unique(array()));
+    }
+
+    public function testBatch_hilbertSort()
+    {
+        $reader = new GEOSWKTReader();
+
+        $geoms = array(
+            'a' => $reader->read('POINT(10 0)'),
+            'b' => $reader->read('POLYGON((9 9, 11 9, 11 11, 9 11, 9 9))'),
+            3 => $reader->read('POINT(0 0)'),
+            'c' => $reader->read('POINT EMPTY'),
+            'd' => $reader->read('LINESTRING(-1 10, 1 10)'),
+        );
+
+        /* the curve goes up, right then down; empties last */
+        $this->assertEquals(array(3, 'd', 'b', 'a', 'c'),
+            GEOSBatch::hilbertSort($geoms));
+        $this->assertEquals(array(3, 'd', 'b', 'a', 'c'),
+            GEOSBatch::hilbertSort($geoms, array(0, 0, 10, 10)));
+        $this->assertEquals(array(3, 'd', 'b', 'a', 'c'),
+            GEOSBatch::hilbertSort($geoms, array('minx' => 0, 'miny' => 0,
+                'maxx' => 10, 'maxy' => 10)));
+
+        /* the end of the curve still sorts before empties */
+        $this->assertEquals(array('o', 'u', 'a', 'e'),
+            GEOSBatch::hilbertSort(array(
+                'e' => $reader->read('POINT EMPTY'),
+                'a' => $reader->read('POINT(10 0)'),
+                'o' => $reader->read('POINT(0 0)'),
+                'u' => $reader->read('POINT(0 10)'),
+            )));
+
+        /* all clamped to the same corner, input order is kept */
+        $this->assertEquals(array('a', 'b', 3, 'd', 'c'),
+            GEOSBatch::hilbertSort($geoms, array(20, 20, 30, 30)));
+
+        $this->assertEquals(array(), GEOSBatch::hilbertSort(array()));
+
+        try {
+            GEOSBatch::hilbertSort($geoms, array(0, 0));
+            $this->assertTrue(FALSE);
+        } catch (Exception $e) {
+            $this->assertContains('Extent must hold', $e->getMessage());
+        }
+    }
+}
+
+BatchTest::run();
+
+?>
+--EXPECT--
+BatchTest->testBatch_buffer	OK
+BatchTest->testBatch_validate	OK
+BatchTest->testBatch_makeValid	OK
+BatchTest->testBatch_unique	OK
+BatchTest->testBatch_hilbertSort	OK
\ No newline at end of file
@@ -0,0 +1,109 @@
+--TEST--
+UnionAggregator tests
+--SKIPIF--
+<?php if (!extension_loaded('geos')) print 'skip'; ?>
+--FILE--
+<?php
+
+require './tests/TestHelper.php';
+
+class UnionAggregatorTest extends GEOSTest
+{
+    public function testUnionAggregator_union()
+    {
+        $reader = new GEOSWKTReader();
+
+        /* small chunks to go through several merge levels */
+        $agg = new GEOSUnionAggregator(GEOSAGG_UNION, 3);
+        for ($i = 0; $i < 10; ++$i) {
+            $agg->add($reader->read(sprintf(
+                'POLYGON((%d 0, %d 0, %d 1, %d 1, %d 0))',
+                $i, $i + 1, $i + 1, $i, $i)));
+        }
+        $this->assertEquals(10, $agg->count());
+        $this->assertTrue($agg->memoryUsage() > 0);
+
+        $res = $agg->result();
+        $this->assertEquals(10, $res->area());
+        $this->assertTrue($res->equals(
+            $reader->read('POLYGON((0 0, 10 0, 10 1, 0 1, 0 0))')));
+
+        /* adding more after a result keeps folding */
+        $agg->add($reader->read('POLYGON((10 0, 11 0, 11 1, 10 1, 10 0))'));
+        $this->assertEquals(11, $agg->result()->area());
+
+        $agg = new GEOSUnionAggregator();
+        $this->assertEquals('GeometryCollection', $agg->result()->typeName());
+        $this->assertTrue($agg->result()->isEmpty());
+    }
+
+    public function testUnionAggregator_envelope()
+    {
+        $reader = new GEOSWKTReader();
+
+        $agg = new GEOSUnionAggregator(GEOSAGG_ENVELOPE);
+        $agg->add($reader->read('POINT(2 3)'));
+        $this->assertTrue($agg->result()->equals($reader->read('POINT(2 3)')));
+
+        $agg->add($reader->read('POINT EMPTY'));
+        $agg->add($reader->read('LINESTRING(-1 0, 4 1)'));
+        $agg->add($reader->read('POINT(0 5)'));
+        $this->assertEquals(4, $agg->count());
+        $this->assertEquals(0, $agg->memoryUsage());
+        $this->assertTrue($agg->result()->equals(
+            $reader->read('POLYGON((-1 0, 4 0, 4 5, -1 5, -1 0))')));
+    }
+
+    public function testUnionAggregator_convexHull()
+    {
+        $reader = new GEOSWKTReader();
+
+        $agg = new GEOSUnionAggregator(GEOSAGG_CONVEX_HULL, 2);
+        $agg->add($reader->read('POINT(0 0)'));
+        $agg->add($reader->read('POINT(10 0)'));
+        $agg->add($reader->read('POINT(5 5)'));
+        $agg->add($reader->read('POINT(5 1)'));
+        $agg->add($reader->read('POINT(10 10)'));
+        $this->assertTrue($agg->result()->equals(
+            $reader->read('POLYGON((0 0, 10 0, 10 10, 0 0))')));
+
+        /* adding more after a result still gives a single hull */
+        $agg->add($reader->read('POINT(0 10)'));
+        $this->assertTrue($agg->result()->equals(
+            $reader->read('POLYGON((0 0, 10 0, 10 10, 0 10, 0 0))')));
+        $agg->add($reader->read('POINT(-5 5)'));
+        $this->assertTrue($agg->result()->equals(
+            $reader->read('POLYGON((0 0, 10 0, 10 10, 0 10, -5 5, 0 0))')));
+    }
+
+    public function testUnionAggregator_rejected()
+    {
+        $reader = new GEOSWKTReader();
+
+        $agg = new GEOSUnionAggregator();
+        $agg->add($reader->read('POLYGON((0 0, 1 0, 1 1, 0 1, 0 0))'));
+
+        /* geometries over the memory limit are not counted */
+        $big = $reader->read('POINT(5 5)')->buffer(1, array('quad_segs' => 64));
+        $old = ini_set('geos.memory_limit', GEOSMemoryUsage() + 16);
+        try {
+            $agg->add($big);
+            $this->assertTrue(FALSE);
+        } catch (Exception $e) {
+            $this->assertContains('memory limit', $e->getMessage());
+        }
+        ini_set('geos.memory_limit', $old);
+
+        $this->assertEquals(1, $agg->count());
+        $this->assertEquals(1.0, $agg->result()->area());
+    }
+}
+
+UnionAggregatorTest::run();
+
+?>
+--EXPECT--
+UnionAggregatorTest->testUnionAggregator_union	OK
+UnionAggregatorTest->testUnionAggregator_envelope	OK
+UnionAggregatorTest->testUnionAggregator_convexHull	OK
+UnionAggregatorTest->testUnionAggregator_rejected	OK
\ No newline at end of file
@@ -0,0 +1,81 @@
+--TEST--
+NearestIndex tests
+--SKIPIF--
+<?php if (!extension_loaded('geos')) print 'skip'; ?>
+--FILE--
+<?php
+
+require './tests/TestHelper.php';
+
+class NearestIndexTest extends GEOSTest
+{
+    public function testNearestIndex_knn()
+    {
+        $reader = new GEOSWKTReader();
+
+        $geoms = array();
+        for ($i = 0; $i < 100; ++$i) {
+            $geoms[] = $reader->read(sprintf('POINT(%d %d)', $i % 10, intval($i / 10)));
+        }
+        $geoms[] = $reader->read('POINT EMPTY');
+        $geoms[] = $reader->read('LINESTRING(20 0, 20 10)');
+
+        $idx = new GEOSNearestIndex($geoms);
+        $this->assertEquals(102, $idx->count());
+
+        $res = $idx->knn($reader->read('POINT(2.1 3)'), 3);
+        $this->assertEquals(array(32, 33, 22), $res['indices']);
+        $this->assertEquals(3, count($res['distances']));
+        $this->assertEquals(0.1, round($res['distances'][0], 6));
+        $this->assertEquals(0.9, round($res['distances'][1], 6));
+        $this->assertEquals(round(sqrt(1.01), 6), round($res['distances'][2], 6));
+
+        $res = $idx->knn($reader->read('POINT(19 5)'), 1);
+        $this->assertEquals(array(101), $res['indices']);
+        $this->assertEquals(array(1.0), $res['distances']);
+
+        $res = $idx->knn($reader->read('POINT(-5 -5)'), 5, 1.0);
+        $this->assertEquals(array(), $res['indices']);
+
+        $res = $idx->knn($reader->read('POINT EMPTY'), 5);
+        $this->assertEquals(array(), $res['indices']);
+
+        $idx = new GEOSNearestIndex(array());
+        $res = $idx->knn($reader->read('POINT(0 0)'), 5);
+        $this->assertEquals(array(), $res['distances']);
+    }
+
+    public function testNearestIndex_knnMany()
+    {
+        $reader = new GEOSWKTReader();
+
+        $idx = new GEOSNearestIndex(array(
+            $reader->read('POINT(0 0)'),
+            $reader->read('POINT(10 0)'),
+            $reader->read('POINT(5 5)'),
+        ));
+
+        $res = $idx->knnMany(array(
+            'a' => $reader->read('POINT(1 0)'),
+            'b' => $reader->read('POINT(9 1)'),
+        ), 2);
+        $this->assertEquals(array('a', 'b'), array_keys($res));
+        $this->assertEquals(array(0, 2), $res['a']['indices']);
+        $this->assertEquals(array(1, 2), $res['b']['indices']);
+        $this->assertEquals(1.0, $res['a']['distances'][0]);
+
+        try {
+            $idx->knnMany(array('not a geometry'), 1);
+            $this->assertTrue(FALSE);
+        } catch (Exception $e) {
+            $this->assertContains('GEOSGeometry', $e->getMessage());
+        }
+    }
+}
+
+NearestIndexTest::run();
+
+?>
+--EXPECT--
+NearestIndexTest->testNearestIndex_knn	OK
+NearestIndexTest->testNearestIndex_knnMany	OK
\ No newline at end of file
@@ -0,0 +1,78 @@
+--TEST--
+PreparedGeometry tests
+--SKIPIF--
+<?php if (!extension_loaded('geos')) print 'skip'; ?>
+--FILE--
+<?php
+
+require './tests/TestHelper.php';
+
+class PreparedGeometryTest extends GEOSTest
+{
+    public function testPreparedGeometry_predicates()
+    {
+        $reader = new GEOSWKTReader();
+
+        $p = new GEOSPreparedGeometry(
+            $reader->read('POLYGON((0 0, 10 0, 10 10, 0 10, 0 0))'));
+
+        $this->assertTrue($p->contains($reader->read('POINT(5 5)')));
+        $this->assertFalse($p->contains($reader->read('POINT(10 5)')));
+        $this->assertTrue($p->intersects($reader->read('POINT(10 5)')));
+        $this->assertFalse($p->intersects($reader->read('LINESTRING(11 0, 11 10)')));
+    }
+
+    public function testPreparedGeometry_containsPoints()
+    {
+        $reader = new GEOSWKTReader();
+
+        $p = new GEOSPreparedGeometry(
+            $reader->read('POLYGON((0 0, 10 0, 10 10, 0 10, 0 0))'));
+
+        $xy = array();
+        for ($i = 0; $i < 20; ++$i) {
+            $xy[] = $i - 5;
+            $xy[] = 5;
+        }
+        $packed = call_user_func_array('pack', array_merge(array('d*'), $xy));
+
+        /* points 6 to 14 (x = 1 .. 9) are inside */
+        $bits = $p->containsPoints($packed);
+        $this->assertEquals(3, strlen($bits));
+        $this->assertEquals(0xC0, ord($bits[0]));
+        $this->assertEquals(0x7F, ord($bits[1]));
+        $this->assertEquals(0x00, ord($bits[2]));
+
+        /* index is reused */
+        $this->assertEquals($bits, $p->containsPoints($packed));
+
+        /* long teeth, each edge crossing most bands; NaN is outside */
+        $wkt = array();
+        for ($i = 0; $i <= 200; ++$i) {
+            $wkt[] = sprintf('%d %d', $i, $i % 2 ? 100 : 0);
+        }
+        $wkt[] = '0 0';
+        $p = new GEOSPreparedGeometry(
+            $reader->read('POLYGON((' . implode(', ', $wkt) . '))'));
+        $bits = $p->containsPoints(pack('d*', 1, 50, 2, 50, 151, 99,
+            NAN, 50, 1, NAN));
+        $this->assertEquals(chr(0x05), $bits);
+
+        /* only polygons classify points, whatever the GEOS version */
+        $p = new GEOSPreparedGeometry(
+            $reader->read('LINESTRING(0 0, 10 10)'));
+        try {
+            $p->containsPoints($packed);
+            $this->assertTrue(FALSE);
+        } catch (Exception $e) {
+            $this->assertContains('polygonal', $e->getMessage());
+        }
+    }
+}
+
+PreparedGeometryTest::run();
+
+?>
+--EXPECT--
+PreparedGeometryTest->testPreparedGeometry_predicates	OK
+PreparedGeometryTest->testPreparedGeometry_containsPoints	OK
\ No newline at end of file
@@ -0,0 +1,147 @@
+--TEST--
+WKBReader tests
+--SKIPIF--
+<?php if (!extension_loaded('geos')) print 'skip'; ?>
+--FILE--
+<?php
+
+require './tests/TestHelper.php';
+
+class WKBReaderTest extends GEOSTest
+{
+    public function testWKBReader_readMany()
+    {
+        $reader = new GEOSWKBReader();
+        $wktReader = new GEOSWKTReader();
+        $writer = new GEOSWKBWriter();
+
+        $geoms = array(
+            $wktReader->read('POINT(1 2)'),
+            $wktReader->read('POLYGON((0 0, 1 0, 1 1, 0 0), (0.1 0.1, 0.2 0.1, 0.2 0.2, 0.1 0.1))'),
+            $wktReader->read('GEOMETRYCOLLECTION(POINT(1 2), MULTILINESTRING((0 0, 1 1), (2 2, 3 3)))'),
+            $wktReader->read('POINT(1 2 3)'),
+        );
+        $writer->setOutputDimension(3);
+        $writer->setIncludeSRID(true);
+        $geoms[3]->setSRID(4326);
+
+        $res = $writer->writeMany($geoms);
+
+        $read = $reader->readMany($res['data']);
+        $this->assertEquals(4, count($read));
+        foreach ($geoms as $i => $g) {
+            $this->assertTrue($g->equalsExact($read[$i]));
+        }
+        $this->assertEquals(4326, $read[3]->getSRID());
+
+        $read = $reader->readMany($res['data'], $res['offsets']);
+        $this->assertEquals(4, count($read));
+        $this->assertTrue($geoms[2]->equalsExact($read[2]));
+
+        /* record starts only */
+        $read = $reader->readMany($res['data'], array_slice($res['offsets'], 0, 4));
+        $this->assertEquals(4, count($read));
+
+        $this->assertEquals(array(), $reader->readMany(''));
+
+        try {
+            $reader->readMany(substr($res['data'], 0, -1));
+            $this->assertTrue(FALSE);
+        } catch (Exception $e) {
+            $this->assertContains('Malformed WKB record at offset', $e->getMessage());
+        }
+    }
+
+    public function testWKBReader_readManyHEX()
+    {
+        $reader = new GEOSWKBReader();
+        $wktReader = new GEOSWKTReader();
+        $writer = new GEOSWKBWriter();
+
+        $a = $wktReader->read('POINT(1 2)');
+        $b = $wktReader->read('LINESTRING(0 0, 1 1)');
+
+        $read = $reader->readManyHEX($writer->writeHEX($a)."\r\n\n".$writer->writeHEX($b));
+        $this->assertEquals(2, count($read));
+        $this->assertTrue($a->equalsExact($read[0]));
+        $this->assertTrue($b->equalsExact($read[1]));
+    }
+
+    public function testWKBReader_lazy()
+    {
+        $reader = new GEOSWKBReader();
+        $this->assertFalse($reader->getLazy());
+        $reader->setLazy(true);
+        $this->assertTrue($reader->getLazy());
+
+        /* POINT(1 2) with SRID 4326, little endian EWKB */
+        $hex = '0101000020E6100000000000000000F03F0000000000000040';
+        $g = $reader->readHEX(strtolower($hex));
+
+        $this->assertEquals('Point', $g->typeName());
+        $this->assertEquals(GEOS_POINT, $g->typeId());
+        $this->assertEquals(4326, $g->getSRID());
+
+        $writer = new GEOSWKBWriter();
+        $writer->setByteOrder(1);
+        $writer->setIncludeSRID(true);
+        $this->assertEquals($hex, $writer->writeHEX($g));
+        $this->assertEquals(hex2bin($hex), $writer->write($g));
+
+        /* other encodings go through GEOS */
+        $writer->setIncludeSRID(false);
+        $this->assertEquals('0101000000000000000000F03F0000000000000040',
+            $writer->writeHEX($g));
+
+        $wktReader = new GEOSWKTReader();
+        $this->assertTrue($g->equalsExact($wktReader->read('POINT(1 2)')));
+
+        $u = unserialize(serialize($g));
+        $this->assertEquals(4326, $u->getSRID());
+        $this->assertTrue($g->equalsExact($u));
+
+        /* modified geometries lose their original bytes */
+        $g->setSRID(3857);
+        $writer->setIncludeSRID(true);
+        $this->assertEquals('0101000020110F0000000000000000F03F0000000000000040',
+            $writer->writeHEX($g));
+
+        $read = $reader->readMany(hex2bin($hex . $hex));
+        $this->assertEquals(2, count($read));
+        $this->assertEquals(4326, $read[1]->getSRID());
+
+        /* records are not parsed when read, nor when written back */
+        $bad = '010200000001000000000000000000F03F0000000000000040';
+        $g = $reader->readHEX($bad);
+        $this->assertEquals(GEOS_LINESTRING, $g->typeId());
+        $writer->setIncludeSRID(false);
+        $this->assertEquals($bad, $writer->writeHEX($g));
+
+        /* those GEOS rejects throw once needed, as many times as asked */
+        for ($i = 0; $i < 2; ++$i) {
+            try {
+                $g->numPoints();
+                $this->assertTrue(FALSE);
+            } catch (Exception $e) {
+                $this->assertContains('IllegalArgumentException',
+                    $e->getMessage());
+            }
+        }
+
+        /* parsing is accounted for when needed */
+        unset($g);
+        $before = GEOSMemoryUsage();
+        $g = $reader->readHEX($hex);
+        $this->assertEquals($before + strlen($hex) / 2, GEOSMemoryUsage());
+        $this->assertEquals(0, $g->area());
+        $this->assertTrue(GEOSMemoryUsage() > $before + strlen($hex) / 2);
+    }
+}
+
+WKBReaderTest::run();
+
+?>
+--EXPECT--
+WKBReaderTest->testWKBReader_readMany	OK
+WKBReaderTest->testWKBReader_readManyHEX	OK
+WKBReaderTest->testWKBReader_lazy	OK
\ No newline at end of file
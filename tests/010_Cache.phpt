@@ -0,0 +1,87 @@
+--TEST--
+Cache tests
+--SKIPIF--
+<?php if (!extension_loaded('geos')) print 'skip'; ?>
+--INI--
+geos.cache_size=65536
+--FILE--
+<?php
+
+require './tests/TestHelper.php';
+
+class CacheTest extends GEOSTest
+{
+    public function testCache_hits()
+    {
+        GEOSCache::clear();
+
+        $reader = new GEOSWKTReader();
+        $writer = new GEOSWKTWriter();
+        $writer->setRoundingPrecision(0);
+
+        $g = $reader->read('POINT(0 0)');
+        $g->setSRID(4326);
+
+        $b1 = $g->buffer(10, array('quad_segs' => 1));
+        $b2 = $g->buffer(10, array('quad_segs' => 1));
+        $this->assertEquals($writer->write($b1), $writer->write($b2));
+        $this->assertEquals(4326, $b2->getSRID());
+
+        /* different parameters are a different entry */
+        $b3 = $g->buffer(10, array('quad_segs' => 2));
+        $this->assertFalse($writer->write($b1) == $writer->write($b3));
+
+        $s = $reader->read('LINESTRING(0 0, 5 1, 10 0)');
+        $this->assertEquals('LINESTRING (0 0, 10 0)',
+            $writer->write($s->simplify(2)));
+        $this->assertEquals('LINESTRING (0 0, 10 0)',
+            $writer->write($s->simplify(2)));
+
+        $stats = GEOSCache::stats();
+        $this->assertEquals(2, $stats['hits']);
+        $this->assertEquals(3, $stats['misses']);
+        $this->assertEquals(3, $stats['entries']);
+        $this->assertTrue($stats['bytes'] > 0);
+        $this->assertEquals(65536, $stats['capacity']);
+
+        GEOSCache::clear();
+        $stats = GEOSCache::stats();
+        $this->assertEquals(0, $stats['hits']);
+        $this->assertEquals(0, $stats['entries']);
+        $this->assertEquals(0, $stats['bytes']);
+    }
+
+    public function testCache_budget()
+    {
+        GEOSCache::clear();
+
+        $reader = new GEOSWKTReader();
+        $g = $reader->read('POINT(0 0)');
+
+        for ($i = 1; $i <= 200; ++$i) {
+            $g->buffer($i);
+        }
+
+        /* least recently used entries were evicted */
+        $stats = GEOSCache::stats();
+        $this->assertTrue($stats['entries'] > 0);
+        $this->assertTrue($stats['entries'] < 200);
+        $this->assertTrue($stats['bytes'] <= $stats['capacity']);
+
+        $g->buffer(200);
+        $g->buffer(1);
+        $stats = GEOSCache::stats();
+        $this->assertEquals(1, $stats['hits']);
+
+        /* the budget is only set in php.ini */
+        $this->assertFalse(ini_set('geos.cache_size', 0));
+        $this->assertEquals(65536, ini_get('geos.cache_size'));
+    }
+}
+
+CacheTest::run();
+
+?>
+--EXPECT--
+CacheTest->testCache_hits	OK
+CacheTest->testCache_budget	OK
\ No newline at end of file
@@ -0,0 +1,85 @@
+--TEST--
+SharedCache tests
+--SKIPIF--
+<?php if (!extension_loaded('geos') || !class_exists('GEOSSharedCache')) print 'skip'; ?>
+--INI--
+geos.shm_path=/tmp/geos_011_SharedCache.shm
+geos.shm_size=1048576
+--FILE--
+<?php
+
+require './tests/TestHelper.php';
+
+class SharedCacheTest extends GEOSTest
+{
+    public function testSharedCache_storeFetch()
+    {
+        $reader = new GEOSWKTReader();
+        $writer = new GEOSWKTWriter();
+        $writer->setRoundingPrecision(0);
+
+        $key = 'poly-' . uniqid();
+        $this->assertFalse(GEOSSharedCache::has($key));
+        $this->assertNull(GEOSSharedCache::fetch($key));
+        $this->assertNull(GEOSSharedCache::envelope($key));
+
+        $g = $reader->read('POLYGON((0 0, 10 0, 10 5, 0 5, 0 0))');
+        $g->setSRID(3857);
+        $this->assertTrue(GEOSSharedCache::store($key, $g));
+        $this->assertTrue(GEOSSharedCache::has($key));
+
+        $f = GEOSSharedCache::fetch($key);
+        $this->assertEquals('POLYGON ((0 0, 10 0, 10 5, 0 5, 0 0))',
+            $writer->write($f));
+        $this->assertEquals(3857, $f->getSRID());
+
+        /* fetches share the worker's geometry, copied once modified */
+        $used = GEOSMemoryUsage();
+        $f2 = GEOSSharedCache::fetch($key);
+        $this->assertEquals($used, GEOSMemoryUsage());
+        $f->setSRID(4326);
+        $this->assertTrue(GEOSMemoryUsage() > $used);
+        $this->assertEquals(3857, $f2->getSRID());
+        $this->assertEquals(3857, GEOSSharedCache::fetch($key)->getSRID());
+
+        $this->assertEquals(array('minx' => 0.0, 'miny' => 0.0,
+            'maxx' => 10.0, 'maxy' => 5.0), GEOSSharedCache::envelope($key));
+
+        /* storing again replaces */
+        $this->assertTrue(GEOSSharedCache::store($key,
+            $reader->read('POINT(1 2)')));
+        $this->assertEquals('POINT (1 2)',
+            $writer->write(GEOSSharedCache::fetch($key)));
+
+        $stats = GEOSSharedCache::stats();
+        $this->assertEquals(1048576, $stats['size']);
+        $this->assertTrue($stats['used'] > 0);
+        $this->assertTrue($stats['entries'] >= 2);
+    }
+
+    public function testSharedCache_full()
+    {
+        $reader = new GEOSWKTReader();
+        $g = $reader->read('POLYGON((0 0, 10 0, 10 5, 0 5, 0 0))');
+        $big = $g->buffer(100, array('quad_segs' => 1000));
+
+        $stored = 0;
+        for ($i = 0; $i < 100; ++$i) {
+            if (!GEOSSharedCache::store("big-$i-" . uniqid(), $big)) break;
+            ++$stored;
+        }
+        $this->assertTrue($stored < 100);
+
+        $stats = GEOSSharedCache::stats();
+        $this->assertTrue($stats['used'] <= $stats['size']);
+    }
+}
+
+SharedCacheTest::run();
+
+?>
+--CLEAN--
+<?php @unlink('/tmp/geos_011_SharedCache.shm'); ?>
+--EXPECT--
+SharedCacheTest->testSharedCache_storeFetch	OK
+SharedCacheTest->testSharedCache_full	OK
\ No newline at end of file
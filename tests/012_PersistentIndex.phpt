@@ -0,0 +1,66 @@
+--TEST--
+PersistentIndex tests
+--SKIPIF--
+<?php if (!extension_loaded('geos')) print 'skip'; ?>
+--INI--
+geos.persistent_indexes=zones=tests/012_PersistentIndex.idx
+--FILE--
+<?php
+
+require './tests/TestHelper.php';
+
+/*
+ * tests/012_PersistentIndex.idx holds three polygons:
+ *  10: POLYGON((0 0, 10 0, 10 10, 0 10, 0 0))
+ *  20: POLYGON((10 0, 20 0, 20 10, 10 10, 10 0))
+ *  30: POLYGON((0 10, 20 10, 20 20, 0 20, 0 10))
+ */
+class PersistentIndexTest extends GEOSTest
+{
+    public function testPersistentIndex_contains()
+    {
+        $reader = new GEOSWKTReader();
+        $idx = GEOSPersistentIndex::get('zones');
+
+        $this->assertEquals(3, $idx->count());
+        $this->assertEquals(array(10),
+            $idx->contains($reader->read('POINT(5 5)')));
+        $this->assertEquals(array(30),
+            $idx->contains($reader->read('POINT(15 15)')));
+        $this->assertEquals(array(),
+            $idx->contains($reader->read('POINT(10 5)')));
+        $this->assertEquals(array(),
+            $idx->contains($reader->read('POINT(50 50)')));
+    }
+
+    public function testPersistentIndex_query()
+    {
+        $reader = new GEOSWKTReader();
+        $idx = GEOSPersistentIndex::get('zones');
+
+        $this->assertEquals(array(10, 20),
+            $idx->query($reader->read('POINT(10 5)')));
+        $this->assertEquals(array(10, 20, 30),
+            $idx->query($reader->read('LINESTRING(5 5, 15 15)')));
+        $this->assertEquals(array(),
+            $idx->query($reader->read('POINT EMPTY')));
+    }
+
+    public function testPersistentIndex_unknown()
+    {
+        try {
+            GEOSPersistentIndex::get('missing');
+            $this->assertTrue(FALSE);
+        } catch (Exception $e) {
+            $this->assertContains('missing', $e->getMessage());
+        }
+    }
+}
+
+PersistentIndexTest::run();
+
+?>
+--EXPECT--
+PersistentIndexTest->testPersistentIndex_contains	OK
+PersistentIndexTest->testPersistentIndex_query	OK
+PersistentIndexTest->testPersistentIndex_unknown	OK
\ No newline at end of file
@@ -0,0 +1,52 @@
+--TEST--
+Thread safety tests
+--SKIPIF--
+<?php if (!extension_loaded('geos') || !PHP_ZTS || !class_exists('Thread')) print 'skip'; ?>
+--FILE--
+<?php
+
+require './tests/TestHelper.php';
+
+class SerializeThread extends Thread
+{
+    public $ok = 0;
+
+    public function run()
+    {
+        $reader = new GEOSWKTReader();
+        $g = $reader->read('POLYGON((0 0, 10 0, 10 10, 0 10, 0 0))');
+
+        for ($i = 1; $i <= 500; ++$i) {
+            $g->setSRID($i);
+            $u = unserialize(serialize($g));
+            if ($u->getSRID() == $i && $u->equalsExact($g)) {
+                ++$this->ok;
+            }
+        }
+    }
+}
+
+class ThreadSafetyTest extends GEOSTest
+{
+    public function testThreadSafety_serialize()
+    {
+        $threads = array();
+        for ($i = 0; $i < 8; ++$i) {
+            $threads[$i] = new SerializeThread();
+            $threads[$i]->start();
+        }
+
+        $ok = 0;
+        foreach ($threads as $thread) {
+            $thread->join();
+            $ok += $thread->ok;
+        }
+        $this->assertEquals(8 * 500, $ok);
+    }
+}
+
+ThreadSafetyTest::run();
+
+?>
+--EXPECT--
+ThreadSafetyTest->testThreadSafety_serialize	OK
\ No newline at end of file
@@ -0,0 +1,116 @@
+--TEST--
+Async tests
+--SKIPIF--
+<?php if (!extension_loaded('geos') || !class_exists('GEOSAsync')) print 'skip'; ?>
+--INI--
+geos.async_workers=2
+--FILE--
+<?php
+
+require './tests/TestHelper.php';
+
+class AsyncTest extends GEOSTest
+{
+    public function testAsync_union()
+    {
+        $reader = new GEOSWKTReader();
+        $a = $reader->read('POLYGON((0 0, 10 0, 10 10, 0 10, 0 0))');
+        $b = $reader->read('POLYGON((5 0, 15 0, 15 10, 5 10, 5 0))');
+
+        $future = GEOSAsync::submit('union', array($a, $b));
+        $ret = $future->wait();
+        $this->assertTrue($future->isReady());
+        $this->assertTrue($ret->equals($a->union($b)));
+
+        /* over already */
+        $this->assertFalse($future->cancel());
+    }
+
+    public function testAsync_concurrent()
+    {
+        $reader = new GEOSWKTReader();
+        $a = $reader->read('POLYGON((0 0, 10 0, 10 10, 0 10, 0 0))');
+        $b = $reader->read('POLYGON((5 0, 15 0, 15 10, 5 10, 5 0))');
+        $a->setSRID(4326);
+
+        $buffer = GEOSAsync::submit('buffer', array($a, 2));
+        $union = GEOSAsync::submit('unaryUnion', array(array($a, $b)));
+        $diff = GEOSAsync::submit('difference', array($a, $b));
+
+        $ret = $buffer->wait();
+        $this->assertTrue($ret->equals($a->buffer(2)));
+        $this->assertEquals(4326, $ret->getSRID());
+        $ret = $union->wait();
+        $this->assertEquals(150, $ret->area());
+        $ret = $diff->wait(10);
+        $this->assertEquals(50, $ret->area());
+    }
+
+    public function testAsync_invalid()
+    {
+        $reader = new GEOSWKTReader();
+        $a = $reader->read('POINT(0 0)');
+
+        try {
+            GEOSAsync::submit('unknown', array($a));
+            $this->assertTrue(FALSE);
+        } catch (Exception $e) {
+            $this->assertContains('unknown', $e->getMessage());
+        }
+
+        try {
+            GEOSAsync::submit('buffer', array($a));
+            $this->assertTrue(FALSE);
+        } catch (Exception $e) {
+            $this->assertContains('Invalid arguments', $e->getMessage());
+        }
+    }
+
+    public function testAsync_cancel()
+    {
+        $reader = new GEOSWKTReader();
+        $points = array();
+        for ($i = 0; $i < 20000; ++$i) {
+            $points[] = $i . ' ' . ($i % 2 ? 10 : 0);
+        }
+        $zigzag = $reader->read('LINESTRING(' . implode(', ', $points) . ')');
+
+        /* keep both workers busy */
+        $busy = array(
+            GEOSAsync::submit('buffer', array($zigzag, 3)),
+            GEOSAsync::submit('buffer', array($zigzag, 3)),
+        );
+        $queued = GEOSAsync::submit('convexHull', array($zigzag));
+        $dropped = GEOSAsync::submit('convexHull', array($zigzag));
+
+        /* timed out */
+        $this->assertNull($queued->wait(0));
+        $this->assertFalse($queued->isReady());
+
+        $this->assertTrue($queued->cancel());
+        $this->assertTrue($queued->isReady());
+        try {
+            $queued->wait();
+            $this->assertTrue(FALSE);
+        } catch (Exception $e) {
+            $this->assertContains('cancelled', $e->getMessage());
+        }
+        $this->assertFalse($queued->cancel());
+
+        /* skipped by the workers */
+        unset($dropped);
+
+        foreach ($busy as $future) {
+            $this->assertTrue($future->wait() instanceof GEOSGeometry);
+        }
+    }
+}
+
+AsyncTest::run();
+
+?>
+--EXPECT--
+AsyncTest->testAsync_union	OK
+AsyncTest->testAsync_concurrent	OK
+AsyncTest->testAsync_invalid	OK
+AsyncTest->testAsync_cancel	OK
\ No newline at end of file
@@ -0,0 +1,74 @@
+--TEST--
+Coverage tests
+--SKIPIF--
+<?php if (!extension_loaded('geos')) print 'skip'; ?>
+--FILE--
+<?php
+
+require './tests/TestHelper.php';
+
+class CoverageTest extends GEOSTest
+{
+    public function testCoverage_union()
+    {
+        $reader = new GEOSWKTReader();
+        $a = $reader->read('POLYGON((0 0, 10 0, 10 10, 0 10, 0 0))');
+        $b = $reader->read('POLYGON((10 0, 20 0, 20 10, 10 10, 10 0))');
+        $a->setSRID(4326);
+
+        $ret = GEOSCoverage::union(array($a, $b));
+        $this->assertTrue($ret->equals(
+            $reader->read('POLYGON((0 0, 20 0, 20 10, 0 10, 0 0))')));
+        $this->assertEquals(4326, $ret->getSRID());
+
+        try {
+            GEOSCoverage::union(array($a, 'b'));
+            $this->assertTrue(FALSE);
+        } catch (Exception $e) {
+            $this->assertContains('GEOSGeometry', $e->getMessage());
+        }
+    }
+
+    public function testCoverage_simplify()
+    {
+        if (!method_exists(GEOSCoverage::class, 'simplify')) {
+            return;
+        }
+
+        $reader = new GEOSWKTReader();
+        $a = $reader->read('POLYGON((0 0, 5 0.1, 10 0, 10 10, 0 10, 0 0))');
+        $b = $reader->read('POLYGON((10 0, 20 0, 20 10, 10 10, 10 0))');
+
+        $ret = GEOSCoverage::simplify(array('a' => $a, 'b' => $b), 1);
+        $this->assertEquals(array('a', 'b'), array_keys($ret));
+        $this->assertEquals(100, $ret['a']->area());
+        $this->assertEquals(100, $ret['b']->area());
+    }
+
+    public function testCoverage_isValid()
+    {
+        if (!method_exists(GEOSCoverage::class, 'isValid')) {
+            return;
+        }
+
+        $reader = new GEOSWKTReader();
+        $a = $reader->read('POLYGON((0 0, 10 0, 10 10, 0 10, 0 0))');
+        $b = $reader->read('POLYGON((10 0, 20 0, 20 10, 10 10, 10 0))');
+        $c = $reader->read('POLYGON((9 0, 20 0, 20 10, 9 10, 9 0))');
+
+        $this->assertTrue(GEOSCoverage::isValid(array($a, $b)));
+        $this->assertEquals(array(), GEOSCoverage::validate(array($a, $b)));
+
+        $this->assertFalse(GEOSCoverage::isValid(array($a, $c)));
+        $ret = GEOSCoverage::validate(array('a' => $a, 'c' => $c));
+        $this->assertEquals(array('a', 'c'), array_keys($ret));
+    }
+}
+
+CoverageTest::run();
+
+?>
+--EXPECT--
+CoverageTest->testCoverage_union	OK
+CoverageTest->testCoverage_simplify	OK
+CoverageTest->testCoverage_isValid	OK
\ No newline at end of file
@@ -0,0 +1,93 @@
+--TEST--
+PointGrid tests
+--SKIPIF--
+<?php if (!extension_loaded('geos')) print 'skip'; ?>
+--FILE--
+<?php
+
+require './tests/TestHelper.php';
+
+class PointGridTest extends GEOSTest
+{
+    public function testPointGrid_packed()
+    {
+        $grid = new GEOSPointGrid(pack('d*', 0, 0, 1, 0, 5, 5, 10, 10, 1, 1), 2);
+
+        $this->assertEquals(5, $grid->count());
+        $this->assertEquals(array(0, 1, 4), $grid->withinDistance(0, 0, 1.5));
+        $this->assertEquals(array(0, 1), $grid->withinDistance(0, 0, 1));
+        $this->assertEquals(array(), $grid->withinDistance(20, 20, 1));
+        $this->assertEquals(array(2, 3), $grid->bbox(5, 5, 10, 10));
+        $this->assertEquals(array(3), $grid->nearest(9, 9));
+        $this->assertEquals(array(2, 4, 1), $grid->nearest(4, 4, 3));
+        $this->assertEquals(array(0, 1, 4, 2, 3), $grid->nearest(-100, -100, 10));
+        $this->assertEquals(array(), $grid->nearest(20, 20, 1, 5));
+
+        try {
+            new GEOSPointGrid('abc');
+            $this->assertTrue(FALSE);
+        } catch (Exception $e) {
+            $this->assertContains('multiple of', $e->getMessage());
+        }
+    }
+
+    public function testPointGrid_geometry()
+    {
+        $reader = new GEOSWKTReader();
+
+        $grid = new GEOSPointGrid($reader->read(
+            'MULTIPOINT(0 0, 3 4, 6 8)'));
+        $this->assertEquals(3, $grid->count());
+        $this->assertEquals(array(0, 1), $grid->withinDistance(0, 0, 5));
+        $this->assertEquals(array(2), $grid->nearest(7, 7));
+
+        $grid = new GEOSPointGrid(array(
+            $reader->read('POINT(0 0)'),
+            $reader->read('POINT EMPTY'),
+            $reader->read('MULTIPOINT(1 1, 2 2)'),
+        ));
+        $this->assertEquals(3, $grid->count());
+        $this->assertEquals(array(0, 2, 3), $grid->bbox(-1, -1, 3, 3));
+
+        try {
+            new GEOSPointGrid($reader->read('LINESTRING(0 0, 1 1)'));
+            $this->assertTrue(FALSE);
+        } catch (Exception $e) {
+            $this->assertContains('points', $e->getMessage());
+        }
+    }
+
+    public function testPointGrid_nonFinite()
+    {
+        /* infinite points are left out like empty ones */
+        $grid = new GEOSPointGrid(pack('d*', 0, 0, INF, 0, 1, -INF, 2, 2));
+        $this->assertEquals(2, $grid->count());
+        $this->assertEquals(array(0, 3), $grid->bbox(-10, -10, 10, 10));
+
+        /* an extent overflowing a double */
+        $grid = new GEOSPointGrid(pack('d*', -1e308, 0, 1e308, 0, 0, 0));
+        $this->assertEquals(3, $grid->count());
+        $this->assertEquals(array(2), $grid->withinDistance(0, 0, 1));
+        $this->assertEquals(array(1), $grid->nearest(1e308, 1));
+
+        /* NaN queries find nothing */
+        $this->assertEquals(array(), $grid->withinDistance(NAN, 0, 1));
+        $this->assertEquals(array(), $grid->bbox(0, NAN, 1, 1));
+        $this->assertEquals(array(), $grid->nearest(0, NAN));
+
+        try {
+            new GEOSPointGrid(pack('d*', 0, 0), NAN);
+            $this->assertTrue(FALSE);
+        } catch (Exception $e) {
+            $this->assertContains('finite', $e->getMessage());
+        }
+    }
+}
+
+PointGridTest::run();
+
+?>
+--EXPECT--
+PointGridTest->testPointGrid_packed	OK
+PointGridTest->testPointGrid_geometry	OK
+PointGridTest->testPointGrid_nonFinite	OK
\ No newline at end of file
@@ -0,0 +1,98 @@
+--TEST--
+Binning tests
+--SKIPIF--
+<?php if (!extension_loaded('geos')) print 'skip'; ?>
+--FILE--
+<?php
+
+require './tests/TestHelper.php';
+
+class BinningTest extends GEOSTest
+{
+    public function testBinning_squares()
+    {
+        $reader = new GEOSWKTReader();
+
+        /* 2 x 2 cells of size 5, top left corner at (0, 10) */
+        $points = pack('d*', 1, 9, 6, 9, 1, 1, 2, 2, 20, 20);
+        $ret = GEOSBinning::squares($points, 0, 10, 5, 2, 2);
+        $this->assertEquals(array('counts'), array_keys($ret));
+        $this->assertEquals(array(1, 1, 2, 0),
+            array_values(unpack('L*', $ret['counts'])));
+
+        $ret = GEOSBinning::squares($points, 0, 10, 5, 2, 2,
+            pack('d*', 1, 2, 3, 4, 5), TRUE);
+        $this->assertEquals(array(1, 2, 7, 0),
+            array_values(unpack('d*', $ret['sums'])));
+        $this->assertEquals(array(0, 1, 2), array_keys($ret['cells']));
+        $this->assertTrue($ret['cells'][2]->equals(
+            $reader->read('POLYGON((0 0, 5 0, 5 5, 0 5, 0 0))')));
+
+        /* same from geometries, empty points are left out */
+        $g = $reader->read('MULTIPOINT(1 9, 6 9, 1 1, 2 2, 20 20)');
+        $ret = GEOSBinning::squares(array($g, $reader->read('POINT EMPTY')),
+            0, 10, 5, 2, 2);
+        $this->assertEquals(array(1, 1, 2, 0),
+            array_values(unpack('L*', $ret['counts'])));
+
+        $ret = GEOSBinning::squares('', 0, 10, 5, 0, 0, '', TRUE);
+        $this->assertEquals('', $ret['counts']);
+        $this->assertEquals('', $ret['sums']);
+        $this->assertEquals(array(), $ret['cells']);
+
+        try {
+            GEOSBinning::squares($points, 0, 10, 5, 2, 2, pack('d', 1));
+            $this->assertTrue(FALSE);
+        } catch (Exception $e) {
+            $this->assertContains('packed weights', $e->getMessage());
+        }
+
+        try {
+            GEOSBinning::squares($points, 0, 10, -5, 2, 2);
+            $this->assertTrue(FALSE);
+        } catch (Exception $e) {
+            $this->assertContains('must be positive', $e->getMessage());
+        }
+
+        try {
+            GEOSBinning::squares($reader->read('LINESTRING(0 0, 1 1)'),
+                0, 10, 5, 2, 2);
+            $this->assertTrue(FALSE);
+        } catch (Exception $e) {
+            $this->assertContains('POINT or MULTIPOINT', $e->getMessage());
+        }
+    }
+
+    public function testBinning_hexagons()
+    {
+        $reader = new GEOSWKTReader();
+        $w = sqrt(3);
+
+        /* 3 x 2 hexagons of radius 1, first centred on (0, 0) */
+        $points = pack('d*',
+            0, 0,           /* cell 0 */
+            0.2, 0.7,       /* cell 0 */
+            $w, 0,          /* cell 1 */
+            $w / 2, -1.5,   /* cell 3, odd rows are shifted */
+            1.5 * $w, -1.4, /* cell 4 */
+            0, 5            /* outside */
+        );
+        $ret = GEOSBinning::hexagons($points, 0, 0, 1, 3, 2, NULL, TRUE);
+        $this->assertEquals(array(2, 1, 0, 1, 1, 0),
+            array_values(unpack('L*', $ret['counts'])));
+        $this->assertEquals(array(0, 1, 3, 4), array_keys($ret['cells']));
+
+        $hex = $ret['cells'][3];
+        $this->assertEquals('Polygon', $hex->typeName());
+        $this->assertTrue(abs($hex->area() - 1.5 * $w) < 1e-9);
+        $this->assertTrue($hex->contains(
+            $reader->read('POINT(' . ($w / 2) . ' -1.5)')));
+    }
+}
+
+BinningTest::run();
+
+?>
+--EXPECT--
+BinningTest->testBinning_squares	OK
+BinningTest->testBinning_hexagons	OK
\ No newline at end of file
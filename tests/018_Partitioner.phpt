@@ -0,0 +1,192 @@
+--TEST--
+Partitioner tests
+--SKIPIF--
+<?php if (!extension_loaded('geos')) print 'skip'; ?>
+--FILE--
+<?php
+
+require './tests/TestHelper.php';
+
+class PartitionerTest extends GEOSTest
+{
+    /* 10 x 10 points, keyed 10 * x + y */
+    private function points()
+    {
+        $reader = new GEOSWKTReader();
+        $points = array();
+        for ($x = 0; $x < 10; ++$x) {
+            for ($y = 0; $y < 10; ++$y) {
+                $points[10 * $x + $y] = $reader->read("POINT($x $y)");
+            }
+        }
+        return $points;
+    }
+
+    public function testPartitioner_kdtree()
+    {
+        $reader = new GEOSWKTReader();
+
+        $part = new GEOSPartitioner(4);
+        $points = $this->points();
+        $part->sample(array_slice($points, 0, 50, TRUE));
+        $part->sample(array_slice($points, 50, 50, TRUE));
+        $this->assertEquals(4, $part->count());
+
+        $b = $part->boundaries();
+        $this->assertEquals(4, count($b));
+        $this->assertEquals(array('minx' => 0.0, 'miny' => 4.5,
+            'maxx' => 4.5, 'maxy' => 9.0), $b[1]);
+
+        $ret = $part->assign(array(
+            'a' => $reader->read('POINT(4.5 2)'),
+            'b' => $reader->read('POINT(9 9)'),
+            'c' => $reader->read('POINT(100 -5)'),
+            'd' => $reader->read('LINESTRING(4 4, 5 5)'),
+            'e' => $reader->read('POINT EMPTY'),
+        ));
+        $this->assertEquals(array(
+            'a' => array(2),
+            'b' => array(3),
+            'c' => array(2),
+            'd' => array(0, 1, 2, 3),
+            'e' => array(),
+        ), $ret);
+
+        /* each point in exactly one, balanced, partition */
+        $counts = array(0, 0, 0, 0);
+        foreach ($part->assign($points) as $parts) {
+            $this->assertEquals(1, count($parts));
+            $counts[$parts[0]]++;
+        }
+        $this->assertEquals(array(25, 25, 25, 25), $counts);
+
+        try {
+            $part->sample($points);
+            $this->assertTrue(FALSE);
+        } catch (Exception $e) {
+            $this->assertContains('already built', $e->getMessage());
+        }
+    }
+
+    public function testPartitioner_quadtree()
+    {
+        $part = new GEOSPartitioner(4, GEOSPART_QUADTREE);
+        $part->sample($this->points());
+        $this->assertEquals(4, $part->count());
+
+        /* quadrants in Z order */
+        $b = $part->boundaries();
+        $this->assertEquals(array('minx' => 4.5, 'miny' => 0.0,
+            'maxx' => 9.0, 'maxy' => 4.5), $b[1]);
+
+        /* most crowded quadrant split again */
+        $part = new GEOSPartitioner(5, GEOSPART_QUADTREE);
+        $part->sample($this->points());
+        $this->assertEquals(7, $part->count());
+    }
+
+    public function testPartitioner_degenerate()
+    {
+        $reader = new GEOSWKTReader();
+        $points = array();
+        for ($i = 0; $i < 6; ++$i) {
+            $points[] = $reader->read('POINT(1 1)');
+        }
+
+        /* zero width partitions, each point still in a single one */
+        foreach (array(GEOSPART_KDTREE, GEOSPART_QUADTREE) as $method) {
+            $part = new GEOSPartitioner(4, $method);
+            $part->sample($points);
+            $this->assertEquals(4, $part->count());
+            $ret = $part->assign($points);
+            foreach ($ret as $parts) {
+                $this->assertEquals(1, count($parts));
+                $this->assertEquals($ret[0], $parts);
+            }
+        }
+    }
+
+    public function testPartitioner_writePartitions()
+    {
+        $pattern = '/tmp/geos_018_Partitioner_%d.idx';
+        foreach (glob('/tmp/geos_018_Partitioner_*.idx') as $file) {
+            unlink($file);
+        }
+
+        $part = new GEOSPartitioner(4);
+        $points = $this->points();
+        $part->sample($points);
+
+        $this->assertEquals(array(25, 25, 25, 25),
+            $part->writePartitions($points, $pattern));
+
+        /* id, length and WKB records, in input order */
+        $data = file_get_contents('/tmp/geos_018_Partitioner_1.idx');
+        $header = unpack('Vlo/Vhi/Vlen', substr($data, 0, 12));
+        $this->assertEquals(5, $header['lo']);
+        $this->assertEquals(0, $header['hi']);
+        $this->assertEquals(25 * (12 + $header['len']), strlen($data));
+
+        $reader = new GEOSWKBReader();
+        $g = $reader->read(substr($data, 12, $header['len']));
+        $this->assertTrue($g->equals($points[5]));
+
+        /* appended to */
+        $part->writePartitions(array(5 => $points[5]), $pattern);
+        clearstatcache();
+        $this->assertEquals(26 * (12 + $header['len']),
+            filesize('/tmp/geos_018_Partitioner_1.idx'));
+
+        try {
+            $part->writePartitions(array('a' => $points[5]), $pattern);
+            $this->assertTrue(FALSE);
+        } catch (Exception $e) {
+            $this->assertContains('integer keys', $e->getMessage());
+        }
+
+        try {
+            $part->writePartitions($points, '/tmp/geos_018_Partitioner.idx');
+            $this->assertTrue(FALSE);
+        } catch (Exception $e) {
+            $this->assertContains('single %d', $e->getMessage());
+        }
+    }
+
+    public function testPartitioner_errors()
+    {
+        try {
+            new GEOSPartitioner(0);
+            $this->assertTrue(FALSE);
+        } catch (Exception $e) {
+            $this->assertContains('Number of partitions', $e->getMessage());
+        }
+
+        try {
+            new GEOSPartitioner(4, 7);
+            $this->assertTrue(FALSE);
+        } catch (Exception $e) {
+            $this->assertContains('Unknown partitioning method',
+                $e->getMessage());
+        }
+
+        $part = new GEOSPartitioner(4);
+        try {
+            $part->boundaries();
+            $this->assertTrue(FALSE);
+        } catch (Exception $e) {
+            $this->assertContains('no sampled geometries', $e->getMessage());
+        }
+    }
+}
+
+PartitionerTest::run();
+
+?>
+--CLEAN--
+<?php foreach (glob('/tmp/geos_018_Partitioner_*.idx') as $f) @unlink($f); ?>
+--EXPECT--
+PartitionerTest->testPartitioner_kdtree	OK
+PartitionerTest->testPartitioner_quadtree	OK
+PartitionerTest->testPartitioner_degenerate	OK
+PartitionerTest->testPartitioner_writePartitions	OK
+PartitionerTest->testPartitioner_errors	OK
\ No newline at end of file